@@ -0,0 +1,430 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+/* AxingCachingResolver wraps another resolver and remembers what it
+   resolved each (base, xml:base, link, public ID, hint) to, failures
+   included. Only the GFile is kept, and each hit gets a new AxingResource
+   for it, since resources hold the stream they were read from. Results
+   that come with a stream already open aren't cached at all.
+
+   The cache holds at most max_entries results, dropping the ones used
+   least recently. It's safe to share between threads.
+ */
+
+#include "axing-caching-resolver.h"
+
+#define DEFAULT_MAX_ENTRIES 1024
+
+typedef struct {
+    char      *key;
+    GFile     *file;   /* NULL for failures */
+    GError    *error;  /* if the wrapped resolver set one */
+    guint64    mtime;
+    GList     *link;   /* in lru */
+} CacheEntry;
+
+struct _AxingCachingResolver {
+    AxingResolver parent;
+
+    AxingResolver *resolver;
+    guint          max_entries;
+    gboolean       check_mtime;
+
+    GMutex         mutex;
+    GHashTable    *entries;
+    GQueue         lru;    /* most recently used at the head */
+};
+
+static void      axing_caching_resolver_init           (AxingCachingResolver       *resolver);
+static void      axing_caching_resolver_class_init     (AxingCachingResolverClass  *klass);
+static void      axing_caching_resolver_dispose        (GObject                    *object);
+static void      axing_caching_resolver_finalize       (GObject                    *object);
+
+static AxingResource * caching_resolver_resolve        (AxingResolver        *resolver,
+                                                        AxingResource        *base,
+                                                        const char           *xml_base,
+                                                        const char           *link,
+                                                        const char           *pubid,
+                                                        AxingResolverHint     hint,
+                                                        GCancellable         *cancellable,
+                                                        GError              **error);
+static void            caching_resolver_resolve_async  (AxingResolver        *resolver,
+                                                        AxingResource        *base,
+                                                        const char           *xml_base,
+                                                        const char           *link,
+                                                        const char           *pubid,
+                                                        AxingResolverHint     hint,
+                                                        GCancellable         *cancellable,
+                                                        GAsyncReadyCallback   callback,
+                                                        gpointer              user_data);
+static AxingResource * caching_resolver_resolve_finish (AxingResolver        *resolver,
+                                                        GAsyncResult         *result,
+                                                        GError              **error);
+
+static char *          cache_make_key                  (AxingResource        *base,
+                                                        const char           *xml_base,
+                                                        const char           *link,
+                                                        const char           *pubid,
+                                                        AxingResolverHint     hint);
+static gboolean        cache_lookup                    (AxingCachingResolver *resolver,
+                                                        const char           *key,
+                                                        AxingResource       **resource,
+                                                        GError              **error);
+static void            cache_store                     (AxingCachingResolver *resolver,
+                                                        char                 *key,
+                                                        AxingResource        *resource,
+                                                        const GError         *error);
+static void            cache_entry_free                (CacheEntry           *entry);
+static guint64         file_get_mtime                  (GFile                *file);
+
+G_DEFINE_TYPE (AxingCachingResolver, axing_caching_resolver, AXING_TYPE_RESOLVER);
+
+static void
+axing_caching_resolver_init (AxingCachingResolver *resolver)
+{
+    g_mutex_init (&(resolver->mutex));
+    /* Keys are owned by the entries */
+    resolver->entries = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                               (GDestroyNotify) cache_entry_free);
+    g_queue_init (&(resolver->lru));
+}
+
+static void
+axing_caching_resolver_class_init (AxingCachingResolverClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS (klass);
+    AxingResolverClass *resolver_class = AXING_RESOLVER_CLASS (klass);
+
+    resolver_class->resolve = caching_resolver_resolve;
+    resolver_class->resolve_async = caching_resolver_resolve_async;
+    resolver_class->resolve_finish = caching_resolver_resolve_finish;
+
+    object_class->dispose = axing_caching_resolver_dispose;
+    object_class->finalize = axing_caching_resolver_finalize;
+}
+
+static void
+axing_caching_resolver_dispose (GObject *object)
+{
+    AxingCachingResolver *resolver = AXING_CACHING_RESOLVER (object);
+    g_clear_object (&(resolver->resolver));
+    G_OBJECT_CLASS (axing_caching_resolver_parent_class)->dispose (object);
+}
+
+static void
+axing_caching_resolver_finalize (GObject *object)
+{
+    AxingCachingResolver *resolver = AXING_CACHING_RESOLVER (object);
+    g_queue_clear (&(resolver->lru));
+    g_hash_table_destroy (resolver->entries);
+    g_mutex_clear (&(resolver->mutex));
+    G_OBJECT_CLASS (axing_caching_resolver_parent_class)->finalize (object);
+}
+
+/* resolver NULL means the default resolver. max_entries 0 means a
+   reasonable default.
+ */
+AxingResolver *
+axing_caching_resolver_new (AxingResolver *resolver,
+                            guint          max_entries)
+{
+    AxingCachingResolver *ret;
+
+    g_return_val_if_fail (resolver == NULL || AXING_IS_RESOLVER (resolver), NULL);
+
+    ret = g_object_new (AXING_TYPE_CACHING_RESOLVER, NULL);
+    ret->resolver = resolver ? g_object_ref (resolver) : axing_resolver_get_default ();
+    ret->max_entries = max_entries ? max_entries : DEFAULT_MAX_ENTRIES;
+    return AXING_RESOLVER (ret);
+}
+
+/* If set, a cached file whose modification time changed since it was
+   resolved, or that went away, gets resolved again.
+ */
+void
+axing_caching_resolver_set_check_mtime (AxingCachingResolver *resolver,
+                                        gboolean              check)
+{
+    g_return_if_fail (AXING_IS_CACHING_RESOLVER (resolver));
+    resolver->check_mtime = check;
+}
+
+void
+axing_caching_resolver_clear (AxingCachingResolver *resolver)
+{
+    g_return_if_fail (AXING_IS_CACHING_RESOLVER (resolver));
+    g_mutex_lock (&(resolver->mutex));
+    g_queue_clear (&(resolver->lru));
+    g_hash_table_remove_all (resolver->entries);
+    g_mutex_unlock (&(resolver->mutex));
+}
+
+static AxingResource *
+caching_resolver_resolve (AxingResolver     *resolver,
+                          AxingResource     *base,
+                          const char        *xml_base,
+                          const char        *link,
+                          const char        *pubid,
+                          AxingResolverHint  hint,
+                          GCancellable      *cancellable,
+                          GError           **error)
+{
+    AxingCachingResolver *cacher = AXING_CACHING_RESOLVER (resolver);
+    AxingResource *resource;
+    GError *tmperror = NULL;
+    char *key;
+
+    key = cache_make_key (base, xml_base, link, pubid, hint);
+    if (cache_lookup (cacher, key, &resource, error)) {
+        g_free (key);
+        return resource;
+    }
+
+    resource = axing_resolver_resolve (cacher->resolver, base, xml_base, link, pubid,
+                                       hint, cancellable, &tmperror);
+    /* Don't remember that we were cancelled */
+    if (!g_error_matches (tmperror, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        cache_store (cacher, key, resource, tmperror);
+    else
+        g_free (key);
+
+    if (tmperror != NULL)
+        g_propagate_error (error, tmperror);
+    return resource;
+}
+
+typedef struct {
+    char    *key;
+    GTask   *task;
+} AsyncData;
+
+static void
+caching_resolver_resolved (AxingResolver *inner,
+                           GAsyncResult  *result,
+                           gpointer       user_data)
+{
+    AsyncData *data = user_data;
+    AxingCachingResolver *cacher = g_task_get_source_object (data->task);
+    AxingResource *resource;
+    GError *error = NULL;
+
+    resource = axing_resolver_resolve_finish (inner, result, &error);
+    if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        cache_store (cacher, data->key, resource, error);
+    else
+        g_free (data->key);
+
+    if (resource)
+        g_task_return_pointer (data->task, resource, g_object_unref);
+    else if (error)
+        g_task_return_error (data->task, error);
+    else
+        g_task_return_pointer (data->task, NULL, NULL);
+
+    g_object_unref (data->task);
+    g_free (data);
+}
+
+static void
+caching_resolver_resolve_async (AxingResolver       *resolver,
+                                AxingResource       *base,
+                                const char          *xml_base,
+                                const char          *link,
+                                const char          *pubid,
+                                AxingResolverHint    hint,
+                                GCancellable        *cancellable,
+                                GAsyncReadyCallback  callback,
+                                gpointer             user_data)
+{
+    AxingCachingResolver *cacher = AXING_CACHING_RESOLVER (resolver);
+    AxingResource *resource;
+    AsyncData *data;
+    GError *error = NULL;
+    GTask *task;
+    char *key;
+
+    task = g_task_new (G_OBJECT (resolver), cancellable, callback, user_data);
+    key = cache_make_key (base, xml_base, link, pubid, hint);
+
+    if (cache_lookup (cacher, key, &resource, &error)) {
+        if (resource)
+            g_task_return_pointer (task, resource, g_object_unref);
+        else if (error)
+            g_task_return_error (task, error);
+        else
+            g_task_return_pointer (task, NULL, NULL);
+        g_object_unref (task);
+        g_free (key);
+        return;
+    }
+
+    data = g_new0 (AsyncData, 1);
+    data->key = key;
+    data->task = task;
+    axing_resolver_resolve_async (cacher->resolver, base, xml_base, link, pubid, hint,
+                                  cancellable,
+                                  (GAsyncReadyCallback) caching_resolver_resolved,
+                                  data);
+}
+
+static AxingResource *
+caching_resolver_resolve_finish (AxingResolver *resolver,
+                                 GAsyncResult  *result,
+                                 GError       **error)
+{
+    return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+static char *
+cache_make_key (AxingResource     *base,
+                const char        *xml_base,
+                const char        *link,
+                const char        *pubid,
+                AxingResolverHint  hint)
+{
+    GFile *file = base ? axing_resource_get_file (base) : NULL;
+    char *baseuri = file ? g_file_get_uri (file) : NULL;
+    char *key;
+
+    /* \1 can't appear in any of these, and NULL and "" mean the same */
+    key = g_strdup_printf ("%s\1%s\1%s\1%s\1%i",
+                           baseuri ? baseuri : "",
+                           xml_base ? xml_base : "",
+                           link ? link : "",
+                           pubid ? pubid : "",
+                           (int) hint);
+    g_free (baseuri);
+    return key;
+}
+
+/* Returns TRUE on a hit, with resource and error set as the wrapped
+   resolver left them.
+ */
+static gboolean
+cache_lookup (AxingCachingResolver  *resolver,
+              const char            *key,
+              AxingResource        **resource,
+              GError               **error)
+{
+    CacheEntry *entry;
+    GFile *file = NULL;
+    guint64 mtime = 0;
+
+    *resource = NULL;
+
+    g_mutex_lock (&(resolver->mutex));
+    entry = g_hash_table_lookup (resolver->entries, key);
+    if (entry == NULL) {
+        g_mutex_unlock (&(resolver->mutex));
+        return FALSE;
+    }
+    g_queue_unlink (&(resolver->lru), entry->link);
+    g_queue_push_head_link (&(resolver->lru), entry->link);
+    if (entry->file)
+        file = g_object_ref (entry->file);
+    else if (entry->error)
+        g_propagate_error (error, g_error_copy (entry->error));
+    mtime = entry->mtime;
+    g_mutex_unlock (&(resolver->mutex));
+
+    if (file == NULL)
+        return TRUE;
+
+    /* Stat outside the lock. If it's stale, the caller resolves again and
+       the new result replaces this one.
+     */
+    if (resolver->check_mtime && file_get_mtime (file) != mtime) {
+        g_object_unref (file);
+        return FALSE;
+    }
+
+    *resource = axing_resource_new (file, NULL);
+    g_object_unref (file);
+    return TRUE;
+}
+
+/* Takes key */
+static void
+cache_store (AxingCachingResolver *resolver,
+             char                 *key,
+             AxingResource        *resource,
+             const GError         *error)
+{
+    CacheEntry *entry;
+
+    if (resource != NULL && axing_resource_get_input_stream (resource) != NULL) {
+        g_free (key);
+        return;
+    }
+
+    entry = g_new0 (CacheEntry, 1);
+    entry->key = key;
+    if (resource != NULL) {
+        entry->file = g_object_ref (axing_resource_get_file (resource));
+        if (resolver->check_mtime)
+            entry->mtime = file_get_mtime (entry->file);
+    }
+    else if (error != NULL) {
+        entry->error = g_error_copy (error);
+    }
+
+    g_mutex_lock (&(resolver->mutex));
+    if (g_hash_table_contains (resolver->entries, key)) {
+        CacheEntry *old = g_hash_table_lookup (resolver->entries, key);
+        g_queue_delete_link (&(resolver->lru), old->link);
+        g_hash_table_remove (resolver->entries, key);
+    }
+    while (g_hash_table_size (resolver->entries) >= resolver->max_entries) {
+        CacheEntry *last = g_queue_pop_tail (&(resolver->lru));
+        g_hash_table_remove (resolver->entries, last->key);
+    }
+    g_queue_push_head (&(resolver->lru), entry);
+    entry->link = resolver->lru.head;
+    g_hash_table_insert (resolver->entries, entry->key, entry);
+    g_mutex_unlock (&(resolver->mutex));
+}
+
+static void
+cache_entry_free (CacheEntry *entry)
+{
+    g_free (entry->key);
+    g_clear_object (&(entry->file));
+    g_clear_error (&(entry->error));
+    g_free (entry);
+}
+
+/* 0 if it doesn't exist or has no modification time */
+static guint64
+file_get_mtime (GFile *file)
+{
+    GFileInfo *info;
+    guint64 mtime;
+
+    info = g_file_query_info (file, G_FILE_ATTRIBUTE_TIME_MODIFIED,
+                              G_FILE_QUERY_INFO_NONE, NULL, NULL);
+    if (info == NULL)
+        return 0;
+    mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+    g_object_unref (info);
+    return mtime;
+}
@@ -0,0 +1,555 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+/* AxingCatalogResolver maps public and system identifiers to other URIs,
+   usually local copies, using OASIS XML catalogs. Catalogs are read once
+   with AxingXmlParser into hash tables, so an exact match is one lookup.
+   Rewrite entries are kept in a table keyed by the prefix, along with the
+   distinct prefix lengths from longest to shortest, so the longest match
+   takes one lookup per distinct length. Anything the catalogs don't map
+   goes to the fallback resolver.
+
+   This handles public, system, uri, rewriteSystem, rewriteURI, group,
+   nextCatalog, xml:base, and prefer. The delegate entries and suffix entries
+   aren't handled yet. Add catalogs before sharing the resolver between
+   threads. After that, resolving only reads.
+ */
+
+#include <string.h>
+
+#include "axing-catalog-resolver.h"
+#include "axing-reader.h"
+#include "axing-utils.h"
+#include "axing-xml-parser.h"
+
+#define CATALOG_NS "urn:oasis:names:tc:entity:xmlns:xml:catalog"
+
+/* prefer_public is from the prefer attribute in scope for the entry */
+typedef struct {
+    char       *uri;
+    gboolean    prefer_public;
+} PublicEntry;
+
+typedef struct {
+    GHashTable *table;   /* prefix to rewritten prefix */
+    GArray     *lengths; /* distinct prefix lengths, longest first */
+} RewriteIndex;
+
+struct _AxingCatalogResolver {
+    AxingResolver parent;
+
+    AxingResolver *fallback;
+
+    GHashTable    *public_ids;
+    GHashTable    *system_ids;
+    GHashTable    *uris;
+    RewriteIndex   rewrite_system;
+    RewriteIndex   rewrite_uri;
+
+    GHashTable    *loaded;   /* catalog URIs, so nextCatalog loops end */
+};
+
+static void      axing_catalog_resolver_init           (AxingCatalogResolver       *resolver);
+static void      axing_catalog_resolver_class_init     (AxingCatalogResolverClass  *klass);
+static void      axing_catalog_resolver_dispose        (GObject                    *object);
+static void      axing_catalog_resolver_finalize       (GObject                    *object);
+
+static AxingResource * catalog_resolver_resolve        (AxingResolver        *resolver,
+                                                        AxingResource        *base,
+                                                        const char           *xml_base,
+                                                        const char           *link,
+                                                        const char           *pubid,
+                                                        AxingResolverHint     hint,
+                                                        GCancellable         *cancellable,
+                                                        GError              **error);
+static void            catalog_resolver_resolve_async  (AxingResolver        *resolver,
+                                                        AxingResource        *base,
+                                                        const char           *xml_base,
+                                                        const char           *link,
+                                                        const char           *pubid,
+                                                        AxingResolverHint     hint,
+                                                        GCancellable         *cancellable,
+                                                        GAsyncReadyCallback   callback,
+                                                        gpointer              user_data);
+static AxingResource * catalog_resolver_resolve_finish (AxingResolver        *resolver,
+                                                        GAsyncResult         *result,
+                                                        GError              **error);
+
+static char *          catalog_lookup                  (AxingCatalogResolver *resolver,
+                                                        const char           *link,
+                                                        const char           *pubid,
+                                                        AxingResolverHint     hint);
+static void            rewrite_index_init              (RewriteIndex         *index);
+static void            rewrite_index_clear             (RewriteIndex         *index);
+static void            rewrite_index_add               (RewriteIndex         *index,
+                                                        const char           *prefix,
+                                                        char                 *rewrite);
+static char *          rewrite_index_lookup            (RewriteIndex         *index,
+                                                        const char           *str);
+static char *          normalize_public_id             (const char           *pubid);
+static void            public_entry_free               (gpointer              data);
+
+G_DEFINE_TYPE (AxingCatalogResolver, axing_catalog_resolver, AXING_TYPE_RESOLVER);
+
+static void
+axing_catalog_resolver_init (AxingCatalogResolver *resolver)
+{
+    resolver->public_ids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, public_entry_free);
+    resolver->system_ids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+    resolver->uris = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+    rewrite_index_init (&(resolver->rewrite_system));
+    rewrite_index_init (&(resolver->rewrite_uri));
+    resolver->loaded = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+}
+
+static void
+axing_catalog_resolver_class_init (AxingCatalogResolverClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS (klass);
+    AxingResolverClass *resolver_class = AXING_RESOLVER_CLASS (klass);
+
+    resolver_class->resolve = catalog_resolver_resolve;
+    resolver_class->resolve_async = catalog_resolver_resolve_async;
+    resolver_class->resolve_finish = catalog_resolver_resolve_finish;
+
+    object_class->dispose = axing_catalog_resolver_dispose;
+    object_class->finalize = axing_catalog_resolver_finalize;
+}
+
+static void
+axing_catalog_resolver_dispose (GObject *object)
+{
+    AxingCatalogResolver *resolver = AXING_CATALOG_RESOLVER (object);
+    g_clear_object (&(resolver->fallback));
+    G_OBJECT_CLASS (axing_catalog_resolver_parent_class)->dispose (object);
+}
+
+static void
+axing_catalog_resolver_finalize (GObject *object)
+{
+    AxingCatalogResolver *resolver = AXING_CATALOG_RESOLVER (object);
+    g_hash_table_destroy (resolver->public_ids);
+    g_hash_table_destroy (resolver->system_ids);
+    g_hash_table_destroy (resolver->uris);
+    rewrite_index_clear (&(resolver->rewrite_system));
+    rewrite_index_clear (&(resolver->rewrite_uri));
+    g_hash_table_destroy (resolver->loaded);
+    G_OBJECT_CLASS (axing_catalog_resolver_parent_class)->finalize (object);
+}
+
+/* fallback NULL means the default resolver */
+AxingResolver *
+axing_catalog_resolver_new (AxingResolver *fallback)
+{
+    AxingCatalogResolver *resolver;
+
+    g_return_val_if_fail (fallback == NULL || AXING_IS_RESOLVER (fallback), NULL);
+
+    resolver = g_object_new (AXING_TYPE_CATALOG_RESOLVER, NULL);
+    resolver->fallback = fallback ? g_object_ref (fallback) : axing_resolver_get_default ();
+    return AXING_RESOLVER (resolver);
+}
+
+/* Entries from earlier catalogs win over later ones, like the spec says
+   for the catalog entry files list. Catalogs in nextCatalog entries are
+   read right away, but their entries only fill in what's still missing.
+ */
+gboolean
+axing_catalog_resolver_add_catalog (AxingCatalogResolver  *resolver,
+                                    GFile                 *catalog,
+                                    GCancellable          *cancellable,
+                                    GError               **error)
+{
+    AxingResource *resource;
+    AxingXmlParser *parser;
+    AxingReader *reader;
+    GPtrArray *bases;
+    GArray *prefers;
+    GPtrArray *next;
+    GError *readerror = NULL;
+    gboolean ret = FALSE;
+    char *uri;
+    guint i;
+
+    g_return_val_if_fail (AXING_IS_CATALOG_RESOLVER (resolver), FALSE);
+    g_return_val_if_fail (G_IS_FILE (catalog), FALSE);
+
+    uri = g_file_get_uri (catalog);
+    if (g_hash_table_contains (resolver->loaded, uri)) {
+        g_free (uri);
+        return TRUE;
+    }
+    g_hash_table_add (resolver->loaded, g_strdup (uri));
+
+    resource = axing_resource_new (catalog, NULL);
+    parser = axing_xml_parser_new (resource, NULL);
+    reader = AXING_READER (parser);
+
+    /* xml:base in scope for each open element, with the catalog's own
+       URI at the bottom.
+     */
+    bases = g_ptr_array_new_with_free_func (g_free);
+    g_ptr_array_add (bases, uri);
+    /* Likewise for prefer, which is public unless a catalog says otherwise */
+    prefers = g_array_new (FALSE, FALSE, sizeof (gboolean));
+    g_array_set_size (prefers, 1);
+    g_array_index (prefers, gboolean, 0) = TRUE;
+    next = g_ptr_array_new_with_free_func (g_free);
+
+    while (axing_reader_read (reader, &readerror)) {
+        AxingNodeType type = axing_reader_get_node_type (reader);
+        const char *base = g_ptr_array_index (bases, bases->len - 1);
+        gboolean prefer_public = g_array_index (prefers, gboolean, prefers->len - 1);
+        const char *localname, *val;
+        char *target;
+
+        if (type == AXING_NODE_TYPE_END_ELEMENT) {
+            g_ptr_array_remove_index (bases, bases->len - 1);
+            g_array_set_size (prefers, prefers->len - 1);
+            continue;
+        }
+        if (type != AXING_NODE_TYPE_ELEMENT)
+            continue;
+
+        val = axing_reader_get_attr_value (reader, "xml:base");
+        g_ptr_array_add (bases, val ? axing_uri_resolve_relative (base, val) : g_strdup (base));
+        base = g_ptr_array_index (bases, bases->len - 1);
+
+        if (g_strcmp0 (axing_reader_get_namespace (reader), CATALOG_NS) == 0) {
+            localname = axing_reader_get_localname (reader);
+            val = axing_reader_get_attr_value (reader, "prefer");
+            if (val != NULL && (g_str_equal (localname, "catalog") ||
+                                g_str_equal (localname, "group"))) {
+                if (g_str_equal (val, "system"))
+                    prefer_public = FALSE;
+                else if (g_str_equal (val, "public"))
+                    prefer_public = TRUE;
+            }
+        }
+        g_array_append_val (prefers, prefer_public);
+
+        if (g_strcmp0 (axing_reader_get_namespace (reader), CATALOG_NS) != 0)
+            continue;
+        localname = axing_reader_get_localname (reader);
+
+#define ATTR(name) (axing_reader_get_attr_value (reader, name))
+        if (g_str_equal (localname, "public") && ATTR ("publicId") && ATTR ("uri")) {
+            char *id = normalize_public_id (ATTR ("publicId"));
+            if (g_hash_table_contains (resolver->public_ids, id)) {
+                g_free (id);
+            }
+            else {
+                PublicEntry *entry = g_new (PublicEntry, 1);
+                entry->uri = axing_uri_resolve_relative (base, ATTR ("uri"));
+                entry->prefer_public = prefer_public;
+                g_hash_table_insert (resolver->public_ids, id, entry);
+            }
+        }
+        else if (g_str_equal (localname, "system") && ATTR ("systemId") && ATTR ("uri")) {
+            if (!g_hash_table_contains (resolver->system_ids, ATTR ("systemId")))
+                g_hash_table_insert (resolver->system_ids, g_strdup (ATTR ("systemId")),
+                                     axing_uri_resolve_relative (base, ATTR ("uri")));
+        }
+        else if (g_str_equal (localname, "uri") && ATTR ("name") && ATTR ("uri")) {
+            if (!g_hash_table_contains (resolver->uris, ATTR ("name")))
+                g_hash_table_insert (resolver->uris, g_strdup (ATTR ("name")),
+                                     axing_uri_resolve_relative (base, ATTR ("uri")));
+        }
+        else if (g_str_equal (localname, "rewriteSystem") &&
+                 ATTR ("systemIdStartString") && ATTR ("rewritePrefix")) {
+            target = axing_uri_resolve_relative (base, ATTR ("rewritePrefix"));
+            rewrite_index_add (&(resolver->rewrite_system), ATTR ("systemIdStartString"), target);
+        }
+        else if (g_str_equal (localname, "rewriteURI") &&
+                 ATTR ("uriStartString") && ATTR ("rewritePrefix")) {
+            target = axing_uri_resolve_relative (base, ATTR ("rewritePrefix"));
+            rewrite_index_add (&(resolver->rewrite_uri), ATTR ("uriStartString"), target);
+        }
+        else if (g_str_equal (localname, "nextCatalog") && ATTR ("catalog")) {
+            g_ptr_array_add (next, axing_uri_resolve_relative (base, ATTR ("catalog")));
+        }
+#undef ATTR
+    }
+
+    if (readerror != NULL) {
+        /* The parser owns its error */
+        if (error != NULL)
+            *error = g_error_copy (readerror);
+        goto error;
+    }
+
+    ret = TRUE;
+    for (i = 0; i < next->len; i++) {
+        GFile *file = g_file_new_for_uri (g_ptr_array_index (next, i));
+        /* A missing next catalog is skipped, like the spec says */
+        axing_catalog_resolver_add_catalog (resolver, file, cancellable, NULL);
+        g_object_unref (file);
+    }
+
+ error:
+    g_ptr_array_free (next, TRUE);
+    g_ptr_array_free (bases, TRUE);
+    g_array_free (prefers, TRUE);
+    g_object_unref (parser);
+    g_object_unref (resource);
+    return ret;
+}
+
+/* Reads the catalogs in XML_CATALOG_FILES, or /etc/xml/catalog if that
+   isn't set, the same as libxml2 does. Catalogs that can't be read are
+   skipped.
+ */
+void
+axing_catalog_resolver_add_default_catalogs (AxingCatalogResolver *resolver)
+{
+    const char *env;
+    char **paths;
+    int i;
+
+    g_return_if_fail (AXING_IS_CATALOG_RESOLVER (resolver));
+
+    env = g_getenv ("XML_CATALOG_FILES");
+    paths = g_strsplit (env ? env : "/etc/xml/catalog", " ", -1);
+    for (i = 0; paths[i] != NULL; i++) {
+        GFile *file;
+        if (paths[i][0] == '\0')
+            continue;
+        file = g_file_new_for_commandline_arg (paths[i]);
+        axing_catalog_resolver_add_catalog (resolver, file, NULL, NULL);
+        g_object_unref (file);
+    }
+    g_strfreev (paths);
+}
+
+static AxingResource *
+catalog_resolver_resolve (AxingResolver     *resolver,
+                          AxingResource     *base,
+                          const char        *xml_base,
+                          const char        *link,
+                          const char        *pubid,
+                          AxingResolverHint  hint,
+                          GCancellable      *cancellable,
+                          GError           **error)
+{
+    AxingCatalogResolver *catalog = AXING_CATALOG_RESOLVER (resolver);
+    AxingResource *resource;
+    GFile *file;
+    char *mapped;
+
+    mapped = catalog_lookup (catalog, link, pubid, hint);
+    if (mapped == NULL)
+        return axing_resolver_resolve (catalog->fallback, base, xml_base, link, pubid,
+                                       hint, cancellable, error);
+
+    file = g_file_new_for_uri (mapped);
+    resource = axing_resource_new (file, NULL);
+    g_object_unref (file);
+    g_free (mapped);
+    return resource;
+}
+
+static void
+catalog_resolver_resolve_async (AxingResolver       *resolver,
+                                AxingResource       *base,
+                                const char          *xml_base,
+                                const char          *link,
+                                const char          *pubid,
+                                AxingResolverHint    hint,
+                                GCancellable        *cancellable,
+                                GAsyncReadyCallback  callback,
+                                gpointer             user_data)
+{
+    AxingCatalogResolver *catalog = AXING_CATALOG_RESOLVER (resolver);
+    AxingResource *resource;
+    GFile *file;
+    GTask *task;
+    char *mapped;
+
+    mapped = catalog_lookup (catalog, link, pubid, hint);
+    if (mapped == NULL) {
+        /* Let the fallback report straight to the caller. Our finish
+           tells its results from ours by the source object.
+         */
+        axing_resolver_resolve_async (catalog->fallback, base, xml_base, link, pubid, hint,
+                                      cancellable, callback, user_data);
+        return;
+    }
+
+    task = g_task_new (G_OBJECT (resolver), cancellable, callback, user_data);
+    file = g_file_new_for_uri (mapped);
+    resource = axing_resource_new (file, NULL);
+    g_task_return_pointer (task, resource, g_object_unref);
+    g_object_unref (task);
+    g_object_unref (file);
+    g_free (mapped);
+}
+
+static AxingResource *
+catalog_resolver_resolve_finish (AxingResolver *resolver,
+                                 GAsyncResult  *result,
+                                 GError       **error)
+{
+    AxingCatalogResolver *catalog = AXING_CATALOG_RESOLVER (resolver);
+    if (g_task_is_valid (result, resolver))
+        return g_task_propagate_pointer (G_TASK (result), error);
+    return axing_resolver_resolve_finish (catalog->fallback, result, error);
+}
+
+/* System entries are tried first. Public entries are used when there's
+   no system identifier, or when they were read with prefer="public", which
+   is the default.
+ */
+static char *
+catalog_lookup (AxingCatalogResolver *resolver,
+                const char           *link,
+                const char           *pubid,
+                AxingResolverHint     hint)
+{
+    const char *val;
+    char *ret;
+
+    if (link != NULL && hint == AXING_RESOLVER_HINT_ENTITY) {
+        val = g_hash_table_lookup (resolver->system_ids, link);
+        if (val != NULL)
+            return g_strdup (val);
+        ret = rewrite_index_lookup (&(resolver->rewrite_system), link);
+        if (ret != NULL)
+            return ret;
+    }
+
+    if (pubid != NULL) {
+        char *id = normalize_public_id (pubid);
+        PublicEntry *entry = g_hash_table_lookup (resolver->public_ids, id);
+        g_free (id);
+        if (entry != NULL && (entry->prefer_public || link == NULL))
+            return g_strdup (entry->uri);
+    }
+
+    if (link != NULL && hint != AXING_RESOLVER_HINT_ENTITY) {
+        val = g_hash_table_lookup (resolver->uris, link);
+        if (val != NULL)
+            return g_strdup (val);
+        ret = rewrite_index_lookup (&(resolver->rewrite_uri), link);
+        if (ret != NULL)
+            return ret;
+    }
+
+    return NULL;
+}
+
+static void
+rewrite_index_init (RewriteIndex *index)
+{
+    index->table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+    index->lengths = g_array_new (FALSE, FALSE, sizeof (gsize));
+}
+
+static void
+rewrite_index_clear (RewriteIndex *index)
+{
+    g_hash_table_destroy (index->table);
+    g_array_free (index->lengths, TRUE);
+}
+
+/* Takes rewrite */
+static void
+rewrite_index_add (RewriteIndex *index,
+                   const char   *prefix,
+                   char         *rewrite)
+{
+    gsize len = strlen (prefix);
+    guint i;
+
+    if (len == 0 || g_hash_table_contains (index->table, prefix)) {
+        g_free (rewrite);
+        return;
+    }
+    g_hash_table_insert (index->table, g_strdup (prefix), rewrite);
+
+    for (i = 0; i < index->lengths->len; i++) {
+        gsize cur = g_array_index (index->lengths, gsize, i);
+        if (cur == len)
+            return;
+        if (cur < len)
+            break;
+    }
+    g_array_insert_val (index->lengths, i, len);
+}
+
+static char *
+rewrite_index_lookup (RewriteIndex *index,
+                      const char   *str)
+{
+    gsize len = strlen (str);
+    char *prefix;
+    guint i;
+
+    if (index->lengths->len == 0)
+        return NULL;
+
+    prefix = g_strdup (str);
+    for (i = 0; i < index->lengths->len; i++) {
+        gsize cur = g_array_index (index->lengths, gsize, i);
+        const char *rewrite;
+        if (cur > len)
+            continue;
+        prefix[cur] = '\0';
+        rewrite = g_hash_table_lookup (index->table, prefix);
+        if (rewrite != NULL) {
+            char *ret = g_strconcat (rewrite, str + cur, NULL);
+            g_free (prefix);
+            return ret;
+        }
+    }
+    g_free (prefix);
+    return NULL;
+}
+
+/* Public identifiers match after collapsing whitespace */
+static char *
+normalize_public_id (const char *pubid)
+{
+    GString *ret = g_string_sized_new (strlen (pubid));
+    const char *c;
+    gboolean space = FALSE;
+
+    for (c = pubid; *c != '\0'; c++) {
+        if (*c == ' ' || *c == '\t' || *c == '\n' || *c == '\r') {
+            space = ret->len > 0;
+            continue;
+        }
+        if (space)
+            g_string_append_c (ret, ' ');
+        space = FALSE;
+        g_string_append_c (ret, *c);
+    }
+    return g_string_free (ret, FALSE);
+}
+
+static void
+public_entry_free (gpointer data)
+{
+    PublicEntry *entry = data;
+    g_free (entry->uri);
+    g_free (entry);
+}
@@ -0,0 +1,45 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+#ifndef __AXING_CATALOG_RESOLVER_H__
+#define __AXING_CATALOG_RESOLVER_H__
+
+#include <glib-object.h>
+#include <gio/gio.h>
+#include "axing-resolver.h"
+
+G_BEGIN_DECLS
+
+#define AXING_TYPE_CATALOG_RESOLVER axing_catalog_resolver_get_type ()
+G_DECLARE_FINAL_TYPE (AxingCatalogResolver, axing_catalog_resolver, AXING, CATALOG_RESOLVER, AxingResolver)
+
+AxingResolver *  axing_catalog_resolver_new                   (AxingResolver         *fallback);
+gboolean         axing_catalog_resolver_add_catalog           (AxingCatalogResolver  *resolver,
+                                                               GFile                 *catalog,
+                                                               GCancellable          *cancellable,
+                                                               GError               **error);
+void             axing_catalog_resolver_add_default_catalogs  (AxingCatalogResolver  *resolver);
+
+G_END_DECLS
+
+#endif /* __AXING_CATALOG_RESOLVER_H__ */
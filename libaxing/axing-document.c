@@ -0,0 +1,448 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+#include "axing-document.h"
+
+typedef struct {
+    guint32  type;
+    guint32  parent;
+    guint32  next_sibling;
+    guint32  name_id;
+    guint32  ns_id;
+    guint32  first; /* first attribute for elements, text offset otherwise */
+    guint32  count; /* number of attributes for elements, text length otherwise */
+    gint64   linenum;
+    gint64   colnum;
+} Node;
+
+typedef struct {
+    guint32  name_id;
+    guint32  ns_id;
+    guint32  offset;
+    guint32  len;
+} Attr;
+
+/* One for each open node while building */
+typedef struct {
+    guint32  node;
+    guint32  last_child;
+} OpenNode;
+
+struct _AxingDocument {
+    GObject parent;
+
+    AxingNameTable *names;
+    GArray         *nodes;
+    GArray         *attrs;
+    GString        *pool;
+};
+
+G_DEFINE_TYPE (AxingDocument, axing_document, G_TYPE_OBJECT);
+
+static void      axing_document_init            (AxingDocument        *document);
+static void      axing_document_class_init      (AxingDocumentClass   *klass);
+static void      axing_document_finalize        (GObject              *object);
+
+static gboolean  document_add_text              (AxingDocument        *document,
+                                                 const char           *text,
+                                                 gsize                 len,
+                                                 guint32              *offset,
+                                                 GError              **error);
+
+#define NODE(document, node) (&g_array_index ((document)->nodes, Node, (node)))
+
+static void
+axing_document_init (AxingDocument *document)
+{
+    document->nodes = g_array_sized_new (FALSE, FALSE, sizeof (Node), 256);
+    document->attrs = g_array_sized_new (FALSE, FALSE, sizeof (Attr), 64);
+    document->pool = g_string_sized_new (4096);
+}
+
+static void
+axing_document_class_init (AxingDocumentClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+    object_class->finalize = axing_document_finalize;
+}
+
+static void
+axing_document_finalize (GObject *object)
+{
+    AxingDocument *document = AXING_DOCUMENT (object);
+    g_array_free (document->nodes, TRUE);
+    g_array_free (document->attrs, TRUE);
+    g_string_free (document->pool, TRUE);
+    g_clear_pointer (&(document->names), axing_name_table_unref);
+    G_OBJECT_CLASS (axing_document_parent_class)->finalize (object);
+}
+
+/* Reads all remaining events from reader into a new document. Names share
+   the reader's name table.
+ */
+AxingDocument *
+axing_document_new_from_reader (AxingReader  *reader,
+                                GError      **error)
+{
+    AxingDocument *document;
+    AxingEventRecord *records;
+    guint n_records = 256;
+    GArray *open;
+    OpenNode top;
+    Node docnode = { AXING_NODE_TYPE_DOCUMENT, AXING_DOCUMENT_NO_NODE, AXING_DOCUMENT_NO_NODE,
+                     0, 0, 0, 0, 0, 0 };
+    GError *batcherror = NULL;
+
+    g_return_val_if_fail (AXING_IS_READER (reader), NULL);
+
+    document = g_object_new (AXING_TYPE_DOCUMENT, NULL);
+    document->names = axing_name_table_ref (axing_reader_get_name_table (reader));
+    g_array_append_val (document->nodes, docnode);
+
+    open = g_array_new (FALSE, FALSE, sizeof (OpenNode));
+    top.node = 0;
+    top.last_child = AXING_DOCUMENT_NO_NODE;
+    g_array_append_val (open, top);
+
+    records = g_new (AxingEventRecord, n_records);
+
+    while (TRUE) {
+        guint count, i;
+
+        count = axing_reader_read_batch (reader, records, n_records, &batcherror);
+        if (batcherror != NULL) {
+            /* The reader keeps the element pending, so the next call with
+               a bigger buffer gets it.
+             */
+            if (g_error_matches (batcherror, G_IO_ERROR, G_IO_ERROR_NO_SPACE)) {
+                g_clear_error (&batcherror);
+                n_records *= 2;
+                records = g_renew (AxingEventRecord, records, n_records);
+                continue;
+            }
+            g_propagate_error (error, batcherror);
+            goto error;
+        }
+        if (count == 0)
+            break;
+
+        for (i = 0; i < count; i++) {
+            AxingEventRecord *record = &(records[i]);
+            OpenNode *parent;
+            Node node;
+            guint32 index;
+
+            switch (record->type) {
+            case AXING_NODE_TYPE_END_ELEMENT:
+                if (open->len > 1)
+                    g_array_set_size (open, open->len - 1);
+                continue;
+            case AXING_NODE_TYPE_ELEMENT:
+            case AXING_NODE_TYPE_CONTENT:
+            case AXING_NODE_TYPE_COMMENT:
+            case AXING_NODE_TYPE_CDATA:
+            case AXING_NODE_TYPE_INSTRUCTION:
+                break;
+            default:
+                continue;
+            }
+
+            parent = &g_array_index (open, OpenNode, open->len - 1);
+            index = document->nodes->len;
+
+            node.type = record->type;
+            node.parent = parent->node;
+            node.next_sibling = AXING_DOCUMENT_NO_NODE;
+            node.name_id = record->name_id;
+            node.ns_id = record->ns_id;
+            node.linenum = record->linenum;
+            node.colnum = record->colnum;
+
+            if (record->type == AXING_NODE_TYPE_ELEMENT) {
+                guint j;
+                node.first = document->attrs->len;
+                node.count = record->n_attrs;
+                for (j = 1; j <= record->n_attrs; j++) {
+                    Attr attr;
+                    attr.name_id = records[i + j].name_id;
+                    attr.ns_id = records[i + j].ns_id;
+                    attr.len = records[i + j].text_len;
+                    if (!document_add_text (document, records[i + j].text, attr.len,
+                                            &(attr.offset), error))
+                        goto error;
+                    g_array_append_val (document->attrs, attr);
+                }
+                i += record->n_attrs;
+            }
+            else {
+                node.count = record->text_len;
+                if (!document_add_text (document, record->text, record->text_len,
+                                        &(node.first), error))
+                    goto error;
+            }
+
+            g_array_append_val (document->nodes, node);
+            if (parent->last_child != AXING_DOCUMENT_NO_NODE)
+                NODE (document, parent->last_child)->next_sibling = index;
+            parent->last_child = index;
+
+            if (record->type == AXING_NODE_TYPE_ELEMENT) {
+                top.node = index;
+                top.last_child = AXING_DOCUMENT_NO_NODE;
+                g_array_append_val (open, top);
+            }
+        }
+    }
+
+    g_free (records);
+    g_array_free (open, TRUE);
+    return document;
+
+ error:
+    g_free (records);
+    g_array_free (open, TRUE);
+    g_object_unref (document);
+    return NULL;
+}
+
+/* Text offsets are 32-bit to keep nodes small, so the pool stops at 4GB */
+static gboolean
+document_add_text (AxingDocument  *document,
+                   const char     *text,
+                   gsize           len,
+                   guint32        *offset,
+                   GError        **error)
+{
+    if (len >= G_MAXUINT32 - document->pool->len) {
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_NO_SPACE,
+                     "Document text is larger than %u bytes", G_MAXUINT32);
+        return FALSE;
+    }
+    *offset = document->pool->len;
+    g_string_append_len (document->pool, text, len);
+    g_string_append_c (document->pool, '\0');
+    return TRUE;
+}
+
+AxingNameTable *
+axing_document_get_name_table (AxingDocument *document)
+{
+    g_return_val_if_fail (AXING_IS_DOCUMENT (document), NULL);
+    return document->names;
+}
+
+guint32
+axing_document_get_n_nodes (AxingDocument *document)
+{
+    g_return_val_if_fail (AXING_IS_DOCUMENT (document), 0);
+    return document->nodes->len;
+}
+
+guint32
+axing_document_get_root_element (AxingDocument *document)
+{
+    guint32 node;
+    g_return_val_if_fail (AXING_IS_DOCUMENT (document), AXING_DOCUMENT_NO_NODE);
+    for (node = axing_document_node_get_first_child (document, 0);
+         node != AXING_DOCUMENT_NO_NODE;
+         node = NODE (document, node)->next_sibling) {
+        if (NODE (document, node)->type == AXING_NODE_TYPE_ELEMENT)
+            return node;
+    }
+    return AXING_DOCUMENT_NO_NODE;
+}
+
+AxingNodeType
+axing_document_node_get_node_type (AxingDocument *document,
+                                   guint32        node)
+{
+    g_return_val_if_fail (AXING_IS_DOCUMENT (document), AXING_NODE_TYPE_NONE);
+    g_return_val_if_fail (node < document->nodes->len, AXING_NODE_TYPE_NONE);
+    return NODE (document, node)->type;
+}
+
+guint32
+axing_document_node_get_parent (AxingDocument *document,
+                                guint32        node)
+{
+    g_return_val_if_fail (AXING_IS_DOCUMENT (document), AXING_DOCUMENT_NO_NODE);
+    g_return_val_if_fail (node < document->nodes->len, AXING_DOCUMENT_NO_NODE);
+    return NODE (document, node)->parent;
+}
+
+/* Children come right after their parent, so there's no need to store this */
+guint32
+axing_document_node_get_first_child (AxingDocument *document,
+                                     guint32        node)
+{
+    g_return_val_if_fail (AXING_IS_DOCUMENT (document), AXING_DOCUMENT_NO_NODE);
+    g_return_val_if_fail (node < document->nodes->len, AXING_DOCUMENT_NO_NODE);
+    if (node + 1 < document->nodes->len && NODE (document, node + 1)->parent == node)
+        return node + 1;
+    return AXING_DOCUMENT_NO_NODE;
+}
+
+guint32
+axing_document_node_get_next_sibling (AxingDocument *document,
+                                      guint32        node)
+{
+    g_return_val_if_fail (AXING_IS_DOCUMENT (document), AXING_DOCUMENT_NO_NODE);
+    g_return_val_if_fail (node < document->nodes->len, AXING_DOCUMENT_NO_NODE);
+    return NODE (document, node)->next_sibling;
+}
+
+/* The local name for elements, or the target for instructions */
+guint32
+axing_document_node_get_name_id (AxingDocument *document,
+                                 guint32        node)
+{
+    g_return_val_if_fail (AXING_IS_DOCUMENT (document), 0);
+    g_return_val_if_fail (node < document->nodes->len, 0);
+    return NODE (document, node)->name_id;
+}
+
+guint32
+axing_document_node_get_ns_id (AxingDocument *document,
+                               guint32        node)
+{
+    g_return_val_if_fail (AXING_IS_DOCUMENT (document), 0);
+    g_return_val_if_fail (node < document->nodes->len, 0);
+    return NODE (document, node)->ns_id;
+}
+
+const char *
+axing_document_node_get_name (AxingDocument *document,
+                              guint32        node)
+{
+    g_return_val_if_fail (AXING_IS_DOCUMENT (document), NULL);
+    g_return_val_if_fail (node < document->nodes->len, NULL);
+    return axing_name_table_lookup (document->names, NODE (document, node)->name_id);
+}
+
+const char *
+axing_document_node_get_namespace (AxingDocument *document,
+                                   guint32        node)
+{
+    g_return_val_if_fail (AXING_IS_DOCUMENT (document), NULL);
+    g_return_val_if_fail (node < document->nodes->len, NULL);
+    return axing_name_table_lookup (document->names, NODE (document, node)->ns_id);
+}
+
+/* Returns NULL for elements and the document node */
+const char *
+axing_document_node_get_content (AxingDocument *document,
+                                 guint32        node,
+                                 gsize         *len)
+{
+    Node *data;
+    g_return_val_if_fail (AXING_IS_DOCUMENT (document), NULL);
+    g_return_val_if_fail (node < document->nodes->len, NULL);
+    data = NODE (document, node);
+    if (data->type == AXING_NODE_TYPE_ELEMENT || data->type == AXING_NODE_TYPE_DOCUMENT) {
+        if (len)
+            *len = 0;
+        return NULL;
+    }
+    if (len)
+        *len = data->count;
+    return document->pool->str + data->first;
+}
+
+gint64
+axing_document_node_get_linenum (AxingDocument *document,
+                                 guint32        node)
+{
+    g_return_val_if_fail (AXING_IS_DOCUMENT (document), 0);
+    g_return_val_if_fail (node < document->nodes->len, 0);
+    return NODE (document, node)->linenum;
+}
+
+gint64
+axing_document_node_get_colnum (AxingDocument *document,
+                                guint32        node)
+{
+    g_return_val_if_fail (AXING_IS_DOCUMENT (document), 0);
+    g_return_val_if_fail (node < document->nodes->len, 0);
+    return NODE (document, node)->colnum;
+}
+
+guint
+axing_document_node_get_n_attrs (AxingDocument *document,
+                                 guint32        node)
+{
+    g_return_val_if_fail (AXING_IS_DOCUMENT (document), 0);
+    g_return_val_if_fail (node < document->nodes->len, 0);
+    if (NODE (document, node)->type != AXING_NODE_TYPE_ELEMENT)
+        return 0;
+    return NODE (document, node)->count;
+}
+
+#define ATTR(document, node, attr) \
+    (&g_array_index ((document)->attrs, Attr, NODE (document, node)->first + (attr)))
+
+guint32
+axing_document_node_get_attr_name_id (AxingDocument *document,
+                                      guint32        node,
+                                      guint          attr)
+{
+    g_return_val_if_fail (attr < axing_document_node_get_n_attrs (document, node), 0);
+    return ATTR (document, node, attr)->name_id;
+}
+
+guint32
+axing_document_node_get_attr_ns_id (AxingDocument *document,
+                                    guint32        node,
+                                    guint          attr)
+{
+    g_return_val_if_fail (attr < axing_document_node_get_n_attrs (document, node), 0);
+    return ATTR (document, node, attr)->ns_id;
+}
+
+const char *
+axing_document_node_get_attr_value (AxingDocument *document,
+                                    guint32        node,
+                                    guint          attr)
+{
+    g_return_val_if_fail (attr < axing_document_node_get_n_attrs (document, node), NULL);
+    return document->pool->str + ATTR (document, node, attr)->offset;
+}
+
+/* Finds an attribute by name and namespace IDs from the document's name
+   table. Use axing_name_table_find to get IDs without adding names.
+ */
+const char *
+axing_document_node_lookup_attr (AxingDocument *document,
+                                 guint32        node,
+                                 guint32        name_id,
+                                 guint32        ns_id)
+{
+    guint i, n_attrs;
+    n_attrs = axing_document_node_get_n_attrs (document, node);
+    for (i = 0; i < n_attrs; i++) {
+        Attr *attr = ATTR (document, node, i);
+        if (attr->name_id == name_id && attr->ns_id == ns_id)
+            return document->pool->str + attr->offset;
+    }
+    return NULL;
+}
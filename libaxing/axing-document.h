@@ -0,0 +1,95 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+#ifndef __AXING_DOCUMENT_H__
+#define __AXING_DOCUMENT_H__
+
+#include <glib-object.h>
+#include <gio/gio.h>
+#include "axing-enums.h"
+#include "axing-name-table.h"
+#include "axing-reader.h"
+
+G_BEGIN_DECLS
+
+#define AXING_TYPE_DOCUMENT (axing_document_get_type ())
+G_DECLARE_FINAL_TYPE (AxingDocument, axing_document, AXING, DOCUMENT, GObject)
+
+/* Nodes are indexes into the document's node array. Node 0 is the document
+   node itself, and nodes come in document order, so a node's descendants
+   are the nodes right after it. AXING_DOCUMENT_NO_NODE is returned where
+   there's no parent, child, or sibling.
+ */
+#define AXING_DOCUMENT_NO_NODE G_MAXUINT32
+
+AxingDocument *   axing_document_new_from_reader            (AxingReader     *reader,
+                                                             GError         **error);
+
+AxingNameTable *  axing_document_get_name_table             (AxingDocument   *document);
+guint32           axing_document_get_n_nodes                (AxingDocument   *document);
+guint32           axing_document_get_root_element           (AxingDocument   *document);
+
+AxingNodeType     axing_document_node_get_node_type         (AxingDocument   *document,
+                                                             guint32          node);
+guint32           axing_document_node_get_parent            (AxingDocument   *document,
+                                                             guint32          node);
+guint32           axing_document_node_get_first_child       (AxingDocument   *document,
+                                                             guint32          node);
+guint32           axing_document_node_get_next_sibling      (AxingDocument   *document,
+                                                             guint32          node);
+
+guint32           axing_document_node_get_name_id           (AxingDocument   *document,
+                                                             guint32          node);
+guint32           axing_document_node_get_ns_id             (AxingDocument   *document,
+                                                             guint32          node);
+const char *      axing_document_node_get_name              (AxingDocument   *document,
+                                                             guint32          node);
+const char *      axing_document_node_get_namespace         (AxingDocument   *document,
+                                                             guint32          node);
+const char *      axing_document_node_get_content           (AxingDocument   *document,
+                                                             guint32          node,
+                                                             gsize           *len);
+gint64            axing_document_node_get_linenum           (AxingDocument   *document,
+                                                             guint32          node);
+gint64            axing_document_node_get_colnum            (AxingDocument   *document,
+                                                             guint32          node);
+
+guint             axing_document_node_get_n_attrs           (AxingDocument   *document,
+                                                             guint32          node);
+guint32           axing_document_node_get_attr_name_id      (AxingDocument   *document,
+                                                             guint32          node,
+                                                             guint            attr);
+guint32           axing_document_node_get_attr_ns_id        (AxingDocument   *document,
+                                                             guint32          node,
+                                                             guint            attr);
+const char *      axing_document_node_get_attr_value        (AxingDocument   *document,
+                                                             guint32          node,
+                                                             guint            attr);
+const char *      axing_document_node_lookup_attr           (AxingDocument   *document,
+                                                             guint32          node,
+                                                             guint32          name_id,
+                                                             guint32          ns_id);
+
+G_END_DECLS
+
+#endif /* __AXING_DOCUMENT_H__ */
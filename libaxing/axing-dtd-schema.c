@@ -20,7 +20,29 @@
  * Author: Shaun McCance  <shaunm@gnome.org>
  */
 
+#include <string.h>
+
 #include "axing-dtd-schema.h"
+#include "axing-utils.h"
+
+/* Saved schemas are a header followed by strings and counts, all numbers
+   being 32-bit little-endian:
+
+     header:     "AXDT" version
+     strings:    doctype public system base
+     entities:   count (name value public system ndata) for each
+     parameters: count (name value public system ndata) for each
+     notations:  count (name value public system ndata) for each
+
+   Strings are a length, the bytes, and a NUL, or just 0xFFFFFFFF for
+   NULL. Loaded schemas point right into the data, so mapping the file is
+   most of the work. Element and attribute list declarations aren't kept
+   by the schema yet, so they aren't saved either. Later versions can add
+   sections after the notations.
+ */
+#define DTD_FILE_MAGIC   "AXDT"
+#define DTD_FILE_VERSION 1
+#define DTD_FILE_NULL    0xFFFFFFFF
 
 struct _AxingDtdSchema {
     GObject parent;
@@ -31,6 +53,16 @@ struct _AxingDtdSchema {
     GHashTable *general_entities;
     GHashTable *parameter_entities;
     GHashTable *notations;
+
+    /* Frozen schemas can't change, so they can be shared between threads
+       and used as the external subset of other schemas.
+     */
+    gboolean frozen;
+    char *base;
+    AxingDtdSchema *external;
+
+    /* Entity strings point into this for loaded schemas */
+    GBytes *bytes;
 };
 
 typedef struct {
@@ -59,6 +91,31 @@ static void      axing_dtd_schema_class_init    (AxingDtdSchemaClass  *klass);
 static void      axing_dtd_schema_dispose       (GObject              *object);
 static void      axing_dtd_schema_finalize      (GObject              *object);
 
+static EntityData *  schema_lookup_entity       (AxingDtdSchema       *dtd,
+                                                 const char           *name,
+                                                 AxingDtdSchema      **owner);
+static EntityData *  schema_lookup_parameter    (AxingDtdSchema       *dtd,
+                                                 const char           *name,
+                                                 AxingDtdSchema      **owner);
+static char *        entity_get_system          (AxingDtdSchema       *owner,
+                                                 EntityData           *data);
+
+static void          data_put_u32               (GByteArray           *buf,
+                                                 guint32               val);
+static void          data_put_string            (GByteArray           *buf,
+                                                 const char           *str);
+static void          data_put_table             (GByteArray           *buf,
+                                                 GHashTable           *table);
+static gboolean      data_get_u32               (const char          **pos,
+                                                 const char           *end,
+                                                 guint32              *val);
+static gboolean      data_get_string            (const char          **pos,
+                                                 const char           *end,
+                                                 const char          **str);
+static gboolean      data_get_table             (const char          **pos,
+                                                 const char           *end,
+                                                 GHashTable           *table);
+
 static void
 axing_dtd_schema_init (AxingDtdSchema *dtd)
 {
@@ -85,6 +142,8 @@ axing_dtd_schema_class_init (AxingDtdSchemaClass *klass)
 static void
 axing_dtd_schema_dispose (GObject *object)
 {
+    AxingDtdSchema *dtd = AXING_DTD_SCHEMA (object);
+    g_clear_object (&(dtd->external));
     G_OBJECT_CLASS (axing_dtd_schema_parent_class)->dispose (object);
 }
 
@@ -95,6 +154,9 @@ axing_dtd_schema_finalize (GObject *object)
     g_free (dtd->doctype);
     g_free (dtd->public);
     g_free (dtd->system);
+    g_free (dtd->base);
+    if (dtd->bytes)
+        g_bytes_unref (dtd->bytes);
     g_hash_table_destroy (dtd->general_entities);
     g_hash_table_destroy (dtd->parameter_entities);
     g_hash_table_destroy (dtd->notations);
@@ -107,11 +169,231 @@ axing_dtd_schema_new (void)
     return g_object_new (AXING_TYPE_DTD_SCHEMA, NULL);
 }
 
+/* Loads a schema written by axing_dtd_schema_save. The schema keeps a
+   reference to bytes and comes back frozen.
+ */
+AxingDtdSchema *
+axing_dtd_schema_new_from_bytes (GBytes  *bytes,
+                                 GError **error)
+{
+    AxingDtdSchema *dtd;
+    const char *pos, *end;
+    const char *doctype, *public, *system, *base;
+    guint32 version;
+    gsize size;
+
+    g_return_val_if_fail (bytes != NULL, NULL);
+
+    pos = g_bytes_get_data (bytes, &size);
+    end = pos + size;
+    if (size < 8 || memcmp (pos, DTD_FILE_MAGIC, 4) != 0) {
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                     "Not a saved DTD schema");
+        return NULL;
+    }
+    pos += 4;
+    data_get_u32 (&pos, end, &version);
+    if (version != DTD_FILE_VERSION) {
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                     "Unsupported DTD schema version %u", version);
+        return NULL;
+    }
+
+    dtd = axing_dtd_schema_new ();
+    dtd->bytes = g_bytes_ref (bytes);
+
+    /* The strings aren't ours to free, only the EntityData structs */
+    g_hash_table_destroy (dtd->general_entities);
+    g_hash_table_destroy (dtd->parameter_entities);
+    g_hash_table_destroy (dtd->notations);
+    dtd->general_entities = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
+    dtd->parameter_entities = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
+    dtd->notations = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
+
+    if (!data_get_string (&pos, end, &doctype) ||
+        !data_get_string (&pos, end, &public) ||
+        !data_get_string (&pos, end, &system) ||
+        !data_get_string (&pos, end, &base) ||
+        !data_get_table (&pos, end, dtd->general_entities) ||
+        !data_get_table (&pos, end, dtd->parameter_entities) ||
+        !data_get_table (&pos, end, dtd->notations)) {
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                     "Corrupt DTD schema");
+        g_object_unref (dtd);
+        return NULL;
+    }
+
+    dtd->doctype = g_strdup (doctype);
+    dtd->public = g_strdup (public);
+    dtd->system = g_strdup (system);
+    dtd->base = g_strdup (base);
+    dtd->frozen = TRUE;
+    return dtd;
+}
+
+/* Maps local files instead of reading them */
+AxingDtdSchema *
+axing_dtd_schema_new_for_file (GFile         *file,
+                               GCancellable  *cancellable,
+                               GError       **error)
+{
+    AxingDtdSchema *dtd;
+    GBytes *bytes;
+    char *path;
+
+    g_return_val_if_fail (G_IS_FILE (file), NULL);
+
+    path = g_file_get_path (file);
+    if (path != NULL) {
+        GMappedFile *mapped = g_mapped_file_new (path, FALSE, error);
+        g_free (path);
+        if (mapped == NULL)
+            return NULL;
+        bytes = g_mapped_file_get_bytes (mapped);
+        g_mapped_file_unref (mapped);
+    }
+    else {
+        bytes = g_file_load_bytes (file, cancellable, NULL, error);
+        if (bytes == NULL)
+            return NULL;
+    }
+
+    dtd = axing_dtd_schema_new_from_bytes (bytes, error);
+    g_bytes_unref (bytes);
+    return dtd;
+}
+
+/* Only the declarations in dtd itself are saved, not its external subset.
+   Save the external subset on its own and load it with its own URI.
+ */
+gboolean
+axing_dtd_schema_save (AxingDtdSchema  *dtd,
+                       GOutputStream   *stream,
+                       GCancellable    *cancellable,
+                       GError         **error)
+{
+    GByteArray *buf;
+    gboolean ret;
+
+    g_return_val_if_fail (dtd && AXING_IS_DTD_SCHEMA (dtd), FALSE);
+    g_return_val_if_fail (G_IS_OUTPUT_STREAM (stream), FALSE);
+
+    buf = g_byte_array_new ();
+    g_byte_array_append (buf, (const guint8 *) DTD_FILE_MAGIC, 4);
+    data_put_u32 (buf, DTD_FILE_VERSION);
+    data_put_string (buf, dtd->doctype);
+    data_put_string (buf, dtd->public);
+    data_put_string (buf, dtd->system);
+    data_put_string (buf, dtd->base);
+    data_put_table (buf, dtd->general_entities);
+    data_put_table (buf, dtd->parameter_entities);
+    data_put_table (buf, dtd->notations);
+
+    ret = g_output_stream_write_all (stream, buf->data, buf->len, NULL, cancellable, error);
+    g_byte_array_free (buf, TRUE);
+    return ret;
+}
+
+static void
+data_put_u32 (GByteArray *buf,
+              guint32     val)
+{
+    val = GUINT32_TO_LE (val);
+    g_byte_array_append (buf, (const guint8 *) &val, 4);
+}
+
+static void
+data_put_string (GByteArray *buf,
+                 const char *str)
+{
+    if (str == NULL) {
+        data_put_u32 (buf, DTD_FILE_NULL);
+        return;
+    }
+    data_put_u32 (buf, strlen (str));
+    g_byte_array_append (buf, (const guint8 *) str, strlen (str) + 1);
+}
+
+static void
+data_put_table (GByteArray *buf,
+                GHashTable *table)
+{
+    GHashTableIter iter;
+    EntityData *data;
+
+    data_put_u32 (buf, g_hash_table_size (table));
+    g_hash_table_iter_init (&iter, table);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &data)) {
+        data_put_string (buf, data->name);
+        data_put_string (buf, data->value);
+        data_put_string (buf, data->public);
+        data_put_string (buf, data->system);
+        data_put_string (buf, data->ndata);
+    }
+}
+
+static gboolean
+data_get_u32 (const char **pos,
+              const char  *end,
+              guint32     *val)
+{
+    if (end - *pos < 4)
+        return FALSE;
+    memcpy (val, *pos, 4);
+    *val = GUINT32_FROM_LE (*val);
+    *pos += 4;
+    return TRUE;
+}
+
+static gboolean
+data_get_string (const char **pos,
+                 const char  *end,
+                 const char **str)
+{
+    guint32 len;
+    if (!data_get_u32 (pos, end, &len))
+        return FALSE;
+    if (len == DTD_FILE_NULL) {
+        *str = NULL;
+        return TRUE;
+    }
+    if ((gsize) (end - *pos) <= len || (*pos)[len] != '\0')
+        return FALSE;
+    *str = *pos;
+    *pos += len + 1;
+    return TRUE;
+}
+
+static gboolean
+data_get_table (const char **pos,
+                const char  *end,
+                GHashTable  *table)
+{
+    guint32 count, i;
+    if (!data_get_u32 (pos, end, &count))
+        return FALSE;
+    for (i = 0; i < count; i++) {
+        EntityData *data = g_new0 (EntityData, 1);
+        if (!data_get_string (pos, end, (const char **) &(data->name)) ||
+            !data_get_string (pos, end, (const char **) &(data->value)) ||
+            !data_get_string (pos, end, (const char **) &(data->public)) ||
+            !data_get_string (pos, end, (const char **) &(data->system)) ||
+            !data_get_string (pos, end, (const char **) &(data->ndata)) ||
+            data->name == NULL) {
+            g_free (data);
+            return FALSE;
+        }
+        g_hash_table_insert (table, data->name, data);
+    }
+    return TRUE;
+}
+
 void
 axing_dtd_schema_set_doctype (AxingDtdSchema *dtd,
                               const char     *doctype)
 {
     g_return_if_fail (dtd && AXING_IS_DTD_SCHEMA (dtd));
+    g_return_if_fail (!dtd->frozen);
     if (dtd->doctype)
         g_free (dtd->doctype);
     dtd->doctype = g_strdup (doctype);
@@ -122,6 +404,7 @@ axing_dtd_schema_set_public_id (AxingDtdSchema *dtd,
                                 const char     *public)
 {
     g_return_if_fail (dtd && AXING_IS_DTD_SCHEMA (dtd));
+    g_return_if_fail (!dtd->frozen);
     if (dtd->public)
         g_free (dtd->public);
     dtd->public = g_strdup (public);
@@ -132,11 +415,107 @@ axing_dtd_schema_set_system_id (AxingDtdSchema *dtd,
                                 const char     *system)
 {
     g_return_if_fail (dtd && AXING_IS_DTD_SCHEMA (dtd));
+    g_return_if_fail (!dtd->frozen);
     if (dtd->system)
         g_free (dtd->system);
     dtd->system = g_strdup (system);
 }
 
+const char *
+axing_dtd_schema_get_public_id (AxingDtdSchema *dtd)
+{
+    g_return_val_if_fail (dtd && AXING_IS_DTD_SCHEMA (dtd), NULL);
+    return dtd->public;
+}
+
+const char *
+axing_dtd_schema_get_system_id (AxingDtdSchema *dtd)
+{
+    g_return_val_if_fail (dtd && AXING_IS_DTD_SCHEMA (dtd), NULL);
+    return dtd->system;
+}
+
+/* Relative system IDs of entities declared in this schema are resolved
+   against base when they're looked up through another schema that uses
+   this one as its external subset.
+ */
+void
+axing_dtd_schema_set_base_uri (AxingDtdSchema *dtd,
+                               const char     *base)
+{
+    g_return_if_fail (dtd && AXING_IS_DTD_SCHEMA (dtd));
+    g_return_if_fail (!dtd->frozen);
+    g_free (dtd->base);
+    dtd->base = g_strdup (base);
+}
+
+/* After this, nothing can be added and the schema is safe to read from
+   any number of threads at once.
+ */
+void
+axing_dtd_schema_freeze (AxingDtdSchema *dtd)
+{
+    g_return_if_fail (dtd && AXING_IS_DTD_SCHEMA (dtd));
+    dtd->frozen = TRUE;
+}
+
+gboolean
+axing_dtd_schema_is_frozen (AxingDtdSchema *dtd)
+{
+    g_return_val_if_fail (dtd && AXING_IS_DTD_SCHEMA (dtd), FALSE);
+    return dtd->frozen;
+}
+
+/* Lookups that don't find anything in dtd itself fall back to external.
+   The internal subset is read first, so its declarations win anyway.
+ */
+void
+axing_dtd_schema_set_external_subset (AxingDtdSchema *dtd,
+                                      AxingDtdSchema *external)
+{
+    g_return_if_fail (dtd && AXING_IS_DTD_SCHEMA (dtd));
+    g_return_if_fail (!dtd->frozen);
+    g_return_if_fail (external == NULL || axing_dtd_schema_is_frozen (external));
+    g_clear_object (&(dtd->external));
+    if (external)
+        dtd->external = g_object_ref (external);
+}
+
+static EntityData *
+schema_lookup_entity (AxingDtdSchema  *dtd,
+                      const char      *name,
+                      AxingDtdSchema **owner)
+{
+    EntityData *data = g_hash_table_lookup (dtd->general_entities, name);
+    if (data == NULL && dtd->external != NULL)
+        return schema_lookup_entity (dtd->external, name, owner);
+    if (owner)
+        *owner = dtd;
+    return data;
+}
+
+static EntityData *
+schema_lookup_parameter (AxingDtdSchema  *dtd,
+                         const char      *name,
+                         AxingDtdSchema **owner)
+{
+    EntityData *data = g_hash_table_lookup (dtd->parameter_entities, name);
+    if (data == NULL && dtd->external != NULL)
+        return schema_lookup_parameter (dtd->external, name, owner);
+    if (owner)
+        *owner = dtd;
+    return data;
+}
+
+static char *
+entity_get_system (AxingDtdSchema *owner,
+                   EntityData     *data)
+{
+    if (data->system == NULL || owner->base == NULL)
+        return g_strdup (data->system);
+    return axing_uri_resolve_relative (owner->base, data->system);
+}
+
 gboolean
 axing_dtd_schema_add_element (AxingDtdSchema *dtd,
                               const char     *name,
@@ -144,6 +523,7 @@ axing_dtd_schema_add_element (AxingDtdSchema *dtd,
                               GError        **error)
 {
     g_return_val_if_fail (dtd && AXING_IS_DTD_SCHEMA (dtd), FALSE);
+    g_return_val_if_fail (!dtd->frozen, FALSE);
     /* FIXME */
     return FALSE;
 }
@@ -155,6 +535,7 @@ axing_dtd_schema_add_attlist (AxingDtdSchema *dtd,
                               GError        **error)
 {
     g_return_val_if_fail (dtd && AXING_IS_DTD_SCHEMA (dtd), FALSE);
+    g_return_val_if_fail (!dtd->frozen, FALSE);
     /* FIXME */
     return FALSE;
 }
@@ -168,6 +549,7 @@ axing_dtd_schema_add_entity (AxingDtdSchema *dtd,
     EntityData *data;
 
     g_return_val_if_fail (dtd && AXING_IS_DTD_SCHEMA (dtd), FALSE);
+    g_return_val_if_fail (!dtd->frozen, FALSE);
 
     if (g_hash_table_lookup (dtd->general_entities, name))
         return FALSE;
@@ -189,6 +571,7 @@ axing_dtd_schema_add_external_entity (AxingDtdSchema *dtd,
     EntityData *data;
 
     g_return_val_if_fail (dtd && AXING_IS_DTD_SCHEMA (dtd), FALSE);
+    g_return_val_if_fail (!dtd->frozen, FALSE);
 
     if (g_hash_table_lookup (dtd->general_entities, name))
         return FALSE;
@@ -212,6 +595,7 @@ axing_dtd_schema_add_unparsed_entity (AxingDtdSchema *dtd,
     EntityData *data;
 
     g_return_val_if_fail (dtd && AXING_IS_DTD_SCHEMA (dtd), FALSE);
+    g_return_val_if_fail (!dtd->frozen, FALSE);
 
     if (g_hash_table_lookup (dtd->general_entities, name))
         return FALSE;
@@ -234,6 +618,7 @@ axing_dtd_schema_add_parameter (AxingDtdSchema *dtd,
     EntityData *data;
 
     g_return_val_if_fail (dtd && AXING_IS_DTD_SCHEMA (dtd), FALSE);
+    g_return_val_if_fail (!dtd->frozen, FALSE);
 
     if (g_hash_table_lookup (dtd->parameter_entities, name))
         return FALSE;
@@ -255,6 +640,7 @@ axing_dtd_schema_add_external_parameter (AxingDtdSchema *dtd,
     EntityData *data;
 
     g_return_val_if_fail (dtd && AXING_IS_DTD_SCHEMA (dtd), FALSE);
+    g_return_val_if_fail (!dtd->frozen, FALSE);
 
     if (g_hash_table_lookup (dtd->parameter_entities, name))
         return FALSE;
@@ -277,6 +663,7 @@ axing_dtd_schema_add_notation (AxingDtdSchema *dtd,
     EntityData *data;
 
     g_return_val_if_fail (dtd && AXING_IS_DTD_SCHEMA (dtd), FALSE);
+    g_return_val_if_fail (!dtd->frozen, FALSE);
 
     /* FIXME: Unlike with other declarations, redefining a NOTATION
        is a validity error. We cannot error out here, because this
@@ -303,7 +690,7 @@ axing_dtd_schema_get_entity (AxingDtdSchema *dtd,
 
     g_return_val_if_fail (dtd && AXING_IS_DTD_SCHEMA (dtd), FALSE);
 
-    data = (EntityData *) g_hash_table_lookup (dtd->general_entities, name);
+    data = schema_lookup_entity (dtd, name, NULL);
 
     if (data == NULL)
         return NULL;
@@ -315,11 +702,12 @@ char *
 axing_dtd_schema_get_external_entity (AxingDtdSchema *dtd,
                                       const char     *name)
 {
+    AxingDtdSchema *owner;
     EntityData *data;
 
     g_return_val_if_fail (dtd && AXING_IS_DTD_SCHEMA (dtd), FALSE);
 
-    data = (EntityData *) g_hash_table_lookup (dtd->general_entities, name);
+    data = schema_lookup_entity (dtd, name, &owner);
 
     if (data == NULL)
         return NULL;
@@ -327,18 +715,19 @@ axing_dtd_schema_get_external_entity (AxingDtdSchema *dtd,
     if (data->ndata != NULL)
         return NULL;
 
-    return g_strdup (data->system);
+    return entity_get_system (owner, data);
 }
 
 char *
 axing_dtd_schema_get_unparsed_entity (AxingDtdSchema *dtd,
                                       const char     *name)
 {
+    AxingDtdSchema *owner;
     EntityData *data;
 
     g_return_val_if_fail (dtd && AXING_IS_DTD_SCHEMA (dtd), FALSE);
 
-    data = (EntityData *) g_hash_table_lookup (dtd->general_entities, name);
+    data = schema_lookup_entity (dtd, name, &owner);
 
     if (data == NULL)
         return NULL;
@@ -346,7 +735,7 @@ axing_dtd_schema_get_unparsed_entity (AxingDtdSchema *dtd,
     if (data->ndata == NULL)
         return NULL;
 
-    return g_strdup (data->system);
+    return entity_get_system (owner, data);
 }
 
 gboolean
@@ -357,23 +746,63 @@ axing_dtd_schema_get_entity_full (AxingDtdSchema  *dtd,
                                   char           **system,
                                   char           **ndata)
 {
+    AxingDtdSchema *owner;
     EntityData *data;
 
     g_return_val_if_fail (dtd && AXING_IS_DTD_SCHEMA (dtd), FALSE);
 
-    data = (EntityData *) g_hash_table_lookup (dtd->general_entities, name);
+    data = schema_lookup_entity (dtd, name, &owner);
 
     if (data == NULL)
         return FALSE;
 
     *value = g_strdup (data->value);
     *public = g_strdup (data->public);
-    *system = g_strdup (data->system);
+    *system = entity_get_system (owner, data);
     *ndata = g_strdup (data->ndata);
 
     return TRUE;
 }
 
+static void
+schema_add_external_entity_names (AxingDtdSchema *dtd,
+                                  GPtrArray      *names,
+                                  GHashTable     *seen)
+{
+    GHashTableIter iter;
+    EntityData *data;
+
+    g_hash_table_iter_init (&iter, dtd->general_entities);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &data)) {
+        if (g_hash_table_contains (seen, data->name))
+            continue;
+        g_hash_table_add (seen, data->name);
+        if (data->system != NULL && data->ndata == NULL)
+            g_ptr_array_add (names, g_strdup (data->name));
+    }
+    if (dtd->external != NULL)
+        schema_add_external_entity_names (dtd->external, names, seen);
+}
+
+/* Names of the parsed external entities, including the external subset's.
+   Free with g_strfreev.
+ */
+char **
+axing_dtd_schema_get_external_entity_names (AxingDtdSchema *dtd)
+{
+    GPtrArray *names;
+    GHashTable *seen;
+
+    g_return_val_if_fail (dtd && AXING_IS_DTD_SCHEMA (dtd), NULL);
+
+    names = g_ptr_array_new ();
+    seen = g_hash_table_new (g_str_hash, g_str_equal);
+    schema_add_external_entity_names (dtd, names, seen);
+    g_hash_table_destroy (seen);
+    g_ptr_array_add (names, NULL);
+    return (char **) g_ptr_array_free (names, FALSE);
+}
+
 char *
 axing_dtd_schema_get_parameter (AxingDtdSchema *dtd,
                                 const char     *name)
@@ -382,10 +811,37 @@ axing_dtd_schema_get_parameter (AxingDtdSchema *dtd,
 
     g_return_val_if_fail (dtd && AXING_IS_DTD_SCHEMA (dtd), FALSE);
 
-    data = (EntityData *) g_hash_table_lookup (dtd->parameter_entities, name);
+    data = schema_lookup_parameter (dtd, name, NULL);
 
     if (data == NULL)
         return NULL;
 
     return g_strdup (data->value);
 }
+
+/* Like axing_dtd_schema_get_entity_full, for parameter entities. value is
+   NULL for external ones.
+ */
+gboolean
+axing_dtd_schema_get_parameter_full (AxingDtdSchema  *dtd,
+                                     const char      *name,
+                                     char           **value,
+                                     char           **public,
+                                     char           **system)
+{
+    AxingDtdSchema *owner;
+    EntityData *data;
+
+    g_return_val_if_fail (dtd && AXING_IS_DTD_SCHEMA (dtd), FALSE);
+
+    data = schema_lookup_parameter (dtd, name, &owner);
+
+    if (data == NULL)
+        return FALSE;
+
+    *value = g_strdup (data->value);
+    *public = g_strdup (data->public);
+    *system = entity_get_system (owner, data);
+
+    return TRUE;
+}
@@ -43,6 +43,15 @@ typedef enum {
 GQuark            axing_dtd_schema_error_quark     (void);
 
 AxingDtdSchema *  axing_dtd_schema_new             (void);
+AxingDtdSchema *  axing_dtd_schema_new_from_bytes  (GBytes           *bytes,
+                                                    GError          **error);
+AxingDtdSchema *  axing_dtd_schema_new_for_file    (GFile            *file,
+                                                    GCancellable     *cancellable,
+                                                    GError          **error);
+gboolean          axing_dtd_schema_save            (AxingDtdSchema   *dtd,
+                                                    GOutputStream    *stream,
+                                                    GCancellable     *cancellable,
+                                                    GError          **error);
 
 void              axing_dtd_schema_set_doctype              (AxingDtdSchema   *dtd,
                                                              const char       *doctype);
@@ -50,6 +59,15 @@ void              axing_dtd_schema_set_public_id            (AxingDtdSchema   *d
                                                              const char       *public);
 void              axing_dtd_schema_set_system_id            (AxingDtdSchema   *dtd,
                                                              const char       *system);
+const char *      axing_dtd_schema_get_public_id            (AxingDtdSchema   *dtd);
+const char *      axing_dtd_schema_get_system_id            (AxingDtdSchema   *dtd);
+void              axing_dtd_schema_set_base_uri             (AxingDtdSchema   *dtd,
+                                                             const char       *base);
+
+void              axing_dtd_schema_freeze                   (AxingDtdSchema   *dtd);
+gboolean          axing_dtd_schema_is_frozen                (AxingDtdSchema   *dtd);
+void              axing_dtd_schema_set_external_subset      (AxingDtdSchema   *dtd,
+                                                             AxingDtdSchema   *external);
 
 gboolean          axing_dtd_schema_add_element              (AxingDtdSchema   *dtd,
                                                              const char       *name,
@@ -96,8 +114,14 @@ gboolean          axing_dtd_schema_get_entity_full          (AxingDtdSchema  *dt
                                                              char           **public,
                                                              char           **system,
                                                              char           **ndata);
+char **           axing_dtd_schema_get_external_entity_names (AxingDtdSchema *dtd);
 char *            axing_dtd_schema_get_parameter            (AxingDtdSchema  *dtd,
                                                              const char      *name);
+gboolean          axing_dtd_schema_get_parameter_full       (AxingDtdSchema  *dtd,
+                                                             const char      *name,
+                                                             char           **value,
+                                                             char           **public,
+                                                             char           **system);
 
 G_END_DECLS
 
@@ -48,6 +48,11 @@ typedef enum {
     AXING_NODE_TYPE_INSTRUCTION,
 } AxingNodeType;
 
+typedef enum {
+    AXING_SKIP_MODE_WELL_FORMED, /* check everything that doesn't need names kept */
+    AXING_SKIP_MODE_BALANCED     /* only count tags */
+} AxingSkipMode;
+
 G_END_DECLS
 
 #endif /* __AXING_NODE_TYPE_H__ */
@@ -0,0 +1,583 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+#include <string.h>
+
+#include "axing-event-reader.h"
+#include "axing-private.h"
+
+typedef struct {
+    guint32      qname;
+    guint32      ns;
+    gint64       linenum;
+    gint64       colnum;
+    const char  *value;
+} EventAttr;
+
+typedef struct {
+    guint32      qname;
+    guint32      ns;
+    gint64       linenum;
+    gint64       colnum;
+} OpenElement;
+
+struct _AxingEventReader {
+    GObject parent;
+
+    GBytes      *bytes;
+    const char  *pos;
+    const char  *end;
+
+    /* Indexed by name ID. qnames point into the data. */
+    GPtrArray   *qnames;
+    GPtrArray   *localnames;
+    GPtrArray   *prefixes;
+
+    AxingNodeType  event_type;
+    guint32        qname;
+    guint32        ns;
+    gint64         linenum;
+    gint64         colnum;
+    const char    *content;
+
+    GArray      *attrs;
+    GPtrArray   *attrkeys;
+    GArray      *stack;
+    GString     *nsname;
+};
+
+static void      axing_event_reader_init         (AxingEventReader      *reader);
+static void      axing_event_reader_class_init   (AxingEventReaderClass *klass);
+static void      axing_event_reader_init_reader  (AxingReaderInterface  *iface);
+static void      axing_event_reader_finalize     (GObject               *object);
+
+static gboolean              reader_read                    (AxingReader        *reader,
+                                                             GError            **error);
+static void                  reader_read_async              (AxingReader        *reader,
+                                                             GCancellable       *cancellable,
+                                                             GAsyncReadyCallback callback,
+                                                             gpointer            user_data);
+static gboolean              reader_read_finish             (AxingReader        *reader,
+                                                             GAsyncResult       *result,
+                                                             GError            **error);
+
+static AxingNodeType         reader_get_node_type           (AxingReader    *reader);
+static const char *          reader_get_qname               (AxingReader    *reader);
+static const char *          reader_get_prefix              (AxingReader    *reader);
+static const char *          reader_get_localname           (AxingReader    *reader);
+static const char *          reader_get_namespace           (AxingReader    *reader);
+static const char *          reader_get_nsname              (AxingReader    *reader);
+static const char *          reader_get_content             (AxingReader    *reader);
+static gint64                reader_get_linenum             (AxingReader    *reader);
+static gint64                reader_get_colnum              (AxingReader    *reader);
+
+static const char * const *  reader_get_attrs               (AxingReader    *reader);
+static const char *          reader_get_attr_localname      (AxingReader    *reader, const char *qname);
+static const char *          reader_get_attr_prefix         (AxingReader    *reader, const char *qname);
+static const char *          reader_get_attr_namespace      (AxingReader    *reader, const char *qname);
+static const char *          reader_get_attr_nsname         (AxingReader    *reader, const char *qname);
+static const char *          reader_get_attr_value          (AxingReader    *reader, const char *qname);
+static gint64                reader_get_attr_linenum        (AxingReader    *reader, const char *qname);
+static gint64                reader_get_attr_colnum         (AxingReader    *reader, const char *qname);
+
+static gboolean              data_get_u32                   (AxingEventReader  *reader,
+                                                             guint32           *val);
+static gboolean              data_get_u64                   (AxingEventReader  *reader,
+                                                             guint64           *val);
+static gboolean              data_get_string                (AxingEventReader  *reader,
+                                                             const char       **str);
+static gboolean              data_get_name                  (AxingEventReader  *reader,
+                                                             guint32           *id);
+static EventAttr *           reader_find_attr               (AxingEventReader  *reader,
+                                                             const char        *qname);
+
+G_DEFINE_TYPE_WITH_CODE (AxingEventReader, axing_event_reader, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (AXING_TYPE_READER,
+                                                axing_event_reader_init_reader))
+
+static void
+axing_event_reader_init (AxingEventReader *reader)
+{
+    reader->qnames = g_ptr_array_new ();
+    reader->localnames = g_ptr_array_new ();
+    reader->prefixes = g_ptr_array_new_with_free_func (g_free);
+    /* ID 0 is no name */
+    g_ptr_array_add (reader->qnames, "");
+    g_ptr_array_add (reader->localnames, "");
+    g_ptr_array_add (reader->prefixes, NULL);
+
+    reader->attrs = g_array_new (FALSE, FALSE, sizeof (EventAttr));
+    reader->attrkeys = g_ptr_array_new ();
+    reader->stack = g_array_new (FALSE, FALSE, sizeof (OpenElement));
+    reader->nsname = g_string_new (NULL);
+}
+
+static void
+axing_event_reader_class_init (AxingEventReaderClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+    object_class->finalize = axing_event_reader_finalize;
+}
+
+static void
+axing_event_reader_init_reader (AxingReaderInterface *iface)
+{
+    iface->read = reader_read;
+    iface->read_async = reader_read_async;
+    iface->read_finish = reader_read_finish;
+
+    iface->get_node_type = reader_get_node_type;
+
+    iface->get_qname = reader_get_qname;
+    iface->get_localname = reader_get_localname;
+    iface->get_prefix = reader_get_prefix;
+    iface->get_namespace = reader_get_namespace;
+    iface->get_nsname = reader_get_nsname;
+
+    iface->get_content = reader_get_content;
+    iface->get_linenum = reader_get_linenum;
+    iface->get_colnum = reader_get_colnum;
+
+    iface->get_attrs = reader_get_attrs;
+    iface->get_attr_localname = reader_get_attr_localname;
+    iface->get_attr_prefix = reader_get_attr_prefix;
+    iface->get_attr_namespace = reader_get_attr_namespace;
+    iface->get_attr_nsname = reader_get_attr_nsname;
+    iface->get_attr_value = reader_get_attr_value;
+    iface->get_attr_linenum = reader_get_attr_linenum;
+    iface->get_attr_colnum = reader_get_attr_colnum;
+}
+
+static void
+axing_event_reader_finalize (GObject *object)
+{
+    AxingEventReader *reader = AXING_EVENT_READER (object);
+    g_bytes_unref (reader->bytes);
+    g_ptr_array_free (reader->qnames, TRUE);
+    g_ptr_array_free (reader->localnames, TRUE);
+    g_ptr_array_free (reader->prefixes, TRUE);
+    g_array_free (reader->attrs, TRUE);
+    g_ptr_array_free (reader->attrkeys, TRUE);
+    g_array_free (reader->stack, TRUE);
+    g_string_free (reader->nsname, TRUE);
+    G_OBJECT_CLASS (axing_event_reader_parent_class)->finalize (object);
+}
+
+/* Replays an event stream written by AxingEventWriter. Strings point right
+   into bytes, so nothing is copied.
+ */
+AxingEventReader *
+axing_event_reader_new (GBytes  *bytes,
+                        GError **error)
+{
+    AxingEventReader *reader;
+    const char *data;
+    gsize size;
+    guint32 version;
+
+    g_return_val_if_fail (bytes != NULL, NULL);
+
+    data = g_bytes_get_data (bytes, &size);
+    if (size < 8 || memcmp (data, EVENT_STREAM_MAGIC, 4) != 0) {
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                     "Not an event stream");
+        return NULL;
+    }
+    memcpy (&version, data + 4, 4);
+    if (GUINT32_FROM_LE (version) != EVENT_STREAM_VERSION) {
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                     "Unsupported event stream version %u", GUINT32_FROM_LE (version));
+        return NULL;
+    }
+
+    reader = g_object_new (AXING_TYPE_EVENT_READER, NULL);
+    reader->bytes = g_bytes_ref (bytes);
+    reader->pos = data + 8;
+    reader->end = data + size;
+    return reader;
+}
+
+/* Maps local files instead of reading them */
+AxingEventReader *
+axing_event_reader_new_for_file (GFile         *file,
+                                 GCancellable  *cancellable,
+                                 GError       **error)
+{
+    AxingEventReader *reader;
+    GBytes *bytes;
+    char *path;
+
+    g_return_val_if_fail (G_IS_FILE (file), NULL);
+
+    path = g_file_get_path (file);
+    if (path != NULL) {
+        GMappedFile *mapped = g_mapped_file_new (path, FALSE, error);
+        g_free (path);
+        if (mapped == NULL)
+            return NULL;
+        bytes = g_mapped_file_get_bytes (mapped);
+        g_mapped_file_unref (mapped);
+    }
+    else {
+        bytes = g_file_load_bytes (file, cancellable, NULL, error);
+        if (bytes == NULL)
+            return NULL;
+    }
+
+    reader = axing_event_reader_new (bytes, error);
+    g_bytes_unref (bytes);
+    return reader;
+}
+
+#define ERROR_DATA(reader) { g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Corrupt event stream"); goto error; }
+
+static gboolean
+reader_read (AxingReader  *reader,
+             GError      **error)
+{
+    AxingEventReader *evreader = AXING_EVENT_READER (reader);
+    guint32 val;
+
+    if (evreader->event_type == AXING_NODE_TYPE_ERROR)
+        return FALSE;
+
+    while (evreader->pos < evreader->end) {
+        guint8 tag = (guint8) evreader->pos[0];
+        evreader->pos++;
+
+        if (tag == EVENT_STREAM_NAME) {
+            const char *name, *colon;
+            if (!data_get_u32 (evreader, &val) || val != evreader->qnames->len)
+                ERROR_DATA (evreader);
+            if (!data_get_string (evreader, &name))
+                ERROR_DATA (evreader);
+            colon = strchr (name, ':');
+            g_ptr_array_add (evreader->qnames, (gpointer) name);
+            g_ptr_array_add (evreader->localnames, (gpointer) (colon ? colon + 1 : name));
+            g_ptr_array_add (evreader->prefixes, colon ? g_strndup (name, colon - name) : NULL);
+            continue;
+        }
+
+        evreader->event_type = tag;
+        evreader->content = NULL;
+        switch (tag) {
+        case AXING_NODE_TYPE_ELEMENT: {
+            OpenElement open;
+            guint32 n_attrs, i;
+            if (!data_get_name (evreader, &(evreader->qname)) ||
+                !data_get_name (evreader, &(evreader->ns)) ||
+                !data_get_u64 (evreader, (guint64 *) &(evreader->linenum)) ||
+                !data_get_u64 (evreader, (guint64 *) &(evreader->colnum)) ||
+                !data_get_u32 (evreader, &n_attrs))
+                ERROR_DATA (evreader);
+            g_array_set_size (evreader->attrs, n_attrs);
+            g_ptr_array_set_size (evreader->attrkeys, 0);
+            for (i = 0; i < n_attrs; i++) {
+                EventAttr *attr = &g_array_index (evreader->attrs, EventAttr, i);
+                if (!data_get_name (evreader, &(attr->qname)) ||
+                    !data_get_name (evreader, &(attr->ns)) ||
+                    !data_get_u64 (evreader, (guint64 *) &(attr->linenum)) ||
+                    !data_get_u64 (evreader, (guint64 *) &(attr->colnum)) ||
+                    !data_get_string (evreader, &(attr->value)))
+                    ERROR_DATA (evreader);
+                g_ptr_array_add (evreader->attrkeys, evreader->qnames->pdata[attr->qname]);
+            }
+            g_ptr_array_add (evreader->attrkeys, NULL);
+            open.qname = evreader->qname;
+            open.ns = evreader->ns;
+            open.linenum = evreader->linenum;
+            open.colnum = evreader->colnum;
+            g_array_append_val (evreader->stack, open);
+            return TRUE;
+        }
+        case AXING_NODE_TYPE_END_ELEMENT: {
+            OpenElement *open;
+            if (evreader->stack->len == 0)
+                ERROR_DATA (evreader);
+            open = &g_array_index (evreader->stack, OpenElement, evreader->stack->len - 1);
+            evreader->qname = open->qname;
+            evreader->ns = open->ns;
+            evreader->linenum = open->linenum;
+            evreader->colnum = open->colnum;
+            g_array_set_size (evreader->stack, evreader->stack->len - 1);
+            return TRUE;
+        }
+        case AXING_NODE_TYPE_INSTRUCTION:
+            if (!data_get_name (evreader, &(evreader->qname)))
+                ERROR_DATA (evreader);
+            /* fall through */
+        case AXING_NODE_TYPE_CONTENT:
+        case AXING_NODE_TYPE_COMMENT:
+        case AXING_NODE_TYPE_CDATA:
+            if (!data_get_u64 (evreader, (guint64 *) &(evreader->linenum)) ||
+                !data_get_u64 (evreader, (guint64 *) &(evreader->colnum)) ||
+                !data_get_string (evreader, &(evreader->content)))
+                ERROR_DATA (evreader);
+            return TRUE;
+        default:
+            ERROR_DATA (evreader);
+        }
+    }
+
+    evreader->event_type = AXING_NODE_TYPE_NONE;
+    return FALSE;
+
+ error:
+    evreader->event_type = AXING_NODE_TYPE_ERROR;
+    return FALSE;
+}
+
+/* There's no I/O to wait on, so this just reads and returns */
+static void
+reader_read_async (AxingReader         *reader,
+                   GCancellable        *cancellable,
+                   GAsyncReadyCallback  callback,
+                   gpointer             user_data)
+{
+    GTask *task = g_task_new (reader, cancellable, callback, user_data);
+    GError *error = NULL;
+    if (reader_read (reader, &error))
+        g_task_return_boolean (task, TRUE);
+    else if (error != NULL)
+        g_task_return_error (task, error);
+    else
+        g_task_return_boolean (task, FALSE);
+    g_object_unref (task);
+}
+
+static gboolean
+reader_read_finish (AxingReader   *reader,
+                    GAsyncResult  *result,
+                    GError       **error)
+{
+    g_return_val_if_fail (g_task_is_valid (result, reader), FALSE);
+    return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+static gboolean
+data_get_u32 (AxingEventReader *reader,
+              guint32          *val)
+{
+    guint32 le;
+    if (reader->end - reader->pos < 4)
+        return FALSE;
+    memcpy (&le, reader->pos, 4);
+    *val = GUINT32_FROM_LE (le);
+    reader->pos += 4;
+    return TRUE;
+}
+
+static gboolean
+data_get_u64 (AxingEventReader *reader,
+              guint64          *val)
+{
+    guint64 le;
+    if (reader->end - reader->pos < 8)
+        return FALSE;
+    memcpy (&le, reader->pos, 8);
+    *val = GUINT64_FROM_LE (le);
+    reader->pos += 8;
+    return TRUE;
+}
+
+static gboolean
+data_get_string (AxingEventReader  *reader,
+                 const char       **str)
+{
+    guint32 len;
+    if (!data_get_u32 (reader, &len))
+        return FALSE;
+    if ((gsize) (reader->end - reader->pos) <= len || reader->pos[len] != '\0')
+        return FALSE;
+    *str = reader->pos;
+    reader->pos += len + 1;
+    return TRUE;
+}
+
+static gboolean
+data_get_name (AxingEventReader *reader,
+               guint32          *id)
+{
+    return data_get_u32 (reader, id) && *id < reader->qnames->len;
+}
+
+static EventAttr *
+reader_find_attr (AxingEventReader *reader,
+                  const char       *qname)
+{
+    guint i;
+    for (i = 0; i < reader->attrs->len; i++) {
+        EventAttr *attr = &g_array_index (reader->attrs, EventAttr, i);
+        if (g_str_equal (qname, reader->qnames->pdata[attr->qname]))
+            return attr;
+    }
+    return NULL;
+}
+
+#define IS_ELEMENT_EVENT(reader) \
+    (reader->event_type == AXING_NODE_TYPE_ELEMENT || reader->event_type == AXING_NODE_TYPE_END_ELEMENT)
+
+static AxingNodeType
+reader_get_node_type (AxingReader *reader)
+{
+    return AXING_EVENT_READER (reader)->event_type;
+}
+
+static const char *
+reader_get_qname (AxingReader *reader)
+{
+    AxingEventReader *evreader = AXING_EVENT_READER (reader);
+    g_return_val_if_fail (IS_ELEMENT_EVENT (evreader) ||
+                          evreader->event_type == AXING_NODE_TYPE_INSTRUCTION,
+                          NULL);
+    return evreader->qnames->pdata[evreader->qname];
+}
+
+static const char *
+reader_get_prefix (AxingReader *reader)
+{
+    AxingEventReader *evreader = AXING_EVENT_READER (reader);
+    const char *prefix;
+    g_return_val_if_fail (IS_ELEMENT_EVENT (evreader), NULL);
+    prefix = evreader->prefixes->pdata[evreader->qname];
+    return prefix ? prefix : "";
+}
+
+static const char *
+reader_get_localname (AxingReader *reader)
+{
+    AxingEventReader *evreader = AXING_EVENT_READER (reader);
+    g_return_val_if_fail (IS_ELEMENT_EVENT (evreader), NULL);
+    return evreader->localnames->pdata[evreader->qname];
+}
+
+static const char *
+reader_get_namespace (AxingReader *reader)
+{
+    AxingEventReader *evreader = AXING_EVENT_READER (reader);
+    g_return_val_if_fail (IS_ELEMENT_EVENT (evreader), NULL);
+    return evreader->qnames->pdata[evreader->ns];
+}
+
+/* Only good until the next call to this or reader_get_attr_nsname */
+static const char *
+reader_get_nsname (AxingReader *reader)
+{
+    AxingEventReader *evreader = AXING_EVENT_READER (reader);
+    g_return_val_if_fail (IS_ELEMENT_EVENT (evreader), NULL);
+    g_string_printf (evreader->nsname, "{%s}%s",
+                     (char *) evreader->qnames->pdata[evreader->ns],
+                     (char *) evreader->localnames->pdata[evreader->qname]);
+    return evreader->nsname->str;
+}
+
+static const char *
+reader_get_content (AxingReader *reader)
+{
+    AxingEventReader *evreader = AXING_EVENT_READER (reader);
+    g_return_val_if_fail (evreader->content != NULL, NULL);
+    return evreader->content;
+}
+
+static gint64
+reader_get_linenum (AxingReader *reader)
+{
+    return AXING_EVENT_READER (reader)->linenum;
+}
+
+static gint64
+reader_get_colnum (AxingReader *reader)
+{
+    return AXING_EVENT_READER (reader)->colnum;
+}
+
+static const char * const *
+reader_get_attrs (AxingReader *reader)
+{
+    AxingEventReader *evreader = AXING_EVENT_READER (reader);
+    g_return_val_if_fail (evreader->event_type == AXING_NODE_TYPE_ELEMENT, NULL);
+    return (const char * const *) evreader->attrkeys->pdata;
+}
+
+static const char *
+reader_get_attr_localname (AxingReader *reader, const char *qname)
+{
+    AxingEventReader *evreader = AXING_EVENT_READER (reader);
+    EventAttr *attr = reader_find_attr (evreader, qname);
+    return attr ? evreader->localnames->pdata[attr->qname] : NULL;
+}
+
+static const char *
+reader_get_attr_prefix (AxingReader *reader, const char *qname)
+{
+    AxingEventReader *evreader = AXING_EVENT_READER (reader);
+    EventAttr *attr = reader_find_attr (evreader, qname);
+    const char *prefix;
+    if (attr == NULL)
+        return NULL;
+    prefix = evreader->prefixes->pdata[attr->qname];
+    return prefix ? prefix : "";
+}
+
+static const char *
+reader_get_attr_namespace (AxingReader *reader, const char *qname)
+{
+    AxingEventReader *evreader = AXING_EVENT_READER (reader);
+    EventAttr *attr = reader_find_attr (evreader, qname);
+    return attr ? evreader->qnames->pdata[attr->ns] : NULL;
+}
+
+static const char *
+reader_get_attr_nsname (AxingReader *reader, const char *qname)
+{
+    AxingEventReader *evreader = AXING_EVENT_READER (reader);
+    EventAttr *attr = reader_find_attr (evreader, qname);
+    if (attr == NULL)
+        return NULL;
+    g_string_printf (evreader->nsname, "{%s}%s",
+                     (char *) evreader->qnames->pdata[attr->ns],
+                     (char *) evreader->localnames->pdata[attr->qname]);
+    return evreader->nsname->str;
+}
+
+static const char *
+reader_get_attr_value (AxingReader *reader, const char *qname)
+{
+    EventAttr *attr = reader_find_attr (AXING_EVENT_READER (reader), qname);
+    return attr ? attr->value : NULL;
+}
+
+static gint64
+reader_get_attr_linenum (AxingReader *reader, const char *qname)
+{
+    EventAttr *attr = reader_find_attr (AXING_EVENT_READER (reader), qname);
+    return attr ? attr->linenum : 0;
+}
+
+static gint64
+reader_get_attr_colnum (AxingReader *reader, const char *qname)
+{
+    EventAttr *attr = reader_find_attr (AXING_EVENT_READER (reader), qname);
+    return attr ? attr->colnum : 0;
+}
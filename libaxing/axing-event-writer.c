@@ -0,0 +1,312 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+/* The event stream format is a header followed by records, all numbers
+   being little-endian. Line and column numbers are 64-bit, everything
+   else is 32-bit:
+
+     header:      "AXEV" version
+     name:        0xFF id string
+     ELEMENT:     type qname ns linenum colnum n_attrs
+                  (qname ns linenum colnum string) for each attribute
+     END_ELEMENT: type
+     INSTRUCTION: type target linenum colnum string
+     others:      type linenum colnum string
+
+   type is one byte with the AxingNodeType. Strings are a length, the
+   bytes, and a NUL, so readers can point right into the data. Names and
+   namespaces are IDs, with 0 for none. Each name is defined in a name
+   record before the first event that uses it, and IDs count up from 1.
+ */
+
+#include <string.h>
+
+#include "axing-event-writer.h"
+#include "axing-name-table.h"
+#include "axing-private.h"
+
+#define FLUSH_SIZE 65536
+
+struct _AxingEventWriter {
+    GObject parent;
+
+    GOutputStream  *stream;
+    GByteArray     *buf;
+    AxingNameTable *names;
+    guint32         n_names_written;
+    GArray         *attrnames; /* name and namespace IDs for each attribute */
+    gboolean        header_written;
+    gboolean        too_long;  /* a string in this event didn't fit a length */
+};
+
+G_DEFINE_TYPE (AxingEventWriter, axing_event_writer, G_TYPE_OBJECT);
+
+static void      axing_event_writer_init        (AxingEventWriter      *writer);
+static void      axing_event_writer_class_init  (AxingEventWriterClass *klass);
+static void      axing_event_writer_dispose     (GObject               *object);
+static void      axing_event_writer_finalize    (GObject               *object);
+
+static void      writer_put_u32                 (AxingEventWriter      *writer,
+                                                 guint32                val);
+static void      writer_put_u64                 (AxingEventWriter      *writer,
+                                                 guint64                val);
+static void      writer_put_string              (AxingEventWriter      *writer,
+                                                 const char            *str);
+static guint32   writer_put_name                (AxingEventWriter      *writer,
+                                                 const char            *name);
+
+static void
+axing_event_writer_init (AxingEventWriter *writer)
+{
+    writer->buf = g_byte_array_sized_new (FLUSH_SIZE + 1024);
+    writer->names = axing_name_table_new ();
+    writer->attrnames = g_array_new (FALSE, FALSE, sizeof (guint32));
+}
+
+static void
+axing_event_writer_class_init (AxingEventWriterClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+    object_class->dispose = axing_event_writer_dispose;
+    object_class->finalize = axing_event_writer_finalize;
+}
+
+static void
+axing_event_writer_dispose (GObject *object)
+{
+    AxingEventWriter *writer = AXING_EVENT_WRITER (object);
+    g_clear_object (&(writer->stream));
+    G_OBJECT_CLASS (axing_event_writer_parent_class)->dispose (object);
+}
+
+static void
+axing_event_writer_finalize (GObject *object)
+{
+    AxingEventWriter *writer = AXING_EVENT_WRITER (object);
+    g_byte_array_free (writer->buf, TRUE);
+    axing_name_table_unref (writer->names);
+    g_array_free (writer->attrnames, TRUE);
+    G_OBJECT_CLASS (axing_event_writer_parent_class)->finalize (object);
+}
+
+AxingEventWriter *
+axing_event_writer_new (GOutputStream *stream)
+{
+    AxingEventWriter *writer;
+    g_return_val_if_fail (G_IS_OUTPUT_STREAM (stream), NULL);
+    writer = g_object_new (AXING_TYPE_EVENT_WRITER, NULL);
+    writer->stream = g_object_ref (stream);
+    return writer;
+}
+
+/* Records the reader's current event. Output is buffered, so call
+   axing_event_writer_flush when you're done.
+ */
+gboolean
+axing_event_writer_write_event (AxingEventWriter  *writer,
+                                AxingReader       *reader,
+                                GError           **error)
+{
+    AxingNodeType type;
+    guint8 tag;
+    guint start;
+    guint32 n_names;
+
+    g_return_val_if_fail (AXING_IS_EVENT_WRITER (writer), FALSE);
+    g_return_val_if_fail (AXING_IS_READER (reader), FALSE);
+
+    start = writer->buf->len;
+    n_names = writer->n_names_written;
+
+    if (!writer->header_written) {
+        g_byte_array_append (writer->buf, (const guint8 *) EVENT_STREAM_MAGIC, 4);
+        writer_put_u32 (writer, EVENT_STREAM_VERSION);
+        writer->header_written = TRUE;
+    }
+
+    type = axing_reader_get_node_type (reader);
+    switch (type) {
+    case AXING_NODE_TYPE_ELEMENT: {
+        const char * const *attrs = axing_reader_get_attrs (reader);
+        guint32 qname, ns, n_attrs, i;
+        guint32 *attrnames;
+        /* Names have to be defined before the record that uses them */
+        n_attrs = g_strv_length ((char **) attrs);
+        g_array_set_size (writer->attrnames, 2 * n_attrs);
+        attrnames = (guint32 *) writer->attrnames->data;
+        qname = writer_put_name (writer, axing_reader_get_qname (reader));
+        ns = writer_put_name (writer, axing_reader_get_namespace (reader));
+        for (i = 0; i < n_attrs; i++) {
+            attrnames[2 * i] = writer_put_name (writer, attrs[i]);
+            attrnames[2 * i + 1] = writer_put_name (writer,
+                                                    axing_reader_get_attr_namespace (reader, attrs[i]));
+        }
+        tag = type;
+        g_byte_array_append (writer->buf, &tag, 1);
+        writer_put_u32 (writer, qname);
+        writer_put_u32 (writer, ns);
+        writer_put_u64 (writer, axing_reader_get_linenum (reader));
+        writer_put_u64 (writer, axing_reader_get_colnum (reader));
+        writer_put_u32 (writer, n_attrs);
+        for (i = 0; i < n_attrs; i++) {
+            writer_put_u32 (writer, attrnames[2 * i]);
+            writer_put_u32 (writer, attrnames[2 * i + 1]);
+            writer_put_u64 (writer, axing_reader_get_attr_linenum (reader, attrs[i]));
+            writer_put_u64 (writer, axing_reader_get_attr_colnum (reader, attrs[i]));
+            writer_put_string (writer, axing_reader_get_attr_value (reader, attrs[i]));
+        }
+        break;
+    }
+    case AXING_NODE_TYPE_END_ELEMENT:
+        tag = type;
+        g_byte_array_append (writer->buf, &tag, 1);
+        break;
+    case AXING_NODE_TYPE_INSTRUCTION: {
+        guint32 target = writer_put_name (writer, axing_reader_get_qname (reader));
+        tag = type;
+        g_byte_array_append (writer->buf, &tag, 1);
+        writer_put_u32 (writer, target);
+        writer_put_u64 (writer, axing_reader_get_linenum (reader));
+        writer_put_u64 (writer, axing_reader_get_colnum (reader));
+        writer_put_string (writer, axing_reader_get_content (reader));
+        break;
+    }
+    case AXING_NODE_TYPE_CONTENT:
+    case AXING_NODE_TYPE_COMMENT:
+    case AXING_NODE_TYPE_CDATA:
+        tag = type;
+        g_byte_array_append (writer->buf, &tag, 1);
+        writer_put_u64 (writer, axing_reader_get_linenum (reader));
+        writer_put_u64 (writer, axing_reader_get_colnum (reader));
+        writer_put_string (writer, axing_reader_get_content (reader));
+        break;
+    default:
+        break;
+    }
+
+    /* Drop the whole event, names included. writer_put_name writes any
+       names it skips over, so the ones interned here still get defined
+       in order when they're next used.
+     */
+    if (writer->too_long) {
+        writer->too_long = FALSE;
+        g_byte_array_set_size (writer->buf, start);
+        writer->n_names_written = n_names;
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                     "String too long for an event stream");
+        return FALSE;
+    }
+
+    if (writer->buf->len >= FLUSH_SIZE)
+        return axing_event_writer_flush (writer, error);
+    return TRUE;
+}
+
+/* Reads the rest of reader, recording each event, and flushes */
+gboolean
+axing_event_writer_write_all (AxingEventWriter  *writer,
+                              AxingReader       *reader,
+                              GError           **error)
+{
+    GError *readerror = NULL;
+
+    g_return_val_if_fail (AXING_IS_EVENT_WRITER (writer), FALSE);
+    g_return_val_if_fail (AXING_IS_READER (reader), FALSE);
+
+    while (axing_reader_read (reader, &readerror)) {
+        if (!axing_event_writer_write_event (writer, reader, error))
+            return FALSE;
+    }
+    if (readerror != NULL) {
+        if (error != NULL)
+            *error = g_error_copy (readerror);
+        return FALSE;
+    }
+    return axing_event_writer_flush (writer, error);
+}
+
+gboolean
+axing_event_writer_flush (AxingEventWriter  *writer,
+                          GError           **error)
+{
+    g_return_val_if_fail (AXING_IS_EVENT_WRITER (writer), FALSE);
+
+    if (writer->buf->len > 0) {
+        if (!g_output_stream_write_all (writer->stream, writer->buf->data, writer->buf->len,
+                                        NULL, NULL, error))
+            return FALSE;
+        g_byte_array_set_size (writer->buf, 0);
+    }
+    return g_output_stream_flush (writer->stream, NULL, error);
+}
+
+static void
+writer_put_u32 (AxingEventWriter *writer,
+                guint32           val)
+{
+    guint32 le = GUINT32_TO_LE (val);
+    g_byte_array_append (writer->buf, (const guint8 *) &le, 4);
+}
+
+static void
+writer_put_u64 (AxingEventWriter *writer,
+                guint64           val)
+{
+    guint64 le = GUINT64_TO_LE (val);
+    g_byte_array_append (writer->buf, (const guint8 *) &le, 8);
+}
+
+/* Lengths are 32-bit. Anything longer marks the event to be dropped. */
+static void
+writer_put_string (AxingEventWriter *writer,
+                   const char       *str)
+{
+    gsize len = str ? strlen (str) : 0;
+    if (len > G_MAXUINT32) {
+        writer->too_long = TRUE;
+        return;
+    }
+    writer_put_u32 (writer, len);
+    g_byte_array_append (writer->buf, (const guint8 *) (str ? str : ""), len + 1);
+}
+
+/* Returns the ID for name, writing a name record if it's new. The name
+   table hands out IDs in order, and readers need them defined in order, so
+   this also writes any earlier names a dropped event left unwritten.
+ */
+static guint32
+writer_put_name (AxingEventWriter *writer,
+                 const char       *name)
+{
+    guint32 id = axing_name_table_intern (writer->names, name, -1);
+    while (id > writer->n_names_written) {
+        guint8 tag = EVENT_STREAM_NAME;
+        guint32 next = writer->n_names_written + 1;
+        g_byte_array_append (writer->buf, &tag, 1);
+        writer_put_u32 (writer, next);
+        writer_put_string (writer, axing_name_table_lookup (writer->names, next));
+        writer->n_names_written = next;
+    }
+    return id;
+}
@@ -0,0 +1,907 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+
+/* AxingHttpResolver wraps another resolver. Anything that one resolves to
+   an http or https URI is fetched here and kept in a cache directory, and
+   the resource that comes back reads from the cached copy. Cached copies
+   are revalidated with If-None-Match and If-Modified-Since, so a file that
+   hasn't changed costs a round trip but no transfer. Copies fetched less
+   than max_age seconds ago aren't revalidated at all.
+
+   Offline, only the cache is used, and anything not in it fails. Online,
+   if the server can't be reached, a cached copy is used anyway.
+
+   Each entry is two files named for a SHA-256 of the URI: the body, and a
+   key file with the validators. The HTTP client is deliberately small:
+   HTTP/1.1 GET over GSocketClient, one request per connection, identity
+   encoding, Content-Length, chunked, or read-to-close bodies, and up to
+   five redirects. Connecting and each read give up after a timeout, and
+   header lines, header counts and chunk sizes are capped, so a broken or
+   hostile server can't stall a parse or run us out of memory. It's safe to share between threads. Two threads that
+   fetch the same URI both write the entry, and each write replaces the
+   files whole.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "axing-http-resolver.h"
+#include "axing-private.h"
+#include "axing-utils.h"
+
+#define MAX_REDIRECTS 5
+#define HTTP_TIMEOUT 30           /* seconds, for connecting and each read */
+#define HTTP_MAX_LINE 8192        /* status, header, and chunk-size lines */
+#define HTTP_MAX_HEADERS 100
+#define HTTP_MAX_CHUNK G_MAXINT32
+
+typedef struct {
+    char      *uri;       /* as asked for */
+    char      *location;  /* where it ended up after redirects */
+    char      *etag;
+    char      *last_modified;
+    gint64     fetched;   /* real time, in seconds */
+    gboolean   valid;     /* there's a body to use */
+    GFile     *body;
+    GFile     *meta;
+} CacheEntry;
+
+typedef struct {
+    guint      status;
+    char      *location;
+    char      *etag;
+    char      *last_modified;
+    gint64     content_length;  /* -1 if not given */
+    gboolean   chunked;
+} Response;
+
+struct _AxingHttpResolver {
+    AxingResolver parent;
+
+    AxingResolver *resolver;
+    GFile         *directory;
+    gboolean       offline;
+    guint          max_age;
+    guint          timeout;
+};
+
+static void      axing_http_resolver_init           (AxingHttpResolver       *resolver);
+static void      axing_http_resolver_class_init     (AxingHttpResolverClass  *klass);
+static void      axing_http_resolver_dispose        (GObject                 *object);
+
+static AxingResource * http_resolver_resolve        (AxingResolver        *resolver,
+                                                     AxingResource        *base,
+                                                     const char           *xml_base,
+                                                     const char           *link,
+                                                     const char           *pubid,
+                                                     AxingResolverHint     hint,
+                                                     GCancellable         *cancellable,
+                                                     GError              **error);
+static void            http_resolver_resolve_async  (AxingResolver        *resolver,
+                                                     AxingResource        *base,
+                                                     const char           *xml_base,
+                                                     const char           *link,
+                                                     const char           *pubid,
+                                                     AxingResolverHint     hint,
+                                                     GCancellable         *cancellable,
+                                                     GAsyncReadyCallback   callback,
+                                                     gpointer              user_data);
+static AxingResource * http_resolver_resolve_finish (AxingResolver        *resolver,
+                                                     GAsyncResult         *result,
+                                                     GError              **error);
+
+static AxingResource * http_resolver_fetch          (AxingHttpResolver    *resolver,
+                                                     const char           *uri,
+                                                     GCancellable         *cancellable,
+                                                     GError              **error);
+
+static CacheEntry *    cache_entry_load             (AxingHttpResolver    *resolver,
+                                                     const char           *uri);
+static void            cache_entry_save             (AxingHttpResolver    *resolver,
+                                                     CacheEntry           *entry,
+                                                     GCancellable         *cancellable);
+static void            cache_entry_free             (CacheEntry           *entry);
+
+static gboolean        http_get                     (CacheEntry           *entry,
+                                                     guint                 timeout,
+                                                     guint                *status,
+                                                     GCancellable         *cancellable,
+                                                     GError              **error);
+static gboolean        http_request                 (const char           *url,
+                                                     CacheEntry           *entry,
+                                                     guint                 timeout,
+                                                     Response             *response,
+                                                     GCancellable         *cancellable,
+                                                     GError              **error);
+static char *          http_read_line               (GDataInputStream     *in,
+                                                     GCancellable         *cancellable,
+                                                     GError              **error);
+static gboolean        http_read_head               (GDataInputStream     *in,
+                                                     Response             *response,
+                                                     GCancellable         *cancellable,
+                                                     GError              **error);
+static gboolean        http_read_body               (GDataInputStream     *in,
+                                                     Response             *response,
+                                                     GFile                *dest,
+                                                     GCancellable         *cancellable,
+                                                     GError              **error);
+static gboolean        http_copy_bytes              (GInputStream         *in,
+                                                     GOutputStream        *out,
+                                                     guint64               count,
+                                                     GCancellable         *cancellable,
+                                                     GError              **error);
+static gboolean        http_split_uri               (const char           *url,
+                                                     char                **host,
+                                                     char                **path);
+static void            response_clear               (Response             *response);
+
+G_DEFINE_TYPE (AxingHttpResolver, axing_http_resolver, AXING_TYPE_RESOLVER);
+
+static void
+axing_http_resolver_init (AxingHttpResolver *resolver)
+{
+    resolver->timeout = HTTP_TIMEOUT;
+}
+
+static void
+axing_http_resolver_class_init (AxingHttpResolverClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS (klass);
+    AxingResolverClass *resolver_class = AXING_RESOLVER_CLASS (klass);
+
+    resolver_class->resolve = http_resolver_resolve;
+    resolver_class->resolve_async = http_resolver_resolve_async;
+    resolver_class->resolve_finish = http_resolver_resolve_finish;
+
+    object_class->dispose = axing_http_resolver_dispose;
+}
+
+static void
+axing_http_resolver_dispose (GObject *object)
+{
+    AxingHttpResolver *resolver = AXING_HTTP_RESOLVER (object);
+    g_clear_object (&(resolver->resolver));
+    g_clear_object (&(resolver->directory));
+    G_OBJECT_CLASS (axing_http_resolver_parent_class)->dispose (object);
+}
+
+/* resolver NULL means the default resolver. directory NULL means axing/http
+   in the user cache directory.
+ */
+AxingResolver *
+axing_http_resolver_new (AxingResolver *resolver,
+                         GFile         *directory)
+{
+    AxingHttpResolver *ret;
+
+    g_return_val_if_fail (resolver == NULL || AXING_IS_RESOLVER (resolver), NULL);
+    g_return_val_if_fail (directory == NULL || G_IS_FILE (directory), NULL);
+
+    ret = g_object_new (AXING_TYPE_HTTP_RESOLVER, NULL);
+    ret->resolver = resolver ? g_object_ref (resolver) : axing_resolver_get_default ();
+    if (directory != NULL) {
+        ret->directory = g_object_ref (directory);
+    }
+    else {
+        char *path = g_build_filename (g_get_user_cache_dir (), "axing", "http", NULL);
+        ret->directory = g_file_new_for_path (path);
+        g_free (path);
+    }
+    return AXING_RESOLVER (ret);
+}
+
+/* Offline, nothing goes over the network, and only cached copies are used */
+void
+axing_http_resolver_set_offline (AxingHttpResolver *resolver,
+                                 gboolean           offline)
+{
+    g_return_if_fail (AXING_IS_HTTP_RESOLVER (resolver));
+    resolver->offline = offline;
+}
+
+/* Cached copies younger than this are used without asking the server.
+   The default is 0, which revalidates every time.
+ */
+void
+axing_http_resolver_set_max_age (AxingHttpResolver *resolver,
+                                 guint              seconds)
+{
+    g_return_if_fail (AXING_IS_HTTP_RESOLVER (resolver));
+    resolver->max_age = seconds;
+}
+
+/* How long to wait for a connection, and for each read once connected,
+   before giving up on the server. The default is 30 seconds. 0 waits
+   forever.
+ */
+void
+axing_http_resolver_set_timeout (AxingHttpResolver *resolver,
+                                 guint              seconds)
+{
+    g_return_if_fail (AXING_IS_HTTP_RESOLVER (resolver));
+    resolver->timeout = seconds;
+}
+
+static AxingResource *
+http_resolver_resolve (AxingResolver     *resolver,
+                       AxingResource     *base,
+                       const char        *xml_base,
+                       const char        *link,
+                       const char        *pubid,
+                       AxingResolverHint  hint,
+                       GCancellable      *cancellable,
+                       GError           **error)
+{
+    AxingHttpResolver *http = AXING_HTTP_RESOLVER (resolver);
+    AxingResource *resolved, *ret;
+    GFile *file;
+    char *uri;
+
+    resolved = axing_resolver_resolve (http->resolver, base, xml_base, link, pubid,
+                                       hint, cancellable, error);
+    if (resolved == NULL || axing_resource_get_input_stream (resolved) != NULL)
+        return resolved;
+
+    file = axing_resource_get_file (resolved);
+    if (!g_file_has_uri_scheme (file, "http") && !g_file_has_uri_scheme (file, "https"))
+        return resolved;
+
+    uri = g_file_get_uri (file);
+    ret = http_resolver_fetch (http, uri, cancellable, error);
+    g_free (uri);
+    g_object_unref (resolved);
+    return ret;
+}
+
+typedef struct {
+    AxingResource     *base;
+    char              *xml_base;
+    char              *link;
+    char              *pubid;
+    AxingResolverHint  hint;
+} ResolveData;
+
+static void
+resolve_data_free (ResolveData *data)
+{
+    g_clear_object (&(data->base));
+    g_free (data->xml_base);
+    g_free (data->link);
+    g_free (data->pubid);
+    g_free (data);
+}
+
+static void
+http_resolver_resolve_thread (GTask        *task,
+                              gpointer      source,
+                              gpointer      task_data,
+                              GCancellable *cancellable)
+{
+    ResolveData *data = task_data;
+    AxingResource *resource;
+    GError *error = NULL;
+
+    resource = http_resolver_resolve (AXING_RESOLVER (source), data->base,
+                                      data->xml_base, data->link, data->pubid,
+                                      data->hint, cancellable, &error);
+    if (resource)
+        g_task_return_pointer (task, resource, g_object_unref);
+    else if (error)
+        g_task_return_error (task, error);
+    else
+        g_task_return_pointer (task, NULL, NULL);
+}
+
+/* Fetching blocks, so the whole thing runs on a worker thread */
+static void
+http_resolver_resolve_async (AxingResolver       *resolver,
+                             AxingResource       *base,
+                             const char          *xml_base,
+                             const char          *link,
+                             const char          *pubid,
+                             AxingResolverHint    hint,
+                             GCancellable        *cancellable,
+                             GAsyncReadyCallback  callback,
+                             gpointer             user_data)
+{
+    ResolveData *data;
+    GTask *task;
+
+    task = g_task_new (G_OBJECT (resolver), cancellable, callback, user_data);
+
+    data = g_new0 (ResolveData, 1);
+    data->base = base ? g_object_ref (base) : NULL;
+    data->xml_base = g_strdup (xml_base);
+    data->link = g_strdup (link);
+    data->pubid = g_strdup (pubid);
+    data->hint = hint;
+    g_task_set_task_data (task, data, (GDestroyNotify) resolve_data_free);
+
+    g_task_set_return_on_cancel (task, TRUE);
+    g_task_run_in_thread (task, http_resolver_resolve_thread);
+    g_object_unref (task);
+}
+
+static AxingResource *
+http_resolver_resolve_finish (AxingResolver *resolver,
+                              GAsyncResult  *result,
+                              GError       **error)
+{
+    return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+static AxingResource *
+http_resolver_fetch (AxingHttpResolver  *resolver,
+                     const char         *uri,
+                     GCancellable       *cancellable,
+                     GError            **error)
+{
+    CacheEntry *entry;
+    AxingResource *ret = NULL;
+    GInputStream *stream;
+    GFile *file;
+    GError *tmperror = NULL;
+    guint status = 0;
+    gint64 now;
+
+    entry = cache_entry_load (resolver, uri);
+    now = g_get_real_time () / G_USEC_PER_SEC;
+
+    if (entry->valid && (resolver->offline || now - entry->fetched < resolver->max_age))
+        goto found;
+
+    if (resolver->offline) {
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                     "%s is not in the HTTP cache", uri);
+        goto error;
+    }
+
+    if (!http_get (entry, resolver->timeout, &status, cancellable, &tmperror)) {
+        /* Use a stale copy if we never heard from the server */
+        if (entry->valid && status == 0 &&
+            !g_error_matches (tmperror, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            g_clear_error (&tmperror);
+            goto found;
+        }
+        g_propagate_error (error, tmperror);
+        goto error;
+    }
+    entry->fetched = now;
+    cache_entry_save (resolver, entry, cancellable);
+
+ found:
+    stream = axing_file_open_buffered (entry->body, cancellable, error);
+    if (stream == NULL)
+        goto error;
+    file = g_file_new_for_uri (entry->location ? entry->location : uri);
+    ret = axing_resource_new (file, stream);
+    g_object_unref (file);
+    g_object_unref (stream);
+
+ error:
+    cache_entry_free (entry);
+    return ret;
+}
+
+static CacheEntry *
+cache_entry_load (AxingHttpResolver *resolver,
+                  const char        *uri)
+{
+    CacheEntry *entry;
+    GKeyFile *keyfile;
+    char *hash, *name, *data, *stored;
+    gsize len;
+
+    entry = g_new0 (CacheEntry, 1);
+    entry->uri = g_strdup (uri);
+
+    hash = g_compute_checksum_for_string (G_CHECKSUM_SHA256, uri, -1);
+    name = g_strconcat (hash, ".body", NULL);
+    entry->body = g_file_get_child (resolver->directory, name);
+    g_free (name);
+    name = g_strconcat (hash, ".meta", NULL);
+    entry->meta = g_file_get_child (resolver->directory, name);
+    g_free (name);
+    g_free (hash);
+
+    if (!g_file_load_contents (entry->meta, NULL, &data, &len, NULL, NULL))
+        return entry;
+
+    keyfile = g_key_file_new ();
+    if (g_key_file_load_from_data (keyfile, data, len, G_KEY_FILE_NONE, NULL)) {
+        stored = g_key_file_get_string (keyfile, "entry", "uri", NULL);
+        if (g_strcmp0 (stored, uri) == 0 && g_file_query_exists (entry->body, NULL)) {
+            entry->valid = TRUE;
+            entry->location = g_key_file_get_string (keyfile, "entry", "location", NULL);
+            entry->etag = g_key_file_get_string (keyfile, "entry", "etag", NULL);
+            entry->last_modified = g_key_file_get_string (keyfile, "entry", "last-modified", NULL);
+            entry->fetched = g_key_file_get_int64 (keyfile, "entry", "fetched", NULL);
+        }
+        g_free (stored);
+    }
+    g_key_file_free (keyfile);
+    g_free (data);
+    return entry;
+}
+
+/* Failing to save isn't an error. We just fetch again next time. */
+static void
+cache_entry_save (AxingHttpResolver *resolver,
+                  CacheEntry        *entry,
+                  GCancellable      *cancellable)
+{
+    GKeyFile *keyfile;
+    char *data;
+    gsize len;
+
+    keyfile = g_key_file_new ();
+    g_key_file_set_string (keyfile, "entry", "uri", entry->uri);
+    if (entry->location)
+        g_key_file_set_string (keyfile, "entry", "location", entry->location);
+    if (entry->etag)
+        g_key_file_set_string (keyfile, "entry", "etag", entry->etag);
+    if (entry->last_modified)
+        g_key_file_set_string (keyfile, "entry", "last-modified", entry->last_modified);
+    g_key_file_set_int64 (keyfile, "entry", "fetched", entry->fetched);
+    data = g_key_file_to_data (keyfile, &len, NULL);
+    g_key_file_free (keyfile);
+
+    g_file_replace_contents (entry->meta, data, len, NULL, FALSE, G_FILE_CREATE_NONE,
+                             NULL, cancellable, NULL);
+    g_free (data);
+}
+
+static void
+cache_entry_free (CacheEntry *entry)
+{
+    g_free (entry->uri);
+    g_free (entry->location);
+    g_free (entry->etag);
+    g_free (entry->last_modified);
+    g_clear_object (&(entry->body));
+    g_clear_object (&(entry->meta));
+    g_free (entry);
+}
+
+/* Fetches entry->uri, following redirects, and updates entry. A new body
+   goes straight into the cache. status is the last HTTP status we got, or
+   0 if no server ever answered.
+ */
+static gboolean
+http_get (CacheEntry    *entry,
+          guint          timeout,
+          guint         *status,
+          GCancellable  *cancellable,
+          GError       **error)
+{
+    Response response;
+    char *url;
+    int redirects;
+
+    url = g_strdup (entry->uri);
+    for (redirects = 0; redirects <= MAX_REDIRECTS; redirects++) {
+        if (!http_request (url, entry, timeout, &response, cancellable, error))
+            break;
+        *status = response.status;
+
+        if (response.status == 200 || (response.status == 304 && entry->valid)) {
+            g_free (entry->location);
+            entry->location = url;
+            if (response.status == 200 || response.etag) {
+                g_free (entry->etag);
+                entry->etag = g_steal_pointer (&(response.etag));
+            }
+            if (response.status == 200 || response.last_modified) {
+                g_free (entry->last_modified);
+                entry->last_modified = g_steal_pointer (&(response.last_modified));
+            }
+            entry->valid = TRUE;
+            response_clear (&response);
+            return TRUE;
+        }
+        else if ((response.status == 301 || response.status == 302 ||
+                  response.status == 303 || response.status == 307 ||
+                  response.status == 308) && response.location != NULL) {
+            char *next = axing_uri_resolve_relative (url, response.location);
+            g_free (url);
+            url = next;
+            response_clear (&response);
+            continue;
+        }
+
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                     "HTTP status %u for %s", response.status, url);
+        response_clear (&response);
+        break;
+    }
+
+    if (redirects > MAX_REDIRECTS)
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                     "Too many redirects for %s", entry->uri);
+    g_free (url);
+    return FALSE;
+}
+
+/* Sends one GET with the entry's validators. The body of a 200 replaces
+   the entry's body file. Anything else has its body ignored.
+ */
+static gboolean
+http_request (const char    *url,
+              CacheEntry    *entry,
+              guint          timeout,
+              Response      *response,
+              GCancellable  *cancellable,
+              GError       **error)
+{
+    GSocketClient *client;
+    GSocketConnection *conn = NULL;
+    GDataInputStream *in = NULL;
+    GString *req;
+    char *host = NULL, *path = NULL, *escaped;
+    gboolean https, ret = FALSE;
+
+    memset (response, 0, sizeof (Response));
+    response->content_length = -1;
+
+    if (!http_split_uri (url, &host, &path)) {
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                     "Not an HTTP URI: %s", url);
+        return FALSE;
+    }
+
+    /* Nothing from the URI goes on the wire raw. Stray spaces or line
+       breaks would split the request line or inject headers. */
+    if (host[0] == '\0' || strpbrk (host, " \t\r\n") != NULL) {
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                     "Bad host in HTTP URI: %s", url);
+        g_free (host);
+        g_free (path);
+        return FALSE;
+    }
+    escaped = g_uri_escape_string (path, "!$&'()*+,;=:@/?%", FALSE);
+    g_free (path);
+    path = escaped;
+
+    https = g_str_has_prefix (url, "https:");
+    client = g_socket_client_new ();
+    g_socket_client_set_tls (client, https);
+    g_socket_client_set_timeout (client, timeout);
+    conn = g_socket_client_connect_to_uri (client, url, https ? 443 : 80,
+                                           cancellable, error);
+    if (conn == NULL)
+        goto error;
+
+    req = g_string_new (NULL);
+    g_string_append_printf (req,
+                            "GET %s HTTP/1.1\r\n"
+                            "Host: %s\r\n"
+                            "User-Agent: axing\r\n"
+                            "Accept-Encoding: identity\r\n"
+                            "Connection: close\r\n",
+                            path, host);
+    if (entry->valid && entry->etag)
+        g_string_append_printf (req, "If-None-Match: %s\r\n", entry->etag);
+    if (entry->valid && entry->last_modified)
+        g_string_append_printf (req, "If-Modified-Since: %s\r\n", entry->last_modified);
+    g_string_append (req, "\r\n");
+    ret = g_output_stream_write_all (g_io_stream_get_output_stream (G_IO_STREAM (conn)),
+                                     req->str, req->len, NULL, cancellable, error);
+    g_string_free (req, TRUE);
+    if (!ret)
+        goto error;
+
+    in = g_data_input_stream_new (g_io_stream_get_input_stream (G_IO_STREAM (conn)));
+    g_buffered_input_stream_set_buffer_size (G_BUFFERED_INPUT_STREAM (in), HTTP_MAX_LINE);
+    ret = http_read_head (in, response, cancellable, error);
+    if (ret && response->status == 200)
+        ret = http_read_body (in, response, entry->body, cancellable, error);
+
+ error:
+    if (!ret)
+        response_clear (response);
+    g_clear_object (&in);
+    if (conn != NULL)
+        g_io_stream_close (G_IO_STREAM (conn), NULL, NULL);
+    g_clear_object (&conn);
+    g_object_unref (client);
+    g_free (host);
+    g_free (path);
+    return ret;
+}
+
+static gboolean
+http_header_is (const char *line,
+                const char *colon,
+                const char *name)
+{
+    gsize len = strlen (name);
+    return (gsize) (colon - line) == len && g_ascii_strncasecmp (line, name, len) == 0;
+}
+
+/* Reads one line, without its CRLF or LF, from what's buffered in in. A
+   line that doesn't fit in the buffer is an error, and so is running out
+   of input before the end of the line.
+ */
+static char *
+http_read_line (GDataInputStream  *in,
+                GCancellable      *cancellable,
+                GError           **error)
+{
+    GBufferedInputStream *buffered = G_BUFFERED_INPUT_STREAM (in);
+
+    while (TRUE) {
+        const char *buf, *nl;
+        gsize avail;
+        gssize len;
+
+        buf = g_buffered_input_stream_peek_buffer (buffered, &avail);
+        nl = memchr (buf, '\n', avail);
+        if (nl != NULL) {
+            gsize linelen = nl - buf;
+            char *line;
+            if (linelen > 0 && buf[linelen - 1] == '\r')
+                linelen--;
+            line = g_strndup (buf, linelen);
+            if (g_input_stream_skip (G_INPUT_STREAM (in), nl - buf + 1,
+                                     cancellable, error) < 0) {
+                g_free (line);
+                return NULL;
+            }
+            return line;
+        }
+        if (avail >= HTTP_MAX_LINE) {
+            g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                         "HTTP line longer than %d bytes", HTTP_MAX_LINE);
+            return NULL;
+        }
+        len = g_buffered_input_stream_fill (buffered, -1, cancellable, error);
+        if (len < 0)
+            return NULL;
+        if (len == 0) {
+            g_set_error (error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT,
+                         "HTTP response ended early");
+            return NULL;
+        }
+    }
+}
+
+static gboolean
+http_read_head (GDataInputStream  *in,
+                Response          *response,
+                GCancellable      *cancellable,
+                GError           **error)
+{
+    char *line;
+    int headers;
+
+    line = http_read_line (in, cancellable, error);
+    if (line == NULL)
+        return FALSE;
+    if (!g_str_has_prefix (line, "HTTP/1.") || strlen (line) < 12) {
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                     "Bad HTTP response");
+        g_free (line);
+        return FALSE;
+    }
+    response->status = strtoul (line + 9, NULL, 10);
+    g_free (line);
+
+    for (headers = 0; ; headers++) {
+        const char *colon;
+        char *value;
+
+        line = http_read_line (in, cancellable, error);
+        if (line == NULL)
+            return FALSE;
+        if (line[0] == '\0') {
+            g_free (line);
+            return TRUE;
+        }
+        if (headers >= HTTP_MAX_HEADERS) {
+            g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                         "More than %d HTTP headers", HTTP_MAX_HEADERS);
+            g_free (line);
+            return FALSE;
+        }
+
+        colon = strchr (line, ':');
+        if (colon == NULL) {
+            g_free (line);
+            continue;
+        }
+        value = g_strstrip (g_strdup (colon + 1));
+        if (http_header_is (line, colon, "ETag")) {
+            g_free (response->etag);
+            response->etag = g_steal_pointer (&value);
+        }
+        else if (http_header_is (line, colon, "Last-Modified")) {
+            g_free (response->last_modified);
+            response->last_modified = g_steal_pointer (&value);
+        }
+        else if (http_header_is (line, colon, "Location")) {
+            g_free (response->location);
+            response->location = g_steal_pointer (&value);
+        }
+        else if (http_header_is (line, colon, "Content-Length")) {
+            response->content_length = g_ascii_strtoll (value, NULL, 10);
+        }
+        else if (http_header_is (line, colon, "Transfer-Encoding")) {
+            response->chunked = (g_ascii_strcasecmp (value, "chunked") == 0);
+        }
+        g_free (value);
+        g_free (line);
+    }
+}
+
+/* Writes to a temporary file next to dest and moves it over dest once the
+   whole body is in, so a broken transfer never clobbers a good copy.
+ */
+static gboolean
+http_read_body (GDataInputStream  *in,
+                Response          *response,
+                GFile             *dest,
+                GCancellable      *cancellable,
+                GError           **error)
+{
+    GFile *parent, *part;
+    GFileOutputStream *out = NULL;
+    GInputStream *instream = G_INPUT_STREAM (in);
+    char *name;
+    gboolean ret = FALSE;
+
+    parent = g_file_get_parent (dest);
+    g_file_make_directory_with_parents (parent, cancellable, NULL);
+    name = g_strdup_printf ("%08x.part", g_random_int ());
+    part = g_file_get_child (parent, name);
+    g_free (name);
+    g_object_unref (parent);
+
+    out = g_file_replace (part, NULL, FALSE, G_FILE_CREATE_PRIVATE, cancellable, error);
+    if (out == NULL)
+        goto error;
+
+    if (response->chunked) {
+        while (TRUE) {
+            char *line, *end;
+            guint64 size;
+            gboolean bad;
+
+            line = http_read_line (in, cancellable, error);
+            if (line == NULL)
+                goto error;
+            /* Chunk extensions after ';' are ignored */
+            size = g_ascii_strtoull (line, &end, 16);
+            bad = (end == line || !(end[0] == '\0' || end[0] == ';' ||
+                                    end[0] == ' ' || end[0] == '\t') ||
+                   size > HTTP_MAX_CHUNK);
+            g_free (line);
+            if (bad) {
+                g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                             "Bad HTTP chunk size");
+                goto error;
+            }
+            if (size == 0)
+                break;
+            if (!http_copy_bytes (instream, G_OUTPUT_STREAM (out), size, cancellable, error))
+                goto error;
+            /* The CRLF after the chunk */
+            line = http_read_line (in, cancellable, error);
+            if (line == NULL)
+                goto error;
+            g_free (line);
+        }
+        /* Trailers are ignored. Nothing after them matters. */
+    }
+    else if (response->content_length >= 0) {
+        if (!http_copy_bytes (instream, G_OUTPUT_STREAM (out),
+                              response->content_length, cancellable, error))
+            goto error;
+    }
+    else {
+        if (g_output_stream_splice (G_OUTPUT_STREAM (out), instream,
+                                    G_OUTPUT_STREAM_SPLICE_NONE,
+                                    cancellable, error) < 0)
+            goto error;
+    }
+
+    if (!g_output_stream_close (G_OUTPUT_STREAM (out), cancellable, error))
+        goto error;
+    ret = g_file_move (part, dest, G_FILE_COPY_OVERWRITE, cancellable, NULL, NULL, error);
+
+ error:
+    if (out != NULL) {
+        if (!ret)
+            g_output_stream_close (G_OUTPUT_STREAM (out), NULL, NULL);
+        g_object_unref (out);
+    }
+    if (!ret)
+        g_file_delete (part, NULL, NULL);
+    g_object_unref (part);
+    return ret;
+}
+
+static gboolean
+http_copy_bytes (GInputStream   *in,
+                 GOutputStream  *out,
+                 guint64         count,
+                 GCancellable   *cancellable,
+                 GError        **error)
+{
+    char buf[8192];
+
+    while (count > 0) {
+        gssize len = g_input_stream_read (in, buf, MIN (count, sizeof (buf)),
+                                          cancellable, error);
+        if (len < 0)
+            return FALSE;
+        if (len == 0) {
+            g_set_error (error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT,
+                         "HTTP response ended early");
+            return FALSE;
+        }
+        if (!g_output_stream_write_all (out, buf, len, NULL, cancellable, error))
+            return FALSE;
+        count -= len;
+    }
+    return TRUE;
+}
+
+/* Splits out what goes in the Host header and the request line */
+static gboolean
+http_split_uri (const char  *url,
+                char       **host,
+                char       **path)
+{
+    const char *auth, *end, *at;
+
+    auth = strstr (url, "://");
+    if (auth == NULL)
+        return FALSE;
+    auth += 3;
+    for (end = auth; end[0] != '\0'; end++)
+        if (end[0] == '/' || end[0] == '?' || end[0] == '#')
+            break;
+    if (end == auth)
+        return FALSE;
+    for (at = end; at > auth; at--)
+        if (at[-1] == '@')
+            break;
+    *host = g_strndup (at, end - at);
+
+    if (end[0] == '/')
+        *path = g_strndup (end, strcspn (end, "#"));
+    else if (end[0] == '?')
+        *path = g_strdup_printf ("/%.*s", (int) strcspn (end, "#"), end);
+    else
+        *path = g_strdup ("/");
+    return TRUE;
+}
+
+static void
+response_clear (Response *response)
+{
+    g_clear_pointer (&(response->location), g_free);
+    g_clear_pointer (&(response->etag), g_free);
+    g_clear_pointer (&(response->last_modified), g_free);
+}
@@ -0,0 +1,48 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+
+#ifndef __AXING_HTTP_RESOLVER_H__
+#define __AXING_HTTP_RESOLVER_H__
+
+#include <glib-object.h>
+#include <gio/gio.h>
+#include "axing-resolver.h"
+
+G_BEGIN_DECLS
+
+#define AXING_TYPE_HTTP_RESOLVER axing_http_resolver_get_type ()
+G_DECLARE_FINAL_TYPE (AxingHttpResolver, axing_http_resolver, AXING, HTTP_RESOLVER, AxingResolver)
+
+AxingResolver *  axing_http_resolver_new              (AxingResolver      *resolver,
+                                                       GFile              *directory);
+void             axing_http_resolver_set_offline      (AxingHttpResolver  *resolver,
+                                                       gboolean            offline);
+void             axing_http_resolver_set_max_age      (AxingHttpResolver  *resolver,
+                                                       guint               seconds);
+void             axing_http_resolver_set_timeout      (AxingHttpResolver  *resolver,
+                                                       guint               seconds);
+
+G_END_DECLS
+
+#endif /* __AXING_HTTP_RESOLVER_H__ */
@@ -0,0 +1,132 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+#include <string.h>
+
+#include "axing-name-table.h"
+
+struct _AxingNameTable {
+    gint          ref_count;
+    GStringChunk *chunk;
+    GPtrArray    *names;  /* indexed by id, names->pdata[0] is "" */
+    GHashTable   *ids;    /* keys owned by chunk */
+    GString      *scratch;
+};
+
+G_DEFINE_BOXED_TYPE (AxingNameTable, axing_name_table,
+                     axing_name_table_ref, axing_name_table_unref)
+
+AxingNameTable *
+axing_name_table_new (void)
+{
+    AxingNameTable *table = g_new0 (AxingNameTable, 1);
+    table->ref_count = 1;
+    table->chunk = g_string_chunk_new (4096);
+    table->names = g_ptr_array_sized_new (256);
+    table->ids = g_hash_table_new (g_str_hash, g_str_equal);
+    table->scratch = g_string_sized_new (64);
+    g_ptr_array_add (table->names, (gpointer) "");
+    return table;
+}
+
+AxingNameTable *
+axing_name_table_ref (AxingNameTable *table)
+{
+    g_return_val_if_fail (table != NULL, NULL);
+    table->ref_count++;
+    return table;
+}
+
+void
+axing_name_table_unref (AxingNameTable *table)
+{
+    g_return_if_fail (table != NULL);
+    if (--table->ref_count > 0)
+        return;
+    g_hash_table_destroy (table->ids);
+    g_ptr_array_free (table->names, TRUE);
+    g_string_chunk_free (table->chunk);
+    g_string_free (table->scratch, TRUE);
+    g_free (table);
+}
+
+/* len may be -1 for NUL-terminated names. Otherwise only len bytes are
+   read, so name can point into a larger buffer. Spans are copied to a
+   scratch buffer for the lookup, and only copied into the table when
+   they're new.
+ */
+guint32
+axing_name_table_intern (AxingNameTable *table,
+                         const char     *name,
+                         gssize          len)
+{
+    gpointer id;
+    char *key;
+
+    g_return_val_if_fail (table != NULL, 0);
+
+    if (name == NULL || len == 0 || name[0] == '\0')
+        return 0;
+
+    if (len > 0) {
+        g_string_truncate (table->scratch, 0);
+        g_string_append_len (table->scratch, name, len);
+        name = table->scratch->str;
+    }
+
+    id = g_hash_table_lookup (table->ids, name);
+    if (id != NULL)
+        return GPOINTER_TO_UINT (id);
+
+    key = g_string_chunk_insert (table->chunk, name);
+    g_ptr_array_add (table->names, key);
+    g_hash_table_insert (table->ids, key, GUINT_TO_POINTER (table->names->len - 1));
+    return table->names->len - 1;
+}
+
+/* Like axing_name_table_intern, but returns 0 instead of adding new names */
+guint32
+axing_name_table_find (AxingNameTable *table,
+                       const char     *name)
+{
+    g_return_val_if_fail (table != NULL, 0);
+    if (name == NULL || name[0] == '\0')
+        return 0;
+    return GPOINTER_TO_UINT (g_hash_table_lookup (table->ids, name));
+}
+
+const char *
+axing_name_table_lookup (AxingNameTable *table,
+                         guint32         id)
+{
+    g_return_val_if_fail (table != NULL, NULL);
+    g_return_val_if_fail (id < table->names->len, NULL);
+    return table->names->pdata[id];
+}
+
+guint32
+axing_name_table_get_size (AxingNameTable *table)
+{
+    g_return_val_if_fail (table != NULL, 0);
+    return table->names->len;
+}
@@ -0,0 +1,58 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+#ifndef __AXING_NAME_TABLE_H__
+#define __AXING_NAME_TABLE_H__
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/* Maps names and namespaces to small integer IDs that stay the same for the
+   life of the table. ID 0 is never used for a name. It stands for NULL or the
+   empty string, so it can mean "no namespace". Strings returned by
+   axing_name_table_lookup live as long as the table. Tables are refcounted,
+   but not thread-safe.
+ */
+typedef struct _AxingNameTable AxingNameTable;
+
+#define AXING_TYPE_NAME_TABLE (axing_name_table_get_type ())
+
+GType             axing_name_table_get_type    (void);
+
+AxingNameTable *  axing_name_table_new         (void);
+AxingNameTable *  axing_name_table_ref         (AxingNameTable *table);
+void              axing_name_table_unref       (AxingNameTable *table);
+
+guint32           axing_name_table_intern      (AxingNameTable *table,
+                                                const char     *name,
+                                                gssize          len);
+guint32           axing_name_table_find        (AxingNameTable *table,
+                                                const char     *name);
+const char *      axing_name_table_lookup      (AxingNameTable *table,
+                                                guint32         id);
+guint32           axing_name_table_get_size    (AxingNameTable *table);
+
+G_END_DECLS
+
+#endif /* __AXING_NAME_TABLE_H__ */
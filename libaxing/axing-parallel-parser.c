@@ -0,0 +1,1132 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+/* AxingParallelParser parses one large document on several threads. It
+   works on documents that are mostly a long list of children of the root
+   element, which is what big feeds and dumps usually look like.
+
+   First the prolog is scanned up to the end of the root start tag. The
+   rest is cut into pieces at '<' characters, and each piece is scanned on
+   its own thread, guessing that it starts in plain content. The scanner
+   only knows enough XML to track comments, CDATA, instructions, quotes,
+   and element depth. Pieces are then checked in order, and any piece
+   whose guess was wrong is scanned again from where the one before it
+   really ended. With the real depths known, each piece gives us the first
+   child of the root element in it, and those are where chunks start.
+
+   Each chunk is parsed on the thread pool by a normal AxingXmlParser. All
+   but the first chunk get the prolog and root start tag put in front, so
+   they see the same DTD and namespaces, and all but the last get the root
+   end tag put after. The events are recorded with AxingEventWriter, then
+   replayed in order, dropping the wrapper events and fixing positions.
+
+   Memory goes by bytes, not by threads. Pieces are about CHUNK_SIZE, so
+   chunks are too, unless one child of the root is bigger than that. Each
+   chunk's input is read from slices of the document with nothing copied,
+   and chunks are only queued while the input of the ones parsed or being
+   parsed but not yet replayed is under MAX_AHEAD. Recorded events are
+   freed as soon as they're replayed.
+
+   If a chunk has an error, we don't trust its positions or even that it's
+   an error in the whole document, since the chunk was guessed. The whole
+   document is parsed normally instead, past the events already returned,
+   and whatever it says is the answer.
+
+   Documents that can't be split this way are just parsed normally.
+ */
+
+#include <string.h>
+
+#include "axing-event-reader.h"
+#include "axing-event-writer.h"
+#include "axing-parallel-parser.h"
+#include "axing-xml-parser.h"
+
+/* Not worth splitting anything smaller than this */
+#define MIN_CHUNK_SIZE (1 << 20)
+/* What we aim for in bigger documents */
+#define CHUNK_SIZE     (4 << 20)
+/* Input bytes of chunks queued and not yet replayed */
+#define MAX_AHEAD      (64 << 20)
+
+typedef enum {
+    SCAN_TEXT,
+    SCAN_STAG,
+    SCAN_ETAG,
+    SCAN_COMMENT,
+    SCAN_CDATA,
+    SCAN_PI,
+    SCAN_DECL
+} ScanState;
+
+typedef struct {
+    ScanState  state;
+    char       quote;  /* open quote in a tag or declaration */
+    int        count;  /* trailing '-' or ']', or '[' depth in a declaration */
+    gboolean   flag;   /* last char was '/' in a start tag, or '?' in an instruction */
+} Scanner;
+
+/* The first start tag at some depth relative to the start of a piece */
+typedef struct {
+    gsize      pos;
+    gsize      newlines; /* from the start of the piece */
+} FirstTag;
+
+typedef struct {
+    gsize      start;
+    gsize      end;
+    Scanner    scanner;  /* the guessed start state, then the end state */
+    gsize      stop;     /* where the scan stopped, past end if markup started at the end */
+    int        depth;    /* net change in depth */
+    gsize      newlines;
+    GArray    *firsts;   /* FirstTag for relative depth 0, -1, -2, ... */
+    const char *data;
+    gsize      len;
+} Piece;
+
+typedef struct {
+    guint      index;
+    gsize      start;
+    gsize      end;
+    gint64     linenum;  /* where start is in the document */
+    gint64     colnum;
+    gboolean   done;
+    GBytes    *events;
+    GError    *error;
+} Chunk;
+
+struct _AxingParallelParser {
+    GObject parent;
+
+    AxingResource  *resource;
+    AxingResolver  *resolver;
+    guint           n_threads;
+    gboolean        started;
+
+    GBytes         *bytes;
+    const char     *data;
+    gsize           len;
+    gsize           body_start; /* after the root start tag */
+    char           *root_end;   /* the root end tag */
+    gint64          body_linenum;
+    gint64          body_colnum;
+
+    GArray         *chunks;
+    GThreadPool    *pool;
+    GMutex          mutex;
+    GCond           cond;
+    guint           next_queue;
+    gsize           ahead;      /* input bytes queued and not replayed */
+
+    /* What we're replaying */
+    guint           cur_chunk;
+    AxingReader    *current;
+    gboolean        sequential; /* current is a parser for the whole document */
+    gboolean        in_wrapper;
+    int             depth;
+    guint64         n_read;
+    GError         *error;
+};
+
+static void      axing_parallel_parser_init         (AxingParallelParser      *parser);
+static void      axing_parallel_parser_class_init   (AxingParallelParserClass *klass);
+static void      axing_parallel_parser_init_reader  (AxingReaderInterface     *iface);
+static void      axing_parallel_parser_dispose      (GObject                  *object);
+static void      axing_parallel_parser_finalize     (GObject                  *object);
+
+static gboolean              reader_read                    (AxingReader        *reader,
+                                                             GError            **error);
+static void                  reader_read_async              (AxingReader        *reader,
+                                                             GCancellable       *cancellable,
+                                                             GAsyncReadyCallback callback,
+                                                             gpointer            user_data);
+static gboolean              reader_read_finish             (AxingReader        *reader,
+                                                             GAsyncResult       *result,
+                                                             GError            **error);
+static void                  reader_read_thread             (GTask              *task,
+                                                             gpointer            source,
+                                                             gpointer            task_data,
+                                                             GCancellable       *cancellable);
+
+static AxingNodeType         reader_get_node_type           (AxingReader    *reader);
+static const char *          reader_get_qname               (AxingReader    *reader);
+static const char *          reader_get_prefix              (AxingReader    *reader);
+static const char *          reader_get_localname           (AxingReader    *reader);
+static const char *          reader_get_namespace           (AxingReader    *reader);
+static const char *          reader_get_nsname              (AxingReader    *reader);
+static const char *          reader_get_content             (AxingReader    *reader);
+static gint64                reader_get_linenum             (AxingReader    *reader);
+static gint64                reader_get_colnum              (AxingReader    *reader);
+
+static const char * const *  reader_get_attrs               (AxingReader    *reader);
+static const char *          reader_get_attr_localname      (AxingReader    *reader, const char *qname);
+static const char *          reader_get_attr_prefix         (AxingReader    *reader, const char *qname);
+static const char *          reader_get_attr_namespace      (AxingReader    *reader, const char *qname);
+static const char *          reader_get_attr_nsname         (AxingReader    *reader, const char *qname);
+static const char *          reader_get_attr_value          (AxingReader    *reader, const char *qname);
+static gint64                reader_get_attr_linenum        (AxingReader    *reader, const char *qname);
+static gint64                reader_get_attr_colnum         (AxingReader    *reader, const char *qname);
+static gboolean              reader_get_offsets             (AxingReader    *reader,
+                                                             goffset        *start,
+                                                             goffset        *end);
+static gboolean              reader_get_attr_offsets        (AxingReader    *reader,
+                                                             const char     *qname,
+                                                             goffset        *start,
+                                                             goffset        *end);
+
+static gboolean  parser_start                   (AxingParallelParser  *parser,
+                                                 GError              **error);
+static gboolean  parser_split                   (AxingParallelParser  *parser);
+static gboolean  parser_read                    (AxingParallelParser  *parser,
+                                                 gboolean              block,
+                                                 gboolean             *blocked,
+                                                 GError              **error);
+static void      parser_queue_ahead             (AxingParallelParser  *parser);
+static gboolean  parser_fall_back               (AxingParallelParser  *parser,
+                                                 GError              **error);
+static void      parser_map_position            (AxingParallelParser  *parser,
+                                                 gint64               *linenum,
+                                                 gint64               *colnum);
+
+static gsize     scan_step                      (const char           *data,
+                                                 gsize                 len,
+                                                 gsize                 pos,
+                                                 Scanner              *scanner,
+                                                 int                  *depth,
+                                                 gboolean             *stag);
+static void      scan_piece                     (Piece                *piece,
+                                                 gsize                 from);
+static void      scan_piece_func                (gpointer              data,
+                                                 gpointer              user_data);
+static void      chunk_parse_func               (gpointer              data,
+                                                 gpointer              user_data);
+
+G_DEFINE_TYPE_WITH_CODE (AxingParallelParser, axing_parallel_parser, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (AXING_TYPE_READER,
+                                                axing_parallel_parser_init_reader))
+
+static void
+axing_parallel_parser_init (AxingParallelParser *parser)
+{
+    g_mutex_init (&(parser->mutex));
+    g_cond_init (&(parser->cond));
+    parser->chunks = g_array_new (FALSE, TRUE, sizeof (Chunk));
+}
+
+static void
+axing_parallel_parser_class_init (AxingParallelParserClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+    object_class->dispose = axing_parallel_parser_dispose;
+    object_class->finalize = axing_parallel_parser_finalize;
+}
+
+static void
+axing_parallel_parser_init_reader (AxingReaderInterface *iface)
+{
+    iface->read = reader_read;
+    iface->read_async = reader_read_async;
+    iface->read_finish = reader_read_finish;
+
+    iface->get_node_type = reader_get_node_type;
+
+    iface->get_qname = reader_get_qname;
+    iface->get_localname = reader_get_localname;
+    iface->get_prefix = reader_get_prefix;
+    iface->get_namespace = reader_get_namespace;
+    iface->get_nsname = reader_get_nsname;
+
+    iface->get_content = reader_get_content;
+    iface->get_linenum = reader_get_linenum;
+    iface->get_colnum = reader_get_colnum;
+
+    iface->get_attrs = reader_get_attrs;
+    iface->get_attr_localname = reader_get_attr_localname;
+    iface->get_attr_prefix = reader_get_attr_prefix;
+    iface->get_attr_namespace = reader_get_attr_namespace;
+    iface->get_attr_nsname = reader_get_attr_nsname;
+    iface->get_attr_value = reader_get_attr_value;
+    iface->get_attr_linenum = reader_get_attr_linenum;
+    iface->get_attr_colnum = reader_get_attr_colnum;
+    iface->get_offsets = reader_get_offsets;
+    iface->get_attr_offsets = reader_get_attr_offsets;
+}
+
+static void
+axing_parallel_parser_dispose (GObject *object)
+{
+    AxingParallelParser *parser = AXING_PARALLEL_PARSER (object);
+
+    /* Drop queued chunks and wait for running ones */
+    if (parser->pool) {
+        g_thread_pool_free (parser->pool, TRUE, TRUE);
+        parser->pool = NULL;
+    }
+
+    g_clear_object (&(parser->current));
+    g_clear_object (&(parser->resource));
+    g_clear_object (&(parser->resolver));
+
+    G_OBJECT_CLASS (axing_parallel_parser_parent_class)->dispose (object);
+}
+
+static void
+axing_parallel_parser_finalize (GObject *object)
+{
+    AxingParallelParser *parser = AXING_PARALLEL_PARSER (object);
+    guint i;
+
+    for (i = 0; i < parser->chunks->len; i++) {
+        Chunk *chunk = &g_array_index (parser->chunks, Chunk, i);
+        if (chunk->events)
+            g_bytes_unref (chunk->events);
+        g_clear_error (&(chunk->error));
+    }
+    g_array_free (parser->chunks, TRUE);
+
+    if (parser->bytes)
+        g_bytes_unref (parser->bytes);
+    g_free (parser->root_end);
+    g_clear_error (&(parser->error));
+    g_mutex_clear (&(parser->mutex));
+    g_cond_clear (&(parser->cond));
+
+    G_OBJECT_CLASS (axing_parallel_parser_parent_class)->finalize (object);
+}
+
+/* n_threads of 0 means one for each processor */
+AxingParallelParser *
+axing_parallel_parser_new (AxingResource *resource,
+                           AxingResolver *resolver,
+                           guint          n_threads)
+{
+    AxingParallelParser *parser;
+
+    g_return_val_if_fail (AXING_IS_RESOURCE (resource), NULL);
+
+    parser = g_object_new (AXING_TYPE_PARALLEL_PARSER, NULL);
+    parser->resource = g_object_ref (resource);
+    /* Get the default here so the threads don't race to make it */
+    parser->resolver = resolver ? g_object_ref (resolver) : axing_resolver_get_default ();
+    parser->n_threads = n_threads ? n_threads : g_get_num_processors ();
+    return parser;
+}
+
+static gboolean
+parser_start (AxingParallelParser  *parser,
+              GError              **error)
+{
+    GFile *file = axing_resource_get_file (parser->resource);
+    char *path = file ? g_file_get_path (file) : NULL;
+    Chunk *chunk;
+    guint i;
+
+    if (path != NULL && axing_resource_get_input_stream (parser->resource) == NULL) {
+        GMappedFile *mapped = g_mapped_file_new (path, FALSE, error);
+        g_free (path);
+        if (mapped == NULL)
+            return FALSE;
+        parser->bytes = g_mapped_file_get_bytes (mapped);
+        g_mapped_file_unref (mapped);
+    }
+    else {
+        GInputStream *stream;
+        GOutputStream *out;
+        g_free (path);
+        stream = axing_resource_read (parser->resource, NULL, error);
+        if (stream == NULL)
+            return FALSE;
+        out = g_memory_output_stream_new_resizable ();
+        if (g_output_stream_splice (out, stream,
+                                    G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
+                                    G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
+                                    NULL, error) >= 0)
+            parser->bytes = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (out));
+        g_object_unref (out);
+        if (parser->bytes == NULL)
+            return FALSE;
+    }
+    parser->data = g_bytes_get_data (parser->bytes, &(parser->len));
+
+    if (!parser_split (parser)) {
+        /* One chunk for the whole thing */
+        g_array_set_size (parser->chunks, 1);
+        chunk = &g_array_index (parser->chunks, Chunk, 0);
+        chunk->start = 0;
+        chunk->end = parser->len;
+    }
+
+    for (i = 0; i < parser->chunks->len; i++)
+        g_array_index (parser->chunks, Chunk, i).index = i;
+
+    parser->cur_chunk = 0;
+    if (parser->chunks->len == 1) {
+        /* Nothing to replay, so just parse it here */
+        return parser_fall_back (parser, error);
+    }
+
+    parser->pool = g_thread_pool_new (chunk_parse_func, parser, parser->n_threads, FALSE, NULL);
+    parser_queue_ahead (parser);
+    return TRUE;
+}
+
+/* Parses the whole document here from the start, skipping the events
+   we've already returned.
+ */
+static gboolean
+parser_fall_back (AxingParallelParser  *parser,
+                  GError              **error)
+{
+    GInputStream *stream;
+    AxingResource *resource;
+    GError *readerror = NULL;
+    guint64 i;
+    guint c;
+
+    /* Queued chunks are dropped, running ones are waited for */
+    if (parser->pool) {
+        g_thread_pool_free (parser->pool, TRUE, TRUE);
+        parser->pool = NULL;
+    }
+    for (c = 0; c < parser->chunks->len; c++) {
+        Chunk *chunk = &g_array_index (parser->chunks, Chunk, c);
+        g_clear_pointer (&(chunk->events), g_bytes_unref);
+    }
+    g_clear_object (&(parser->current));
+
+    stream = g_memory_input_stream_new_from_bytes (parser->bytes);
+    resource = axing_resource_new (axing_resource_get_file (parser->resource), stream);
+    parser->current = AXING_READER (axing_xml_parser_new (resource, parser->resolver));
+    parser->sequential = TRUE;
+    g_object_unref (resource);
+    g_object_unref (stream);
+
+    for (i = 0; i < parser->n_read; i++) {
+        if (!axing_reader_read (parser->current, &readerror)) {
+            /* The parser owns the error it reports */
+            if (readerror != NULL)
+                g_propagate_error (error, g_error_copy (readerror));
+            else
+                g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                             "Document ended before the events already read");
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/* Fills in chunks and returns TRUE if the document is worth splitting */
+static gboolean
+parser_split (AxingParallelParser *parser)
+{
+    const char *data = parser->data;
+    gsize len = parser->len;
+    Scanner scanner = { SCAN_TEXT, 0, 0, FALSE };
+    gsize pos = 0, rootpos = 0, linestart = 0, newlines = 0;
+    int depth = 0;
+    guint n_pieces, i;
+    Piece *pieces;
+    GThreadPool *scanpool;
+    gboolean seenroot = FALSE, ret = FALSE;
+
+    if (parser->n_threads < 2 || len < 2 * MIN_CHUNK_SIZE)
+        return FALSE;
+
+    /* The scanner only works on encodings where '<' is a single byte */
+    if ((guchar) data[0] == 0xFE || (guchar) data[0] == 0xFF || data[0] == '\0' || data[1] == '\0')
+        return FALSE;
+
+    /* Scan the prolog to the end of the root start tag */
+    while (pos < len) {
+        gboolean stag = FALSE;
+        if (data[pos] == '\n') {
+            newlines++;
+            linestart = pos + 1;
+        }
+        pos = scan_step (data, len, pos, &scanner, &depth, &stag);
+        if (stag) {
+            rootpos = pos - 1;
+            seenroot = TRUE;
+        }
+        if (seenroot && scanner.state == SCAN_TEXT)
+            break;
+    }
+    /* No root element, or an empty one */
+    if (!seenroot || scanner.state != SCAN_TEXT || depth != 1)
+        return FALSE;
+    parser->body_start = pos;
+    parser->body_linenum = 1 + newlines;
+    parser->body_colnum = 1 + g_utf8_strlen (data + linestart, pos - linestart);
+
+    {
+        gsize namelen = 0;
+        while (rootpos + 1 + namelen < pos &&
+               !g_ascii_isspace (data[rootpos + 1 + namelen]) &&
+               data[rootpos + 1 + namelen] != '/' &&
+               data[rootpos + 1 + namelen] != '>')
+            namelen++;
+        parser->root_end = g_strdup_printf ("</%.*s>", (int) namelen, data + rootpos + 1);
+    }
+
+    /* Cut the body into pieces at '<' and scan them in parallel. Pieces
+       are CHUNK_SIZE, or smaller if that keeps the threads busy.
+     */
+    n_pieces = MAX ((len - pos) / CHUNK_SIZE,
+                    MIN (parser->n_threads, (len - pos) / MIN_CHUNK_SIZE));
+    if (n_pieces < 2)
+        return FALSE;
+    pieces = g_new0 (Piece, n_pieces);
+    for (i = 0; i < n_pieces; i++) {
+        gsize start = pos + i * ((len - pos) / n_pieces);
+        if (i > 0) {
+            const char *lt = memchr (data + start, '<', len - start);
+            start = lt ? (gsize) (lt - data) : len;
+            pieces[i - 1].end = start;
+        }
+        pieces[i].start = start;
+        pieces[i].data = data;
+        pieces[i].len = len;
+        pieces[i].firsts = g_array_new (FALSE, FALSE, sizeof (FirstTag));
+    }
+    pieces[n_pieces - 1].end = len;
+
+    scanpool = g_thread_pool_new (scan_piece_func, NULL, parser->n_threads, FALSE, NULL);
+    for (i = 1; i < n_pieces; i++)
+        g_thread_pool_push (scanpool, &(pieces[i]), NULL);
+    scan_piece (&(pieces[0]), pieces[0].start);
+    g_thread_pool_free (scanpool, FALSE, TRUE);
+
+    /* Check the guesses in order and fix the wrong ones. Then the first
+       child of the root in each piece starts a chunk.
+     */
+    depth = 1;
+    for (i = 0; i < n_pieces; i++) {
+        Piece *piece = &(pieces[i]);
+        if (i > 0) {
+            Piece *prev = &(pieces[i - 1]);
+            if (prev->scanner.state != SCAN_TEXT || prev->stop != piece->start) {
+                piece->scanner = prev->scanner;
+                scan_piece (piece, prev->stop);
+            }
+            newlines += prev->newlines;
+        }
+        if (i > 0 && depth >= 1 && (guint) depth - 1 < piece->firsts->len) {
+            FirstTag *first = &g_array_index (piece->firsts, FirstTag, depth - 1);
+            if (first->pos != G_MAXSIZE) {
+                Chunk chunk = { 0, };
+                gsize lstart = first->pos;
+                while (lstart > 0 && data[lstart - 1] != '\n')
+                    lstart--;
+                chunk.start = first->pos;
+                chunk.linenum = 1 + newlines + first->newlines;
+                chunk.colnum = 1 + g_utf8_strlen (data + lstart, first->pos - lstart);
+                g_array_append_val (parser->chunks, chunk);
+            }
+        }
+        depth += piece->depth;
+    }
+
+    if (parser->chunks->len > 0) {
+        Chunk first = { 0, };
+        first.start = 0;
+        g_array_prepend_val (parser->chunks, first);
+        for (i = 0; i < parser->chunks->len; i++) {
+            Chunk *chunk = &g_array_index (parser->chunks, Chunk, i);
+            chunk->end = (i + 1 < parser->chunks->len) ?
+                g_array_index (parser->chunks, Chunk, i + 1).start : len;
+        }
+        ret = TRUE;
+    }
+
+    for (i = 0; i < n_pieces; i++)
+        g_array_free (pieces[i].firsts, TRUE);
+    g_free (pieces);
+    return ret;
+}
+
+/* Moves past one character or markup opener, tracking depth. Sets stag if
+   a start tag begins at pos.
+ */
+static gsize
+scan_step (const char *data,
+           gsize       len,
+           gsize       pos,
+           Scanner    *scanner,
+           int        *depth,
+           gboolean   *stag)
+{
+    char c = data[pos];
+    switch (scanner->state) {
+    case SCAN_TEXT:
+        if (c != '<')
+            break;
+        if (pos + 1 < len && data[pos + 1] == '/') {
+            scanner->state = SCAN_ETAG;
+            (*depth)--;
+            return pos + 2;
+        }
+        if (pos + 1 < len && data[pos + 1] == '?') {
+            scanner->state = SCAN_PI;
+            scanner->flag = FALSE;
+            return pos + 2;
+        }
+        if (len - pos >= 4 && memcmp (data + pos, "<!--", 4) == 0) {
+            scanner->state = SCAN_COMMENT;
+            scanner->count = 0;
+            return pos + 4;
+        }
+        if (len - pos >= 9 && memcmp (data + pos, "<![CDATA[", 9) == 0) {
+            scanner->state = SCAN_CDATA;
+            scanner->count = 0;
+            return pos + 9;
+        }
+        if (pos + 1 < len && data[pos + 1] == '!') {
+            scanner->state = SCAN_DECL;
+            scanner->quote = 0;
+            scanner->count = 0;
+            return pos + 2;
+        }
+        scanner->state = SCAN_STAG;
+        scanner->quote = 0;
+        scanner->flag = FALSE;
+        *stag = TRUE;
+        break;
+    case SCAN_STAG:
+        if (scanner->quote) {
+            if (c == scanner->quote)
+                scanner->quote = 0;
+        }
+        else if (c == '"' || c == '\'') {
+            scanner->quote = c;
+            scanner->flag = FALSE;
+        }
+        else if (c == '>') {
+            if (!scanner->flag)
+                (*depth)++;
+            scanner->state = SCAN_TEXT;
+        }
+        else if (!g_ascii_isspace (c)) {
+            scanner->flag = (c == '/');
+        }
+        break;
+    case SCAN_ETAG:
+        if (c == '>')
+            scanner->state = SCAN_TEXT;
+        break;
+    case SCAN_COMMENT:
+    case SCAN_CDATA:
+        if (c == (scanner->state == SCAN_COMMENT ? '-' : ']')) {
+            scanner->count++;
+        }
+        else {
+            if (c == '>' && scanner->count >= 2)
+                scanner->state = SCAN_TEXT;
+            scanner->count = 0;
+        }
+        break;
+    case SCAN_PI:
+        if (c == '>' && scanner->flag)
+            scanner->state = SCAN_TEXT;
+        scanner->flag = (c == '?');
+        break;
+    case SCAN_DECL:
+        if (scanner->quote) {
+            if (c == scanner->quote)
+                scanner->quote = 0;
+        }
+        else if (c == '"' || c == '\'')
+            scanner->quote = c;
+        else if (c == '[')
+            scanner->count++;
+        else if (c == ']')
+            scanner->count--;
+        else if (c == '>' && scanner->count == 0)
+            scanner->state = SCAN_TEXT;
+        break;
+    }
+    return pos + 1;
+}
+
+static void
+scan_piece (Piece *piece,
+            gsize  from)
+{
+    gsize pos = from;
+    int depth = 0;
+    FirstTag unset = { G_MAXSIZE, 0 };
+
+    piece->newlines = 0;
+    g_array_set_size (piece->firsts, 0);
+
+    while (pos < piece->end) {
+        gboolean stag = FALSE;
+        if (piece->data[pos] == '\n')
+            piece->newlines++;
+        pos = scan_step (piece->data, piece->len, pos, &(piece->scanner), &depth, &stag);
+        if (stag && depth <= 0) {
+            while (piece->firsts->len <= (guint) -depth)
+                g_array_append_val (piece->firsts, unset);
+            if (g_array_index (piece->firsts, FirstTag, -depth).pos == G_MAXSIZE) {
+                FirstTag *first = &g_array_index (piece->firsts, FirstTag, -depth);
+                first->pos = pos - 1;
+                first->newlines = piece->newlines;
+            }
+        }
+    }
+    piece->stop = MAX (pos, from);
+    piece->depth = depth;
+}
+
+static void
+scan_piece_func (gpointer data,
+                 gpointer user_data)
+{
+    Piece *piece = data;
+    scan_piece (piece, piece->start);
+}
+
+/* Queues chunks in order while there's room under MAX_AHEAD. The chunk
+   being replayed always gets queued, however big it is.
+ */
+static void
+parser_queue_ahead (AxingParallelParser *parser)
+{
+    while (parser->next_queue < parser->chunks->len) {
+        Chunk *chunk = &g_array_index (parser->chunks, Chunk, parser->next_queue);
+        gsize size = chunk->end - chunk->start;
+        if (parser->next_queue > parser->cur_chunk && parser->ahead + size > MAX_AHEAD)
+            break;
+        parser->ahead += size;
+        parser->next_queue++;
+        g_thread_pool_push (parser->pool, chunk, NULL);
+    }
+}
+
+static void
+chunk_parse_func (gpointer data,
+                  gpointer user_data)
+{
+    Chunk *chunk = data;
+    AxingParallelParser *parser = user_data;
+    gboolean last = (chunk->index + 1 == parser->chunks->len);
+    GBytes *events = NULL;
+    GInputStream *stream;
+    GOutputStream *out;
+    AxingResource *resource;
+    AxingXmlParser *xmlparser;
+    AxingEventWriter *writer;
+    GError *error = NULL;
+
+    /* Slices of the document, so nothing's copied */
+    stream = g_memory_input_stream_new ();
+    if (chunk->index > 0) {
+        GBytes *prolog = g_bytes_new_from_bytes (parser->bytes, 0, parser->body_start);
+        g_memory_input_stream_add_bytes (G_MEMORY_INPUT_STREAM (stream), prolog);
+        g_bytes_unref (prolog);
+    }
+    {
+        GBytes *body = g_bytes_new_from_bytes (parser->bytes, chunk->start, chunk->end - chunk->start);
+        g_memory_input_stream_add_bytes (G_MEMORY_INPUT_STREAM (stream), body);
+        g_bytes_unref (body);
+    }
+    if (!last)
+        g_memory_input_stream_add_data (G_MEMORY_INPUT_STREAM (stream),
+                                        parser->root_end, strlen (parser->root_end), NULL);
+
+    resource = axing_resource_new (axing_resource_get_file (parser->resource), stream);
+    xmlparser = axing_xml_parser_new (resource, parser->resolver);
+
+    out = g_memory_output_stream_new_resizable ();
+    writer = axing_event_writer_new (out);
+    if (axing_event_writer_write_all (writer, AXING_READER (xmlparser), &error) &&
+        g_output_stream_close (out, NULL, &error))
+        events = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (out));
+
+    g_object_unref (writer);
+    g_object_unref (out);
+    g_object_unref (xmlparser);
+    g_object_unref (resource);
+    g_object_unref (stream);
+
+    g_mutex_lock (&(parser->mutex));
+    chunk->events = events;
+    chunk->error = error;
+    chunk->done = TRUE;
+    g_cond_broadcast (&(parser->cond));
+    g_mutex_unlock (&(parser->mutex));
+}
+
+static gboolean
+reader_read (AxingReader  *reader,
+             GError      **error)
+{
+    return parser_read (AXING_PARALLEL_PARSER (reader), TRUE, NULL, error);
+}
+
+/* Without block, this sets blocked and returns FALSE instead of starting
+   or waiting for a chunk.
+ */
+static gboolean
+parser_read (AxingParallelParser  *parser,
+             gboolean              block,
+             gboolean             *blocked,
+             GError              **error)
+{
+    GError *readerror = NULL;
+
+    if (parser->error)
+        return FALSE;
+
+    if (!parser->started) {
+        if (!block) {
+            *blocked = TRUE;
+            return FALSE;
+        }
+        parser->started = TRUE;
+        if (!parser_start (parser, &(parser->error)))
+            goto error;
+    }
+
+    if (parser->sequential) {
+        if (axing_reader_read (parser->current, &readerror)) {
+            parser->n_read++;
+            return TRUE;
+        }
+        if (readerror != NULL) {
+            parser->error = g_error_copy (readerror);
+            goto error;
+        }
+        return FALSE;
+    }
+
+    while (parser->cur_chunk < parser->chunks->len) {
+        Chunk *chunk = &g_array_index (parser->chunks, Chunk, parser->cur_chunk);
+        AxingNodeType type;
+
+        if (parser->current == NULL) {
+            gboolean done;
+            g_mutex_lock (&(parser->mutex));
+            if (block) {
+                while (!chunk->done)
+                    g_cond_wait (&(parser->cond), &(parser->mutex));
+            }
+            done = chunk->done;
+            g_mutex_unlock (&(parser->mutex));
+            if (!done) {
+                *blocked = TRUE;
+                return FALSE;
+            }
+            if (chunk->error) {
+                if (!block) {
+                    *blocked = TRUE;
+                    return FALSE;
+                }
+                if (!parser_fall_back (parser, &(parser->error)))
+                    goto error;
+                return parser_read (parser, block, blocked, error);
+            }
+            parser->current = AXING_READER (axing_event_reader_new (chunk->events, &(parser->error)));
+            if (parser->current == NULL)
+                goto error;
+            parser->in_wrapper = (parser->cur_chunk > 0);
+            parser->depth = (parser->cur_chunk > 0) ? 1 : 0;
+        }
+
+        if (!axing_reader_read (parser->current, &readerror)) {
+            if (readerror != NULL) {
+                parser->error = g_error_copy (readerror);
+                goto error;
+            }
+            g_clear_object (&(parser->current));
+            g_clear_pointer (&(chunk->events), g_bytes_unref);
+            parser->ahead -= chunk->end - chunk->start;
+            parser->cur_chunk++;
+            parser_queue_ahead (parser);
+            continue;
+        }
+
+        /* Skip everything up to the copy of the root start tag, and the
+           root end tag we put after all but the last chunk.
+         */
+        type = axing_reader_get_node_type (parser->current);
+        if (parser->in_wrapper) {
+            if (type == AXING_NODE_TYPE_ELEMENT)
+                parser->in_wrapper = FALSE;
+            continue;
+        }
+        if (type == AXING_NODE_TYPE_ELEMENT)
+            parser->depth++;
+        else if (type == AXING_NODE_TYPE_END_ELEMENT)
+            parser->depth--;
+        if (type == AXING_NODE_TYPE_END_ELEMENT && parser->depth == 0 &&
+            parser->cur_chunk + 1 < parser->chunks->len)
+            continue;
+        parser->n_read++;
+        return TRUE;
+    }
+
+    return FALSE;
+
+ error:
+    if (error != NULL)
+        *error = g_error_copy (parser->error);
+    return FALSE;
+}
+
+/* Replaying recorded events doesn't block, so those are returned right
+   away. Starting, waiting for a chunk, and parsing the whole document
+   after an error happen on a worker thread, and so does every read once
+   we're parsing the whole document.
+ */
+static void
+reader_read_async (AxingReader         *reader,
+                   GCancellable        *cancellable,
+                   GAsyncReadyCallback  callback,
+                   gpointer             user_data)
+{
+    AxingParallelParser *parser = AXING_PARALLEL_PARSER (reader);
+    GTask *task = g_task_new (reader, cancellable, callback, user_data);
+    GError *error = NULL;
+    gboolean blocked = FALSE;
+
+    if (parser->sequential && parser->error == NULL)
+        g_task_run_in_thread (task, reader_read_thread);
+    else if (parser_read (parser, FALSE, &blocked, &error))
+        g_task_return_boolean (task, TRUE);
+    else if (blocked)
+        g_task_run_in_thread (task, reader_read_thread);
+    else if (error != NULL)
+        g_task_return_error (task, error);
+    else
+        g_task_return_boolean (task, FALSE);
+    g_object_unref (task);
+}
+
+static void
+reader_read_thread (GTask        *task,
+                    gpointer      source,
+                    gpointer      task_data,
+                    GCancellable *cancellable)
+{
+    GError *error = NULL;
+    if (parser_read (AXING_PARALLEL_PARSER (source), TRUE, NULL, &error))
+        g_task_return_boolean (task, TRUE);
+    else if (error != NULL)
+        g_task_return_error (task, error);
+    else
+        g_task_return_boolean (task, FALSE);
+}
+
+static gboolean
+reader_read_finish (AxingReader   *reader,
+                    GAsyncResult  *result,
+                    GError       **error)
+{
+    g_return_val_if_fail (g_task_is_valid (result, reader), FALSE);
+    return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+/* Chunks after the first are parsed with the prolog in front, so the
+   first line of the chunk is on the line where the body starts.
+ */
+static void
+parser_map_position (AxingParallelParser *parser,
+                     gint64              *linenum,
+                     gint64              *colnum)
+{
+    Chunk *chunk;
+    if (parser->sequential || parser->cur_chunk == 0)
+        return;
+    chunk = &g_array_index (parser->chunks, Chunk, parser->cur_chunk);
+    if (*linenum == parser->body_linenum)
+        *colnum = *colnum - parser->body_colnum + chunk->colnum;
+    *linenum = *linenum - parser->body_linenum + chunk->linenum;
+}
+
+#define CURRENT(reader) (AXING_PARALLEL_PARSER (reader)->current)
+
+static AxingNodeType
+reader_get_node_type (AxingReader *reader)
+{
+    AxingParallelParser *parser = AXING_PARALLEL_PARSER (reader);
+    if (parser->error)
+        return AXING_NODE_TYPE_ERROR;
+    if (parser->current == NULL)
+        return AXING_NODE_TYPE_NONE;
+    return axing_reader_get_node_type (parser->current);
+}
+
+static const char *
+reader_get_qname (AxingReader *reader)
+{
+    g_return_val_if_fail (CURRENT (reader) != NULL, NULL);
+    return axing_reader_get_qname (CURRENT (reader));
+}
+
+static const char *
+reader_get_prefix (AxingReader *reader)
+{
+    g_return_val_if_fail (CURRENT (reader) != NULL, NULL);
+    return axing_reader_get_prefix (CURRENT (reader));
+}
+
+static const char *
+reader_get_localname (AxingReader *reader)
+{
+    g_return_val_if_fail (CURRENT (reader) != NULL, NULL);
+    return axing_reader_get_localname (CURRENT (reader));
+}
+
+static const char *
+reader_get_namespace (AxingReader *reader)
+{
+    g_return_val_if_fail (CURRENT (reader) != NULL, NULL);
+    return axing_reader_get_namespace (CURRENT (reader));
+}
+
+static const char *
+reader_get_nsname (AxingReader *reader)
+{
+    g_return_val_if_fail (CURRENT (reader) != NULL, NULL);
+    return axing_reader_get_nsname (CURRENT (reader));
+}
+
+static const char *
+reader_get_content (AxingReader *reader)
+{
+    g_return_val_if_fail (CURRENT (reader) != NULL, NULL);
+    return axing_reader_get_content (CURRENT (reader));
+}
+
+static gint64
+reader_get_linenum (AxingReader *reader)
+{
+    gint64 linenum, colnum;
+    g_return_val_if_fail (CURRENT (reader) != NULL, 0);
+    linenum = axing_reader_get_linenum (CURRENT (reader));
+    colnum = axing_reader_get_colnum (CURRENT (reader));
+    parser_map_position (AXING_PARALLEL_PARSER (reader), &linenum, &colnum);
+    return linenum;
+}
+
+static gint64
+reader_get_colnum (AxingReader *reader)
+{
+    gint64 linenum, colnum;
+    g_return_val_if_fail (CURRENT (reader) != NULL, 0);
+    linenum = axing_reader_get_linenum (CURRENT (reader));
+    colnum = axing_reader_get_colnum (CURRENT (reader));
+    parser_map_position (AXING_PARALLEL_PARSER (reader), &linenum, &colnum);
+    return colnum;
+}
+
+static const char * const *
+reader_get_attrs (AxingReader *reader)
+{
+    g_return_val_if_fail (CURRENT (reader) != NULL, NULL);
+    return axing_reader_get_attrs (CURRENT (reader));
+}
+
+static const char *
+reader_get_attr_localname (AxingReader *reader, const char *qname)
+{
+    g_return_val_if_fail (CURRENT (reader) != NULL, NULL);
+    return axing_reader_get_attr_localname (CURRENT (reader), qname);
+}
+
+static const char *
+reader_get_attr_prefix (AxingReader *reader, const char *qname)
+{
+    g_return_val_if_fail (CURRENT (reader) != NULL, NULL);
+    return axing_reader_get_attr_prefix (CURRENT (reader), qname);
+}
+
+static const char *
+reader_get_attr_namespace (AxingReader *reader, const char *qname)
+{
+    g_return_val_if_fail (CURRENT (reader) != NULL, NULL);
+    return axing_reader_get_attr_namespace (CURRENT (reader), qname);
+}
+
+static const char *
+reader_get_attr_nsname (AxingReader *reader, const char *qname)
+{
+    g_return_val_if_fail (CURRENT (reader) != NULL, NULL);
+    return axing_reader_get_attr_nsname (CURRENT (reader), qname);
+}
+
+static const char *
+reader_get_attr_value (AxingReader *reader, const char *qname)
+{
+    g_return_val_if_fail (CURRENT (reader) != NULL, NULL);
+    return axing_reader_get_attr_value (CURRENT (reader), qname);
+}
+
+static gint64
+reader_get_attr_linenum (AxingReader *reader, const char *qname)
+{
+    gint64 linenum, colnum;
+    g_return_val_if_fail (CURRENT (reader) != NULL, 0);
+    linenum = axing_reader_get_attr_linenum (CURRENT (reader), qname);
+    colnum = axing_reader_get_attr_colnum (CURRENT (reader), qname);
+    parser_map_position (AXING_PARALLEL_PARSER (reader), &linenum, &colnum);
+    return linenum;
+}
+
+static gint64
+reader_get_attr_colnum (AxingReader *reader, const char *qname)
+{
+    gint64 linenum, colnum;
+    g_return_val_if_fail (CURRENT (reader) != NULL, 0);
+    linenum = axing_reader_get_attr_linenum (CURRENT (reader), qname);
+    colnum = axing_reader_get_attr_colnum (CURRENT (reader), qname);
+    parser_map_position (AXING_PARALLEL_PARSER (reader), &linenum, &colnum);
+    return colnum;
+}
+
+/* Recorded events don't keep offsets, so we only know them when we're
+   parsing the whole document.
+ */
+static gboolean
+reader_get_offsets (AxingReader *reader,
+                    goffset     *start,
+                    goffset     *end)
+{
+    AxingParallelParser *parser = AXING_PARALLEL_PARSER (reader);
+    if (!parser->sequential || parser->current == NULL)
+        return FALSE;
+    return axing_reader_get_offsets (parser->current, start, end);
+}
+
+static gboolean
+reader_get_attr_offsets (AxingReader *reader,
+                         const char  *qname,
+                         goffset     *start,
+                         goffset     *end)
+{
+    AxingParallelParser *parser = AXING_PARALLEL_PARSER (reader);
+    if (!parser->sequential || parser->current == NULL)
+        return FALSE;
+    return axing_reader_get_attr_offsets (parser->current, qname, start, end);
+}
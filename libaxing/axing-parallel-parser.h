@@ -0,0 +1,44 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+#ifndef __AXING_PARALLEL_PARSER_H__
+#define __AXING_PARALLEL_PARSER_H__
+
+#include <glib-object.h>
+#include <gio/gio.h>
+#include "axing-reader.h"
+#include "axing-resolver.h"
+#include "axing-resource.h"
+
+G_BEGIN_DECLS
+
+#define AXING_TYPE_PARALLEL_PARSER (axing_parallel_parser_get_type ())
+G_DECLARE_FINAL_TYPE (AxingParallelParser, axing_parallel_parser, AXING, PARALLEL_PARSER, GObject)
+
+AxingParallelParser *  axing_parallel_parser_new      (AxingResource        *resource,
+                                                       AxingResolver        *resolver,
+                                                       guint                 n_threads);
+
+G_END_DECLS
+
+#endif /* __AXING_PARALLEL_PARSER_H__ */
@@ -0,0 +1,517 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+/* Each cache file is named for a SHA-256 of the resource URI and content.
+   It holds the dependencies, then the event stream from AxingEventWriter.
+   Numbers are 32-bit little-endian, and strings are a length, the bytes,
+   and a NUL:
+
+     "AXPC" version n_deps
+     (uri sha256) for each dependency
+     event stream
+
+   Dependencies are everything the parser got through the resolver, like
+   external entities. An entry is only used if each dependency still has
+   the same hash. Dependencies are checked by URI, so an entry can go
+   stale if the resolver starts mapping a reference somewhere else. With
+   external DTD loading on, the parser skips the shared DTD cache, so the
+   DTD and its parameter entities are read through the resolver and end
+   up in the dependencies too.
+ */
+
+#include <string.h>
+
+#include "axing-event-reader.h"
+#include "axing-event-writer.h"
+#include "axing-parse-cache.h"
+#include "axing-private.h"
+#include "axing-xml-parser.h"
+
+#define PARSE_CACHE_MAGIC   "AXPC"
+#define PARSE_CACHE_VERSION 2
+
+struct _AxingParseCache {
+    GObject parent;
+
+    GFile *directory;
+    gboolean load_dtd;
+};
+
+G_DEFINE_TYPE (AxingParseCache, axing_parse_cache, G_TYPE_OBJECT);
+
+static void      axing_parse_cache_init         (AxingParseCache      *cache);
+static void      axing_parse_cache_class_init   (AxingParseCacheClass *klass);
+static void      axing_parse_cache_dispose      (GObject              *object);
+
+static GBytes *  resource_load_bytes            (AxingResource        *resource,
+                                                 GCancellable         *cancellable,
+                                                 GError              **error);
+static GBytes *  cache_entry_check              (GBytes               *entry,
+                                                 GCancellable         *cancellable);
+static GBytes *  cache_parse                    (AxingParseCache      *cache,
+                                                 AxingResource        *resource,
+                                                 GBytes               *content,
+                                                 AxingResolver        *resolver,
+                                                 GFile                *entryfile,
+                                                 GCancellable         *cancellable,
+                                                 GError              **error);
+
+
+/* Wraps the real resolver to read everything it resolves and remember a
+   hash of it. The parser gets the bytes that were hashed, so the cache
+   entry matches what was actually parsed.
+ */
+#define AXING_TYPE_RECORDING_RESOLVER (axing_recording_resolver_get_type ())
+G_DECLARE_FINAL_TYPE (AxingRecordingResolver, axing_recording_resolver, AXING, RECORDING_RESOLVER, AxingResolver)
+
+struct _AxingRecordingResolver {
+    AxingResolver parent;
+
+    AxingResolver *resolver;
+    GPtrArray     *deps; /* URI and hash pairs */
+};
+
+G_DEFINE_TYPE (AxingRecordingResolver, axing_recording_resolver, AXING_TYPE_RESOLVER);
+
+static AxingResource * recording_resolver_resolve        (AxingResolver        *resolver,
+                                                          AxingResource        *base,
+                                                          const char           *xml_base,
+                                                          const char           *link,
+                                                          const char           *pubid,
+                                                          AxingResolverHint     hint,
+                                                          GCancellable         *cancellable,
+                                                          GError              **error);
+static void            recording_resolver_resolve_async  (AxingResolver        *resolver,
+                                                          AxingResource        *base,
+                                                          const char           *xml_base,
+                                                          const char           *link,
+                                                          const char           *pubid,
+                                                          AxingResolverHint     hint,
+                                                          GCancellable         *cancellable,
+                                                          GAsyncReadyCallback   callback,
+                                                          gpointer              user_data);
+static AxingResource * recording_resolver_resolve_finish (AxingResolver        *resolver,
+                                                          GAsyncResult         *result,
+                                                          GError              **error);
+
+static void
+axing_recording_resolver_init (AxingRecordingResolver *resolver)
+{
+    resolver->deps = g_ptr_array_new_with_free_func (g_free);
+}
+
+static void
+axing_recording_resolver_finalize (GObject *object)
+{
+    AxingRecordingResolver *resolver = AXING_RECORDING_RESOLVER (object);
+    g_clear_object (&(resolver->resolver));
+    g_ptr_array_free (resolver->deps, TRUE);
+    G_OBJECT_CLASS (axing_recording_resolver_parent_class)->finalize (object);
+}
+
+static void
+axing_recording_resolver_class_init (AxingRecordingResolverClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS (klass);
+    AxingResolverClass *resolver_class = AXING_RESOLVER_CLASS (klass);
+
+    resolver_class->resolve = recording_resolver_resolve;
+    resolver_class->resolve_async = recording_resolver_resolve_async;
+    resolver_class->resolve_finish = recording_resolver_resolve_finish;
+
+    object_class->finalize = axing_recording_resolver_finalize;
+}
+
+static AxingResource *
+recording_resolver_resolve (AxingResolver     *resolver,
+                            AxingResource     *base,
+                            const char        *xml_base,
+                            const char        *link,
+                            const char        *pubid,
+                            AxingResolverHint  hint,
+                            GCancellable      *cancellable,
+                            GError           **error)
+{
+    AxingRecordingResolver *recorder = AXING_RECORDING_RESOLVER (resolver);
+    AxingResource *resolved, *ret;
+    GInputStream *stream;
+    GBytes *bytes;
+    GFile *file;
+
+    resolved = axing_resolver_resolve (recorder->resolver, base, xml_base, link, pubid,
+                                       hint, cancellable, error);
+    if (resolved == NULL)
+        return NULL;
+
+    bytes = resource_load_bytes (resolved, cancellable, error);
+    if (bytes == NULL) {
+        g_object_unref (resolved);
+        return NULL;
+    }
+
+    file = axing_resource_get_file (resolved);
+    g_ptr_array_add (recorder->deps, g_file_get_uri (file));
+    g_ptr_array_add (recorder->deps, g_compute_checksum_for_bytes (G_CHECKSUM_SHA256, bytes));
+
+    stream = g_memory_input_stream_new_from_bytes (bytes);
+    ret = axing_resource_new (file, stream);
+    g_object_unref (stream);
+    g_bytes_unref (bytes);
+    g_object_unref (resolved);
+    return ret;
+}
+
+/* The parser only resolves synchronously, so this just wraps the sync */
+static void
+recording_resolver_resolve_async (AxingResolver       *resolver,
+                                  AxingResource       *base,
+                                  const char          *xml_base,
+                                  const char          *link,
+                                  const char          *pubid,
+                                  AxingResolverHint    hint,
+                                  GCancellable        *cancellable,
+                                  GAsyncReadyCallback  callback,
+                                  gpointer             user_data)
+{
+    AxingResource *resource;
+    GError *error = NULL;
+    GTask *task;
+
+    task = g_task_new (G_OBJECT (resolver), cancellable, callback, user_data);
+    resource = recording_resolver_resolve (resolver, base, xml_base, link, pubid,
+                                           hint, cancellable, &error);
+    if (resource)
+        g_task_return_pointer (task, resource, g_object_unref);
+    else
+        g_task_return_error (task, error);
+    g_object_unref (task);
+}
+
+static AxingResource *
+recording_resolver_resolve_finish (AxingResolver *resolver,
+                                   GAsyncResult  *result,
+                                   GError       **error)
+{
+    return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+
+static void
+axing_parse_cache_init (AxingParseCache *cache)
+{
+}
+
+static void
+axing_parse_cache_class_init (AxingParseCacheClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+    object_class->dispose = axing_parse_cache_dispose;
+}
+
+static void
+axing_parse_cache_dispose (GObject *object)
+{
+    AxingParseCache *cache = AXING_PARSE_CACHE (object);
+    g_clear_object (&(cache->directory));
+    G_OBJECT_CLASS (axing_parse_cache_parent_class)->dispose (object);
+}
+
+/* Cache files go in directory, which is created when it's first needed */
+AxingParseCache *
+axing_parse_cache_new (GFile *directory)
+{
+    AxingParseCache *cache;
+    g_return_val_if_fail (G_IS_FILE (directory), NULL);
+    cache = g_object_new (AXING_TYPE_PARSE_CACHE, NULL);
+    cache->directory = g_object_ref (directory);
+    return cache;
+}
+
+/* Loads external DTDs, like axing_xml_parser_set_load_external_dtd.
+   Entries made with and without it are kept apart.
+ */
+void
+axing_parse_cache_set_load_external_dtd (AxingParseCache *cache,
+                                         gboolean         load)
+{
+    g_return_if_fail (AXING_IS_PARSE_CACHE (cache));
+    cache->load_dtd = load;
+}
+
+/* Returns a reader for the events of resource, replayed from the cache if
+   neither the resource nor anything it pulled in has changed. Otherwise
+   the resource is parsed with resolver and the result is stored. Either
+   way, parse errors are reported here, not by the reader.
+ */
+AxingReader *
+axing_parse_cache_read (AxingParseCache  *cache,
+                        AxingResource    *resource,
+                        AxingResolver    *resolver,
+                        GCancellable     *cancellable,
+                        GError          **error)
+{
+    AxingReader *reader = NULL;
+    GBytes *content = NULL, *entry = NULL, *events = NULL;
+    GFile *entryfile = NULL;
+    GChecksum *checksum;
+    char *uri, *name;
+    const guint8 *data;
+    gsize size;
+
+    g_return_val_if_fail (AXING_IS_PARSE_CACHE (cache), NULL);
+    g_return_val_if_fail (AXING_IS_RESOURCE (resource), NULL);
+
+    content = resource_load_bytes (resource, cancellable, error);
+    if (content == NULL)
+        goto error;
+
+    /* The URI is part of the key because relative references depend on it */
+    checksum = g_checksum_new (G_CHECKSUM_SHA256);
+    uri = g_file_get_uri (axing_resource_get_file (resource));
+    g_checksum_update (checksum, (const guchar *) uri, strlen (uri) + 1);
+    g_free (uri);
+    if (cache->load_dtd)
+        g_checksum_update (checksum, (const guchar *) "dtd", 4);
+    data = g_bytes_get_data (content, &size);
+    g_checksum_update (checksum, data, size);
+    name = g_strconcat (g_checksum_get_string (checksum), ".axpc", NULL);
+    g_checksum_free (checksum);
+    entryfile = g_file_get_child (cache->directory, name);
+    g_free (name);
+
+    entry = g_file_load_bytes (entryfile, cancellable, NULL, NULL);
+    if (entry != NULL)
+        events = cache_entry_check (entry, cancellable);
+
+    if (events == NULL) {
+        events = cache_parse (cache, resource, content, resolver, entryfile,
+                              cancellable, error);
+        if (events == NULL)
+            goto error;
+    }
+
+    reader = AXING_READER (axing_event_reader_new (events, error));
+
+ error:
+    if (content)
+        g_bytes_unref (content);
+    if (entry)
+        g_bytes_unref (entry);
+    if (events)
+        g_bytes_unref (events);
+    g_clear_object (&entryfile);
+    return reader;
+}
+
+static GBytes *
+resource_load_bytes (AxingResource  *resource,
+                     GCancellable   *cancellable,
+                     GError        **error)
+{
+    GInputStream *stream;
+    GOutputStream *out;
+    GBytes *bytes = NULL;
+
+    stream = axing_resource_read (resource, cancellable, error);
+    if (stream == NULL)
+        return NULL;
+
+    /* Already in memory if it came from the resource cache */
+    if (axing_resource_get_bytes (resource) != NULL)
+        return g_bytes_ref (axing_resource_get_bytes (resource));
+
+    out = g_memory_output_stream_new_resizable ();
+    if (g_output_stream_splice (out, stream,
+                                G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
+                                G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
+                                cancellable, error) >= 0)
+        bytes = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (out));
+
+    g_object_unref (out);
+    return bytes;
+}
+
+static gboolean
+entry_get_u32 (const guint8 **pos,
+               const guint8  *end,
+               guint32       *val)
+{
+    guint32 le;
+    if (end - *pos < 4)
+        return FALSE;
+    memcpy (&le, *pos, 4);
+    *val = GUINT32_FROM_LE (le);
+    *pos += 4;
+    return TRUE;
+}
+
+static const char *
+entry_get_string (const guint8 **pos,
+                  const guint8  *end)
+{
+    const char *str;
+    guint32 len;
+    if (!entry_get_u32 (pos, end, &len))
+        return NULL;
+    if ((gsize) (end - *pos) <= len || (*pos)[len] != '\0')
+        return NULL;
+    str = (const char *) *pos;
+    *pos += len + 1;
+    return str;
+}
+
+/* Returns the event stream in entry if every dependency is unchanged */
+static GBytes *
+cache_entry_check (GBytes       *entry,
+                   GCancellable *cancellable)
+{
+    const guint8 *start, *pos, *end;
+    guint32 version, n_deps, i;
+    gsize size;
+
+    start = pos = g_bytes_get_data (entry, &size);
+    end = pos + size;
+    if (size < 4 || memcmp (pos, PARSE_CACHE_MAGIC, 4) != 0)
+        return NULL;
+    pos += 4;
+    if (!entry_get_u32 (&pos, end, &version) || version != PARSE_CACHE_VERSION)
+        return NULL;
+    if (!entry_get_u32 (&pos, end, &n_deps))
+        return NULL;
+
+    for (i = 0; i < n_deps; i++) {
+        const char *uri, *hash;
+        GFile *file;
+        GBytes *bytes;
+        gboolean same;
+
+        uri = entry_get_string (&pos, end);
+        if (uri == NULL)
+            return NULL;
+        hash = entry_get_string (&pos, end);
+        if (hash == NULL)
+            return NULL;
+
+        file = g_file_new_for_uri (uri);
+        bytes = g_file_load_bytes (file, cancellable, NULL, NULL);
+        g_object_unref (file);
+        if (bytes == NULL)
+            return NULL;
+        {
+            char *newhash = g_compute_checksum_for_bytes (G_CHECKSUM_SHA256, bytes);
+            same = g_str_equal (hash, newhash);
+            g_free (newhash);
+        }
+        g_bytes_unref (bytes);
+        if (!same)
+            return NULL;
+    }
+
+    return g_bytes_new_from_bytes (entry, pos - start, end - pos);
+}
+
+static void
+entry_put_u32 (GByteArray *buf,
+               guint32     val)
+{
+    guint32 le = GUINT32_TO_LE (val);
+    g_byte_array_append (buf, (const guint8 *) &le, 4);
+}
+
+static void
+entry_put_string (GByteArray *buf,
+                  const char *str)
+{
+    gsize len = strlen (str);
+    entry_put_u32 (buf, len);
+    g_byte_array_append (buf, (const guint8 *) str, len + 1);
+}
+
+/* Parses content into an event stream, and tries to store it along with
+   the dependencies. Failing to store the entry isn't an error.
+ */
+static GBytes *
+cache_parse (AxingParseCache  *cache,
+             AxingResource    *resource,
+             GBytes           *content,
+             AxingResolver    *resolver,
+             GFile            *entryfile,
+             GCancellable     *cancellable,
+             GError          **error)
+{
+    AxingRecordingResolver *recorder;
+    AxingResource *memresource;
+    AxingXmlParser *parser;
+    AxingEventWriter *writer;
+    GInputStream *stream;
+    GOutputStream *out;
+    GByteArray *buf;
+    GBytes *events = NULL;
+    gconstpointer data;
+    gsize size;
+    guint i;
+
+    recorder = g_object_new (AXING_TYPE_RECORDING_RESOLVER, NULL);
+    recorder->resolver = resolver ? g_object_ref (resolver) : axing_resolver_get_default ();
+
+    stream = g_memory_input_stream_new_from_bytes (content);
+    memresource = axing_resource_new (axing_resource_get_file (resource), stream);
+    g_object_unref (stream);
+    parser = axing_xml_parser_new (memresource, AXING_RESOLVER (recorder));
+    g_object_unref (memresource);
+    axing_xml_parser_set_load_external_dtd (parser, cache->load_dtd);
+    axing_xml_parser_set_dtd_cache (parser, FALSE);
+
+    out = g_memory_output_stream_new_resizable ();
+    writer = axing_event_writer_new (out);
+    if (axing_event_writer_write_all (writer, AXING_READER (parser), error) &&
+        g_output_stream_close (out, cancellable, error))
+        events = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (out));
+    g_object_unref (writer);
+    g_object_unref (out);
+    g_object_unref (parser);
+
+    if (events == NULL) {
+        g_object_unref (recorder);
+        return NULL;
+    }
+
+    buf = g_byte_array_new ();
+    g_byte_array_append (buf, (const guint8 *) PARSE_CACHE_MAGIC, 4);
+    entry_put_u32 (buf, PARSE_CACHE_VERSION);
+    entry_put_u32 (buf, recorder->deps->len / 2);
+    for (i = 0; i < recorder->deps->len; i++)
+        entry_put_string (buf, recorder->deps->pdata[i]);
+    data = g_bytes_get_data (events, &size);
+    g_byte_array_append (buf, data, size);
+    g_object_unref (recorder);
+
+    g_file_make_directory_with_parents (cache->directory, cancellable, NULL);
+    g_file_replace_contents (entryfile, (const char *) buf->data, buf->len,
+                             NULL, FALSE, G_FILE_CREATE_NONE, NULL,
+                             cancellable, NULL);
+    g_byte_array_free (buf, TRUE);
+
+    return events;
+}
@@ -0,0 +1,336 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+#include <string.h>
+
+#include "axing-path-filter.h"
+#include "axing-utf8.h"
+
+typedef struct {
+    gboolean  descendant;
+    char     *name;  /* NULL for "*" */
+    char     *attr;  /* NULL when there's no attribute test */
+    char     *value; /* NULL when the attribute only has to exist */
+} Step;
+
+typedef struct {
+    Step  *steps;
+    guint  n_steps;
+} Pattern;
+
+/* The filter works like a little NFA. For every open element we descended
+   into, we keep the set of pattern steps that the next element could match,
+   packed as (pattern << 16 | step). The sets are all kept in one array, with
+   frames marking where each element's set starts.
+ */
+struct _AxingPathFilter {
+    GArray *patterns;
+    GArray *active;
+    GArray *frames;
+};
+
+#define ACTIVE_PACK(pattern, step) (((guint32) (pattern) << 16) | (guint32) (step))
+#define ACTIVE_PATTERN(packed) ((packed) >> 16)
+#define ACTIVE_STEP(packed) ((packed) & 0xFFFF)
+
+static void      step_clear          (Step            *step);
+static char *    pattern_get_name    (const char     **cur);
+static gboolean  step_matches        (Step            *step,
+                                      const char      *qname,
+                                      AxingReader     *reader);
+static void      filter_add_active   (AxingPathFilter *filter,
+                                      guint            frame,
+                                      guint            pattern,
+                                      guint            step);
+static gboolean  filter_advance      (AxingPathFilter *filter,
+                                      guint            frame,
+                                      guint            pattern,
+                                      guint            step,
+                                      const char      *qname,
+                                      AxingReader     *reader);
+
+GQuark
+axing_path_filter_error_quark (void)
+{
+    return g_quark_from_static_string ("axing-path-filter-error-quark");
+}
+
+AxingPathFilter *
+axing_path_filter_new (void)
+{
+    AxingPathFilter *filter = g_new0 (AxingPathFilter, 1);
+    filter->patterns = g_array_new (FALSE, TRUE, sizeof (Pattern));
+    filter->active = g_array_new (FALSE, FALSE, sizeof (guint32));
+    filter->frames = g_array_new (FALSE, FALSE, sizeof (guint));
+    return filter;
+}
+
+void
+axing_path_filter_free (AxingPathFilter *filter)
+{
+    guint i, j;
+    if (filter == NULL)
+        return;
+    for (i = 0; i < filter->patterns->len; i++) {
+        Pattern *pattern = &g_array_index (filter->patterns, Pattern, i);
+        for (j = 0; j < pattern->n_steps; j++)
+            step_clear (&pattern->steps[j]);
+        g_free (pattern->steps);
+    }
+    g_array_free (filter->patterns, TRUE);
+    g_array_free (filter->active, TRUE);
+    g_array_free (filter->frames, TRUE);
+    g_free (filter);
+}
+
+static void
+step_clear (Step *step)
+{
+    g_clear_pointer (&(step->name), g_free);
+    g_clear_pointer (&(step->attr), g_free);
+    g_clear_pointer (&(step->value), g_free);
+}
+
+static char *
+pattern_get_name (const char **cur)
+{
+    const char *start = *cur;
+    gsize bytes = axing_utf8_bytes_name_start (*cur);
+    if (bytes == 0)
+        return NULL;
+    do {
+        *cur += bytes;
+    } while ((bytes = axing_utf8_bytes_name (*cur)) != 0);
+    return g_strndup (start, *cur - start);
+}
+
+gboolean
+axing_path_filter_add (AxingPathFilter *filter,
+                       const char      *pattern,
+                       GError         **error)
+{
+    GArray *steps;
+    Pattern newpat;
+    const char *cur = pattern;
+    const char *msg = NULL;
+
+    g_return_val_if_fail (filter != NULL, FALSE);
+    g_return_val_if_fail (pattern != NULL, FALSE);
+    g_return_val_if_fail (filter->frames->len == 0, FALSE);
+
+    steps = g_array_new (FALSE, TRUE, sizeof (Step));
+
+    while (TRUE) {
+        Step step = { FALSE, NULL, NULL, NULL };
+
+        if (steps->len == 0 && cur[0] != '/') {
+            step.descendant = TRUE;
+        }
+        else if (cur[0] == '/' && cur[1] == '/') {
+            step.descendant = TRUE;
+            cur += 2;
+        }
+        else if (cur[0] == '/') {
+            cur++;
+        }
+        else {
+            msg = "Expected slash";
+            goto error;
+        }
+
+        if (cur[0] == '*') {
+            cur++;
+        }
+        else if ((step.name = pattern_get_name (&cur)) == NULL) {
+            msg = "Expected name or asterisk";
+            goto error;
+        }
+
+        if (cur[0] == '[') {
+            cur++;
+            if (cur[0] != '@') {
+                step_clear (&step);
+                msg = "Expected attribute test";
+                goto error;
+            }
+            cur++;
+            if ((step.attr = pattern_get_name (&cur)) == NULL) {
+                step_clear (&step);
+                msg = "Expected attribute name";
+                goto error;
+            }
+            if (cur[0] == '=') {
+                const char *end;
+                char quote;
+                cur++;
+                quote = cur[0];
+                if ((quote != '\'' && quote != '"') || (end = strchr (cur + 1, quote)) == NULL) {
+                    step_clear (&step);
+                    msg = "Expected quoted attribute value";
+                    goto error;
+                }
+                step.value = g_strndup (cur + 1, end - cur - 1);
+                cur = end + 1;
+            }
+            if (cur[0] != ']') {
+                step_clear (&step);
+                msg = "Expected closing bracket";
+                goto error;
+            }
+            cur++;
+        }
+
+        g_array_append_val (steps, step);
+        if (cur[0] == '\0')
+            break;
+    }
+
+    if (steps->len > 0xFFFF || filter->patterns->len >= 0xFFFF) {
+        msg = "Too many steps or patterns";
+        goto error;
+    }
+
+    newpat.n_steps = steps->len;
+    newpat.steps = (Step *) g_array_free (steps, FALSE);
+    g_array_append_val (filter->patterns, newpat);
+    return TRUE;
+
+ error:
+    {
+        guint i;
+        for (i = 0; i < steps->len; i++)
+            step_clear (&g_array_index (steps, Step, i));
+        g_array_free (steps, TRUE);
+    }
+    g_set_error (error, AXING_PATH_FILTER_ERROR, AXING_PATH_FILTER_ERROR_SYNTAX,
+                 "%s:%i: %s.", pattern, (int) (cur - pattern) + 1, msg);
+    return FALSE;
+}
+
+static gboolean
+step_matches (Step        *step,
+              const char  *qname,
+              AxingReader *reader)
+{
+    const char *value;
+    if (step->name != NULL && !g_str_equal (step->name, qname))
+        return FALSE;
+    if (step->attr == NULL)
+        return TRUE;
+    value = axing_reader_get_attr_value (reader, step->attr);
+    if (value == NULL)
+        return FALSE;
+    return step->value == NULL || g_str_equal (step->value, value);
+}
+
+static void
+filter_add_active (AxingPathFilter *filter,
+                   guint            frame,
+                   guint            pattern,
+                   guint            step)
+{
+    guint32 packed = ACTIVE_PACK (pattern, step);
+    guint i;
+    for (i = frame; i < filter->active->len; i++) {
+        if (g_array_index (filter->active, guint32, i) == packed)
+            return;
+    }
+    g_array_append_val (filter->active, packed);
+}
+
+/* Returns TRUE if this completes the pattern */
+static gboolean
+filter_advance (AxingPathFilter *filter,
+                guint            frame,
+                guint            pattern,
+                guint            step,
+                const char      *qname,
+                AxingReader     *reader)
+{
+    Pattern *pat = &g_array_index (filter->patterns, Pattern, pattern);
+    if (pat->steps[step].descendant)
+        filter_add_active (filter, frame, pattern, step);
+    if (!step_matches (&pat->steps[step], qname, reader))
+        return FALSE;
+    if (step + 1 == pat->n_steps)
+        return TRUE;
+    filter_add_active (filter, frame, pattern, step + 1);
+    return FALSE;
+}
+
+AxingPathFilterResult
+axing_path_filter_push (AxingPathFilter *filter,
+                        AxingReader     *reader)
+{
+    const char *qname;
+    guint frame, i;
+    gboolean matched = FALSE;
+
+    g_return_val_if_fail (filter != NULL, AXING_PATH_FILTER_SKIP);
+    g_return_val_if_fail (axing_reader_get_node_type (reader) == AXING_NODE_TYPE_ELEMENT,
+                          AXING_PATH_FILTER_SKIP);
+
+    qname = axing_reader_get_qname (reader);
+    frame = filter->active->len;
+
+    if (filter->frames->len == 0) {
+        /* At the top, every pattern is waiting on its first step */
+        for (i = 0; i < filter->patterns->len && !matched; i++)
+            matched = filter_advance (filter, frame, i, 0, qname, reader);
+    }
+    else {
+        guint start = g_array_index (filter->frames, guint, filter->frames->len - 1);
+        for (i = start; i < frame && !matched; i++) {
+            guint32 packed = g_array_index (filter->active, guint32, i);
+            matched = filter_advance (filter, frame,
+                                      ACTIVE_PATTERN (packed), ACTIVE_STEP (packed),
+                                      qname, reader);
+        }
+    }
+
+    if (matched) {
+        g_array_set_size (filter->active, frame);
+        return AXING_PATH_FILTER_MATCH;
+    }
+    if (filter->active->len == frame)
+        return AXING_PATH_FILTER_SKIP;
+    g_array_append_val (filter->frames, frame);
+    return AXING_PATH_FILTER_DESCEND;
+}
+
+void
+axing_path_filter_pop (AxingPathFilter *filter)
+{
+    g_return_if_fail (filter != NULL && filter->frames->len > 0);
+    g_array_set_size (filter->active,
+                      g_array_index (filter->frames, guint, filter->frames->len - 1));
+    g_array_set_size (filter->frames, filter->frames->len - 1);
+}
+
+void
+axing_path_filter_reset (AxingPathFilter *filter)
+{
+    g_return_if_fail (filter != NULL);
+    g_array_set_size (filter->active, 0);
+    g_array_set_size (filter->frames, 0);
+}
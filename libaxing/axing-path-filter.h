@@ -0,0 +1,74 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+#ifndef __AXING_PATH_FILTER_H__
+#define __AXING_PATH_FILTER_H__
+
+#include <glib.h>
+#include "axing-reader.h"
+
+G_BEGIN_DECLS
+
+/* A set of simple path patterns, matched against the elements of a stream
+   as they start. Patterns are made of steps separated by "/" for children
+   or "//" for descendants. Each step is a qname or "*", optionally followed
+   by an attribute test like [@type] or [@type='video']. A pattern that does
+   not start with a slash matches at any depth, as if it started with "//".
+   Names are matched as written in the document, prefixes included.
+ */
+typedef struct _AxingPathFilter AxingPathFilter;
+
+#define AXING_PATH_FILTER_ERROR axing_path_filter_error_quark()
+
+typedef enum {
+    AXING_PATH_FILTER_ERROR_SYNTAX
+} AxingPathFilterError;
+
+typedef enum {
+    AXING_PATH_FILTER_SKIP,    /* nothing at or below this element can match */
+    AXING_PATH_FILTER_DESCEND, /* no match here, but maybe below */
+    AXING_PATH_FILTER_MATCH    /* this element and everything in it match */
+} AxingPathFilterResult;
+
+GQuark                 axing_path_filter_error_quark  (void);
+
+AxingPathFilter *      axing_path_filter_new          (void);
+void                   axing_path_filter_free         (AxingPathFilter *filter);
+
+gboolean               axing_path_filter_add          (AxingPathFilter *filter,
+                                                       const char      *pattern,
+                                                       GError         **error);
+
+/* Call on each ELEMENT event that isn't inside a match or a skipped element.
+   Only a DESCEND result pushes state, and only those elements need a call
+   to axing_path_filter_pop when they end.
+ */
+AxingPathFilterResult  axing_path_filter_push         (AxingPathFilter *filter,
+                                                       AxingReader     *reader);
+void                   axing_path_filter_pop          (AxingPathFilter *filter);
+
+void                   axing_path_filter_reset        (AxingPathFilter *filter);
+
+G_END_DECLS
+
+#endif /* __AXING_PATH_FILTER_H__ */
@@ -4,7 +4,34 @@
 #define GETTEXT_PACKAGE "axing"
 
 #include <glib/gi18n-lib.h>
+#include <gio/gio.h>
+
+#include "axing-xml-parser.h"
 
 #define P_(String) g_dgettext(GETTEXT_PACKAGE, String)
 
+/* Shared by AxingEventWriter and AxingEventReader. The format is described
+   at the top of axing-event-writer.c.
+ */
+#define EVENT_STREAM_MAGIC   "AXEV"
+#define EVENT_STREAM_VERSION 2
+#define EVENT_STREAM_NAME    0xFF
+
+/* Opens file and fills the first buffer. This blocks, so it's for code
+   that's already running on a worker thread.
+ */
+GInputStream *  axing_file_open_buffered   (GFile         *file,
+                                            GCancellable  *cancellable,
+                                            GError       **error);
+
+/* Turns off the shared DTD cache for one parser, so every file an external
+   subset pulls in goes through its resolver. AxingParseCache needs that to
+   see everything a document depends on.
+ */
+void            axing_xml_parser_set_dtd_cache (AxingXmlParser *parser,
+                                                gboolean        use_cache);
+
+/* For AxingXmlWriter, which copies start tags with their declarations */
+const char **   axing_xml_parser_get_ns_declarations (AxingXmlParser *parser);
+
 #endif /* __AXING_PRIVATE_H__ */
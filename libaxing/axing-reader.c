@@ -20,13 +20,258 @@
  * Author: Shaun McCance  <shaunm@gnome.org>
  */
 
+#include <string.h>
+
 #include "axing-reader.h"
 
 G_DEFINE_INTERFACE (AxingReader, axing_reader, G_TYPE_OBJECT)
 
+/* Kept on readers that use the default read_batch */
+typedef struct {
+    AxingNameTable *names;
+    GString        *buf;     /* text for the current batch */
+    gboolean        pending; /* current event didn't fit in the last batch */
+} BatchData;
+
+static gboolean          reader_real_skip_element  (AxingReader      *reader,
+                                                    AxingSkipMode     mode,
+                                                    GError          **error);
+static guint             reader_real_read_batch    (AxingReader      *reader,
+                                                    AxingEventRecord *records,
+                                                    guint             n_records,
+                                                    GError          **error);
+static AxingNameTable *  reader_real_get_name_table(AxingReader      *reader);
+static gboolean          reader_real_get_offsets   (AxingReader      *reader,
+                                                    goffset          *start,
+                                                    goffset          *end);
+static gboolean          reader_real_get_attr_offsets (AxingReader   *reader,
+                                                       const char    *qname,
+                                                       goffset       *start,
+                                                       goffset       *end);
+
+static BatchData *       reader_get_batch_data     (AxingReader      *reader);
+static void              batch_data_free           (gpointer          data);
+static void              batch_add_text            (GString          *buf,
+                                                    AxingEventRecord *record,
+                                                    const char       *text);
+
 static void
 axing_reader_default_init (AxingReaderInterface *iface)
 {
+    iface->skip_element = reader_real_skip_element;
+    iface->read_batch = reader_real_read_batch;
+    iface->get_name_table = reader_real_get_name_table;
+    iface->get_offsets = reader_real_get_offsets;
+    iface->get_attr_offsets = reader_real_get_attr_offsets;
+}
+
+/* Readers that don't know where things were in their input */
+static gboolean
+reader_real_get_offsets (AxingReader *reader,
+                         goffset     *start,
+                         goffset     *end)
+{
+    return FALSE;
+}
+
+static gboolean
+reader_real_get_attr_offsets (AxingReader *reader,
+                              const char  *qname,
+                              goffset     *start,
+                              goffset     *end)
+{
+    return FALSE;
+}
+
+/* Readers that can't scan their input any faster just read through the
+   subtree and count elements. There's nothing to check that reading
+   didn't already check, so the mode doesn't matter here.
+ */
+static gboolean
+reader_real_skip_element (AxingReader  *reader,
+                          AxingSkipMode mode,
+                          GError      **error)
+{
+    int depth = 1;
+    while (depth > 0) {
+        if (!axing_reader_read (reader, error))
+            return FALSE;
+        switch (axing_reader_get_node_type (reader)) {
+        case AXING_NODE_TYPE_ELEMENT:
+            depth++;
+            break;
+        case AXING_NODE_TYPE_END_ELEMENT:
+            depth--;
+            break;
+        default:
+            break;
+        }
+    }
+    return TRUE;
+}
+
+/* This reads one event at a time through the public API, so it only saves
+   the caller's calls, not ours. Readers that can fill records directly
+   should override it.
+ */
+static guint
+reader_real_read_batch (AxingReader      *reader,
+                        AxingEventRecord *records,
+                        guint             n_records,
+                        GError          **error)
+{
+    BatchData *data = reader_get_batch_data (reader);
+    AxingNameTable *names = axing_reader_get_name_table (reader);
+    guint count = 0;
+    guint i;
+
+    g_string_truncate (data->buf, 0);
+
+    while (count < n_records) {
+        AxingEventRecord *record;
+        AxingNodeType type;
+
+        if (data->pending)
+            data->pending = FALSE;
+        else if (!axing_reader_read (reader, error)) {
+            /* Drop the partial batch on errors */
+            if (axing_reader_get_node_type (reader) == AXING_NODE_TYPE_ERROR)
+                return 0;
+            break;
+        }
+
+        type = axing_reader_get_node_type (reader);
+
+        if (type == AXING_NODE_TYPE_ELEMENT) {
+            const char * const *attrs = axing_reader_get_attrs (reader);
+            guint n_attrs = g_strv_length ((char **) attrs);
+            if (count + n_attrs + 1 > n_records) {
+                /* Keep it for the next call either way */
+                data->pending = TRUE;
+                if (count == 0) {
+                    g_set_error (error, G_IO_ERROR, G_IO_ERROR_NO_SPACE,
+                                 "Element with %u attributes does not fit in %u records",
+                                 n_attrs, n_records);
+                    return 0;
+                }
+                break;
+            }
+        }
+
+        record = &(records[count++]);
+        record->type = type;
+        record->name_id = 0;
+        record->ns_id = 0;
+        record->n_attrs = 0;
+        record->text = NULL;
+        record->text_len = 0;
+        record->linenum = axing_reader_get_linenum (reader);
+        record->colnum = axing_reader_get_colnum (reader);
+
+        switch (type) {
+        case AXING_NODE_TYPE_ELEMENT:
+        case AXING_NODE_TYPE_END_ELEMENT:
+            record->name_id = axing_name_table_intern (names, axing_reader_get_localname (reader), -1);
+            record->ns_id = axing_name_table_intern (names, axing_reader_get_namespace (reader), -1);
+            if (type == AXING_NODE_TYPE_ELEMENT) {
+                const char * const *attrs;
+                for (attrs = axing_reader_get_attrs (reader); *attrs != NULL; attrs++) {
+                    AxingEventRecord *attr = &(records[count++]);
+                    attr->type = AXING_NODE_TYPE_ATTRIBUTE;
+                    attr->name_id = axing_name_table_intern (names,
+                                                             axing_reader_get_attr_localname (reader, *attrs),
+                                                             -1);
+                    attr->ns_id = axing_name_table_intern (names,
+                                                           axing_reader_get_attr_namespace (reader, *attrs),
+                                                           -1);
+                    attr->n_attrs = 0;
+                    attr->linenum = axing_reader_get_attr_linenum (reader, *attrs);
+                    attr->colnum = axing_reader_get_attr_colnum (reader, *attrs);
+                    batch_add_text (data->buf, attr, axing_reader_get_attr_value (reader, *attrs));
+                    record->n_attrs++;
+                }
+            }
+            break;
+        case AXING_NODE_TYPE_INSTRUCTION:
+            record->name_id = axing_name_table_intern (names, axing_reader_get_qname (reader), -1);
+            batch_add_text (data->buf, record, axing_reader_get_content (reader));
+            break;
+        case AXING_NODE_TYPE_CONTENT:
+        case AXING_NODE_TYPE_COMMENT:
+        case AXING_NODE_TYPE_CDATA:
+            batch_add_text (data->buf, record, axing_reader_get_content (reader));
+            break;
+        default:
+            break;
+        }
+    }
+
+    /* The buffer may have moved while we filled it, so text holds offsets
+       until now.
+     */
+    for (i = 0; i < count; i++) {
+        switch (records[i].type) {
+        case AXING_NODE_TYPE_ATTRIBUTE:
+        case AXING_NODE_TYPE_INSTRUCTION:
+        case AXING_NODE_TYPE_CONTENT:
+        case AXING_NODE_TYPE_COMMENT:
+        case AXING_NODE_TYPE_CDATA:
+            records[i].text = data->buf->str + GPOINTER_TO_SIZE (records[i].text);
+            break;
+        default:
+            break;
+        }
+    }
+
+    return count;
+}
+
+static AxingNameTable *
+reader_real_get_name_table (AxingReader *reader)
+{
+    BatchData *data = reader_get_batch_data (reader);
+    if (data->names == NULL)
+        data->names = axing_name_table_new ();
+    return data->names;
+}
+
+static BatchData *
+reader_get_batch_data (AxingReader *reader)
+{
+    static GQuark quark = 0;
+    BatchData *data;
+
+    if (G_UNLIKELY (quark == 0))
+        quark = g_quark_from_static_string ("axing-reader-batch-data");
+
+    data = g_object_get_qdata (G_OBJECT (reader), quark);
+    if (data == NULL) {
+        data = g_new0 (BatchData, 1);
+        data->buf = g_string_sized_new (1024);
+        g_object_set_qdata_full (G_OBJECT (reader), quark, data, batch_data_free);
+    }
+    return data;
+}
+
+static void
+batch_data_free (gpointer data)
+{
+    BatchData *batch = data;
+    g_clear_pointer (&(batch->names), axing_name_table_unref);
+    g_string_free (batch->buf, TRUE);
+    g_free (batch);
+}
+
+static void
+batch_add_text (GString          *buf,
+                AxingEventRecord *record,
+                const char       *text)
+{
+    gsize len = text ? strlen (text) : 0;
+    record->text = GSIZE_TO_POINTER (buf->len);
+    record->text_len = len;
+    g_string_append_len (buf, text ? text : "", len);
+    g_string_append_c (buf, '\0');
 }
 
 gboolean
@@ -105,14 +350,14 @@ axing_reader_get_content (AxingReader *reader)
     return AXING_READER_GET_IFACE (reader)->get_content (reader);
 }
 
-int
+gint64
 axing_reader_get_linenum (AxingReader *reader)
 {
     g_return_val_if_fail (AXING_IS_READER (reader), 0);
     return AXING_READER_GET_IFACE (reader)->get_linenum (reader);
 }
 
-int
+gint64
 axing_reader_get_colnum (AxingReader *reader)
 {
     g_return_val_if_fail (AXING_IS_READER (reader), 0);
@@ -166,7 +411,7 @@ axing_reader_get_attr_value (AxingReader *reader,
     return AXING_READER_GET_IFACE (reader)->get_attr_value (reader, qname);
 }
 
-int
+gint64
 axing_reader_get_attr_linenum (AxingReader *reader,
                                const char  *qname)
 {
@@ -174,7 +419,7 @@ axing_reader_get_attr_linenum (AxingReader *reader,
     return AXING_READER_GET_IFACE (reader)->get_attr_linenum (reader, qname);
 }
 
-int
+gint64
 axing_reader_get_attr_colnum (AxingReader *reader,
                               const char  *qname)
 {
@@ -182,4 +427,75 @@ axing_reader_get_attr_colnum (AxingReader *reader,
     return AXING_READER_GET_IFACE (reader)->get_attr_colnum (reader, qname);
 }
 
+/* After an ELEMENT event, moves the reader to that element's END_ELEMENT
+   without delivering anything inside it. Readers that can will scan the
+   raw data instead of building events. With AXING_SKIP_MODE_BALANCED,
+   they may check no more than that tags are balanced.
+ */
+gboolean
+axing_reader_skip_element (AxingReader   *reader,
+                           AxingSkipMode  mode,
+                           GError       **error)
+{
+    g_return_val_if_fail (AXING_IS_READER (reader), FALSE);
+    g_return_val_if_fail (axing_reader_get_node_type (reader) == AXING_NODE_TYPE_ELEMENT, FALSE);
+    return AXING_READER_GET_IFACE (reader)->skip_element (reader, mode, error);
+}
+
+/* Reads up to n_records events into records and returns how many records
+   it filled, or 0 at the end of the document or on error. Elements are
+   never split from their attributes, so an element that doesn't fit is
+   left for the next batch. If it doesn't fit in n_records at all, this
+   fails with G_IO_ERROR_NO_SPACE and keeps the element, so a call with
+   more records gets it. Don't mix this with axing_reader_read.
+ */
+guint
+axing_reader_read_batch (AxingReader       *reader,
+                         AxingEventRecord  *records,
+                         guint              n_records,
+                         GError           **error)
+{
+    g_return_val_if_fail (AXING_IS_READER (reader), 0);
+    g_return_val_if_fail (records != NULL || n_records == 0, 0);
+    return AXING_READER_GET_IFACE (reader)->read_batch (reader, records, n_records, error);
+}
+
+/* The table that axing_reader_read_batch takes name IDs from. It belongs
+   to the reader.
+ */
+AxingNameTable *
+axing_reader_get_name_table (AxingReader *reader)
+{
+    g_return_val_if_fail (AXING_IS_READER (reader), NULL);
+    return AXING_READER_GET_IFACE (reader)->get_name_table (reader);
+}
 
+/* Gets the byte offsets in the input where the current event's markup
+   starts and ends, with end just past it. For END_ELEMENT, that's the end
+   tag, or an empty span after the start tag for empty elements. Offsets
+   are in the original stream, before any decoding. Events from entity
+   replacement text get the span of the entity reference in the document.
+   Returns FALSE if the reader doesn't know.
+ */
+gboolean
+axing_reader_get_offsets (AxingReader *reader,
+                          goffset     *start,
+                          goffset     *end)
+{
+    g_return_val_if_fail (AXING_IS_READER (reader), FALSE);
+    return AXING_READER_GET_IFACE (reader)->get_offsets (reader, start, end);
+}
+
+/* Like axing_reader_get_offsets, for an attribute of the current ELEMENT,
+   from the start of its name to just past its closing quote.
+ */
+gboolean
+axing_reader_get_attr_offsets (AxingReader *reader,
+                               const char  *qname,
+                               goffset     *start,
+                               goffset     *end)
+{
+    g_return_val_if_fail (AXING_IS_READER (reader), FALSE);
+    g_return_val_if_fail (qname != NULL, FALSE);
+    return AXING_READER_GET_IFACE (reader)->get_attr_offsets (reader, qname, start, end);
+}
@@ -27,12 +27,31 @@
 #include <gio/gio.h>
 
 #include "axing-enums.h"
+#include "axing-name-table.h"
 
 G_BEGIN_DECLS
 
 #define AXING_TYPE_READER axing_reader_get_type ()
 G_DECLARE_INTERFACE (AxingReader, axing_reader, AXING, READER, GObject)
 
+/* One event from axing_reader_read_batch. An ELEMENT record is followed by
+   n_attrs ATTRIBUTE records for its attributes, in document order. Names
+   are IDs in the reader's name table: the local name and namespace for
+   elements and attributes, and the target for instructions. text is the
+   content or attribute value, NUL-terminated, and stays valid until the
+   next call that reads from the reader.
+ */
+typedef struct {
+    AxingNodeType  type;
+    guint32        name_id;
+    guint32        ns_id;
+    guint32        n_attrs;
+    const char    *text;
+    gsize          text_len;
+    gint64         linenum;
+    gint64         colnum;
+} AxingEventRecord;
+
 struct _AxingReaderInterface {
     GTypeInterface g_iface;
 
@@ -57,8 +76,8 @@ struct _AxingReaderInterface {
 
     const char *  (* get_content)   (AxingReader *reader);
 
-    int           (* get_linenum)   (AxingReader *reader);
-    int           (* get_colnum)    (AxingReader *reader);
+    gint64        (* get_linenum)   (AxingReader *reader);
+    gint64        (* get_colnum)    (AxingReader *reader);
 
     const char * const *  (* get_attrs)            (AxingReader *reader);
     const char *          (* get_attr_localname)   (AxingReader *reader,
@@ -71,13 +90,31 @@ struct _AxingReaderInterface {
                                                     const char  *qname);
     const char *          (* get_attr_value)       (AxingReader *reader,
                                                     const char  *qname);
-    int                   (* get_attr_linenum)     (AxingReader *reader,
+    gint64                (* get_attr_linenum)     (AxingReader *reader,
                                                     const char  *qname);
-    int                   (* get_attr_colnum)      (AxingReader *reader,
+    gint64                (* get_attr_colnum)      (AxingReader *reader,
                                                     const char  *qname);
 
+    gboolean              (* skip_element)         (AxingReader  *reader,
+                                                    AxingSkipMode mode,
+                                                    GError      **error);
+
+    guint                 (* read_batch)           (AxingReader      *reader,
+                                                    AxingEventRecord *records,
+                                                    guint             n_records,
+                                                    GError          **error);
+    AxingNameTable *      (* get_name_table)       (AxingReader      *reader);
+
+    gboolean              (* get_offsets)          (AxingReader      *reader,
+                                                    goffset          *start,
+                                                    goffset          *end);
+    gboolean              (* get_attr_offsets)     (AxingReader      *reader,
+                                                    const char       *qname,
+                                                    goffset          *start,
+                                                    goffset          *end);
+
     /*< private >*/
-    gpointer padding[12];
+    gpointer padding[7];
 };
 
 gboolean axing_reader_read        (AxingReader        *reader,
@@ -100,8 +137,8 @@ const char *   axing_reader_get_nsname           (AxingReader *reader);
 
 const char *   axing_reader_get_content          (AxingReader *reader);
 
-int            axing_reader_get_linenum          (AxingReader *reader);
-int            axing_reader_get_colnum           (AxingReader *reader);
+gint64         axing_reader_get_linenum          (AxingReader *reader);
+gint64         axing_reader_get_colnum           (AxingReader *reader);
 
 const char * const *  axing_reader_get_attrs            (AxingReader *reader);
 const char *          axing_reader_get_attr_localname   (AxingReader *reader,
@@ -114,11 +151,29 @@ const char *          axing_reader_get_attr_nsname      (AxingReader *reader,
                                                          const char  *qname);
 const char *          axing_reader_get_attr_value       (AxingReader *reader,
                                                          const char  *qname);
-int                   axing_reader_get_attr_linenum     (AxingReader *reader,
+gint64                axing_reader_get_attr_linenum     (AxingReader *reader,
                                                          const char  *qname);
-int                   axing_reader_get_attr_colnum      (AxingReader *reader,
+gint64                axing_reader_get_attr_colnum      (AxingReader *reader,
                                                          const char  *qname);
 
+gboolean              axing_reader_skip_element         (AxingReader  *reader,
+                                                         AxingSkipMode mode,
+                                                         GError      **error);
+
+guint                 axing_reader_read_batch           (AxingReader      *reader,
+                                                         AxingEventRecord *records,
+                                                         guint             n_records,
+                                                         GError          **error);
+AxingNameTable *      axing_reader_get_name_table       (AxingReader      *reader);
+
+gboolean              axing_reader_get_offsets          (AxingReader      *reader,
+                                                         goffset          *start,
+                                                         goffset          *end);
+gboolean              axing_reader_get_attr_offsets     (AxingReader      *reader,
+                                                         const char       *qname,
+                                                         goffset          *start,
+                                                         goffset          *end);
+
 G_END_DECLS
 
 #endif /* __AXING_READER_H__ */
@@ -44,11 +44,14 @@ axing_resolver_class_init (AxingResolverClass *klass)
 
 static AxingResolver *default_resolver;
 
+/* Safe to call from any thread. Everyone gets the same resolver. */
 AxingResolver *
 axing_resolver_get_default (void)
 {
-    if (!default_resolver)
-        default_resolver = axing_simple_resolver_new ();
+    if (g_once_init_enter (&default_resolver)) {
+        AxingResolver *resolver = axing_simple_resolver_new ();
+        g_once_init_leave (&default_resolver, resolver);
+    }
 
     return g_object_ref (default_resolver);
 }
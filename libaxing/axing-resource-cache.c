@@ -0,0 +1,291 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+
+/* AxingResourceCache keeps the contents of files in memory, so a file that
+   many documents pull in, like a shared entity file, is only read once.
+   Entries are keyed by URI and checked against the file's size and
+   modification time on every lookup, so an edited file gets read again.
+   That costs a stat, but no open or read.
+
+   The cache holds at most max_bytes of content, dropping the files used
+   least recently. A single file can use at most a quarter of that, and
+   bigger ones are left to be streamed. Files without a modification time
+   aren't cached, since there's no way to tell when they change. It's safe
+   to share between threads. Two threads that miss on the same file at the
+   same time both read it, and the last one in wins.
+
+   When there's a default cache, AxingResource reads files through it.
+ */
+
+#include "axing-resource-cache.h"
+
+#define DEFAULT_MAX_BYTES (64 * 1024 * 1024)
+
+typedef struct {
+    char      *uri;
+    GBytes    *bytes;
+    guint64    mtime;  /* in microseconds */
+    goffset    size;
+    GList     *link;   /* in lru */
+} CacheEntry;
+
+struct _AxingResourceCache {
+    GObject parent;
+
+    gsize          max_bytes;
+
+    GMutex         mutex;
+    GHashTable    *entries;
+    GQueue         lru;    /* most recently used at the head */
+    gsize          total;  /* bytes held by entries */
+};
+
+static void      axing_resource_cache_init        (AxingResourceCache       *cache);
+static void      axing_resource_cache_class_init  (AxingResourceCacheClass  *klass);
+static void      axing_resource_cache_finalize    (GObject                  *object);
+
+static void      cache_store                      (AxingResourceCache       *cache,
+                                                   char                     *uri,
+                                                   GBytes                   *bytes,
+                                                   guint64                   mtime,
+                                                   goffset                   size);
+static void      cache_remove                     (AxingResourceCache       *cache,
+                                                   CacheEntry               *entry);
+static void      cache_entry_free                 (CacheEntry               *entry);
+
+G_DEFINE_TYPE (AxingResourceCache, axing_resource_cache, G_TYPE_OBJECT);
+
+G_LOCK_DEFINE_STATIC (default_cache);
+static AxingResourceCache *default_cache = NULL;
+
+static void
+axing_resource_cache_init (AxingResourceCache *cache)
+{
+    g_mutex_init (&(cache->mutex));
+    /* Keys are owned by the entries */
+    cache->entries = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                            (GDestroyNotify) cache_entry_free);
+    g_queue_init (&(cache->lru));
+}
+
+static void
+axing_resource_cache_class_init (AxingResourceCacheClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+    object_class->finalize = axing_resource_cache_finalize;
+}
+
+static void
+axing_resource_cache_finalize (GObject *object)
+{
+    AxingResourceCache *cache = AXING_RESOURCE_CACHE (object);
+    g_queue_clear (&(cache->lru));
+    g_hash_table_destroy (cache->entries);
+    g_mutex_clear (&(cache->mutex));
+    G_OBJECT_CLASS (axing_resource_cache_parent_class)->finalize (object);
+}
+
+/* max_bytes 0 means a reasonable default */
+AxingResourceCache *
+axing_resource_cache_new (gsize max_bytes)
+{
+    AxingResourceCache *ret;
+
+    ret = g_object_new (AXING_TYPE_RESOURCE_CACHE, NULL);
+    ret->max_bytes = max_bytes ? max_bytes : DEFAULT_MAX_BYTES;
+    return ret;
+}
+
+/* Returns the whole content of file, reading it if it isn't cached or has
+   changed. Returns NULL without setting error if the file can't be cached,
+   in which case the caller should read it some other way.
+ */
+GBytes *
+axing_resource_cache_lookup (AxingResourceCache  *cache,
+                             GFile               *file,
+                             GCancellable        *cancellable,
+                             GError             **error)
+{
+    GFileInfo *info;
+    CacheEntry *entry;
+    GBytes *bytes = NULL;
+    guint64 mtime;
+    goffset size;
+    char *uri, *data;
+    gsize len;
+
+    g_return_val_if_fail (AXING_IS_RESOURCE_CACHE (cache), NULL);
+    g_return_val_if_fail (G_IS_FILE (file), NULL);
+
+    info = g_file_query_info (file,
+                              G_FILE_ATTRIBUTE_STANDARD_TYPE ","
+                              G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+                              G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+                              G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+                              G_FILE_QUERY_INFO_NONE, cancellable, NULL);
+    /* Not every GFile can be queried, but the caller may still be able to
+       read it, so this is just a miss. Real errors come from the read.
+     */
+    if (info == NULL)
+        return NULL;
+    if (g_file_info_get_file_type (info) != G_FILE_TYPE_REGULAR ||
+        !g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_TIME_MODIFIED)) {
+        g_object_unref (info);
+        return NULL;
+    }
+    size = g_file_info_get_size (info);
+    mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC +
+        g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+    g_object_unref (info);
+
+    if (size < 0 || (guint64) size > cache->max_bytes / 4)
+        return NULL;
+
+    uri = g_file_get_uri (file);
+
+    g_mutex_lock (&(cache->mutex));
+    entry = g_hash_table_lookup (cache->entries, uri);
+    if (entry != NULL) {
+        if (entry->mtime == mtime && entry->size == size) {
+            g_queue_unlink (&(cache->lru), entry->link);
+            g_queue_push_head_link (&(cache->lru), entry->link);
+            bytes = g_bytes_ref (entry->bytes);
+        }
+        else {
+            cache_remove (cache, entry);
+        }
+    }
+    g_mutex_unlock (&(cache->mutex));
+
+    if (bytes != NULL) {
+        g_free (uri);
+        return bytes;
+    }
+
+    /* Read outside the lock */
+    if (!g_file_load_contents (file, cancellable, &data, &len, NULL, error)) {
+        g_free (uri);
+        return NULL;
+    }
+    bytes = g_bytes_new_take (data, len);
+
+    /* If it changed size while we read it, don't keep it. The next lookup
+       will see a different size or time and read it again anyway.
+     */
+    if ((goffset) len == size)
+        cache_store (cache, uri, g_bytes_ref (bytes), mtime, size);
+    else
+        g_free (uri);
+
+    return bytes;
+}
+
+void
+axing_resource_cache_clear (AxingResourceCache *cache)
+{
+    g_return_if_fail (AXING_IS_RESOURCE_CACHE (cache));
+    g_mutex_lock (&(cache->mutex));
+    g_queue_clear (&(cache->lru));
+    g_hash_table_remove_all (cache->entries);
+    cache->total = 0;
+    g_mutex_unlock (&(cache->mutex));
+}
+
+/* Returns a new ref to the default cache, or NULL if there isn't one.
+   There's no default cache unless one is set.
+ */
+AxingResourceCache *
+axing_resource_cache_get_default (void)
+{
+    AxingResourceCache *ret = NULL;
+    G_LOCK (default_cache);
+    if (default_cache != NULL)
+        ret = g_object_ref (default_cache);
+    G_UNLOCK (default_cache);
+    return ret;
+}
+
+/* Sets the cache AxingResource reads files through. NULL turns it off. */
+void
+axing_resource_cache_set_default (AxingResourceCache *cache)
+{
+    AxingResourceCache *old;
+
+    g_return_if_fail (cache == NULL || AXING_IS_RESOURCE_CACHE (cache));
+
+    G_LOCK (default_cache);
+    old = default_cache;
+    default_cache = cache ? g_object_ref (cache) : NULL;
+    G_UNLOCK (default_cache);
+
+    if (old != NULL)
+        g_object_unref (old);
+}
+
+/* Takes uri and bytes */
+static void
+cache_store (AxingResourceCache *cache,
+             char               *uri,
+             GBytes             *bytes,
+             guint64             mtime,
+             goffset             size)
+{
+    CacheEntry *entry;
+
+    entry = g_new0 (CacheEntry, 1);
+    entry->uri = uri;
+    entry->bytes = bytes;
+    entry->mtime = mtime;
+    entry->size = size;
+
+    g_mutex_lock (&(cache->mutex));
+    if (g_hash_table_contains (cache->entries, uri))
+        cache_remove (cache, g_hash_table_lookup (cache->entries, uri));
+    while (cache->total + size > cache->max_bytes && cache->lru.tail != NULL)
+        cache_remove (cache, cache->lru.tail->data);
+    g_queue_push_head (&(cache->lru), entry);
+    entry->link = cache->lru.head;
+    cache->total += size;
+    g_hash_table_insert (cache->entries, entry->uri, entry);
+    g_mutex_unlock (&(cache->mutex));
+}
+
+/* Call with the mutex held. Anyone still holding the bytes keeps them. */
+static void
+cache_remove (AxingResourceCache *cache,
+              CacheEntry         *entry)
+{
+    g_queue_delete_link (&(cache->lru), entry->link);
+    cache->total -= entry->size;
+    g_hash_table_remove (cache->entries, entry->uri);
+}
+
+static void
+cache_entry_free (CacheEntry *entry)
+{
+    g_free (entry->uri);
+    g_bytes_unref (entry->bytes);
+    g_free (entry);
+}
@@ -21,12 +21,14 @@
  */
 
 #include "axing-resource.h"
+#include "axing-resource-cache.h"
 #include "axing-private.h"
 
 struct _AxingResource {
     GObject parent;
     GFile *file;
     GInputStream *input;
+    GBytes *bytes;
 };
 
 G_DEFINE_TYPE (AxingResource, axing_resource, G_TYPE_OBJECT);
@@ -42,6 +44,10 @@ static void      axing_resource_set_property  (GObject             *object,
                                                guint                prop_id,
                                                const GValue        *value,
                                                GParamSpec          *pspec);
+static GInputStream * resource_open_cached    (GFile               *file,
+                                               GBytes             **bytes,
+                                               GCancellable        *cancellable,
+                                               GError             **error);
 
 enum {
     PROP_0,
@@ -93,6 +99,10 @@ axing_resource_dispose (GObject *object)
         g_object_unref (resource->input);
         resource->input = NULL;
     }
+    if (resource->bytes) {
+        g_bytes_unref (resource->bytes);
+        resource->bytes = NULL;
+    }
     G_OBJECT_CLASS (axing_resource_parent_class)->dispose (object);
 }
 
@@ -161,42 +171,120 @@ axing_resource_get_input_stream (AxingResource *resource)
     return resource->input;
 }
 
+/* The whole content, if the resource was read from the default
+   AxingResourceCache, so callers that want it all at once don't have to
+   copy it out of the stream. Otherwise NULL.
+ */
+GBytes *
+axing_resource_get_bytes (AxingResource *resource)
+{
+    return resource->bytes;
+}
+
 GInputStream *
 axing_resource_read (AxingResource  *resource,
                      GCancellable   *cancellable,
                      GError        **error)
 {
-    if (resource->input) {
+    GError *tmperror = NULL;
+
+    if (resource->input)
         return resource->input;
+
+    resource->input = resource_open_cached (resource->file, &(resource->bytes),
+                                            cancellable, &tmperror);
+    if (tmperror != NULL) {
+        g_propagate_error (error, tmperror);
+        return NULL;
     }
-    else {
+    if (resource->input == NULL)
         resource->input = G_INPUT_STREAM (g_file_read (resource->file, cancellable, error));
-        return resource->input;
+    return resource->input;
+}
+
+/* Returns NULL without setting error if there's no default cache or it
+   won't take file, and the caller should just read it.
+ */
+static GInputStream *
+resource_open_cached (GFile         *file,
+                      GBytes       **bytes,
+                      GCancellable  *cancellable,
+                      GError       **error)
+{
+    AxingResourceCache *cache;
+
+    cache = axing_resource_cache_get_default ();
+    if (cache == NULL)
+        return NULL;
+    *bytes = axing_resource_cache_lookup (cache, file, cancellable, error);
+    g_object_unref (cache);
+    if (*bytes == NULL)
+        return NULL;
+    return g_memory_input_stream_new_from_bytes (*bytes);
+}
+
+GInputStream *
+axing_file_open_buffered (GFile         *file,
+                          GCancellable  *cancellable,
+                          GError       **error)
+{
+    GFileInputStream *fstream;
+    GInputStream *stream;
+
+    fstream = g_file_read (file, cancellable, error);
+    if (fstream == NULL)
+        return NULL;
+
+    stream = g_buffered_input_stream_new (G_INPUT_STREAM (fstream));
+    g_object_unref (fstream);
+    if (g_buffered_input_stream_fill (G_BUFFERED_INPUT_STREAM (stream), -1,
+                                      cancellable, error) < 0) {
+        g_object_unref (stream);
+        return NULL;
     }
+    return stream;
 }
 
+typedef struct {
+    GInputStream *stream;
+    GBytes       *bytes;
+} ReadResult;
+
 static void
-resource_file_read_cb (GFile        *file,
-                       GAsyncResult *result,
-                       gpointer      user_data)
+read_result_free (ReadResult *result)
 {
-    AxingResource *resource;
-    GTask *task = G_TASK (user_data);
-    GError *error = NULL;
+    g_clear_object (&(result->stream));
+    if (result->bytes)
+        g_bytes_unref (result->bytes);
+    g_free (result);
+}
 
-    resource = AXING_RESOURCE (g_task_get_source_object (task));
-    resource->input = G_INPUT_STREAM (g_file_read_finish (file, result, &error));
+static void
+resource_read_thread (GTask        *task,
+                      gpointer      source,
+                      gpointer      task_data,
+                      GCancellable *cancellable)
+{
+    AxingResource *resource = AXING_RESOURCE (source);
+    ReadResult *result;
+    GError *error = NULL;
 
-    if (error) {
-        g_task_return_error (task, error);
-        g_object_unref (task);
-    }
+    result = g_new0 (ReadResult, 1);
+    result->stream = resource_open_cached (resource->file, &(result->bytes),
+                                           cancellable, &error);
+    if (result->stream == NULL && error == NULL)
+        result->stream = axing_file_open_buffered (resource->file, cancellable, &error);
+    if (result->stream)
+        g_task_return_pointer (task, result, (GDestroyNotify) read_result_free);
     else {
-        g_task_return_pointer (task, g_object_ref (resource->input), g_object_unref);
-        g_object_unref (task);
+        read_result_free (result);
+        g_task_return_error (task, error);
     }
 }
 
+/* Opening and the first read happen on a worker thread, so slow file
+   systems don't hold up the main loop.
+ */
 void
 axing_resource_read_async (AxingResource       *resource,
                            GCancellable        *cancellable,
@@ -208,15 +296,15 @@ axing_resource_read_async (AxingResource       *resource,
     task = g_task_new (G_OBJECT (resource),
                        cancellable, callback, user_data);
     if (resource->input) {
-        g_task_return_pointer (task, g_object_ref (resource->input), g_object_unref);
+        ReadResult *result = g_new0 (ReadResult, 1);
+        result->stream = g_object_ref (resource->input);
+        g_task_return_pointer (task, result, (GDestroyNotify) read_result_free);
         g_object_unref (task);
     }
     else {
-        g_file_read_async (resource->file,
-                           G_PRIORITY_DEFAULT,
-                           cancellable,
-                           (GAsyncReadyCallback) resource_file_read_cb,
-                           resource);
+        g_task_set_return_on_cancel (task, TRUE);
+        g_task_run_in_thread (task, resource_read_thread);
+        g_object_unref (task);
     }
 }
 
@@ -225,9 +313,24 @@ axing_resource_read_finish (AxingResource *resource,
                             GAsyncResult  *result,
                             GError       **error)
 {
+    ReadResult *read;
+    GInputStream *stream;
+
     g_assert (AXING_IS_RESOURCE (resource));
     g_assert (G_IS_TASK (result));
 
-    return g_task_propagate_pointer (G_TASK (result), error);
+    /* Set here and not on the worker thread, so only the caller's thread
+       ever touches the resource.
+     */
+    read = g_task_propagate_pointer (G_TASK (result), error);
+    if (read == NULL)
+        return NULL;
+    stream = g_steal_pointer (&(read->stream));
+    if (resource->input == NULL) {
+        resource->input = g_object_ref (stream);
+        resource->bytes = g_steal_pointer (&(read->bytes));
+    }
+    read_result_free (read);
+    return stream;
 }
 
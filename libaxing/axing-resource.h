@@ -67,6 +67,7 @@ methods on GFile.
 
 GFile *              axing_resource_get_file           (AxingResource       *resource);
 GInputStream *       axing_resource_get_input_stream   (AxingResource       *resource);
+GBytes *             axing_resource_get_bytes          (AxingResource       *resource);
 
 GInputStream *       axing_resource_read               (AxingResource       *resource,
                                                         GCancellable        *cancellable,
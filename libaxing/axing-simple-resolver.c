@@ -150,18 +150,20 @@ simple_resolver_resolve_async (AxingResolver       *resolver,
     task = g_task_new (G_OBJECT (resolver), cancellable, callback, user_data);
 
     /* SimpleResolver doesn't do any blocking IO to resolve, so the
-       async method is just a trivial wrapper around the sync. */
+       async method is just a trivial wrapper around the sync. Opening
+       the resource is up to axing_resource_read_async, which does it on
+       a worker thread.
+     */
     resource = simple_resolver_resolve (resolver, base, xml_base,
                                         link, pubid, hint,
                                         cancellable, &error);
-    if (resource) {
+    if (resource)
         g_task_return_pointer (task, resource, g_object_unref);
-        g_object_unref (task);
-    }
-    else {
+    else if (error)
         g_task_return_error (task, error);
-        g_object_unref (task);
-    }
+    else
+        g_task_return_pointer (task, NULL, NULL);
+    g_object_unref (task);
 }
 
 static AxingResource *
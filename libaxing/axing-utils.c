@@ -23,39 +23,49 @@
 #include <string.h>
 #include "axing-utils.h"
 
+/* URIs are parsed into spans pointing into the original string, and the
+   result is built in a buffer the caller gives us, so resolving doesn't
+   need to allocate anything. A component's str is NULL when it isn't in
+   the URI at all, which isn't the same as being empty.
+ */
+typedef struct {
+    const char *str;
+    gsize       len;
+} UriSpan;
+
+typedef struct {
+    UriSpan scheme;
+    UriSpan authority;
+    UriSpan path;
+    UriSpan query;
+    UriSpan fragment;
+} UriSpans;
+
 typedef struct {
-    char *scheme;
-    char *authority;
-    char *path;
-    char *query;
-    char *fragment;
-} AxingUri;
+    char   *buf;
+    gsize   size;
+    gsize   len;
+} UriBuf;
 
 static void
-axing_uri_free (AxingUri *uri)
+uri_parse (const char *str,
+           UriSpans   *uri)
 {
-    g_free (uri->scheme);
-    g_free (uri->authority);
-    g_free (uri->path);
-    g_free (uri->query);
-    g_free (uri->fragment);
-    g_free (uri);
-}
+    const char *delim, *path;
 
-static AxingUri *
-axing_uri_parse (const char *str)
-{
-    char *delim, *path;
-    AxingUri *uri = g_new0 (AxingUri, 1);
+    memset (uri, 0, sizeof (UriSpans));
 
-    path = (char *) str;
+    path = str;
     /* want at least one char in scheme, else just treat it as path */
-    for (delim = path + 1; delim[0] != '\0'; delim++)
-        if (delim[0] == ':' || delim[0] == '/' || delim[0] == '?' || delim[0] == '#')
-            break;
-    if (delim[0] == ':') {
-        uri->scheme = g_strndup (str, delim - str);
-        path = delim + 1;
+    if (str[0] != '\0') {
+        for (delim = path + 1; delim[0] != '\0'; delim++)
+            if (delim[0] == ':' || delim[0] == '/' || delim[0] == '?' || delim[0] == '#')
+                break;
+        if (delim[0] == ':') {
+            uri->scheme.str = str;
+            uri->scheme.len = delim - str;
+            path = delim + 1;
+        }
     }
 
     if (path[0] == '/' && path[1] == '/') {
@@ -63,7 +73,8 @@ axing_uri_parse (const char *str)
         for (delim = path; delim[0] != '\0'; delim++)
             if (delim[0] == '/' || delim[0] == '?' || delim[0] == '#')
                 break;
-        uri->authority = g_strndup (path, delim - path);
+        uri->authority.str = path;
+        uri->authority.len = delim - path;
         path = delim;
     }
 
@@ -71,7 +82,8 @@ axing_uri_parse (const char *str)
         for (delim = path; delim[0] != '\0'; delim++)
             if (delim[0] == '?' || delim[0] == '#')
                 break;
-        uri->path = g_strndup (path, delim - path);
+        uri->path.str = path;
+        uri->path.len = delim - path;
         path = delim;
     }
 
@@ -80,137 +92,159 @@ axing_uri_parse (const char *str)
         for (delim = path; delim[0] != '\0'; delim++)
             if (delim[0] == '#')
                 break;
-        uri->query = g_strndup (path, delim - path);
+        uri->query.str = path;
+        uri->query.len = delim - path;
         path = delim;
     }
 
-    if (path[0] == '#')
-        uri->fragment = g_strdup (path + 1);
+    if (path[0] == '#') {
+        uri->fragment.str = path + 1;
+        uri->fragment.len = strlen (path + 1);
+    }
+}
 
-    return uri;
+static void
+uri_buf_append (UriBuf     *out,
+                const char *str,
+                gsize       len)
+{
+    if (out->len + len < out->size)
+        memcpy (out->buf + out->len, str, len);
+    out->len += len;
 }
 
-char *
-axing_uri_remove_dots (const char *path)
+/* Removes dot segments from the len bytes at path, in place, and returns
+   the new length. Output never gets ahead of input, so one buffer works.
+ */
+static gsize
+uri_remove_dots (char  *path,
+                 gsize  len)
 {
-    GString *ret = g_string_new_len (NULL, strlen(path));
-    char *cur = (char *) path;
+    gsize in = 0, out = 0;
 
-    while (cur[0]) {
-        if (cur[0] == '/') {
-            g_string_append_c (ret, '/');
-            cur++;
+    while (in < len) {
+        gsize rest = len - in;
+        if (path[in] == '/') {
+            path[out++] = '/';
+            in++;
         }
-        else if (g_str_has_prefix (cur, "./") || g_str_equal (cur, ".")) {
-            cur++;
-            if (cur[0])
-                cur++;
+        else if ((rest >= 2 && path[in] == '.' && path[in + 1] == '/') ||
+                 (rest == 1 && path[in] == '.')) {
+            in += rest >= 2 ? 2 : 1;
         }
-        else if (g_str_has_prefix (cur, "../") || g_str_equal (cur, "..")) {
+        else if ((rest >= 3 && path[in] == '.' && path[in + 1] == '.' && path[in + 2] == '/') ||
+                 (rest == 2 && path[in] == '.' && path[in + 1] == '.')) {
             gsize top, end;
-            for (top = ret->len - 1; top > 0; top--)
-                if (ret->str[top] != '/')
+            /* Drop the last segment written, keeping any trailing slashes */
+            for (top = out ? out - 1 : 0; top > 0; top--)
+                if (path[top] != '/')
                     break;
             if (top > 0) {
-                for (end = top; end > 0 && ret->str[end] != '/'; end--);
+                for (end = top; end > 0 && path[end] != '/'; end--);
                 top++;
-                while (ret->str[top]) {
-                    ret->str[end] = ret->str[top];
-                    end++; top++;
-                }
-                ret->str[end] = '\0';
-                ret->len = end;
+                while (top < out)
+                    path[end++] = path[top++];
+                out = end;
             }
-            cur += 2;
-            if (cur[0])
-                cur++;
+            in += rest >= 3 ? 3 : 2;
         }
         else {
-            while (cur[0] && cur[0] != '/') {
-                g_string_append_c (ret, cur[0]);
-                cur++;
-            }
+            while (in < len && path[in] != '/')
+                path[out++] = path[in++];
         }
     }
 
-    return g_string_free (ret, FALSE);
+    return out;
 }
 
-char *
-axing_uri_to_string (AxingUri *uri)
+/* Resolves link against base into buf, with a NUL at the end. Dot segments
+   are removed in buf, so it needs room for the merged path before they go.
+   Returns FALSE if buf is too small. strlen (base) + strlen (link) + 2 bytes
+   is always enough. If len isn't NULL, it's set to the length of the result.
+ */
+gboolean
+axing_uri_resolve_relative_buf (const char *base,
+                                const char *link,
+                                char       *buf,
+                                gsize       size,
+                                gsize      *len)
 {
-    return g_strconcat (uri->scheme ? uri->scheme : "",
-                        uri->scheme ? ":" : "",
-                        uri->authority ? "//" : "",
-                        uri->authority ? uri->authority : "",
-                        uri->path ? uri->path : "",
-                        uri->query ? "?" : "",
-                        uri->query ? uri->query : "",
-                        uri->fragment ? "#" : "",
-                        uri->fragment ? uri->fragment : "",
-                        NULL);
-}
+    UriSpans baseu, linku;
+    const UriSpan *query;
+    UriBuf out = { buf, size, 0 };
+
+    uri_parse (link, &linku);
+    if (linku.scheme.str && linku.scheme.len) {
+        uri_buf_append (&out, link, strlen (link));
+        goto done;
+    }
 
-char *
-axing_uri_resolve_relative (const char *base, const char *link)
-{
-    AxingUri *baseu, *linku, *ret;
-    char *retstr;
+    uri_parse (base, &baseu);
 
-    linku = axing_uri_parse (link);
-    if (linku->scheme && linku->scheme[0]) {
-        axing_uri_free (linku);
-        return g_strdup (link);
+    if (baseu.scheme.str) {
+        uri_buf_append (&out, baseu.scheme.str, baseu.scheme.len);
+        uri_buf_append (&out, ":", 1);
     }
 
-    baseu = axing_uri_parse (base);
-    ret = g_new0 (AxingUri, 1);
-
-    ret->scheme = g_strdup (baseu->scheme);
-    if (linku->authority) {
-        ret->authority = g_strdup (linku->authority);
-        ret->path = g_strdup (linku->path);
-        ret->query = g_strdup (linku->query);
+    if (linku.authority.str) {
+        uri_buf_append (&out, "//", 2);
+        uri_buf_append (&out, linku.authority.str, linku.authority.len);
+        if (linku.path.str)
+            uri_buf_append (&out, linku.path.str, linku.path.len);
+        query = &linku.query;
     }
     else {
-        ret->authority = g_strdup (baseu->authority);
-        if (linku->path && linku->path[0]) {
-            if (linku->path[0] == '/') {
-                ret->path = axing_uri_remove_dots (linku->path);
-            }
-            else {
-                char *tmp, *slash;
-                slash = strrchr (baseu->path, '/');
-                if (slash == NULL) {
-                    tmp = g_strconcat ("/", linku->path, NULL);
-                }
-                else if (slash[1] == '\0') {
-                    tmp = g_strconcat (baseu->path, linku->path, NULL);
-                }
-                else {
-                    slash[1] = '\0';
-                    tmp = g_strconcat (baseu->path, linku->path, NULL);
-                }
-                ret->path = axing_uri_remove_dots (tmp);
-                g_free (tmp);
+        if (baseu.authority.str) {
+            uri_buf_append (&out, "//", 2);
+            uri_buf_append (&out, baseu.authority.str, baseu.authority.len);
+        }
+        if (linku.path.str && linku.path.len) {
+            gsize pathstart = out.len;
+            if (linku.path.str[0] != '/') {
+                /* Merge with everything up to the last slash in base */
+                gsize slash = baseu.path.len;
+                while (slash > 0 && baseu.path.str[slash - 1] != '/')
+                    slash--;
+                if (slash == 0)
+                    uri_buf_append (&out, "/", 1);
+                else
+                    uri_buf_append (&out, baseu.path.str, slash);
             }
-            ret->query = g_strdup (linku->query);
+            uri_buf_append (&out, linku.path.str, linku.path.len);
+            if (out.len < out.size)
+                out.len = pathstart + uri_remove_dots (buf + pathstart, out.len - pathstart);
+            query = &linku.query;
         }
         else {
-            ret->path = g_strdup (baseu->path);
-            if (linku->query)
-                ret->query = g_strdup (linku->query);
-            else
-                ret->query = g_strdup (baseu->query);
+            if (baseu.path.str)
+                uri_buf_append (&out, baseu.path.str, baseu.path.len);
+            query = linku.query.str ? &linku.query : &baseu.query;
         }
     }
-    ret->fragment = g_strdup (linku->fragment);
 
-    retstr = axing_uri_to_string (ret);
+    if (query->str) {
+        uri_buf_append (&out, "?", 1);
+        uri_buf_append (&out, query->str, query->len);
+    }
+    if (linku.fragment.str) {
+        uri_buf_append (&out, "#", 1);
+        uri_buf_append (&out, linku.fragment.str, linku.fragment.len);
+    }
 
-    axing_uri_free (linku);
-    axing_uri_free (baseu);
-    axing_uri_free (ret);
+ done:
+    if (out.len >= out.size)
+        return FALSE;
+    buf[out.len] = '\0';
+    if (len != NULL)
+        *len = out.len;
+    return TRUE;
+}
 
-    return retstr;
+char *
+axing_uri_resolve_relative (const char *base, const char *link)
+{
+    gsize size = strlen (base) + strlen (link) + 2;
+    char *ret = g_malloc (size);
+    axing_uri_resolve_relative_buf (base, link, ret, size, NULL);
+    return ret;
 }
@@ -30,6 +30,11 @@ G_BEGIN_DECLS
 /* FIXME: GLib 2.66 has g_uri_resolve_relative. Remove this. */
 char *    axing_uri_resolve_relative    (const char *base,
                                          const char *link);
+gboolean  axing_uri_resolve_relative_buf (const char *base,
+                                          const char *link,
+                                          char       *buf,
+                                          gsize       size,
+                                          gsize      *len);
 
 G_END_DECLS
 
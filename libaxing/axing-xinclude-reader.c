@@ -0,0 +1,1447 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+
+/* AxingXIncludeReader reads a document with XInclude processed. Each
+   document is read by its own AxingXmlParser, kept on a stack of frames,
+   and events come from whichever frame is on top. When an xi:include is
+   read, its target is opened, the include element is skipped, and a frame
+   for the target is pushed, or for parse="text", one content event with
+   the whole target is made. If the target can't be had, the xi:fallback
+   child is read instead. Only errors we know about before skipping the
+   include can go to the fallback: opening, resolving, decoding text, and
+   pointers we don't understand. A target that turns out to be malformed,
+   or a pointer that matches nothing, is an error.
+
+   Pointers can use the element() scheme or be a bare ID. IDs are xml:id
+   or id attributes, since we don't read attribute types from the DTD.
+   Matching streams too: branches that can't hold the target are skipped,
+   and the frame is done as soon as the target element ends. Includes with
+   no href, which point into the including document, aren't supported and
+   go to the fallback. Base URI and language fixup aren't done.
+
+   To keep the network and disk out of the way, a thread pool scans each
+   local document ahead of the parser for include tags and resolves and
+   opens their targets. The scan is just looking at bytes for tags named
+   include with an href, without namespaces, so it's only a guess. A guess
+   that's never used costs an open. At most MAX_FETCHES targets are open
+   and waiting at a time. A target the reader gets past without asking
+   for is dropped, and when a document is done, everything still pending,
+   running, or waiting for it is cancelled and dropped.
+ */
+
+#include <string.h>
+
+#include "axing-private.h"
+#include "axing-xinclude-reader.h"
+#include "axing-xml-parser.h"
+
+#define POOL_THREADS 4
+#define MAX_FETCHES  8
+#define SCAN_BLOCK   65536
+
+typedef enum {
+    FETCH_PENDING,
+    FETCH_RUNNING,
+    FETCH_DONE
+} FetchState;
+
+/* A target found by a scan */
+typedef struct {
+    char          *key;      /* document URI, href, and parse */
+    char          *doc;      /* URI of the document it's in */
+    GFile         *base;
+    char          *href;
+    gboolean       text;
+    FetchState     state;
+    gboolean       dropped;  /* nobody wants it, so whoever finishes it frees it */
+    GCancellable  *cancellable;
+    AxingResource *resource;
+    GError        *error;
+} Fetch;
+
+typedef struct {
+    GFile         *scan;     /* or */
+    Fetch         *fetch;
+} Job;
+
+/* element() pointers and bare IDs */
+typedef struct {
+    char          *id;
+    GArray        *steps;     /* 1-based child positions after the ID */
+    GArray        *positions; /* elements seen so far at each depth */
+    int            anchor;    /* depth of the ID element, -1 before the root */
+    int            match;     /* depth of the target, -1 until we're in it */
+    gboolean       found_id;
+} Pointer;
+
+typedef struct {
+    int            depth;    /* of the include element */
+    gboolean       fallback; /* seen its xi:fallback */
+    GError        *error;    /* why it failed */
+} Failed;
+
+typedef struct {
+    AxingReader   *reader;
+    AxingResource *resource;
+    char          *uri;      /* NULL if there's no file */
+    char          *xpointer;
+    int            depth;
+    GArray        *failed;   /* includes we're inside that failed, innermost last */
+    Pointer       *pointer;
+    gboolean       done;     /* the pointer's target ended */
+} Frame;
+
+struct _AxingXIncludeReader {
+    GObject parent;
+
+    AxingResource  *resource;
+    AxingResolver  *resolver;
+    gboolean        started;
+
+    GPtrArray      *frames;
+    AxingReader    *current;  /* where the current event came from */
+    char           *text;     /* or the text of a parse="text" include */
+    gint64          text_linenum;
+    gint64          text_colnum;
+    GError         *error;
+
+    GThreadPool    *pool;
+    GCancellable   *cancellable;
+    GMutex          mutex;
+    GCond           cond;
+    GQueue          fetches;  /* in the order scans found them */
+    GHashTable     *fetch_keys;
+    GHashTable     *scanned;
+    GHashTable     *closed;   /* documents whose frames are gone */
+    guint           n_open;   /* running or done, and not taken */
+};
+
+static void      axing_xinclude_reader_init         (AxingXIncludeReader      *xinc);
+static void      axing_xinclude_reader_class_init   (AxingXIncludeReaderClass *klass);
+static void      axing_xinclude_reader_init_reader  (AxingReaderInterface     *iface);
+static void      axing_xinclude_reader_dispose      (GObject                  *object);
+static void      axing_xinclude_reader_finalize     (GObject                  *object);
+
+static gboolean              reader_read                    (AxingReader        *reader,
+                                                             GError            **error);
+static void                  reader_read_async              (AxingReader        *reader,
+                                                             GCancellable       *cancellable,
+                                                             GAsyncReadyCallback callback,
+                                                             gpointer            user_data);
+static gboolean              reader_read_finish             (AxingReader        *reader,
+                                                             GAsyncResult       *result,
+                                                             GError            **error);
+
+static AxingNodeType         reader_get_node_type           (AxingReader    *reader);
+static const char *          reader_get_qname               (AxingReader    *reader);
+static const char *          reader_get_prefix              (AxingReader    *reader);
+static const char *          reader_get_localname           (AxingReader    *reader);
+static const char *          reader_get_namespace           (AxingReader    *reader);
+static const char *          reader_get_nsname              (AxingReader    *reader);
+static const char *          reader_get_content             (AxingReader    *reader);
+static gint64                reader_get_linenum             (AxingReader    *reader);
+static gint64                reader_get_colnum              (AxingReader    *reader);
+
+static const char * const *  reader_get_attrs               (AxingReader    *reader);
+static const char *          reader_get_attr_localname      (AxingReader    *reader, const char *qname);
+static const char *          reader_get_attr_prefix         (AxingReader    *reader, const char *qname);
+static const char *          reader_get_attr_namespace      (AxingReader    *reader, const char *qname);
+static const char *          reader_get_attr_nsname         (AxingReader    *reader, const char *qname);
+static const char *          reader_get_attr_value          (AxingReader    *reader, const char *qname);
+static gint64                reader_get_attr_linenum        (AxingReader    *reader, const char *qname);
+static gint64                reader_get_attr_colnum         (AxingReader    *reader, const char *qname);
+static gboolean              reader_get_offsets             (AxingReader    *reader,
+                                                             goffset        *start,
+                                                             goffset        *end);
+static gboolean              reader_get_attr_offsets        (AxingReader    *reader,
+                                                             const char     *qname,
+                                                             goffset        *start,
+                                                             goffset        *end);
+
+static gboolean              xinc_push_frame                (AxingXIncludeReader *xinc,
+                                                             AxingResource       *resource,
+                                                             const char          *xpointer,
+                                                             GError             **error);
+static void                  xinc_pop_frame                 (AxingXIncludeReader *xinc);
+static void                  frame_free                     (Frame               *frame);
+static gboolean              xinc_include                   (AxingXIncludeReader *xinc,
+                                                             Frame               *frame,
+                                                             GError             **error);
+static AxingResource *       xinc_open                      (AxingXIncludeReader *xinc,
+                                                             Frame               *frame,
+                                                             const char          *href,
+                                                             gboolean             text,
+                                                             GError             **error);
+static char *                xinc_read_text                 (AxingResource       *resource,
+                                                             const char          *encoding,
+                                                             GCancellable        *cancellable,
+                                                             GError             **error);
+static int                   xinc_pointer_step              (Frame               *frame,
+                                                             int                  level);
+
+static Pointer *             pointer_parse                  (const char          *xpointer);
+static void                  pointer_free                   (Pointer             *pointer);
+
+static void                  prefetch_scan                  (AxingXIncludeReader *xinc,
+                                                             GFile               *file);
+static gboolean              prefetch_take                  (AxingXIncludeReader *xinc,
+                                                             Frame               *frame,
+                                                             const char          *href,
+                                                             gboolean             text,
+                                                             AxingResource      **resource,
+                                                             GError             **error);
+static void                  prefetch_drop_locked           (AxingXIncludeReader *xinc,
+                                                             GList               *link);
+static void                  prefetch_close                 (AxingXIncludeReader *xinc,
+                                                             const char          *doc);
+static void                  prefetch_start_locked          (AxingXIncludeReader *xinc);
+static void                  prefetch_job                   (gpointer             data,
+                                                             gpointer             user_data);
+static void                  prefetch_scan_file             (AxingXIncludeReader *xinc,
+                                                             GFile               *file);
+static void                  prefetch_fetch                 (AxingXIncludeReader *xinc,
+                                                             Fetch               *fetch);
+static void                  prefetch_add                   (AxingXIncludeReader *xinc,
+                                                             GFile               *file,
+                                                             const char          *doc,
+                                                             const char          *href,
+                                                             gboolean             text);
+static void                  fetch_free                     (Fetch               *fetch);
+
+G_DEFINE_TYPE_WITH_CODE (AxingXIncludeReader, axing_xinclude_reader, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (AXING_TYPE_READER,
+                                                axing_xinclude_reader_init_reader))
+
+GQuark
+axing_xinclude_reader_error_quark (void)
+{
+    return g_quark_from_static_string ("axing-xinclude-reader-error-quark");
+}
+
+static void
+axing_xinclude_reader_init (AxingXIncludeReader *xinc)
+{
+    xinc->frames = g_ptr_array_new_with_free_func ((GDestroyNotify) frame_free);
+    xinc->cancellable = g_cancellable_new ();
+    g_mutex_init (&(xinc->mutex));
+    g_cond_init (&(xinc->cond));
+    g_queue_init (&(xinc->fetches));
+    /* Keys are owned by the fetches */
+    xinc->fetch_keys = g_hash_table_new (g_str_hash, g_str_equal);
+    xinc->scanned = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    xinc->closed = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    xinc->pool = g_thread_pool_new (prefetch_job, xinc, POOL_THREADS, FALSE, NULL);
+}
+
+static void
+axing_xinclude_reader_class_init (AxingXIncludeReaderClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+    object_class->dispose = axing_xinclude_reader_dispose;
+    object_class->finalize = axing_xinclude_reader_finalize;
+}
+
+static void
+axing_xinclude_reader_init_reader (AxingReaderInterface *iface)
+{
+    iface->read = reader_read;
+    iface->read_async = reader_read_async;
+    iface->read_finish = reader_read_finish;
+
+    iface->get_node_type = reader_get_node_type;
+
+    iface->get_qname = reader_get_qname;
+    iface->get_localname = reader_get_localname;
+    iface->get_prefix = reader_get_prefix;
+    iface->get_namespace = reader_get_namespace;
+    iface->get_nsname = reader_get_nsname;
+
+    iface->get_content = reader_get_content;
+    iface->get_linenum = reader_get_linenum;
+    iface->get_colnum = reader_get_colnum;
+
+    iface->get_attrs = reader_get_attrs;
+    iface->get_attr_localname = reader_get_attr_localname;
+    iface->get_attr_prefix = reader_get_attr_prefix;
+    iface->get_attr_namespace = reader_get_attr_namespace;
+    iface->get_attr_nsname = reader_get_attr_nsname;
+    iface->get_attr_value = reader_get_attr_value;
+    iface->get_attr_linenum = reader_get_attr_linenum;
+    iface->get_attr_colnum = reader_get_attr_colnum;
+
+    iface->get_offsets = reader_get_offsets;
+    iface->get_attr_offsets = reader_get_attr_offsets;
+}
+
+static void
+axing_xinclude_reader_dispose (GObject *object)
+{
+    AxingXIncludeReader *xinc = AXING_XINCLUDE_READER (object);
+
+    /* Queued jobs still run, but cancelled they finish right away */
+    if (xinc->pool) {
+        GList *link;
+        g_mutex_lock (&(xinc->mutex));
+        g_cancellable_cancel (xinc->cancellable);
+        for (link = xinc->fetches.head; link != NULL; link = link->next)
+            g_cancellable_cancel (((Fetch *) link->data)->cancellable);
+        g_mutex_unlock (&(xinc->mutex));
+        g_thread_pool_free (xinc->pool, FALSE, TRUE);
+        xinc->pool = NULL;
+    }
+    g_queue_free_full (&(xinc->fetches), (GDestroyNotify) fetch_free);
+    g_queue_init (&(xinc->fetches));
+    g_hash_table_remove_all (xinc->fetch_keys);
+
+    g_ptr_array_set_size (xinc->frames, 0);
+    g_clear_object (&(xinc->current));
+    g_clear_object (&(xinc->resource));
+    g_clear_object (&(xinc->resolver));
+    G_OBJECT_CLASS (axing_xinclude_reader_parent_class)->dispose (object);
+}
+
+static void
+axing_xinclude_reader_finalize (GObject *object)
+{
+    AxingXIncludeReader *xinc = AXING_XINCLUDE_READER (object);
+    g_ptr_array_free (xinc->frames, TRUE);
+    g_free (xinc->text);
+    g_clear_error (&(xinc->error));
+    g_object_unref (xinc->cancellable);
+    g_hash_table_destroy (xinc->fetch_keys);
+    g_hash_table_destroy (xinc->scanned);
+    g_hash_table_destroy (xinc->closed);
+    g_mutex_clear (&(xinc->mutex));
+    g_cond_clear (&(xinc->cond));
+    G_OBJECT_CLASS (axing_xinclude_reader_parent_class)->finalize (object);
+}
+
+/* resolver NULL means the default resolver. It's used for the targets and
+   for each parser, and it's called from other threads.
+ */
+AxingXIncludeReader *
+axing_xinclude_reader_new (AxingResource *resource,
+                           AxingResolver *resolver)
+{
+    AxingXIncludeReader *xinc;
+
+    g_return_val_if_fail (AXING_IS_RESOURCE (resource), NULL);
+    g_return_val_if_fail (resolver == NULL || AXING_IS_RESOLVER (resolver), NULL);
+
+    xinc = g_object_new (AXING_TYPE_XINCLUDE_READER, NULL);
+    xinc->resource = g_object_ref (resource);
+    xinc->resolver = resolver ? g_object_ref (resolver) : axing_resolver_get_default ();
+    return xinc;
+}
+
+#define IS_XI(reader, name)                                                     \
+    (g_str_equal (axing_reader_get_localname (reader), name) &&                 \
+     g_strcmp0 (axing_reader_get_namespace (reader), AXING_XINCLUDE_NS) == 0)
+
+static gboolean
+reader_read (AxingReader  *reader,
+             GError      **error)
+{
+    AxingXIncludeReader *xinc = AXING_XINCLUDE_READER (reader);
+    GError *readerror = NULL;
+
+    if (xinc->error)
+        return FALSE;
+
+    g_clear_pointer (&(xinc->text), g_free);
+    g_clear_object (&(xinc->current));
+
+    if (!xinc->started) {
+        xinc->started = TRUE;
+        if (!xinc_push_frame (xinc, xinc->resource, NULL, &(xinc->error)))
+            goto error;
+    }
+
+    while (xinc->frames->len > 0) {
+        Frame *frame = g_ptr_array_index (xinc->frames, xinc->frames->len - 1);
+        AxingNodeType type;
+        int level;
+
+        if (frame->done || !axing_reader_read (frame->reader, &readerror)) {
+            if (readerror != NULL) {
+                xinc->error = g_error_copy (readerror);
+                goto error;
+            }
+            if (frame->pointer && !frame->done) {
+                xinc->error = g_error_new (AXING_XINCLUDE_READER_ERROR,
+                                           AXING_XINCLUDE_READER_ERROR_RESOURCE,
+                                           "XPointer %s matched nothing in %s",
+                                           frame->xpointer, frame->uri ? frame->uri : "");
+                goto error;
+            }
+            xinc_pop_frame (xinc);
+            continue;
+        }
+
+        type = axing_reader_get_node_type (frame->reader);
+        if (type == AXING_NODE_TYPE_END_ELEMENT)
+            frame->depth--;
+        level = frame->depth;
+
+        /* Inside a failed include, only the content of xi:fallback counts */
+        if (frame->failed->len > 0) {
+            Failed *failed = &g_array_index (frame->failed, Failed, frame->failed->len - 1);
+            if (type == AXING_NODE_TYPE_END_ELEMENT && level == failed->depth) {
+                if (!failed->fallback) {
+                    xinc->error = g_error_copy (failed->error);
+                    goto error;
+                }
+                g_clear_error (&(failed->error));
+                g_array_set_size (frame->failed, frame->failed->len - 1);
+                continue;
+            }
+            if (level == failed->depth + 1) {
+                if (type == AXING_NODE_TYPE_ELEMENT) {
+                    if (IS_XI (frame->reader, "fallback") && !failed->fallback) {
+                        failed->fallback = TRUE;
+                        frame->depth++;
+                    }
+                    else if (!axing_reader_skip_element (frame->reader, AXING_SKIP_MODE_BALANCED,
+                                                         &readerror)) {
+                        xinc->error = g_error_copy (readerror);
+                        goto error;
+                    }
+                }
+                continue;
+            }
+        }
+
+        /* Before the pointer's target, we only look at elements */
+        if (frame->pointer && frame->pointer->match < 0) {
+            int step;
+            if (type != AXING_NODE_TYPE_ELEMENT) {
+                if (type == AXING_NODE_TYPE_END_ELEMENT && frame->pointer->found_id &&
+                    level == frame->pointer->anchor)
+                    frame->done = TRUE;
+                continue;
+            }
+            step = xinc_pointer_step (frame, level);
+            if (step < 0) {
+                if (!axing_reader_skip_element (frame->reader, AXING_SKIP_MODE_BALANCED,
+                                                &readerror)) {
+                    xinc->error = g_error_copy (readerror);
+                    goto error;
+                }
+                continue;
+            }
+            if (step == 0) {
+                frame->depth++;
+                continue;
+            }
+            frame->pointer->match = level;
+        }
+
+        if (type == AXING_NODE_TYPE_ELEMENT) {
+            if (IS_XI (frame->reader, "include")) {
+                if (!xinc_include (xinc, frame, &(xinc->error)))
+                    goto error;
+                if (xinc->text != NULL)
+                    return TRUE;
+                continue;
+            }
+            if (IS_XI (frame->reader, "fallback")) {
+                xinc->error = g_error_new (AXING_XINCLUDE_READER_ERROR,
+                                           AXING_XINCLUDE_READER_ERROR_SYNTAX,
+                                           "xi:fallback outside xi:include at %" G_GINT64_FORMAT ":%" G_GINT64_FORMAT,
+                                           axing_reader_get_linenum (frame->reader),
+                                           axing_reader_get_colnum (frame->reader));
+                goto error;
+            }
+            frame->depth++;
+        }
+
+        if (frame->pointer && type == AXING_NODE_TYPE_END_ELEMENT &&
+            level == frame->pointer->match)
+            frame->done = TRUE;
+
+        xinc->current = g_object_ref (frame->reader);
+        return TRUE;
+    }
+
+    return FALSE;
+
+ error:
+    if (error != NULL)
+        *error = g_error_copy (xinc->error);
+    return FALSE;
+}
+
+static void
+reader_read_async (AxingReader         *reader,
+                   GCancellable        *cancellable,
+                   GAsyncReadyCallback  callback,
+                   gpointer             user_data)
+{
+    /* FIXME: Waiting for targets happens in reader_read, so this blocks */
+    GTask *task = g_task_new (reader, cancellable, callback, user_data);
+    GError *error = NULL;
+    if (reader_read (reader, &error))
+        g_task_return_boolean (task, TRUE);
+    else if (error != NULL)
+        g_task_return_error (task, error);
+    else
+        g_task_return_boolean (task, FALSE);
+    g_object_unref (task);
+}
+
+static gboolean
+reader_read_finish (AxingReader   *reader,
+                    GAsyncResult  *result,
+                    GError       **error)
+{
+    g_return_val_if_fail (g_task_is_valid (result, reader), FALSE);
+    return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+static gboolean
+xinc_push_frame (AxingXIncludeReader  *xinc,
+                 AxingResource        *resource,
+                 const char           *xpointer,
+                 GError              **error)
+{
+    Frame *frame;
+    GFile *file;
+
+    frame = g_new0 (Frame, 1);
+    frame->resource = g_object_ref (resource);
+    frame->reader = AXING_READER (axing_xml_parser_new (resource, xinc->resolver));
+    frame->failed = g_array_new (FALSE, FALSE, sizeof (Failed));
+    file = axing_resource_get_file (resource);
+    if (file != NULL) {
+        frame->uri = g_file_get_uri (file);
+        g_mutex_lock (&(xinc->mutex));
+        g_hash_table_remove (xinc->closed, frame->uri);
+        g_mutex_unlock (&(xinc->mutex));
+    }
+    if (xpointer != NULL) {
+        frame->xpointer = g_strdup (xpointer);
+        frame->pointer = pointer_parse (xpointer);
+        g_assert (frame->pointer != NULL);
+    }
+    g_ptr_array_add (xinc->frames, frame);
+
+    if (file != NULL && g_file_is_native (file))
+        prefetch_scan (xinc, file);
+    return TRUE;
+}
+
+/* Once no frame has the document open, nothing it includes will be
+   taken, so its fetches go.
+ */
+static void
+xinc_pop_frame (AxingXIncludeReader *xinc)
+{
+    Frame *frame = g_ptr_array_index (xinc->frames, xinc->frames->len - 1);
+    char *uri = g_strdup (frame->uri);
+    guint i;
+
+    g_ptr_array_set_size (xinc->frames, xinc->frames->len - 1);
+    if (uri == NULL)
+        return;
+    for (i = 0; i < xinc->frames->len; i++) {
+        if (g_strcmp0 (((Frame *) g_ptr_array_index (xinc->frames, i))->uri, uri) == 0) {
+            g_free (uri);
+            return;
+        }
+    }
+    prefetch_close (xinc, uri);
+    g_free (uri);
+}
+
+static void
+frame_free (Frame *frame)
+{
+    guint i;
+    for (i = 0; i < frame->failed->len; i++)
+        g_clear_error (&(g_array_index (frame->failed, Failed, i).error));
+    g_array_free (frame->failed, TRUE);
+    g_clear_object (&(frame->reader));
+    g_clear_object (&(frame->resource));
+    g_free (frame->uri);
+    g_free (frame->xpointer);
+    if (frame->pointer)
+        pointer_free (frame->pointer);
+    g_free (frame);
+}
+
+#define SET_ERROR(code, ...) { g_set_error (&tmperror, AXING_XINCLUDE_READER_ERROR, code, __VA_ARGS__); goto error; }
+
+/* The frame's reader is on an xi:include. Returns FALSE on fatal errors.
+   Resource errors start a failed include, and the fallback is read next.
+ */
+static gboolean
+xinc_include (AxingXIncludeReader  *xinc,
+              Frame                *frame,
+              GError              **error)
+{
+    AxingReader *reader = frame->reader;
+    AxingResource *resource = NULL;
+    const char *href, *parse, *xpointer, *encoding;
+    GError *tmperror = NULL;
+    gboolean text;
+    gint64 linenum, colnum;
+    guint i;
+
+    href = axing_reader_get_attr_value (reader, "href");
+    parse = axing_reader_get_attr_value (reader, "parse");
+    xpointer = axing_reader_get_attr_value (reader, "xpointer");
+    encoding = axing_reader_get_attr_value (reader, "encoding");
+    linenum = axing_reader_get_linenum (reader);
+    colnum = axing_reader_get_colnum (reader);
+
+    if (parse == NULL || g_str_equal (parse, "xml"))
+        text = FALSE;
+    else if (g_str_equal (parse, "text"))
+        text = TRUE;
+    else {
+        g_set_error (error, AXING_XINCLUDE_READER_ERROR, AXING_XINCLUDE_READER_ERROR_SYNTAX,
+                     "Bad parse attribute %s at %" G_GINT64_FORMAT ":%" G_GINT64_FORMAT, parse, linenum, colnum);
+        return FALSE;
+    }
+    if ((href == NULL || href[0] == '\0') && xpointer == NULL) {
+        g_set_error (error, AXING_XINCLUDE_READER_ERROR, AXING_XINCLUDE_READER_ERROR_SYNTAX,
+                     "xi:include with no href or xpointer at %" G_GINT64_FORMAT ":%" G_GINT64_FORMAT, linenum, colnum);
+        return FALSE;
+    }
+    if (href != NULL && strchr (href, '#') != NULL) {
+        g_set_error (error, AXING_XINCLUDE_READER_ERROR, AXING_XINCLUDE_READER_ERROR_SYNTAX,
+                     "Fragment identifier in href at %" G_GINT64_FORMAT ":%" G_GINT64_FORMAT, linenum, colnum);
+        return FALSE;
+    }
+    if (text && xpointer != NULL) {
+        g_set_error (error, AXING_XINCLUDE_READER_ERROR, AXING_XINCLUDE_READER_ERROR_SYNTAX,
+                     "xpointer with parse=\"text\" at %" G_GINT64_FORMAT ":%" G_GINT64_FORMAT, linenum, colnum);
+        return FALSE;
+    }
+
+    if (href == NULL || href[0] == '\0')
+        SET_ERROR (AXING_XINCLUDE_READER_ERROR_RESOURCE,
+                   "Includes within the same document are not supported at %" G_GINT64_FORMAT ":%" G_GINT64_FORMAT,
+                   linenum, colnum);
+    if (xpointer != NULL) {
+        Pointer *pointer = pointer_parse (xpointer);
+        if (pointer == NULL)
+            SET_ERROR (AXING_XINCLUDE_READER_ERROR_RESOURCE,
+                       "Unsupported XPointer %s at %" G_GINT64_FORMAT ":%" G_GINT64_FORMAT, xpointer, linenum, colnum);
+        pointer_free (pointer);
+    }
+
+    resource = xinc_open (xinc, frame, href, text, &tmperror);
+    if (resource == NULL)
+        goto error;
+
+    if (text) {
+        char *content = xinc_read_text (resource, encoding, xinc->cancellable, &tmperror);
+        if (content == NULL)
+            goto error;
+        if (!axing_reader_skip_element (reader, AXING_SKIP_MODE_BALANCED, error)) {
+            g_free (content);
+            g_object_unref (resource);
+            return FALSE;
+        }
+        xinc->text = content;
+        xinc->text_linenum = linenum;
+        xinc->text_colnum = colnum;
+        g_object_unref (resource);
+        return TRUE;
+    }
+
+    if (axing_resource_get_file (resource) != NULL) {
+        char *uri = g_file_get_uri (axing_resource_get_file (resource));
+        for (i = 0; i < xinc->frames->len; i++) {
+            Frame *open = g_ptr_array_index (xinc->frames, i);
+            if (g_strcmp0 (open->uri, uri) == 0 && g_strcmp0 (open->xpointer, xpointer) == 0) {
+                g_set_error (error, AXING_XINCLUDE_READER_ERROR,
+                             AXING_XINCLUDE_READER_ERROR_RECURSION,
+                             "%s includes itself at %" G_GINT64_FORMAT ":%" G_GINT64_FORMAT, uri, linenum, colnum);
+                g_free (uri);
+                g_object_unref (resource);
+                return FALSE;
+            }
+        }
+        g_free (uri);
+    }
+
+    if (!axing_reader_skip_element (reader, AXING_SKIP_MODE_BALANCED, error)) {
+        g_object_unref (resource);
+        return FALSE;
+    }
+    xinc_push_frame (xinc, resource, xpointer, error);
+    g_object_unref (resource);
+    return TRUE;
+
+ error:
+    if (g_error_matches (tmperror, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        g_propagate_error (error, tmperror);
+        g_clear_object (&resource);
+        return FALSE;
+    }
+    {
+        Failed failed = { frame->depth, FALSE, NULL };
+        failed.error = g_error_new (AXING_XINCLUDE_READER_ERROR,
+                                    AXING_XINCLUDE_READER_ERROR_RESOURCE,
+                                    "Cannot include %s at %" G_GINT64_FORMAT ":%" G_GINT64_FORMAT " with no fallback: %s",
+                                    href ? href : "", linenum, colnum, tmperror->message);
+        g_array_append_val (frame->failed, failed);
+    }
+    frame->depth++;
+    g_clear_error (&tmperror);
+    g_clear_object (&resource);
+    return TRUE;
+}
+
+static AxingResource *
+xinc_open (AxingXIncludeReader  *xinc,
+           Frame                *frame,
+           const char           *href,
+           gboolean              text,
+           GError              **error)
+{
+    AxingResource *resource = NULL;
+
+    if (prefetch_take (xinc, frame, href, text, &resource, error))
+        return resource;
+
+    resource = axing_resolver_resolve (xinc->resolver, frame->resource, NULL, href, NULL,
+                                       AXING_RESOLVER_HINT_XINCLUDE, xinc->cancellable, error);
+    if (resource == NULL) {
+        if (error != NULL && *error == NULL)
+            g_set_error (error, AXING_XINCLUDE_READER_ERROR, AXING_XINCLUDE_READER_ERROR_RESOURCE,
+                         "Cannot resolve %s", href);
+        return NULL;
+    }
+    if (axing_resource_read (resource, xinc->cancellable, error) == NULL) {
+        g_object_unref (resource);
+        return NULL;
+    }
+    return resource;
+}
+
+static char *
+xinc_read_text (AxingResource  *resource,
+                const char     *encoding,
+                GCancellable   *cancellable,
+                GError        **error)
+{
+    GInputStream *stream;
+    GOutputStream *out;
+    GBytes *bytes = NULL;
+    const char *data;
+    gsize len;
+    char *ret;
+
+    stream = axing_resource_read (resource, cancellable, error);
+    if (stream == NULL)
+        return NULL;
+    if (axing_resource_get_bytes (resource) != NULL) {
+        bytes = g_bytes_ref (axing_resource_get_bytes (resource));
+    }
+    else {
+        out = g_memory_output_stream_new_resizable ();
+        if (g_output_stream_splice (out, stream,
+                                    G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
+                                    G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
+                                    cancellable, error) >= 0)
+            bytes = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (out));
+        g_object_unref (out);
+        if (bytes == NULL)
+            return NULL;
+    }
+
+    data = g_bytes_get_data (bytes, &len);
+    if (encoding != NULL && g_ascii_strcasecmp (encoding, "UTF-8") != 0) {
+        ret = g_convert (data, len, "UTF-8", encoding, NULL, NULL, error);
+    }
+    else {
+        if (len >= 3 && memcmp (data, "\xEF\xBB\xBF", 3) == 0) {
+            data += 3;
+            len -= 3;
+        }
+        if (g_utf8_validate (data, len, NULL))
+            ret = g_strndup (data, len);
+        else {
+            g_set_error (error, AXING_XINCLUDE_READER_ERROR, AXING_XINCLUDE_READER_ERROR_RESOURCE,
+                         "Text is not valid UTF-8");
+            ret = NULL;
+        }
+    }
+    g_bytes_unref (bytes);
+    return ret;
+}
+
+/* For an element at level while looking for the pointer's target: -1 if
+   the target can't be in it, 0 if it might be, 1 if it's the target.
+ */
+static int
+xinc_pointer_step (Frame *frame,
+                   int    level)
+{
+    Pointer *pointer = frame->pointer;
+    int rel, *pos;
+
+    if ((int) pointer->positions->len < level + 2)
+        g_array_set_size (pointer->positions, level + 2);
+    pos = &g_array_index (pointer->positions, int, level);
+    pos[0]++;
+    pos[1] = 0;
+
+    if (pointer->id != NULL && !pointer->found_id) {
+        const char *id = axing_reader_get_attr_value (frame->reader, "xml:id");
+        if (id == NULL)
+            id = axing_reader_get_attr_value (frame->reader, "id");
+        if (g_strcmp0 (id, pointer->id) != 0)
+            return 0;
+        pointer->found_id = TRUE;
+        pointer->anchor = level;
+        return pointer->steps->len == 0 ? 1 : 0;
+    }
+
+    rel = level - pointer->anchor;
+    if (rel < 1 || rel > (int) pointer->steps->len ||
+        pos[0] != g_array_index (pointer->steps, int, rel - 1))
+        return -1;
+    return rel == (int) pointer->steps->len ? 1 : 0;
+}
+
+/* Returns NULL for pointers we can't handle. The first element() part
+   wins, since the ones after it are only tried if it fails.
+ */
+static Pointer *
+pointer_parse (const char *xpointer)
+{
+    Pointer *pointer;
+    const char *c = xpointer;
+    char *data = NULL;
+    char **parts;
+    int i;
+
+    while (g_ascii_isspace (*c))
+        c++;
+    if (strchr (c, '(') == NULL) {
+        data = g_strstrip (g_strdup (c));
+    }
+    else {
+        while (*c != '\0') {
+            const char *open = strchr (c, '(');
+            const char *close = open ? strchr (open, ')') : NULL;
+            if (close == NULL)
+                return NULL;
+            if (open - c == 7 && strncmp (c, "element", 7) == 0) {
+                data = g_strndup (open + 1, close - open - 1);
+                break;
+            }
+            c = close + 1;
+            while (g_ascii_isspace (*c))
+                c++;
+        }
+        if (data == NULL)
+            return NULL;
+    }
+
+    pointer = g_new0 (Pointer, 1);
+    pointer->steps = g_array_new (FALSE, FALSE, sizeof (int));
+    pointer->positions = g_array_new (FALSE, TRUE, sizeof (int));
+    pointer->anchor = -1;
+    pointer->match = -1;
+
+    /* "id", "id/1/2", or "/1/2", so parts[0] is the ID or empty */
+    parts = g_strsplit (data, "/", -1);
+    g_free (data);
+    if (parts[0] == NULL)
+        goto error;
+    if (parts[0][0] != '\0')
+        pointer->id = g_strdup (parts[0]);
+    for (i = 1; parts[i] != NULL; i++) {
+        char *end;
+        guint64 step = g_ascii_strtoull (parts[i], &end, 10);
+        int istep = (int) step;
+        if (end == parts[i] || *end != '\0' || step == 0 || step > G_MAXINT)
+            goto error;
+        g_array_append_val (pointer->steps, istep);
+    }
+    g_strfreev (parts);
+    if (pointer->id == NULL && pointer->steps->len == 0) {
+        pointer_free (pointer);
+        return NULL;
+    }
+    return pointer;
+
+ error:
+    g_strfreev (parts);
+    pointer_free (pointer);
+    return NULL;
+}
+
+static void
+pointer_free (Pointer *pointer)
+{
+    g_free (pointer->id);
+    g_array_free (pointer->steps, TRUE);
+    g_array_free (pointer->positions, TRUE);
+    g_free (pointer);
+}
+
+static char *
+prefetch_key (const char *doc,
+              const char *href,
+              gboolean    text)
+{
+    return g_strdup_printf ("%s\n%s\n%i", doc, href, text);
+}
+
+/* Queues a scan of file, unless it's been scanned or it's closed */
+static void
+prefetch_scan (AxingXIncludeReader *xinc,
+               GFile               *file)
+{
+    char *uri = g_file_get_uri (file);
+    Job *job;
+
+    g_mutex_lock (&(xinc->mutex));
+    if (g_cancellable_is_cancelled (xinc->cancellable) ||
+        g_hash_table_contains (xinc->scanned, uri) ||
+        g_hash_table_contains (xinc->closed, uri)) {
+        g_mutex_unlock (&(xinc->mutex));
+        g_free (uri);
+        return;
+    }
+    g_hash_table_add (xinc->scanned, uri);
+    job = g_new0 (Job, 1);
+    job->scan = g_object_ref (file);
+    g_thread_pool_push (xinc->pool, job, NULL);
+    g_mutex_unlock (&(xinc->mutex));
+}
+
+/* Returns FALSE if nothing was fetched for this include, so the caller
+   has to open it. Otherwise resource or error is set. Anything the scan
+   of this document found before this include is dropped, since the
+   reader is past it.
+ */
+static gboolean
+prefetch_take (AxingXIncludeReader  *xinc,
+               Frame                *frame,
+               const char           *href,
+               gboolean              text,
+               AxingResource       **resource,
+               GError              **error)
+{
+    Fetch *fetch;
+    GList *link;
+    char *key;
+
+    if (frame->uri == NULL)
+        return FALSE;
+
+    key = prefetch_key (frame->uri, href, text);
+    g_mutex_lock (&(xinc->mutex));
+    fetch = g_hash_table_lookup (xinc->fetch_keys, key);
+    g_free (key);
+    if (fetch == NULL) {
+        g_mutex_unlock (&(xinc->mutex));
+        return FALSE;
+    }
+    while (fetch->state == FETCH_RUNNING)
+        g_cond_wait (&(xinc->cond), &(xinc->mutex));
+
+    link = xinc->fetches.head;
+    while (link != NULL) {
+        Fetch *other = link->data;
+        GList *next = link->next;
+        if (other == fetch)
+            break;
+        if (g_str_equal (other->doc, fetch->doc))
+            prefetch_drop_locked (xinc, link);
+        link = next;
+    }
+    g_queue_remove (&(xinc->fetches), fetch);
+    g_hash_table_remove (xinc->fetch_keys, fetch->key);
+    if (fetch->state == FETCH_DONE)
+        xinc->n_open--;
+    prefetch_start_locked (xinc);
+    g_mutex_unlock (&(xinc->mutex));
+
+    /* Never started, so it's on us */
+    if (fetch->state == FETCH_PENDING) {
+        fetch_free (fetch);
+        return FALSE;
+    }
+
+    *resource = g_steal_pointer (&(fetch->resource));
+    if (fetch->error != NULL)
+        g_propagate_error (error, g_steal_pointer (&(fetch->error)));
+    fetch_free (fetch);
+    return TRUE;
+}
+
+/* Call with the mutex held. Takes the fetch at link out of the queue.
+   A running fetch is cancelled and frees itself when it finishes.
+ */
+static void
+prefetch_drop_locked (AxingXIncludeReader *xinc,
+                      GList               *link)
+{
+    Fetch *fetch = link->data;
+
+    g_queue_delete_link (&(xinc->fetches), link);
+    g_hash_table_remove (xinc->fetch_keys, fetch->key);
+    if (fetch->state != FETCH_PENDING)
+        xinc->n_open--;
+    if (fetch->state == FETCH_RUNNING) {
+        fetch->dropped = TRUE;
+        g_cancellable_cancel (fetch->cancellable);
+    }
+    else {
+        fetch_free (fetch);
+    }
+}
+
+/* Drops everything found in doc. The document is marked closed, so a scan
+   of it that's still going doesn't add more, and if it's opened again, it
+   gets scanned again.
+ */
+static void
+prefetch_close (AxingXIncludeReader *xinc,
+                const char          *doc)
+{
+    GList *link;
+
+    g_mutex_lock (&(xinc->mutex));
+    g_hash_table_add (xinc->closed, g_strdup (doc));
+    g_hash_table_remove (xinc->scanned, doc);
+    link = xinc->fetches.head;
+    while (link != NULL) {
+        GList *next = link->next;
+        if (g_str_equal (((Fetch *) link->data)->doc, doc))
+            prefetch_drop_locked (xinc, link);
+        link = next;
+    }
+    prefetch_start_locked (xinc);
+    g_mutex_unlock (&(xinc->mutex));
+}
+
+/* Call with the mutex held. Nothing is pushed after dispose cancels,
+   since the pool is going away.
+ */
+static void
+prefetch_start_locked (AxingXIncludeReader *xinc)
+{
+    GList *link;
+    if (g_cancellable_is_cancelled (xinc->cancellable))
+        return;
+    for (link = xinc->fetches.head; link != NULL && xinc->n_open < MAX_FETCHES; link = link->next) {
+        Fetch *fetch = link->data;
+        if (fetch->state == FETCH_PENDING) {
+            Job *job = g_new0 (Job, 1);
+            fetch->state = FETCH_RUNNING;
+            xinc->n_open++;
+            job->fetch = fetch;
+            g_thread_pool_push (xinc->pool, job, NULL);
+        }
+    }
+}
+
+static void
+prefetch_job (gpointer data,
+              gpointer user_data)
+{
+    Job *job = data;
+    AxingXIncludeReader *xinc = user_data;
+
+    if (job->scan) {
+        prefetch_scan_file (xinc, job->scan);
+        g_object_unref (job->scan);
+    }
+    else {
+        prefetch_fetch (xinc, job->fetch);
+    }
+    g_free (job);
+}
+
+/* Reads an attribute value out of the tag from '<' to '>' */
+static char *
+scan_attr (const char *tag,
+           gsize       len,
+           const char *name)
+{
+    gsize namelen = strlen (name);
+    const char *c = tag, *end = tag + len;
+
+    while ((c = g_strstr_len (c, end - c, name)) != NULL) {
+        const char *v = c + namelen;
+        if (!g_ascii_isspace (c[-1])) {
+            c = v;
+            continue;
+        }
+        while (v < end && g_ascii_isspace (*v))
+            v++;
+        if (v < end && *v == '=') {
+            const char *close;
+            v++;
+            while (v < end && g_ascii_isspace (*v))
+                v++;
+            if (v < end && (*v == '"' || *v == '\'')) {
+                close = memchr (v + 1, *v, end - v - 1);
+                if (close != NULL)
+                    return g_strndup (v + 1, close - v - 1);
+            }
+        }
+        c = v;
+    }
+    return NULL;
+}
+
+/* Looks through the raw bytes for start tags named include or
+   something:include with an href.
+ */
+static void
+prefetch_scan_file (AxingXIncludeReader *xinc,
+                    GFile               *file)
+{
+    GFileInputStream *stream;
+    GString *buf;
+    char *doc;
+    gsize pos = 0;
+
+    stream = g_file_read (file, xinc->cancellable, NULL);
+    if (stream == NULL)
+        return;
+    doc = g_file_get_uri (file);
+    buf = g_string_sized_new (SCAN_BLOCK);
+
+    while (!g_cancellable_is_cancelled (xinc->cancellable)) {
+        gssize len;
+        gsize done;
+
+        g_string_set_size (buf, pos + SCAN_BLOCK);
+        len = g_input_stream_read (G_INPUT_STREAM (stream), buf->str + pos, SCAN_BLOCK,
+                                   xinc->cancellable, NULL);
+        if (len <= 0)
+            break;
+        g_string_set_size (buf, pos + len);
+
+        for (done = 0; done < buf->len; ) {
+            const char *lt = memchr (buf->str + done, '<', buf->len - done);
+            const char *gt, *name, *c;
+            if (lt == NULL) {
+                done = buf->len;
+                break;
+            }
+            gt = memchr (lt, '>', buf->str + buf->len - lt);
+            if (gt == NULL) {
+                done = lt - buf->str;
+                break;
+            }
+            name = c = lt + 1;
+            while (c < gt && !g_ascii_isspace (*c) && *c != '/')
+                c++;
+            if (c - name >= 7 && strncmp (c - 7, "include", 7) == 0 &&
+                (c - name == 7 || c[-8] == ':')) {
+                char *href = scan_attr (lt, gt - lt, "href");
+                if (href != NULL && href[0] != '\0' && strchr (href, '#') == NULL) {
+                    char *parse = scan_attr (lt, gt - lt, "parse");
+                    prefetch_add (xinc, file, doc, href, g_strcmp0 (parse, "text") == 0);
+                    g_free (parse);
+                }
+                g_free (href);
+            }
+            done = gt + 1 - buf->str;
+        }
+
+        /* Keep an unfinished tag for the next block, unless it's huge */
+        if (buf->len - done > SCAN_BLOCK)
+            done = buf->len;
+        g_string_erase (buf, 0, done);
+        pos = buf->len;
+    }
+
+    g_string_free (buf, TRUE);
+    g_free (doc);
+    g_object_unref (stream);
+}
+
+static void
+prefetch_add (AxingXIncludeReader *xinc,
+              GFile               *file,
+              const char          *doc,
+              const char          *href,
+              gboolean             text)
+{
+    Fetch *fetch;
+    char *key = prefetch_key (doc, href, text);
+
+    g_mutex_lock (&(xinc->mutex));
+    if (g_hash_table_contains (xinc->fetch_keys, key) ||
+        g_hash_table_contains (xinc->closed, doc)) {
+        g_mutex_unlock (&(xinc->mutex));
+        g_free (key);
+        return;
+    }
+    fetch = g_new0 (Fetch, 1);
+    fetch->key = key;
+    fetch->doc = g_strdup (doc);
+    fetch->base = g_object_ref (file);
+    fetch->href = g_strdup (href);
+    fetch->text = text;
+    fetch->state = FETCH_PENDING;
+    fetch->cancellable = g_cancellable_new ();
+    if (g_cancellable_is_cancelled (xinc->cancellable))
+        g_cancellable_cancel (fetch->cancellable);
+    g_queue_push_tail (&(xinc->fetches), fetch);
+    g_hash_table_insert (xinc->fetch_keys, fetch->key, fetch);
+    prefetch_start_locked (xinc);
+    g_mutex_unlock (&(xinc->mutex));
+}
+
+/* Resolves and opens the target the way xinc_open would, so the first
+   buffer is filled by the time the reader wants it. XML targets get
+   scanned too.
+ */
+static void
+prefetch_fetch (AxingXIncludeReader *xinc,
+                Fetch               *fetch)
+{
+    AxingResource *base, *resource;
+    GError *error = NULL;
+
+    base = axing_resource_new (fetch->base, NULL);
+    resource = axing_resolver_resolve (xinc->resolver, base, NULL, fetch->href, NULL,
+                                       AXING_RESOLVER_HINT_XINCLUDE, fetch->cancellable, &error);
+    g_object_unref (base);
+
+    if (resource != NULL && axing_resource_get_input_stream (resource) == NULL) {
+        GFile *file = axing_resource_get_file (resource);
+        GInputStream *stream = axing_file_open_buffered (file, fetch->cancellable, &error);
+        if (stream != NULL) {
+            AxingResource *opened = axing_resource_new (file, stream);
+            g_object_unref (stream);
+            g_object_unref (resource);
+            resource = opened;
+        }
+        else {
+            g_clear_object (&resource);
+        }
+    }
+    else if (resource == NULL && error == NULL) {
+        g_set_error (&error, AXING_XINCLUDE_READER_ERROR, AXING_XINCLUDE_READER_ERROR_RESOURCE,
+                     "Cannot resolve %s", fetch->href);
+    }
+
+    if (resource != NULL && !fetch->text) {
+        GFile *file = axing_resource_get_file (resource);
+        if (file != NULL && g_file_is_native (file))
+            prefetch_scan (xinc, file);
+    }
+
+    g_mutex_lock (&(xinc->mutex));
+    fetch->resource = resource;
+    fetch->error = error;
+    fetch->state = FETCH_DONE;
+    if (fetch->dropped) {
+        fetch_free (fetch);
+        prefetch_start_locked (xinc);
+    }
+    g_cond_broadcast (&(xinc->cond));
+    g_mutex_unlock (&(xinc->mutex));
+}
+
+static void
+fetch_free (Fetch *fetch)
+{
+    g_free (fetch->key);
+    g_free (fetch->doc);
+    g_clear_object (&(fetch->base));
+    g_free (fetch->href);
+    g_clear_object (&(fetch->resource));
+    g_clear_error (&(fetch->error));
+    g_clear_object (&(fetch->cancellable));
+    g_free (fetch);
+}
+
+#define CURRENT(reader) (AXING_XINCLUDE_READER (reader)->current)
+
+static AxingNodeType
+reader_get_node_type (AxingReader *reader)
+{
+    AxingXIncludeReader *xinc = AXING_XINCLUDE_READER (reader);
+    if (xinc->error)
+        return AXING_NODE_TYPE_ERROR;
+    if (xinc->text)
+        return AXING_NODE_TYPE_CONTENT;
+    if (xinc->current == NULL)
+        return AXING_NODE_TYPE_NONE;
+    return axing_reader_get_node_type (xinc->current);
+}
+
+static const char *
+reader_get_qname (AxingReader *reader)
+{
+    g_return_val_if_fail (CURRENT (reader) != NULL, NULL);
+    return axing_reader_get_qname (CURRENT (reader));
+}
+
+static const char *
+reader_get_prefix (AxingReader *reader)
+{
+    g_return_val_if_fail (CURRENT (reader) != NULL, NULL);
+    return axing_reader_get_prefix (CURRENT (reader));
+}
+
+static const char *
+reader_get_localname (AxingReader *reader)
+{
+    g_return_val_if_fail (CURRENT (reader) != NULL, NULL);
+    return axing_reader_get_localname (CURRENT (reader));
+}
+
+static const char *
+reader_get_namespace (AxingReader *reader)
+{
+    g_return_val_if_fail (CURRENT (reader) != NULL, NULL);
+    return axing_reader_get_namespace (CURRENT (reader));
+}
+
+static const char *
+reader_get_nsname (AxingReader *reader)
+{
+    g_return_val_if_fail (CURRENT (reader) != NULL, NULL);
+    return axing_reader_get_nsname (CURRENT (reader));
+}
+
+static const char *
+reader_get_content (AxingReader *reader)
+{
+    AxingXIncludeReader *xinc = AXING_XINCLUDE_READER (reader);
+    if (xinc->text)
+        return xinc->text;
+    g_return_val_if_fail (CURRENT (reader) != NULL, NULL);
+    return axing_reader_get_content (CURRENT (reader));
+}
+
+/* Positions are in whichever document the event came from. Text from a
+   parse="text" include is where the include was.
+ */
+static gint64
+reader_get_linenum (AxingReader *reader)
+{
+    AxingXIncludeReader *xinc = AXING_XINCLUDE_READER (reader);
+    if (xinc->text)
+        return xinc->text_linenum;
+    g_return_val_if_fail (CURRENT (reader) != NULL, 0);
+    return axing_reader_get_linenum (CURRENT (reader));
+}
+
+static gint64
+reader_get_colnum (AxingReader *reader)
+{
+    AxingXIncludeReader *xinc = AXING_XINCLUDE_READER (reader);
+    if (xinc->text)
+        return xinc->text_colnum;
+    g_return_val_if_fail (CURRENT (reader) != NULL, 0);
+    return axing_reader_get_colnum (CURRENT (reader));
+}
+
+static const char * const *
+reader_get_attrs (AxingReader *reader)
+{
+    g_return_val_if_fail (CURRENT (reader) != NULL, NULL);
+    return axing_reader_get_attrs (CURRENT (reader));
+}
+
+static const char *
+reader_get_attr_localname (AxingReader *reader, const char *qname)
+{
+    g_return_val_if_fail (CURRENT (reader) != NULL, NULL);
+    return axing_reader_get_attr_localname (CURRENT (reader), qname);
+}
+
+static const char *
+reader_get_attr_prefix (AxingReader *reader, const char *qname)
+{
+    g_return_val_if_fail (CURRENT (reader) != NULL, NULL);
+    return axing_reader_get_attr_prefix (CURRENT (reader), qname);
+}
+
+static const char *
+reader_get_attr_namespace (AxingReader *reader, const char *qname)
+{
+    g_return_val_if_fail (CURRENT (reader) != NULL, NULL);
+    return axing_reader_get_attr_namespace (CURRENT (reader), qname);
+}
+
+static const char *
+reader_get_attr_nsname (AxingReader *reader, const char *qname)
+{
+    g_return_val_if_fail (CURRENT (reader) != NULL, NULL);
+    return axing_reader_get_attr_nsname (CURRENT (reader), qname);
+}
+
+static const char *
+reader_get_attr_value (AxingReader *reader, const char *qname)
+{
+    g_return_val_if_fail (CURRENT (reader) != NULL, NULL);
+    return axing_reader_get_attr_value (CURRENT (reader), qname);
+}
+
+static gint64
+reader_get_attr_linenum (AxingReader *reader, const char *qname)
+{
+    g_return_val_if_fail (CURRENT (reader) != NULL, 0);
+    return axing_reader_get_attr_linenum (CURRENT (reader), qname);
+}
+
+static gint64
+reader_get_attr_colnum (AxingReader *reader, const char *qname)
+{
+    g_return_val_if_fail (CURRENT (reader) != NULL, 0);
+    return axing_reader_get_attr_colnum (CURRENT (reader), qname);
+}
+
+/* Offsets are in whichever document the event came from, like positions.
+   Text from a parse="text" include has none.
+ */
+static gboolean
+reader_get_offsets (AxingReader *reader,
+                    goffset     *start,
+                    goffset     *end)
+{
+    if (CURRENT (reader) == NULL)
+        return FALSE;
+    return axing_reader_get_offsets (CURRENT (reader), start, end);
+}
+
+static gboolean
+reader_get_attr_offsets (AxingReader *reader,
+                         const char  *qname,
+                         goffset     *start,
+                         goffset     *end)
+{
+    g_return_val_if_fail (CURRENT (reader) != NULL, FALSE);
+    return axing_reader_get_attr_offsets (CURRENT (reader), qname, start, end);
+}
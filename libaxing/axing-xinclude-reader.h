@@ -0,0 +1,56 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+
+#ifndef __AXING_XINCLUDE_READER_H__
+#define __AXING_XINCLUDE_READER_H__
+
+#include <glib-object.h>
+#include <gio/gio.h>
+#include "axing-reader.h"
+#include "axing-resolver.h"
+#include "axing-resource.h"
+
+G_BEGIN_DECLS
+
+#define AXING_TYPE_XINCLUDE_READER (axing_xinclude_reader_get_type ())
+G_DECLARE_FINAL_TYPE (AxingXIncludeReader, axing_xinclude_reader, AXING, XINCLUDE_READER, GObject)
+
+#define AXING_XINCLUDE_READER_ERROR axing_xinclude_reader_error_quark()
+
+typedef enum {
+    AXING_XINCLUDE_READER_ERROR_SYNTAX,
+    AXING_XINCLUDE_READER_ERROR_RESOURCE,
+    AXING_XINCLUDE_READER_ERROR_RECURSION
+} AxingXIncludeReaderError;
+
+#define AXING_XINCLUDE_NS "http://www.w3.org/2001/XInclude"
+
+GQuark                 axing_xinclude_reader_error_quark   (void);
+
+AxingXIncludeReader *  axing_xinclude_reader_new           (AxingResource  *resource,
+                                                            AxingResolver  *resolver);
+
+G_END_DECLS
+
+#endif /* __AXING_XINCLUDE_READER_H__ */
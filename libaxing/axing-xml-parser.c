@@ -22,6 +22,7 @@
 
 #include "axing-enums.h"
 #include "axing-dtd-schema.h"
+#include "axing-path-filter.h"
 #include "axing-private.h"
 #include "axing-resource.h"
 #include "axing-reader.h"
@@ -39,6 +40,7 @@
 #define NS_XML "http://www.w3.org/XML/1998/namespace"
 
 #define EVENTPOOLSIZE 32
+#define CONTEXTPOOLSIZE 8
 
 #define EQ2(s, c1, c2) \
     ((guchar)(s)[0] == c1 && ((guchar)(s)[1] == c2))
@@ -80,6 +82,7 @@ typedef enum {
     PARSER_STATE_INSTRUCTION,
 
     PARSER_STATE_DOCTYPE,
+    PARSER_STATE_SKIP,
     PARSER_STATE_NULL
 } ParserState;
 
@@ -99,6 +102,7 @@ typedef enum {
     (state == PARSER_STATE_CDATA) ? "PARSER_STATE_CDATA" :                 \
     (state == PARSER_STATE_INSTRUCTION) ? "PARSER_STATE_INSTRUCTION" :     \
     (state == PARSER_STATE_DOCTYPE) ? "PARSER_STATE_DOCTYPE" :             \
+    (state == PARSER_STATE_SKIP) ? "PARSER_STATE_SKIP" :                   \
     (state == PARSER_STATE_NULL) ? "PARSER_STATE_NULL" :                   \
     "PARSER_STATE_????"
 
@@ -141,6 +145,19 @@ typedef enum {
     DOCTYPE_STATE_NULL
 } DoctypeState;
 
+/* Substates for PARSER_STATE_SKIP */
+typedef enum {
+    SKIP_STATE_TEXT,
+    SKIP_STATE_STELM,
+    SKIP_STATE_ATTNAME,
+    SKIP_STATE_ATTEQ,
+    SKIP_STATE_ATTVAL,
+    SKIP_STATE_ENDELM,
+    SKIP_STATE_COMMENT,
+    SKIP_STATE_CDATA,
+    SKIP_STATE_INSTRUCTION
+} SkipState;
+
 // FIXME I think I'd like this public, but we don't have an accessor yet
 typedef enum {
     BOM_ENCODING_NONE,
@@ -155,6 +172,23 @@ typedef enum {
     BOM_ENCODING_UTF8
 } BomEncoding;
 
+/* How to count bytes in the original stream from decoded text */
+typedef enum {
+    RAW_ENCODING_UTF8,  /* the same */
+    RAW_ENCODING_UTF16,
+    RAW_ENCODING_UCS4,
+    RAW_ENCODING_OTHER,  /* encode it again and see */
+    RAW_ENCODING_UNKNOWN /* stateful, so pieces don't encode the same */
+} RawEncoding;
+
+/* Where we are in the start of a conditional section, <![ KEYWORD [ */
+typedef enum {
+    COND_STATE_NONE,
+    COND_STATE_KEYWORD,
+    COND_STATE_INCLUDE,
+    COND_STATE_IGNORE
+} CondState;
+
 typedef struct _Context Context;
 struct _Context {
     Context           *parent;
@@ -162,12 +196,24 @@ struct _Context {
     AxingResource     *resource;
     GInputStream      *srcstream;
     GDataInputStream  *datastream;
-    char              *basename;
+    char              *basename; /* shared with parent for string entities */
     char              *entname;
-    char              *showname;
+    char              *showname; /* built by context_get_showname on demand */
+    char               entchar;  /* '&' or '%' for string entity contexts */
 
     char          *line;
     char          *linecur; /* points inside line, do not free */
+    /* Offsets are in the original stream, before decoding. markcur is
+       the last point in line we counted to, to save counting again.
+     */
+    goffset        offset;  /* of line */
+    char          *markcur;
+    goffset        markoffset;
+    RawEncoding    raw_encoding;
+    char          *raw_charset;
+    /* For entity contexts, the reference in the document that got us here */
+    goffset        refstart;
+    goffset        refend;
 
     ParserState    state;
     /* For primary contexts, init_state is always PROLOG. When parsing
@@ -178,10 +224,15 @@ struct _Context {
     ParserState    init_state;
     ParserState    prev_state;
     DoctypeState   doctype_state;
+    /* Conditional sections have to start and end in the same context */
+    CondState      cond_state;
+    int            condsects; /* open INCLUDE sections */
+    int            ignoring;  /* nesting depth inside an IGNORE section */
+    SkipState      skip_state;
     BomEncoding    bom_encoding;
     gboolean       bom_checked;
-    int            linenum;
-    int            colnum;
+    gint64         linenum;
+    gint64         colnum;
 
     char          *pause_line;
     char          *cur_qname;
@@ -211,8 +262,16 @@ struct _Event {
 
     gboolean empty;
 
-    int linenum;
-    int colnum;
+    gint64 linenum;
+    gint64 colnum;
+
+    /* Only for attributes. Elements and text use the parser's span. */
+    goffset start;
+    goffset end;
+
+    /* Set by event_intern_names, 0 until then */
+    guint32 name_id;
+    guint32 ns_id;
 
     Context *context;
 };
@@ -232,17 +291,53 @@ struct _AxingXmlParser {
     AxingXmlVersion     xml_version;
 
     AxingDtdSchema      *doctype;
+    gboolean             load_dtd;
+    gboolean             external_subset; /* allows conditional sections */
+    GPtrArray           *dtd_deps; /* DtdDep for each external PE read */
+    gboolean             no_dtd_cache;
+
+    gboolean             prefetch;
+    GCancellable        *prefetch_cancellable;
+    GHashTable          *prefetched; /* entity name to Prefetch */
 
     AxingNodeType        event_type;
     Event               *event;
 
     GString             *cur_text;
 
-    int                  txtlinenum;
-    int                  txtcolnum;
+    gint64               txtlinenum;
+    gint64               txtcolnum;
+
+    goffset              span_start;
+    goffset              span_end;
+    gboolean             span_entity; /* from entity replacement text */
+
+    AxingSkipMode        skip_mode;
+    int                  skip_depth;
+    GString             *skip_names; /* NUL-separated open element names */
+
+    AxingPathFilter     *filter;
+    AxingSkipMode        filter_skip_mode;
+    int                  filter_depth; /* open elements inside a match */
+    gboolean             filter_skipped;
+
+    AxingNameTable      *names;
+    const AxingXmlParserCallbacks *callbacks;
+    gpointer             callbacks_data;
+    GArray              *attrspans;
+
+    GString             *batchbuf;
+    gboolean             batch_pending;
+
+    AxingXmlEventView    view;
+    gboolean             view_enabled;
+    GPtrArray           *view_attrvals;
 
     Event                eventpool[EVENTPOOLSIZE];
     int                  eventpoolstart;
+
+    Context              contextpool[CONTEXTPOOLSIZE];
+    int                  contextpooldepth;
 };
 
 
@@ -261,6 +356,28 @@ static void      axing_xml_parser_set_property  (GObject              *object,
                                                  GParamSpec           *pspec);
 
 static void      parser_clear_event             (AxingXmlParser       *parser);
+static gboolean  parser_read                    (AxingXmlParser       *parser,
+                                                 GError              **error);
+static void      parser_start_skip              (AxingXmlParser       *parser,
+                                                 AxingSkipMode         mode);
+static gboolean  parser_filter_event            (AxingXmlParser       *parser);
+static void      parser_dispatch_event          (AxingXmlParser       *parser);
+static void      parser_emit_event              (AxingXmlParser       *parser);
+static void      parser_update_view             (AxingXmlParser       *parser);
+static void      parser_load_external_subset    (AxingXmlParser       *parser);
+static void      parser_add_dtd_dep             (AxingXmlParser       *parser,
+                                                 AxingResource        *resource);
+static gboolean  parser_offsets_known           (AxingXmlParser       *parser);
+static void      parser_start_prefetch          (AxingXmlParser       *parser);
+static void      parser_stop_prefetch           (AxingXmlParser       *parser);
+static AxingResource *
+                 parser_take_prefetched         (AxingXmlParser       *parser,
+                                                 const char           *entname);
+static AxingDtdSchema *
+                 external_subset_parse          (AxingXmlParser       *parser,
+                                                 AxingResource        *resource,
+                                                 const char           *uri,
+                                                 GPtrArray           **deps);
 
 static gboolean              reader_read                    (AxingReader        *reader,
                                                              GError            **error);
@@ -281,8 +398,8 @@ static const char *          reader_get_nsname              (AxingReader    *rea
 
 static const char *          reader_get_content             (AxingReader    *reader);
 
-static int                   reader_get_linenum             (AxingReader    *reader);
-static int                   reader_get_colnum              (AxingReader    *reader);
+static gint64                reader_get_linenum             (AxingReader    *reader);
+static gint64                reader_get_colnum              (AxingReader    *reader);
 
 static const char *          reader_lookup_namespace        (AxingReader    *reader,
                                                              const char     *prefix);
@@ -293,8 +410,25 @@ static const char *          reader_get_attr_prefix         (AxingReader    *rea
 static const char *          reader_get_attr_namespace      (AxingReader    *reader, const char *qname);
 static const char *          reader_get_attr_nsname         (AxingReader    *reader, const char *qname);
 static const char *          reader_get_attr_value          (AxingReader    *reader, const char *qname);
-static int                   reader_get_attr_linenum        (AxingReader    *reader, const char *qname);
-static int                   reader_get_attr_colnum         (AxingReader    *reader, const char *qname);
+static gint64                reader_get_attr_linenum        (AxingReader    *reader, const char *qname);
+static gint64                reader_get_attr_colnum         (AxingReader    *reader, const char *qname);
+static gboolean              reader_get_offsets             (AxingReader    *reader,
+                                                             goffset        *start,
+                                                             goffset        *end);
+static gboolean              reader_get_attr_offsets        (AxingReader    *reader,
+                                                             const char     *qname,
+                                                             goffset        *start,
+                                                             goffset        *end);
+
+static gboolean              reader_skip_element            (AxingReader    *reader,
+                                                             AxingSkipMode   mode,
+                                                             GError        **error);
+
+static guint                 reader_read_batch              (AxingReader      *reader,
+                                                             AxingEventRecord *records,
+                                                             guint             n_records,
+                                                             GError          **error);
+static AxingNameTable *      reader_get_name_table          (AxingReader      *reader);
 
 
 #ifdef REFACTOR
@@ -318,6 +452,20 @@ static void      context_read_data_cb           (GDataInputStream     *stream,
 static void      context_check_end              (Context              *context);
 static void      context_set_encoding           (Context              *context,
                                                  const char           *encoding);
+static gsize     context_raw_length             (Context              *context,
+                                                 const char           *text,
+                                                 gsize                 len);
+static goffset   context_offset                 (Context              *context,
+                                                 char                 *cur);
+static void      context_advance_offset         (Context              *context,
+                                                 const char           *text,
+                                                 gsize                 len);
+static void      context_mark_start             (Context              *context,
+                                                 char                 *cur);
+static void      parser_mark_end                (AxingXmlParser       *parser);
+static void      context_set_refspan            (Context              *entctxt,
+                                                 Context              *context,
+                                                 gsize                 reflen);
 static gboolean  context_parse_bom              (Context              *context);
 static void      context_parse_xml_decl         (Context              *context);
 static void      context_parse_line             (Context              *context);
@@ -328,6 +476,9 @@ static void      context_parse_doctype_attlist  (Context              *context);
 static void      context_parse_doctype_notation (Context              *context);
 static void      context_parse_doctype_entity   (Context              *context);
 static void      context_parse_parameter        (Context              *context);
+static void      context_parse_condsect         (Context              *context);
+static void      context_parse_ignore           (Context              *context);
+static gboolean  context_in_external_dtd        (Context              *context);
 static void      context_parse_cdata            (Context              *context);
 static void      context_parse_comment          (Context              *context);
 static void      context_parse_instruction      (Context              *context);
@@ -336,6 +487,9 @@ static void      context_parse_start_element    (Context              *context);
 static void      context_parse_attrs            (Context              *context);
 static void      context_parse_entity           (Context              *context);
 static void      context_parse_text             (Context              *context);
+static void      context_parse_skip             (Context              *context);
+static void      context_skip_text              (Context              *context);
+static void      context_skip_reference         (Context              *context);
 static void      context_finish_start_element   (Context              *context);
 
 #ifdef REFACTOR
@@ -343,7 +497,7 @@ static void      context_complete               (Context              *context);
 #endif /* REFACTOR */
 
 static void      context_process_entity         (Context              *context,
-                                                 const char           *entname);
+                                                 char                 *entname);
 
 #ifdef REFACTOR
 static void      context_process_entity_resolved(AxingResolver        *resolver,
@@ -353,12 +507,15 @@ static void      context_process_entity_finish  (Context              *contetext
 #endif /* REFACTOR */
 
 static char *    resource_get_basename          (AxingResource        *resource);
+static const char *      context_get_showname   (Context              *context);
 
 static inline Context *  context_new            (AxingXmlParser       *parser);
 static inline void       context_free           (Context              *context);
 
 static inline Event *    event_new              (Context              *context);
 static inline void       event_free             (Event                *data);
+static inline void       event_intern_names     (AxingXmlParser       *parser,
+                                                 Event                *event);
 
 
 enum {
@@ -378,6 +535,7 @@ axing_xml_parser_init (AxingXmlParser *parser)
     parser->context = context_new (parser);
     parser->context->state = PARSER_STATE_START;
     parser->cur_text = g_string_sized_new (128);
+    parser->span_start = parser->span_end = -1;
 }
 
 static void
@@ -436,6 +594,14 @@ axing_xml_parser_init_reader (AxingReaderInterface *iface)
     iface->get_attr_value = reader_get_attr_value;
     iface->get_attr_linenum = reader_get_attr_linenum;
     iface->get_attr_colnum = reader_get_attr_colnum;
+
+    iface->skip_element = reader_skip_element;
+
+    iface->read_batch = reader_read_batch;
+    iface->get_name_table = reader_get_name_table;
+
+    iface->get_offsets = reader_get_offsets;
+    iface->get_attr_offsets = reader_get_attr_offsets;
 }
 
 static void
@@ -443,6 +609,8 @@ axing_xml_parser_dispose (GObject *object)
 {
     AxingXmlParser *parser = AXING_XML_PARSER (object);
 
+    parser_stop_prefetch (parser);
+
     g_clear_object (&parser->resource);
     g_clear_object (&parser->resolver);
     g_clear_object (&parser->cancellable);
@@ -467,6 +635,9 @@ axing_xml_parser_finalize (GObject *object)
 
     parser_clear_event (parser);
 
+    if (parser->dtd_deps)
+        g_ptr_array_free (parser->dtd_deps, TRUE);
+
 /* REFACTOR remove and free ->event if necessary
     if (parser->event_stack)
         g_array_free (parser->event_stack, TRUE);
@@ -475,6 +646,19 @@ axing_xml_parser_finalize (GObject *object)
     if (parser->cur_text)
         g_string_free (parser->cur_text, TRUE);
 
+    if (parser->skip_names)
+        g_string_free (parser->skip_names, TRUE);
+
+    axing_path_filter_free (parser->filter);
+
+    g_clear_pointer (&(parser->names), axing_name_table_unref);
+    if (parser->attrspans)
+        g_array_free (parser->attrspans, TRUE);
+    if (parser->batchbuf)
+        g_string_free (parser->batchbuf, TRUE);
+    if (parser->view_attrvals)
+        g_ptr_array_free (parser->view_attrvals, TRUE);
+
     G_OBJECT_CLASS (axing_xml_parser_parent_class)->finalize (object);
 }
 
@@ -548,12 +732,914 @@ axing_xml_parser_new (AxingResource *resource,
 }
 
 
+/* Patterns have to be added before the first read. Once any pattern is
+   added, only events for matching elements and their contents are read.
+ */
+gboolean
+axing_xml_parser_add_path_filter (AxingXmlParser  *parser,
+                                  const char      *pattern,
+                                  GError         **error)
+{
+    g_return_val_if_fail (AXING_IS_XML_PARSER (parser), FALSE);
+    g_return_val_if_fail (parser->context->state == PARSER_STATE_START, FALSE);
+
+    if (parser->filter == NULL)
+        parser->filter = axing_path_filter_new ();
+    return axing_path_filter_add (parser->filter, pattern, error);
+}
+
+
+/* How much checking to do in elements that the path filter skips */
+void
+axing_xml_parser_set_skip_mode (AxingXmlParser *parser,
+                                AxingSkipMode   mode)
+{
+    g_return_if_fail (AXING_IS_XML_PARSER (parser));
+    parser->filter_skip_mode = mode;
+}
+
+
+/* The table the parser interns element, attribute, and namespace names into
+   for the callback API. It's created on first use, and it belongs to the
+   parser unless you take a reference.
+ */
+AxingNameTable *
+axing_xml_parser_get_name_table (AxingXmlParser *parser)
+{
+    g_return_val_if_fail (AXING_IS_XML_PARSER (parser), NULL);
+    if (parser->names == NULL)
+        parser->names = axing_name_table_new ();
+    return parser->names;
+}
+
+
+/* Once this is called, the parser fills in the view as it reads each event,
+   and the same pointer stays good for the life of the parser.
+ */
+const AxingXmlEventView *
+axing_xml_parser_get_event_view (AxingXmlParser *parser)
+{
+    g_return_val_if_fail (AXING_IS_XML_PARSER (parser), NULL);
+    if (!parser->view_enabled) {
+        parser->view_enabled = TRUE;
+        parser->view_attrvals = g_ptr_array_new ();
+        if (parser->event_type != AXING_NODE_TYPE_NONE)
+            parser_update_view (parser);
+    }
+    return &(parser->view);
+}
+
+
+/* Gets the byte offsets of the current event's markup in the document,
+   with end just past it, for copying the bytes as they are. That's like
+   axing_reader_get_offsets, except this returns FALSE unless the bytes
+   really are the event's UTF-8 text: not for events from entity
+   replacement text, and not for documents in other encodings. Text with
+   entity references in it is fine, and the span includes the references.
+ */
+gboolean
+axing_xml_parser_get_event_span (AxingXmlParser *parser,
+                                 goffset        *start,
+                                 goffset        *end)
+{
+    Context *root;
+
+    g_return_val_if_fail (AXING_IS_XML_PARSER (parser), FALSE);
+    if (parser->span_entity)
+        return FALSE;
+    for (root = parser->context; root->parent != NULL; root = root->parent);
+    if (root->raw_encoding != RAW_ENCODING_UTF8)
+        return FALSE;
+    return reader_get_offsets (AXING_READER (parser), start, end);
+}
+
+
+/* The namespace declarations on the current start tag, for code that
+   copies it as it is. Returns prefix and URI pairs, with "" for the
+   default namespace, then NULL. Free the array with g_free. The strings
+   belong to the parser and go away with the event.
+ */
+const char **
+axing_xml_parser_get_ns_declarations (AxingXmlParser *parser)
+{
+    GPtrArray *ret;
+    Event *xmlns;
+
+    g_return_val_if_fail (AXING_IS_XML_PARSER (parser), NULL);
+    g_return_val_if_fail (parser->event_type == AXING_NODE_TYPE_ELEMENT, NULL);
+
+    ret = g_ptr_array_new ();
+    for (xmlns = parser->event->xmlns; xmlns; xmlns = xmlns->parent) {
+        g_ptr_array_add (ret, (gpointer) (xmlns->qname[5] == ':' ? xmlns->qname + 6 : ""));
+        g_ptr_array_add (ret, xmlns->content);
+    }
+    g_ptr_array_add (ret, NULL);
+    return (const char **) g_ptr_array_free (ret, FALSE);
+}
+
+
+/* Parses the whole document, calling the callbacks for each event instead
+   of returning from axing_reader_read. Path filters still apply. Returns
+   FALSE and sets error if the document isn't well-formed.
+
+   This is a convenience API, not a faster tokenizer. It saves the return
+   and resume, the interface call, and the accessor calls for each event,
+   but events are still built and cleared the same way as for
+   axing_reader_read, names and text included. Don't expect much more
+   than a tight read loop would get.
+ */
+gboolean
+axing_xml_parser_parse_with_callbacks (AxingXmlParser                *parser,
+                                       const AxingXmlParserCallbacks *callbacks,
+                                       gpointer                       user_data,
+                                       GError                       **error)
+{
+    GError *readerror = NULL;
+
+    g_return_val_if_fail (AXING_IS_XML_PARSER (parser), FALSE);
+    g_return_val_if_fail (callbacks != NULL, FALSE);
+
+    if (parser->names == NULL)
+        parser->names = axing_name_table_new ();
+    if (parser->attrspans == NULL)
+        parser->attrspans = g_array_new (FALSE, FALSE, sizeof (AxingXmlAttrSpan));
+
+    parser->callbacks = callbacks;
+    parser->callbacks_data = user_data;
+
+    /* parser_read dispatches events itself while callbacks are set, so this
+       only comes back with an event if one was left over from reader_read.
+     */
+    while (parser_read (parser, &readerror))
+        parser_dispatch_event (parser);
+
+    parser->callbacks = NULL;
+    parser->callbacks_data = NULL;
+
+    if (readerror != NULL) {
+        if (error != NULL)
+            *error = g_error_copy (readerror);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+
+/* Gets the parser ready to read another resource from the start. Buffers,
+   the name table, path filters, and the skip mode are kept, so reusing one
+   parser for lots of small documents saves setting all that up each time.
+ */
+void
+axing_xml_parser_reset (AxingXmlParser *parser,
+                        AxingResource  *resource)
+{
+    g_return_if_fail (AXING_IS_XML_PARSER (parser));
+    g_return_if_fail (AXING_IS_RESOURCE (resource));
+    g_return_if_fail (parser->callbacks == NULL);
+
+    /* Text events don't hold anything on the event stack */
+    g_string_truncate (parser->cur_text, 0);
+    while (parser->event) {
+        Event *event = parser->event;
+        parser->event = event->parent;
+        event_free (event);
+    }
+    parser->event_type = AXING_NODE_TYPE_NONE;
+    parser->span_start = parser->span_end = -1;
+
+    while (parser->context) {
+        Context *parent = parser->context->parent;
+        context_free (parser->context);
+        parser->context = parent;
+    }
+
+    parser_stop_prefetch (parser);
+    g_clear_error (&(parser->error));
+    g_clear_object (&parser->cancellable);
+    g_clear_object (&parser->result);
+    g_clear_object (&parser->doctype);
+    parser->xml_version = AXING_XML_VERSION_1_0;
+
+    parser->skip_depth = 0;
+    if (parser->skip_names)
+        g_string_truncate (parser->skip_names, 0);
+    if (parser->filter)
+        axing_path_filter_reset (parser->filter);
+    parser->filter_depth = 0;
+    parser->filter_skipped = FALSE;
+    parser->batch_pending = FALSE;
+
+    if (parser->view_enabled) {
+        memset (&(parser->view), 0, sizeof (AxingXmlEventView));
+        g_ptr_array_set_size (parser->view_attrvals, 0);
+    }
+
+    g_object_ref (resource);
+    g_clear_object (&parser->resource);
+    parser->resource = resource;
+    parser->context = context_new (parser);
+    parser->context->state = PARSER_STATE_START;
+    parser->context->resource = g_object_ref (resource);
+    parser->context->basename = resource_get_basename (resource);
+}
+
+
+typedef struct {
+    AxingResource     **resources;
+    guint               n_resources;
+    AxingResolver      *resolver;
+    AxingParseManyFunc  func;
+    gpointer            user_data;
+    GCancellable       *cancellable;
+    gint                next;
+} ParseMany;
+
+/* Workers take the next resource off a shared counter, so a thread that
+   gets small documents just ends up doing more of them.
+ */
+static gpointer
+parse_many_worker (gpointer data)
+{
+    ParseMany *many = data;
+    AxingXmlParser *parser = NULL;
+
+    while (!g_cancellable_is_cancelled (many->cancellable)) {
+        guint i = (guint) g_atomic_int_add (&(many->next), 1);
+        if (i >= many->n_resources)
+            break;
+        if (parser == NULL)
+            parser = axing_xml_parser_new (many->resources[i], many->resolver);
+        else {
+            /* func adds its filters again for each resource */
+            g_clear_pointer (&(parser->filter), axing_path_filter_free);
+            parser->filter_skip_mode = AXING_SKIP_MODE_WELL_FORMED;
+            axing_xml_parser_reset (parser, many->resources[i]);
+        }
+        if (many->cancellable != NULL)
+            parser->cancellable = g_object_ref (many->cancellable);
+        many->func (parser, many->resources[i], many->user_data);
+    }
+
+    g_clear_object (&parser);
+    return NULL;
+}
+
+/* Calls func for each resource with a parser for it, on n_threads threads
+   including the calling one. n_threads of 0 means one for each processor.
+   Each thread reuses one parser. Path filters and the skip mode are
+   cleared before each resource, but other settings made in func carry over
+   to the next resource on that thread. The resolver is shared by all the
+   threads, and cancellable is set on every parser, so cancelling it also
+   stops the documents being parsed. Returns when every resource is done,
+   or when the remaining ones are skipped because cancellable was cancelled.
+ */
+void
+axing_parse_many (AxingResource      **resources,
+                  guint                n_resources,
+                  AxingResolver       *resolver,
+                  guint                n_threads,
+                  AxingParseManyFunc   func,
+                  gpointer             user_data,
+                  GCancellable        *cancellable)
+{
+    ParseMany many;
+    GThread **threads;
+    guint i;
+
+    g_return_if_fail (resources != NULL || n_resources == 0);
+    g_return_if_fail (func != NULL);
+
+    if (n_threads == 0)
+        n_threads = g_get_num_processors ();
+    n_threads = MAX (1, MIN (n_threads, n_resources));
+
+    many.resources = resources;
+    many.n_resources = n_resources;
+    many.resolver = resolver ? g_object_ref (resolver) : axing_resolver_get_default ();
+    many.func = func;
+    many.user_data = user_data;
+    many.cancellable = cancellable;
+    many.next = 0;
+
+    threads = g_new0 (GThread *, n_threads);
+    for (i = 1; i < n_threads; i++)
+        threads[i] = g_thread_new ("axing-parse-many", parse_many_worker, &many);
+    parse_many_worker (&many);
+    for (i = 1; i < n_threads; i++)
+        g_thread_join (threads[i]);
+
+    g_free (threads);
+    g_object_unref (many.resolver);
+}
+
+
+/* Non-validating parsers don't have to read the external subset, and this
+   one doesn't unless you ask. External subsets are parsed once for each
+   process and shared by every parser that uses them.
+ */
+void
+axing_xml_parser_set_load_external_dtd (AxingXmlParser *parser,
+                                        gboolean        load)
+{
+    g_return_if_fail (AXING_IS_XML_PARSER (parser));
+    parser->load_dtd = load;
+}
+
+
+/* If set, external entities declared in the DOCTYPE are resolved and opened
+   in the background as soon as it closes, so the parse doesn't stop to
+   open them at their first reference. Only the first reference to each
+   entity uses the prefetched stream.
+ */
+void
+axing_xml_parser_set_prefetch_entities (AxingXmlParser *parser,
+                                        gboolean        prefetch)
+{
+    g_return_if_fail (AXING_IS_XML_PARSER (parser));
+    parser->prefetch = prefetch;
+}
+
+
+/* Each prefetch is one job on a shared pool that resolves and opens the
+   entity with the blocking calls, so nothing waits on the caller's main
+   loop or on the parser reaching the reference. The job and the parser
+   each hold a reference, and the parser never waits for jobs it drops.
+   If the parser gets to a reference before its job has left the queue,
+   it takes the job back and resolves the entity itself, rather than wait
+   behind other jobs. Resolvers are already called from worker threads by parse_many and
+   the parallel parser, so they have to be thread-safe anyway.
+ */
+typedef struct {
+    gint            ref_count;
+    AxingResolver  *resolver;
+    AxingResource  *base;
+    char           *public;
+    char           *system;
+    GCancellable   *cancellable;
+    AxingResource  *resource; /* set by the job, NULL if it failed */
+    gboolean        started;
+    gboolean        taken;    /* by the parser, before the job started */
+    gboolean        done;
+} Prefetch;
+
+#define PREFETCH_THREADS 4
+
+static GMutex       prefetch_mutex;
+static GCond        prefetch_cond;
+static GThreadPool *prefetch_pool;
+
+static void
+prefetch_unref (Prefetch *prefetch)
+{
+    if (!g_atomic_int_dec_and_test (&(prefetch->ref_count)))
+        return;
+    g_clear_object (&(prefetch->resolver));
+    g_clear_object (&(prefetch->base));
+    g_free (prefetch->public);
+    g_free (prefetch->system);
+    g_clear_object (&(prefetch->cancellable));
+    g_clear_object (&(prefetch->resource));
+    g_free (prefetch);
+}
+
+static void
+prefetch_job (gpointer data,
+              gpointer user_data)
+{
+    Prefetch *prefetch = data;
+    AxingResource *resource = NULL;
+
+    g_mutex_lock (&prefetch_mutex);
+    if (prefetch->taken) {
+        g_mutex_unlock (&prefetch_mutex);
+        prefetch_unref (prefetch);
+        return;
+    }
+    prefetch->started = TRUE;
+    g_mutex_unlock (&prefetch_mutex);
+
+    /* If anything fails, the parser resolves again to get a real error */
+    if (!g_cancellable_is_cancelled (prefetch->cancellable))
+        resource = axing_resolver_resolve (prefetch->resolver, prefetch->base,
+                                           NULL, prefetch->system, prefetch->public,
+                                           AXING_RESOLVER_HINT_ENTITY,
+                                           prefetch->cancellable, NULL);
+    /* The resource keeps the stream */
+    if (resource != NULL &&
+        axing_resource_read (resource, prefetch->cancellable, NULL) == NULL)
+        g_clear_object (&resource);
+
+    g_mutex_lock (&prefetch_mutex);
+    prefetch->resource = resource;
+    prefetch->done = TRUE;
+    g_cond_broadcast (&prefetch_cond);
+    g_mutex_unlock (&prefetch_mutex);
+
+    prefetch_unref (prefetch);
+}
+
+static void
+parser_start_prefetch (AxingXmlParser *parser)
+{
+    char **names;
+    int i;
+
+    names = axing_dtd_schema_get_external_entity_names (parser->doctype);
+    if (names == NULL || names[0] == NULL) {
+        g_strfreev (names);
+        return;
+    }
+
+    g_mutex_lock (&prefetch_mutex);
+    if (prefetch_pool == NULL)
+        prefetch_pool = g_thread_pool_new (prefetch_job, NULL, PREFETCH_THREADS, FALSE, NULL);
+    g_mutex_unlock (&prefetch_mutex);
+
+    if (parser->resolver == NULL)
+        parser->resolver = axing_resolver_get_default ();
+    parser->prefetch_cancellable = g_cancellable_new ();
+    parser->prefetched = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                                (GDestroyNotify) prefetch_unref);
+
+    for (i = 0; names[i] != NULL; i++) {
+        Prefetch *prefetch;
+        char *value = NULL, *public = NULL, *system = NULL, *ndata = NULL;
+
+        if (!axing_dtd_schema_get_entity_full (parser->doctype, names[i],
+                                               &value, &public, &system, &ndata))
+            continue;
+
+        prefetch = g_new0 (Prefetch, 1);
+        prefetch->ref_count = 2;
+        prefetch->resolver = g_object_ref (parser->resolver);
+        prefetch->base = g_object_ref (parser->resource);
+        prefetch->public = public;
+        prefetch->system = system;
+        prefetch->cancellable = g_object_ref (parser->prefetch_cancellable);
+        g_hash_table_insert (parser->prefetched, g_strdup (names[i]), prefetch);
+        g_thread_pool_push (prefetch_pool, prefetch, NULL);
+
+        g_free (value);
+        g_free (ndata);
+    }
+    g_strfreev (names);
+}
+
+/* Returns NULL if there's no usable prefetch, and the parser should just
+   resolve the entity itself. That includes a job still in the queue,
+   which is marked so the pool drops it. This only waits if the job is
+   already running.
+ */
+static AxingResource *
+parser_take_prefetched (AxingXmlParser *parser,
+                        const char     *entname)
+{
+    Prefetch *prefetch;
+    AxingResource *resource;
+
+    if (parser->prefetched == NULL)
+        return NULL;
+    prefetch = g_hash_table_lookup (parser->prefetched, entname);
+    if (prefetch == NULL)
+        return NULL;
+
+    /* The stream can only be read once */
+    g_mutex_lock (&prefetch_mutex);
+    if (!prefetch->started) {
+        prefetch->taken = TRUE;
+        resource = NULL;
+    }
+    else {
+        while (!prefetch->done)
+            g_cond_wait (&prefetch_cond, &prefetch_mutex);
+        resource = prefetch->resource;
+        prefetch->resource = NULL;
+    }
+    g_mutex_unlock (&prefetch_mutex);
+
+    g_hash_table_remove (parser->prefetched, entname);
+    return resource;
+}
+
+/* Jobs still running finish on their own and drop their references */
+static void
+parser_stop_prefetch (AxingXmlParser *parser)
+{
+    if (parser->prefetched == NULL)
+        return;
+
+    g_cancellable_cancel (parser->prefetch_cancellable);
+    g_clear_pointer (&(parser->prefetched), g_hash_table_destroy);
+    g_clear_object (&(parser->prefetch_cancellable));
+}
+
+/* Only schemas that loaded go in the cache, so a DTD that fails, or a
+   parse that gets cancelled, is tried again next time. Entries for local
+   files remember the modification time of the DTD and of each external
+   parameter entity it read, and get reloaded if any of them changes.
+   Entries are keyed on the resolver too, since another resolver could
+   map those parameter entities somewhere else. Entries added with
+   axing_xml_parser_add_external_dtd are pinned, are used with any
+   resolver, and never go stale. The rest are evicted least recently
+   used first.
+ */
+#define DTD_CACHE_SIZE 32
+
+typedef struct {
+    AxingDtdSchema *schema; /* NULL while loading */
+    gboolean        loading;
+    gboolean        pinned;
+    guint64         mtime;  /* 0 if we can't tell */
+    GPtrArray      *deps;   /* DtdDep, or NULL */
+    guint64         used;
+} DtdCacheEntry;
+
+typedef struct {
+    GFile          *file;
+    guint64         mtime;
+} DtdDep;
+
+static GMutex      dtd_cache_mutex;
+static GCond       dtd_cache_cond;
+static GHashTable *dtd_cache;
+static guint64     dtd_cache_clock;
+static guint       dtd_cache_resolvers;
+
+static void
+dtd_dep_free (DtdDep *dep)
+{
+    g_object_unref (dep->file);
+    g_free (dep);
+}
+
+static void
+dtd_cache_entry_free (DtdCacheEntry *entry)
+{
+    g_clear_object (&(entry->schema));
+    if (entry->deps)
+        g_ptr_array_free (entry->deps, TRUE);
+    g_free (entry);
+}
+
+/* Called with dtd_cache_mutex held. Resolvers get a serial number rather
+   than going by address, so a new resolver that lands where an old one
+   was freed doesn't pick up its entries. A NULL resolver makes the key
+   for pinned entries.
+ */
+static char *
+dtd_cache_key (AxingResolver *resolver,
+               const char    *public,
+               const char    *uri)
+{
+    static GQuark quark = 0;
+    guint serial;
+
+    if (resolver == NULL)
+        return g_strconcat ("\n", public ? public : "", "\n", uri, NULL);
+
+    if (G_UNLIKELY (quark == 0))
+        quark = g_quark_from_static_string ("axing-dtd-cache-resolver");
+    serial = GPOINTER_TO_UINT (g_object_get_qdata (G_OBJECT (resolver), quark));
+    if (serial == 0) {
+        serial = ++dtd_cache_resolvers;
+        g_object_set_qdata (G_OBJECT (resolver), quark, GUINT_TO_POINTER (serial));
+    }
+    return g_strdup_printf ("%u\n%s\n%s", serial, public ? public : "", uri);
+}
+
+static DtdCacheEntry *
+dtd_cache_get_entry (const char *key,
+                     gboolean   *created)
+{
+    DtdCacheEntry *entry;
+    if (dtd_cache == NULL)
+        dtd_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                           (GDestroyNotify) dtd_cache_entry_free);
+    entry = g_hash_table_lookup (dtd_cache, key);
+    *created = (entry == NULL);
+    if (entry == NULL) {
+        entry = g_new0 (DtdCacheEntry, 1);
+        g_hash_table_insert (dtd_cache, g_strdup (key), entry);
+    }
+    return entry;
+}
+
+/* Called with dtd_cache_mutex held */
+static void
+dtd_cache_trim (void)
+{
+    while (g_hash_table_size (dtd_cache) > DTD_CACHE_SIZE) {
+        GHashTableIter iter;
+        gpointer key, value;
+        char *oldest = NULL;
+        guint64 used = G_MAXUINT64;
+
+        g_hash_table_iter_init (&iter, dtd_cache);
+        while (g_hash_table_iter_next (&iter, &key, &value)) {
+            DtdCacheEntry *entry = value;
+            if (entry->loading || entry->pinned)
+                continue;
+            if (entry->used < used) {
+                oldest = key;
+                used = entry->used;
+            }
+        }
+        if (oldest == NULL)
+            break;
+        g_hash_table_remove (dtd_cache, oldest);
+    }
+}
+
+static guint64
+dtd_file_mtime (GFile *file)
+{
+    GFileInfo *info;
+    guint64 mtime = 0;
+
+    if (file == NULL || !g_file_is_native (file))
+        return 0;
+    info = g_file_query_info (file, G_FILE_ATTRIBUTE_TIME_MODIFIED,
+                              G_FILE_QUERY_INFO_NONE, NULL, NULL);
+    if (info != NULL) {
+        mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+        g_object_unref (info);
+    }
+    return mtime;
+}
+
+/* Whether any parameter entity file has changed since it was read. These
+   are local stats, so they're cheap enough to do under dtd_cache_mutex.
+ */
+static gboolean
+dtd_deps_changed (GPtrArray *deps)
+{
+    guint i;
+    if (deps == NULL)
+        return FALSE;
+    for (i = 0; i < deps->len; i++) {
+        DtdDep *dep = deps->pdata[i];
+        if (dtd_file_mtime (dep->file) != dep->mtime)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/* Called for each external parameter entity a parser reads while it's
+   loading an external subset. The mtime is taken before the entity is
+   read, so a change while we read it makes the entry stale, not wrong.
+ */
+static void
+parser_add_dtd_dep (AxingXmlParser *parser,
+                    AxingResource  *resource)
+{
+    GFile *file = axing_resource_get_file (resource);
+    DtdDep *dep;
+
+    if (file == NULL)
+        return;
+    if (parser->dtd_deps == NULL)
+        parser->dtd_deps = g_ptr_array_new_with_free_func ((GDestroyNotify) dtd_dep_free);
+    dep = g_new0 (DtdDep, 1);
+    dep->file = g_object_ref (file);
+    dep->mtime = dtd_file_mtime (file);
+    g_ptr_array_add (parser->dtd_deps, dep);
+}
+
+/* Puts an external subset in the cache, so parsers use it instead of
+   loading the DTD at uri. Use it with schemas from
+   axing_dtd_schema_new_for_file to skip parsing big DTDs at startup.
+   uri is the system ID after resolving, and public can be NULL.
+ */
+void
+axing_xml_parser_add_external_dtd (const char     *public,
+                                   const char     *uri,
+                                   AxingDtdSchema *schema)
+{
+    DtdCacheEntry *entry;
+    gboolean created;
+    char *key;
+
+    g_return_if_fail (uri != NULL);
+    g_return_if_fail (AXING_IS_DTD_SCHEMA (schema) && axing_dtd_schema_is_frozen (schema));
+
+    g_mutex_lock (&dtd_cache_mutex);
+    key = dtd_cache_key (NULL, public, uri);
+    entry = dtd_cache_get_entry (key, &created);
+    g_clear_object (&(entry->schema));
+    entry->schema = g_object_ref (schema);
+    entry->pinned = TRUE;
+    g_mutex_unlock (&dtd_cache_mutex);
+    g_free (key);
+}
+
+void
+axing_xml_parser_set_dtd_cache (AxingXmlParser *parser,
+                                gboolean        use_cache)
+{
+    g_return_if_fail (AXING_IS_XML_PARSER (parser));
+    parser->no_dtd_cache = !use_cache;
+}
+
+/* Failing to find or read the external subset isn't an error, since we
+   don't have to read it at all, but a DTD that doesn't parse is. This
+   runs on whatever thread is reading, like the rest of the parser; read
+   parsers in a thread if that matters.
+ */
+static void
+parser_load_external_subset (AxingXmlParser *parser)
+{
+    const char *public = axing_dtd_schema_get_public_id (parser->doctype);
+    const char *system = axing_dtd_schema_get_system_id (parser->doctype);
+    AxingResource *resource;
+    DtdCacheEntry *entry;
+    AxingDtdSchema *schema = NULL;
+    GPtrArray *deps = NULL;
+    gboolean created = FALSE;
+    guint64 mtime;
+    char *uri, *key;
+
+    if (system == NULL)
+        return;
+
+    if (parser->resolver == NULL)
+        parser->resolver = axing_resolver_get_default ();
+    resource = axing_resolver_resolve (parser->resolver, parser->resource,
+                                       NULL, system, public,
+                                       AXING_RESOLVER_HINT_ENTITY,
+                                       parser->cancellable, NULL);
+    if (resource == NULL)
+        return;
+
+    uri = g_file_get_uri (axing_resource_get_file (resource));
+
+    if (parser->no_dtd_cache) {
+        schema = external_subset_parse (parser, resource, uri, &deps);
+        if (deps != NULL)
+            g_ptr_array_free (deps, TRUE);
+        key = NULL;
+        goto done;
+    }
+
+    mtime = dtd_file_mtime (axing_resource_get_file (resource));
+
+    g_mutex_lock (&dtd_cache_mutex);
+    key = dtd_cache_key (NULL, public, uri);
+    entry = dtd_cache ? g_hash_table_lookup (dtd_cache, key) : NULL;
+    g_free (key);
+    key = dtd_cache_key (parser->resolver, public, uri);
+    if (entry != NULL) {
+        entry->used = ++dtd_cache_clock;
+        schema = g_object_ref (entry->schema);
+    }
+    while (schema == NULL) {
+        entry = dtd_cache_get_entry (key, &created);
+        if (created)
+            break;
+        if (entry->loading) {
+            /* The entry goes away if the load fails, so look it up again */
+            g_cond_wait (&dtd_cache_cond, &dtd_cache_mutex);
+            continue;
+        }
+        if (entry->mtime != mtime || dtd_deps_changed (entry->deps)) {
+            g_hash_table_remove (dtd_cache, key);
+            continue;
+        }
+        entry->used = ++dtd_cache_clock;
+        schema = g_object_ref (entry->schema);
+    }
+
+    if (created) {
+        /* We get to load it. Anyone else who wants it waits for us. */
+        entry->loading = TRUE;
+        g_mutex_unlock (&dtd_cache_mutex);
+
+        schema = external_subset_parse (parser, resource, uri, &deps);
+
+        g_mutex_lock (&dtd_cache_mutex);
+        if (schema != NULL) {
+            entry->schema = g_object_ref (schema);
+            entry->loading = FALSE;
+            entry->mtime = mtime;
+            entry->deps = deps;
+            entry->used = ++dtd_cache_clock;
+            dtd_cache_trim ();
+        }
+        else {
+            g_hash_table_remove (dtd_cache, key);
+        }
+        g_cond_broadcast (&dtd_cache_cond);
+    }
+    g_mutex_unlock (&dtd_cache_mutex);
+
+ done:
+    if (schema != NULL) {
+        axing_dtd_schema_set_external_subset (parser->doctype, schema);
+        g_object_unref (schema);
+    }
+
+    g_free (key);
+    g_free (uri);
+    g_object_unref (resource);
+}
+
+/* The external subset has the same declarations as the internal subset,
+   so we parse it as the internal subset of a tiny document. The parser
+   gets external_subset set, which lets it take conditional sections and
+   load external parameter entities. Parse errors in the DTD are copied
+   to parser->error. Anything else returns NULL with no error set. deps
+   gets the external parameter entities it read, or NULL if none.
+ */
+static AxingDtdSchema *
+external_subset_parse (AxingXmlParser *parser,
+                       AxingResource  *resource,
+                       const char     *uri,
+                       GPtrArray     **deps)
+{
+    GInputStream *stream;
+    GOutputStream *out;
+    GBytes *bytes = NULL;
+    GString *doc;
+    const char *data;
+    gsize len;
+    AxingResource *docresource;
+    AxingXmlParser *docparser;
+    AxingDtdSchema *schema = NULL;
+    GError *error = NULL;
+
+    stream = axing_resource_read (resource, parser->cancellable, NULL);
+    if (stream == NULL)
+        return NULL;
+    if (axing_resource_get_bytes (resource) != NULL) {
+        bytes = g_bytes_ref (axing_resource_get_bytes (resource));
+    }
+    else {
+        out = g_memory_output_stream_new_resizable ();
+        if (g_output_stream_splice (out, stream,
+                                    G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
+                                    G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
+                                    parser->cancellable, NULL) >= 0)
+            bytes = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (out));
+        g_object_unref (out);
+    }
+    if (bytes == NULL)
+        return NULL;
+
+    /* FIXME: Only UTF-8 for now. Drop the BOM and text declaration. */
+    data = g_bytes_get_data (bytes, &len);
+    if (len >= 3 && EQ3 (data, '\xEF', '\xBB', '\xBF')) {
+        data += 3; len -= 3;
+    }
+    if (len >= 6 && strncmp (data, "<?xml", 5) == 0 && g_ascii_isspace (data[5])) {
+        const char *end = g_strstr_len (data, len, "?>");
+        if (end != NULL) {
+            len -= end + 2 - data;
+            data = end + 2;
+        }
+    }
+
+    doc = g_string_sized_new (len + 32);
+    g_string_append (doc, "<!DOCTYPE x [");
+    g_string_append_len (doc, data, len);
+    g_string_append (doc, "]><x/>");
+    g_bytes_unref (bytes);
+    bytes = g_string_free_to_bytes (doc);
+
+    stream = g_memory_input_stream_new_from_bytes (bytes);
+    docresource = axing_resource_new (axing_resource_get_file (resource), stream);
+    docparser = axing_xml_parser_new (docresource, parser->resolver);
+    docparser->external_subset = TRUE;
+    docparser->load_dtd = TRUE;
+    if (parser->cancellable != NULL)
+        docparser->cancellable = g_object_ref (parser->cancellable);
+    /* The parser owns the error it sets */
+    while (axing_reader_read (AXING_READER (docparser), &error)) { }
+
+    if (error != NULL) {
+        if (error->domain == AXING_XML_PARSER_ERROR)
+            parser->error = g_error_copy (error);
+    }
+    else if (docparser->doctype != NULL) {
+        schema = g_object_ref (docparser->doctype);
+        axing_dtd_schema_set_base_uri (schema, uri);
+        axing_dtd_schema_freeze (schema);
+        *deps = g_steal_pointer (&(docparser->dtd_deps));
+    }
+
+    g_object_unref (docparser);
+    g_object_unref (docresource);
+    g_object_unref (stream);
+    g_bytes_unref (bytes);
+    return schema;
+}
+
+
 static void
 parser_clear_event (AxingXmlParser *parser)
 {
     Event *event;
     if (parser->event_type == AXING_NODE_TYPE_ELEMENT && parser->event->empty) {
         parser->event_type = AXING_NODE_TYPE_END_ELEMENT;
+        parser->span_start = parser->span_end;
         return;
     }
     switch (parser->event_type) {
@@ -585,7 +1671,95 @@ reader_read (AxingReader  *reader,
 {
     AxingXmlParser *parser = AXING_XML_PARSER (reader);
 
-    AXING_DEBUG ("reader_read\n");
+    if (parser->filter == NULL) {
+        if (!parser_read (parser, error))
+            goto done;
+        if (parser->view_enabled)
+            parser_update_view (parser);
+        return TRUE;
+    }
+
+    while (parser_read (parser, error)) {
+        if (parser_filter_event (parser)) {
+            if (parser->view_enabled)
+                parser_update_view (parser);
+            return TRUE;
+        }
+    }
+
+ done:
+    if (parser->view_enabled)
+        parser_update_view (parser);
+    return FALSE;
+}
+
+
+static char *nokeys[1] = {NULL};
+
+static void
+parser_update_view (AxingXmlParser *parser)
+{
+    AxingXmlEventView *view = &(parser->view);
+    Event *event = parser->event;
+
+    view->type = parser->event_type;
+    view->qname = NULL;
+    view->localname = NULL;
+    view->prefix = NULL;
+    view->namespace = NULL;
+    view->content = NULL;
+    view->content_len = 0;
+    view->attrs = NULL;
+    view->attr_values = NULL;
+    view->linenum = 0;
+    view->colnum = 0;
+
+    switch (parser->event_type) {
+    case AXING_NODE_TYPE_ELEMENT:
+    case AXING_NODE_TYPE_END_ELEMENT:
+        view->qname = event->qname;
+        view->localname = event->localname ? event->localname : event->qname;
+        view->prefix = event->prefix ? event->prefix : "";
+        view->namespace = event->namespace ? event->namespace : "";
+        view->linenum = event->linenum;
+        view->colnum = event->colnum;
+        if (parser->event_type == AXING_NODE_TYPE_ELEMENT) {
+            Event *attr;
+            guint numattrs = 0, attrnum;
+            for (attr = event->attrs; attr; attr = attr->parent)
+                numattrs++;
+            /* Attributes are stacked last to first, like attrkeys is filled */
+            g_ptr_array_set_size (parser->view_attrvals, numattrs + 1);
+            attrnum = numattrs;
+            for (attr = event->attrs; attr; attr = attr->parent)
+                parser->view_attrvals->pdata[--attrnum] = attr->content ? attr->content : "";
+            parser->view_attrvals->pdata[numattrs] = NULL;
+            view->attrs = (const char * const *) (event->attrkeys ? event->attrkeys : nokeys);
+            view->attr_values = (const char * const *) parser->view_attrvals->pdata;
+        }
+        break;
+    case AXING_NODE_TYPE_INSTRUCTION:
+        view->qname = parser->context->cur_qname;
+        /* fall through */
+    case AXING_NODE_TYPE_CONTENT:
+    case AXING_NODE_TYPE_COMMENT:
+    case AXING_NODE_TYPE_CDATA:
+        view->content = parser->cur_text->str;
+        view->content_len = parser->cur_text->len;
+        view->linenum = parser->txtlinenum;
+        view->colnum = parser->txtcolnum;
+        break;
+    default:
+        break;
+    }
+}
+
+
+static gboolean
+parser_read (AxingXmlParser  *parser,
+             GError         **error)
+{
+    AXING_DEBUG ("parser_read\n");
 
     if (parser->context->state == PARSER_STATE_START) {
         context_start_sync (parser->context);
@@ -632,8 +1806,12 @@ reader_read (AxingReader  *reader,
             context_parse_line (parser->context);
             if (parser->error)
                 goto error;
-            if (parser->event_type != AXING_NODE_TYPE_NONE)
-                return TRUE;
+            if (parser->event_type != AXING_NODE_TYPE_NONE) {
+                parser_mark_end (parser);
+                if (parser->callbacks == NULL)
+                    return TRUE;
+                parser_dispatch_event (parser);
+            }
         }
         if (parser->context->linecur && parser->context->linecur[0] == '\0') {
             /* FIXME: I really don't like this. This is the only spot we reliably hit
@@ -658,6 +1836,8 @@ reader_read (AxingReader  *reader,
                my own GInputStream wrapper, but I really don't want to.
             */
             char eol[2] = {0x0A, 0x00};
+            context_advance_offset (parser->context, parser->context->line,
+                                    parser->context->linecur - parser->context->line);
             if (parser->context->datastream &&
                 (parser->context->line == parser->context->linecur ||
                  (parser->context->linecur - 1)[0] != 0x0D)) {
@@ -665,10 +1845,16 @@ reader_read (AxingReader  *reader,
                 parser->context->line = eol;
                 parser->context->linecur = parser->context->line;
                 context_parse_line (parser->context);
+                if (parser->event_type != AXING_NODE_TYPE_NONE)
+                    parser_mark_end (parser);
+                if (parser->callbacks && parser->event_type != AXING_NODE_TYPE_NONE)
+                    parser_dispatch_event (parser);
             }
             else {
                 g_free (parser->context->line);
             }
+            /* The LF that read_line ate */
+            context_advance_offset (parser->context, "\n", 1);
             parser->context->line = NULL;
             parser->context->linecur = NULL;
         }
@@ -832,7 +2018,7 @@ reader_get_content (AxingReader *reader)
 }
 
 
-static int
+static gint64
 reader_get_linenum(AxingReader *reader)
 {
     AxingXmlParser *parser;
@@ -849,7 +2035,7 @@ reader_get_linenum(AxingReader *reader)
 }
 
 
-static int
+static gint64
 reader_get_colnum (AxingReader *reader)
 {
     AxingXmlParser *parser;
@@ -866,8 +2052,6 @@ reader_get_colnum (AxingReader *reader)
 }
 
 
-static char *nokeys[1] = {NULL};
-
 static const char * const *
 reader_get_attrs (AxingReader *reader)
 {
@@ -966,7 +2150,7 @@ reader_get_attr_value (AxingReader *reader,
 }
 
 
-static int
+static gint64
 reader_get_attr_linenum (AxingReader *reader, const char *qname)
 {
     AxingXmlParser *parser;
@@ -981,21 +2165,391 @@ reader_get_attr_linenum (AxingReader *reader, const char *qname)
 }
 
 
-static int
-reader_get_attr_colnum (AxingReader *reader, const char *qname)
+static gint64
+reader_get_attr_colnum (AxingReader *reader, const char *qname)
+{
+    AxingXmlParser *parser;
+    Event *attr;
+    g_return_val_if_fail (AXING_IS_XML_PARSER (reader), 0);
+    parser = (AxingXmlParser *) reader;
+    g_return_val_if_fail (parser->event_type == AXING_NODE_TYPE_ELEMENT, 0);
+    for (attr = parser->event->attrs; attr; attr = attr->parent)
+        if (g_str_equal (qname, attr->qname))
+            return attr->colnum;
+    return 0;
+}
+
+
+/* Offsets count bytes in the document, so it's the document's encoding
+   that matters, not any entity's.
+ */
+static gboolean
+parser_offsets_known (AxingXmlParser *parser)
+{
+    Context *root;
+    if (parser->context == NULL)
+        return TRUE;
+    for (root = parser->context; root->parent != NULL; root = root->parent);
+    return root->raw_encoding != RAW_ENCODING_UNKNOWN;
+}
+
+
+static gboolean
+reader_get_offsets (AxingReader *reader,
+                    goffset     *start,
+                    goffset     *end)
+{
+    AxingXmlParser *parser;
+    g_return_val_if_fail (AXING_IS_XML_PARSER (reader), FALSE);
+    parser = (AxingXmlParser *) reader;
+    if (parser->event_type == AXING_NODE_TYPE_NONE ||
+        parser->event_type == AXING_NODE_TYPE_ERROR ||
+        parser->span_start < 0 || parser->span_end < 0 ||
+        !parser_offsets_known (parser))
+        return FALSE;
+    if (start != NULL)
+        *start = parser->span_start;
+    if (end != NULL)
+        *end = parser->span_end;
+    return TRUE;
+}
+
+
+static gboolean
+reader_get_attr_offsets (AxingReader *reader,
+                         const char  *qname,
+                         goffset     *start,
+                         goffset     *end)
+{
+    AxingXmlParser *parser;
+    Event *attr;
+    g_return_val_if_fail (AXING_IS_XML_PARSER (reader), FALSE);
+    parser = (AxingXmlParser *) reader;
+    g_return_val_if_fail (parser->event_type == AXING_NODE_TYPE_ELEMENT, FALSE);
+    if (!parser_offsets_known (parser))
+        return FALSE;
+    for (attr = parser->event->attrs; attr; attr = attr->parent) {
+        if (g_str_equal (qname, attr->qname)) {
+            if (start != NULL)
+                *start = attr->start;
+            if (end != NULL)
+                *end = attr->end;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+
+static gboolean
+reader_skip_element (AxingReader    *reader,
+                     AxingSkipMode   mode,
+                     GError        **error)
+{
+    AxingXmlParser *parser;
+    g_return_val_if_fail (AXING_IS_XML_PARSER (reader), FALSE);
+    parser = (AxingXmlParser *) reader;
+    g_return_val_if_fail (parser->event_type == AXING_NODE_TYPE_ELEMENT, FALSE);
+
+    /* Empty elements already turn into END_ELEMENT on the next read */
+    if (!parser->event->empty)
+        parser_start_skip (parser, mode);
+
+    return reader_read (reader, error);
+}
+
+
+/* Like the default in AxingReader, but reads the events directly instead
+   of going through the accessors.
+ */
+static guint
+reader_read_batch (AxingReader       *reader,
+                   AxingEventRecord  *records,
+                   guint              n_records,
+                   GError           **error)
+{
+    AxingXmlParser *parser = AXING_XML_PARSER (reader);
+    GError *readerror = NULL;
+    guint count = 0;
+    guint i;
+
+    if (parser->names == NULL)
+        parser->names = axing_name_table_new ();
+    if (parser->batchbuf == NULL)
+        parser->batchbuf = g_string_sized_new (1024);
+    g_string_truncate (parser->batchbuf, 0);
+
+    while (count < n_records) {
+        AxingEventRecord *record;
+        Event *attr;
+        guint n_attrs = 0;
+
+        if (parser->batch_pending) {
+            parser->batch_pending = FALSE;
+        }
+        else if (!reader_read (reader, &readerror)) {
+            if (readerror != NULL) {
+                /* Drop the partial batch on errors */
+                if (error != NULL)
+                    *error = g_error_copy (readerror);
+                return 0;
+            }
+            break;
+        }
+
+        if (parser->event_type == AXING_NODE_TYPE_ELEMENT) {
+            for (attr = parser->event->attrs; attr; attr = attr->parent)
+                n_attrs++;
+            if (count + n_attrs + 1 > n_records) {
+                /* Keep it for the next call either way */
+                parser->batch_pending = TRUE;
+                if (count == 0) {
+                    g_set_error (error, G_IO_ERROR, G_IO_ERROR_NO_SPACE,
+                                 "Element with %u attributes does not fit in %u records",
+                                 n_attrs, n_records);
+                    return 0;
+                }
+                break;
+            }
+        }
+
+        record = &(records[count++]);
+        record->type = parser->event_type;
+        record->name_id = 0;
+        record->ns_id = 0;
+        record->n_attrs = 0;
+        record->text = NULL;
+        record->text_len = 0;
+
+        switch (parser->event_type) {
+        case AXING_NODE_TYPE_ELEMENT:
+        case AXING_NODE_TYPE_END_ELEMENT:
+            event_intern_names (parser, parser->event);
+            record->name_id = parser->event->name_id;
+            record->ns_id = parser->event->ns_id;
+            record->linenum = parser->event->linenum;
+            record->colnum = parser->event->colnum;
+            if (parser->event_type == AXING_NODE_TYPE_END_ELEMENT)
+                break;
+            /* Attributes are stacked last to first, so fill from the back */
+            record->n_attrs = n_attrs;
+            i = count + n_attrs;
+            for (attr = parser->event->attrs; attr; attr = attr->parent) {
+                AxingEventRecord *attrrec = &(records[--i]);
+                gsize len = attr->content ? strlen (attr->content) : 0;
+                event_intern_names (parser, attr);
+                attrrec->type = AXING_NODE_TYPE_ATTRIBUTE;
+                attrrec->name_id = attr->name_id;
+                attrrec->ns_id = attr->ns_id;
+                attrrec->n_attrs = 0;
+                attrrec->linenum = attr->linenum;
+                attrrec->colnum = attr->colnum;
+                attrrec->text = GSIZE_TO_POINTER (parser->batchbuf->len);
+                attrrec->text_len = len;
+                g_string_append_len (parser->batchbuf, attr->content ? attr->content : "", len);
+                g_string_append_c (parser->batchbuf, '\0');
+            }
+            count += n_attrs;
+            break;
+        case AXING_NODE_TYPE_INSTRUCTION:
+        case AXING_NODE_TYPE_CONTENT:
+        case AXING_NODE_TYPE_COMMENT:
+        case AXING_NODE_TYPE_CDATA:
+            if (parser->event_type == AXING_NODE_TYPE_INSTRUCTION)
+                record->name_id = axing_name_table_intern (parser->names,
+                                                           parser->context->cur_qname, -1);
+            record->linenum = parser->txtlinenum;
+            record->colnum = parser->txtcolnum;
+            record->text = GSIZE_TO_POINTER (parser->batchbuf->len);
+            record->text_len = parser->cur_text->len;
+            g_string_append_len (parser->batchbuf, parser->cur_text->str, parser->cur_text->len + 1);
+            break;
+        default:
+            record->linenum = 0;
+            record->colnum = 0;
+            break;
+        }
+    }
+
+    /* The buffer may have moved while we filled it */
+    for (i = 0; i < count; i++) {
+        switch (records[i].type) {
+        case AXING_NODE_TYPE_ATTRIBUTE:
+        case AXING_NODE_TYPE_INSTRUCTION:
+        case AXING_NODE_TYPE_CONTENT:
+        case AXING_NODE_TYPE_COMMENT:
+        case AXING_NODE_TYPE_CDATA:
+            records[i].text = parser->batchbuf->str + GPOINTER_TO_SIZE (records[i].text);
+            break;
+        default:
+            break;
+        }
+    }
+
+    return count;
+}
+
+
+static AxingNameTable *
+reader_get_name_table (AxingReader *reader)
+{
+    return axing_xml_parser_get_name_table (AXING_XML_PARSER (reader));
+}
+
+
+static void
+parser_start_skip (AxingXmlParser *parser,
+                   AxingSkipMode   mode)
+{
+    /* The start tag is already done, so we're in content now. The element
+       event stays current, and context_parse_skip turns it into the
+       END_ELEMENT event when it finds the matching end tag.
+     */
+    parser->skip_mode = mode;
+    parser->skip_depth = 1;
+    if (mode == AXING_SKIP_MODE_WELL_FORMED) {
+        if (parser->skip_names == NULL)
+            parser->skip_names = g_string_sized_new (64);
+        g_string_truncate (parser->skip_names, 0);
+        g_string_append_len (parser->skip_names, parser->event->qname,
+                             strlen (parser->event->qname) + 1);
+    }
+    parser->context->state = PARSER_STATE_SKIP;
+    parser->context->skip_state = SKIP_STATE_TEXT;
+    parser->event_type = AXING_NODE_TYPE_NONE;
+}
+
+
+/* Returns whether the path filter lets the current event through. Elements
+   that can't contain a match get skipped with the raw scanner, and their
+   END_ELEMENT comes back through here to be dropped.
+ */
+static gboolean
+parser_filter_event (AxingXmlParser *parser)
+{
+    switch (parser->event_type) {
+    case AXING_NODE_TYPE_ELEMENT:
+        if (parser->filter_depth > 0) {
+            parser->filter_depth++;
+            return TRUE;
+        }
+        switch (axing_path_filter_push (parser->filter, AXING_READER (parser))) {
+        case AXING_PATH_FILTER_MATCH:
+            parser->filter_depth = 1;
+            return TRUE;
+        case AXING_PATH_FILTER_DESCEND:
+            return FALSE;
+        case AXING_PATH_FILTER_SKIP:
+            parser->filter_skipped = TRUE;
+            if (!parser->event->empty)
+                parser_start_skip (parser, parser->filter_skip_mode);
+            return FALSE;
+        }
+        return FALSE;
+    case AXING_NODE_TYPE_END_ELEMENT:
+        if (parser->filter_depth > 0) {
+            parser->filter_depth--;
+            return TRUE;
+        }
+        if (parser->filter_skipped)
+            parser->filter_skipped = FALSE;
+        else
+            axing_path_filter_pop (parser->filter);
+        return FALSE;
+    default:
+        return parser->filter_depth > 0;
+    }
+}
+
+
+
+/* Hands the current event to the callbacks and clears it, along with the
+   END_ELEMENT that clearing an empty element produces.
+ */
+static void
+parser_dispatch_event (AxingXmlParser *parser)
 {
-    AxingXmlParser *parser;
-    Event *attr;
-    g_return_val_if_fail (AXING_IS_XML_PARSER (reader), 0);
-    parser = (AxingXmlParser *) reader;
-    g_return_val_if_fail (parser->event_type == AXING_NODE_TYPE_ELEMENT, 0);
-    for (attr = parser->event->attrs; attr; attr = attr->parent)
-        if (g_str_equal (qname, attr->qname))
-            return attr->colnum;
-    return 0;
+    do {
+        if (parser->filter == NULL || parser_filter_event (parser)) {
+            if (parser->view_enabled)
+                parser_update_view (parser);
+            parser_emit_event (parser);
+        }
+        parser_clear_event (parser);
+    } while (parser->event_type != AXING_NODE_TYPE_NONE);
 }
 
 
+static void
+parser_emit_event (AxingXmlParser *parser)
+{
+    const AxingXmlParserCallbacks *callbacks = parser->callbacks;
+    Event *event, *attr;
+    guint i;
+
+    switch (parser->event_type) {
+    case AXING_NODE_TYPE_ELEMENT:
+        if (callbacks->start_element == NULL)
+            break;
+        event = parser->event;
+        event_intern_names (parser, event);
+        /* Attributes are stacked last to first */
+        g_array_set_size (parser->attrspans, 0);
+        for (attr = event->attrs; attr; attr = attr->parent) {
+            AxingXmlAttrSpan span;
+            event_intern_names (parser, attr);
+            span.name_id = attr->name_id;
+            span.ns_id = attr->ns_id;
+            span.value = attr->content ? attr->content : "";
+            span.value_len = attr->content ? strlen (attr->content) : 0;
+            g_array_append_val (parser->attrspans, span);
+        }
+        for (i = 0; i < parser->attrspans->len / 2; i++) {
+            AxingXmlAttrSpan *spans = (AxingXmlAttrSpan *) parser->attrspans->data;
+            AxingXmlAttrSpan swap = spans[i];
+            spans[i] = spans[parser->attrspans->len - 1 - i];
+            spans[parser->attrspans->len - 1 - i] = swap;
+        }
+        callbacks->start_element (parser, event->name_id, event->ns_id,
+                                  (const AxingXmlAttrSpan *) parser->attrspans->data,
+                                  parser->attrspans->len,
+                                  parser->callbacks_data);
+        break;
+    case AXING_NODE_TYPE_END_ELEMENT:
+        if (callbacks->end_element == NULL)
+            break;
+        event_intern_names (parser, parser->event);
+        callbacks->end_element (parser, parser->event->name_id, parser->event->ns_id,
+                                parser->callbacks_data);
+        break;
+    case AXING_NODE_TYPE_CONTENT:
+        if (callbacks->text)
+            callbacks->text (parser, parser->cur_text->str, parser->cur_text->len,
+                             parser->callbacks_data);
+        break;
+    case AXING_NODE_TYPE_CDATA:
+        if (callbacks->cdata)
+            callbacks->cdata (parser, parser->cur_text->str, parser->cur_text->len,
+                              parser->callbacks_data);
+        break;
+    case AXING_NODE_TYPE_COMMENT:
+        if (callbacks->comment)
+            callbacks->comment (parser, parser->cur_text->str, parser->cur_text->len,
+                                parser->callbacks_data);
+        break;
+    case AXING_NODE_TYPE_INSTRUCTION:
+        if (callbacks->instruction)
+            callbacks->instruction (parser,
+                                    axing_name_table_intern (parser->names,
+                                                             parser->context->cur_qname, -1),
+                                    parser->cur_text->str, parser->cur_text->len,
+                                    parser->callbacks_data);
+        break;
+    default:
+        break;
+    }
+}
+
 
 #ifdef REFACTOR
 void
@@ -1171,14 +2725,26 @@ axing_xml_parser_parse_finish (AxingXmlParser *parser,
     namevar = g_strndup (start, context->linecur - start);              \
     }
 
+#define CONTEXT_SKIP_NAME(context) {                                    \
+    gsize bytes = axing_utf8_bytes_name_start (context->linecur);       \
+    if (bytes == 0)                                                     \
+        ERROR_SYNTAX_MSG (context, "Expected name start character");    \
+    context->linecur += bytes;                                          \
+    context->colnum++;                                                  \
+    while ((bytes = axing_utf8_bytes_name (context->linecur)) != 0) {   \
+        context->linecur += bytes;                                      \
+        context->colnum++;                                              \
+    }                                                                   \
+    }
+
 
 /* AXING_XML_PARSER_ERROR_SYNTAX
    We got the wrong kind of special character. Generally, only use this for errors
    we would detect in tokenization, if we had a separate tokenization step. Try to
    use ERROR_SYNTAX_MSG to provide better error messages.
 */
-#define ERROR_SYNTAX(context) { context->parser->error = g_error_new(AXING_XML_PARSER_ERROR, AXING_XML_PARSER_ERROR_SYNTAX, "%s:%i:%i: Syntax error.", context->showname ? context->showname : context->basename, context->linenum, context->colnum); goto error; }
-#define ERROR_SYNTAX_MSG(context, msg) { context->parser->error = g_error_new(AXING_XML_PARSER_ERROR, AXING_XML_PARSER_ERROR_SYNTAX, "%s:%i:%i: Syntax error: %s.", context->showname ? context->showname : context->basename, context->linenum, context->colnum, msg); goto error; }
+#define ERROR_SYNTAX(context) { context->parser->error = g_error_new(AXING_XML_PARSER_ERROR, AXING_XML_PARSER_ERROR_SYNTAX, "%s:%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT ": Syntax error.", context_get_showname (context), context->linenum, context->colnum); goto error; }
+#define ERROR_SYNTAX_MSG(context, msg) { context->parser->error = g_error_new(AXING_XML_PARSER_ERROR, AXING_XML_PARSER_ERROR_SYNTAX, "%s:%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT ": Syntax error: %s.", context_get_showname (context), context->linenum, context->colnum, msg); goto error; }
 
 /* AXING_XML_PARSER_ERROR_ENTITY
    There was an error parsing or dereferencing an entity reference. This is not
@@ -1189,29 +2755,29 @@ axing_xml_parser_parse_finish (AxingXmlParser *parser,
    Make the error message always reference entity references. Be consistent.
    Maybe rename the error code to ENTITYREF?
 */
-#define ERROR_ENTITY(context) { context->parser->error = g_error_new(AXING_XML_PARSER_ERROR, AXING_XML_PARSER_ERROR_ENTITY, "%s:%i:%i: Entity error.", context->showname ? context->showname : context->basename, context->linenum, context->colnum); goto error; }
-#define ERROR_ENTITY_MSG(context, msg) { context->parser->error = g_error_new(AXING_XML_PARSER_ERROR, AXING_XML_PARSER_ERROR_ENTITY, "%s:%i:%i: Entity error: %s.", context->showname ? context->showname : context->basename, context->linenum, context->colnum, msg); goto error; }
+#define ERROR_ENTITY(context) { context->parser->error = g_error_new(AXING_XML_PARSER_ERROR, AXING_XML_PARSER_ERROR_ENTITY, "%s:%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT ": Entity error.", context_get_showname (context), context->linenum, context->colnum); goto error; }
+#define ERROR_ENTITY_MSG(context, msg) { context->parser->error = g_error_new(AXING_XML_PARSER_ERROR, AXING_XML_PARSER_ERROR_ENTITY, "%s:%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT ": Entity error: %s.", context_get_showname (context), context->linenum, context->colnum, msg); goto error; }
 
 /* AXING_XML_PARSER_ERROR_CHARSET
    Something went wrong with detecting the charset. ERROR_BOM_ENCODING is used
    specifically when the encoding from the BOM doesn't match the declaration.
 */
-#define ERROR_BOM_ENCODING(context, bomenc, encoding) { context->parser->error = g_error_new(AXING_XML_PARSER_ERROR, AXING_XML_PARSER_ERROR_CHARSET, "%s:%i:%i: Detected encoding \"%s\" from BOM, but got \"%s\" from declaration.", context->showname ? context->showname : context->basename, context->linenum, context->colnum, bomenc, encoding); goto error; }
+#define ERROR_BOM_ENCODING(context, bomenc, encoding) { context->parser->error = g_error_new(AXING_XML_PARSER_ERROR, AXING_XML_PARSER_ERROR_CHARSET, "%s:%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT ": Detected encoding \"%s\" from BOM, but got \"%s\" from declaration.", context_get_showname (context), context->linenum, context->colnum, bomenc, encoding); goto error; }
 
 /* AXING_XML_PARSER_ERROR_DUPATTR
    Two attritbutes on the same element have the same qname. If they have the
    same expanded name, use AXING_XML_PARSER_ERROR_NS_DUPATTR instead.
 */
-#define ERROR_DUPATTR(context, attr) { context->parser->error = g_error_new(AXING_XML_PARSER_ERROR, AXING_XML_PARSER_ERROR_DUPATTR, "%s:%i:%i: Duplicate attribute \"%s\".", context->showname ? context->showname : context->basename, attr->linenum, attr->colnum, attr->qname); goto error; }
+#define ERROR_DUPATTR(context, attr) { context->parser->error = g_error_new(AXING_XML_PARSER_ERROR, AXING_XML_PARSER_ERROR_DUPATTR, "%s:%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT ": Duplicate attribute \"%s\".", context_get_showname (context), attr->linenum, attr->colnum, attr->qname); goto error; }
 
 /* AXING_XML_PARSER_ERROR_UNBALANCED
    Something is unbalanced in the tree structure. This could be an incorrect
    end tag, missing end tags at the end of a resource, or extra content at
    the end of a resource.
  */
-#define ERROR_MISSINGEND(context, qname) { context->parser->error = g_error_new (AXING_XML_PARSER_ERROR, AXING_XML_PARSER_ERROR_UNBALANCED, "%s:%i:%i: Missing end tag for \"%s\".", context->showname ? context->showname : context->basename, context->linenum, context->colnum, qname); goto error; }
-#define ERROR_EXTRACONTENT(context) { context->parser->error = g_error_new (AXING_XML_PARSER_ERROR, AXING_XML_PARSER_ERROR_UNBALANCED, "%s:%i:%i: Extra content at end of resource.", context->showname ? context->showname : context->basename, context->linenum, context->colnum); goto error; }
-#define ERROR_WRONGEND(context, qname) { context->parser->error = g_error_new(AXING_XML_PARSER_ERROR, AXING_XML_PARSER_ERROR_UNBALANCED, "%s:%i:%i: Incorrect end tag \"%s\".", context->showname ? context->showname : context->basename, context->linenum, context->colnum, qname); goto error; }
+#define ERROR_MISSINGEND(context, qname) { context->parser->error = g_error_new (AXING_XML_PARSER_ERROR, AXING_XML_PARSER_ERROR_UNBALANCED, "%s:%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT ": Missing end tag for \"%s\".", context_get_showname (context), context->linenum, context->colnum, qname); goto error; }
+#define ERROR_EXTRACONTENT(context) { context->parser->error = g_error_new (AXING_XML_PARSER_ERROR, AXING_XML_PARSER_ERROR_UNBALANCED, "%s:%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT ": Extra content at end of resource.", context_get_showname (context), context->linenum, context->colnum); goto error; }
+#define ERROR_WRONGEND(context, qname) { context->parser->error = g_error_new(AXING_XML_PARSER_ERROR, AXING_XML_PARSER_ERROR_UNBALANCED, "%s:%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT ": Incorrect end tag \"%s\".", context_get_showname (context), context->linenum, context->colnum, qname); goto error; }
 
 
 
@@ -1227,28 +2793,28 @@ axing_xml_parser_parse_finish (AxingXmlParser *parser,
 */
 
 /* REFACTOR comment */
-#define ERROR_NS_QNAME(context) { context->parser->error = g_error_new(AXING_XML_PARSER_ERROR, AXING_XML_PARSER_ERROR_NS_QNAME, "%s:%i:%i: Could not parse qname \"%s\".", context->showname ? context->showname : context->basename, context->parser->event->linenum, context->parser->event->colnum, context->parser->event->qname); goto error; }
+#define ERROR_NS_QNAME(context) { context->parser->error = g_error_new(AXING_XML_PARSER_ERROR, AXING_XML_PARSER_ERROR_NS_QNAME, "%s:%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT ": Could not parse qname \"%s\".", context_get_showname (context), context->parser->event->linenum, context->parser->event->colnum, context->parser->event->qname); goto error; }
 
 /* REFACTOR comment */
-#define ERROR_NS_QNAME_ATTR(context, data) { context->parser->error = g_error_new(AXING_XML_PARSER_ERROR, AXING_XML_PARSER_ERROR_NS_QNAME, "%s:%i:%i: Could not parse qname \"%s\".", context->showname ? context->showname : context->basename, data->linenum, data->colnum, data->qname); goto error; }
+#define ERROR_NS_QNAME_ATTR(context, data) { context->parser->error = g_error_new(AXING_XML_PARSER_ERROR, AXING_XML_PARSER_ERROR_NS_QNAME, "%s:%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT ": Could not parse qname \"%s\".", context_get_showname (context), data->linenum, data->colnum, data->qname); goto error; }
 
 /* REFACTOR comment */
-#define ERROR_NS_NOTFOUND(context) { context->parser->error = g_error_new(AXING_XML_PARSER_ERROR, AXING_XML_PARSER_ERROR_NS_NOTFOUND, "%s:%i:%i: Could not find namespace for prefix \"%s\".", context->showname ? context->showname : context->basename, context->parser->event->linenum, context->parser->event->colnum, context->parser->event->prefix); goto error; }
+#define ERROR_NS_NOTFOUND(context) { context->parser->error = g_error_new(AXING_XML_PARSER_ERROR, AXING_XML_PARSER_ERROR_NS_NOTFOUND, "%s:%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT ": Could not find namespace for prefix \"%s\".", context_get_showname (context), context->parser->event->linenum, context->parser->event->colnum, context->parser->event->prefix); goto error; }
 
 /* REFACTOR comment */
-#define ERROR_NS_NOTFOUND_ATTR(context, data) { context->parser->error = g_error_new(AXING_XML_PARSER_ERROR, AXING_XML_PARSER_ERROR_NS_NOTFOUND, "%s:%i:%i: Could not find namespace for prefix \"%s\".", context->showname ? context->showname : context->basename, data->linenum, data->colnum, data->prefix); goto error; }
+#define ERROR_NS_NOTFOUND_ATTR(context, data) { context->parser->error = g_error_new(AXING_XML_PARSER_ERROR, AXING_XML_PARSER_ERROR_NS_NOTFOUND, "%s:%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT ": Could not find namespace for prefix \"%s\".", context_get_showname (context), data->linenum, data->colnum, data->prefix); goto error; }
 
 /* REFACTOR comment */
-#define ERROR_NS_DUPATTR(context, attr) { context->parser->error = g_error_new(AXING_XML_PARSER_ERROR, AXING_XML_PARSER_ERROR_NS_DUPATTR, "%s:%i:%i: Duplicate expanded name for attribute \"%s\".", context->showname ? context->showname : context->basename, attr->linenum, attr->colnum, attr->qname); goto error; }
+#define ERROR_NS_DUPATTR(context, attr) { context->parser->error = g_error_new(AXING_XML_PARSER_ERROR, AXING_XML_PARSER_ERROR_NS_DUPATTR, "%s:%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT ": Duplicate expanded name for attribute \"%s\".", context_get_showname (context), attr->linenum, attr->colnum, attr->qname); goto error; }
 
 /* REFACTOR comment */
-#define ERROR_NS_INVALID(context, prefix) { context->parser->error = g_error_new(AXING_XML_PARSER_ERROR, AXING_XML_PARSER_ERROR_NS_INVALID, "%s:%i:%i: Invalid namespace for prefix \"%s\".", context->showname ? context->showname : context->basename, context->parser->event->xmlns->linenum, context->parser->event->xmlns->colnum, prefix); goto error; }
+#define ERROR_NS_INVALID(context, prefix) { context->parser->error = g_error_new(AXING_XML_PARSER_ERROR, AXING_XML_PARSER_ERROR_NS_INVALID, "%s:%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT ": Invalid namespace for prefix \"%s\".", context_get_showname (context), context->parser->event->xmlns->linenum, context->parser->event->xmlns->colnum, prefix); goto error; }
 
 /* AXING_XML_PARSER_ERROR_OTHER
    Never use this error code or the ERROR_FIXME macro, except as a FIXME
    that you actually intend to fix.
  */
-#define ERROR_FIXME(context) { context->parser->error = g_error_new(AXING_XML_PARSER_ERROR, AXING_XML_PARSER_ERROR_OTHER, "%s:%i:%i: Unsupported feature.", context->showname ? context->showname : context->basename, context->linenum, context->colnum); goto error; }
+#define ERROR_FIXME(context) { context->parser->error = g_error_new(AXING_XML_PARSER_ERROR, AXING_XML_PARSER_ERROR_OTHER, "%s:%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT ": Unsupported feature.", context_get_showname (context), context->linenum, context->colnum); goto error; }
 
 
 #define EAT_SPACES(line, buf, bufsize, context)                         \
@@ -1311,6 +2877,30 @@ axing_xml_parser_parse_finish (AxingXmlParser *parser,
     }                                                                   \
     }
 
+/* Like CONTEXT_ADVANCE_CHAR, but for skipped data, so the text isn't kept.
+   When only checking tag balance, characters aren't validated either.
+ */
+#define SKIP_ADVANCE_CHAR(context, cur) {                               \
+    gsize bytes;                                                        \
+    AxingXmlVersion ver = IS_1_1(context) ?                             \
+        AXING_XML_VERSION_1_1 : AXING_XML_VERSION_1_0;                  \
+    bytes = axing_utf8_bytes_newline (cur, ver);                        \
+    if (bytes) {                                                        \
+        cur += bytes;                                                   \
+        context->linenum++; context->colnum = 1;                        \
+    }                                                                   \
+    else {                                                              \
+        if (context->parser->skip_mode == AXING_SKIP_MODE_BALANCED)     \
+            bytes = g_utf8_skip[(guchar) cur[0]];                       \
+        else                                                            \
+            bytes = axing_utf8_bytes_character (cur, ver);              \
+        if (bytes == 0)                                                 \
+            ERROR_SYNTAX_MSG (context, "Invalid character");            \
+        cur += bytes;                                                   \
+        context->colnum++;                                              \
+    }                                                                   \
+    }
+
 #define CHECK_BUFFER(c, num, buf, bufsize, context)                     \
     if (c - buf + num > bufsize) {                                      \
         context->parser->error =                                        \
@@ -1499,6 +3089,9 @@ context_check_end (Context *context)
         if (context->doctype_state != DOCTYPE_STATE_INT) {
             ERROR_SYNTAX_MSG (context, "Incomplete data at end of parser context"); // test: parameters04
         }
+        if (context->cond_state != COND_STATE_NONE || context->condsects > 0 || context->ignoring > 0) {
+            ERROR_SYNTAX_MSG (context, "Unclosed conditional section");
+        }
     }
 
     if (context->parser->event != NULL) {
@@ -1514,6 +3107,26 @@ context_check_end (Context *context)
 }
 
 
+/* Encodings with shift states, where the bytes for a character depend
+   on what came before it. Encoding a piece of text on its own gets the
+   shifts wrong, so there's no counting bytes for these.
+ */
+static gboolean
+encoding_is_stateful (const char *encoding)
+{
+    static const char *prefixes[] = {
+        "ISO-2022", "ISO2022", "CSISO2022", "CP5022", "UTF-7", "UTF7", "HZ",
+        "IBM930", "IBM933", "IBM935", "IBM937", "IBM939"
+    };
+    gsize i;
+    for (i = 0; i < G_N_ELEMENTS (prefixes); i++) {
+        if (g_ascii_strncasecmp (encoding, prefixes[i], strlen (prefixes[i])) == 0)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+
 static void
 context_set_encoding (Context *context, const char *encoding)
 {
@@ -1532,6 +3145,143 @@ context_set_encoding (Context *context, const char *encoding)
     g_object_unref (context->datastream);
     context->datastream = g_data_input_stream_new (cstream);
     g_object_unref (cstream);
+
+    if (g_ascii_strncasecmp (encoding, "UTF-16", 6) == 0)
+        context->raw_encoding = RAW_ENCODING_UTF16;
+    else if (g_ascii_strncasecmp (encoding, "UCS-4", 5) == 0 ||
+             g_ascii_strncasecmp (encoding, "UTF-32", 6) == 0)
+        context->raw_encoding = RAW_ENCODING_UCS4;
+    else if (encoding_is_stateful (encoding))
+        context->raw_encoding = RAW_ENCODING_UNKNOWN;
+    else if (g_ascii_strcasecmp (encoding, "UTF-8") != 0)
+        context->raw_encoding = RAW_ENCODING_OTHER;
+    g_free (context->raw_charset);
+    context->raw_charset = g_strdup (encoding);
+}
+
+
+/* Returns how many bytes len bytes of decoded text took in the original
+   stream. text always ends on a character boundary.
+ */
+static gsize
+context_raw_length (Context    *context,
+                    const char *text,
+                    gsize       len)
+{
+    const guchar *c = (const guchar *) text, *end = c + len;
+    gsize raw = 0;
+
+    switch (context->raw_encoding) {
+    case RAW_ENCODING_UTF8:
+    case RAW_ENCODING_UNKNOWN:
+        return len;
+    case RAW_ENCODING_UTF16:
+        /* Surrogate pairs for anything that takes four bytes in UTF-8 */
+        for (; c < end; c++) {
+            if ((*c & 0xC0) != 0x80)
+                raw += (*c >= 0xF0) ? 4 : 2;
+        }
+        return raw;
+    case RAW_ENCODING_UCS4:
+        for (; c < end; c++) {
+            if ((*c & 0xC0) != 0x80)
+                raw += 4;
+        }
+        return raw;
+    case RAW_ENCODING_OTHER: {
+        char *enc = g_convert (text, len, context->raw_charset, "UTF-8", NULL, &raw, NULL);
+        if (enc == NULL)
+            return len;
+        g_free (enc);
+        return raw;
+    }
+    }
+    return len;
+}
+
+
+/* Returns the offset in the original stream of cur, which points into the
+   current line. Counting goes on from the last point asked about, since
+   that's almost always just behind.
+ */
+static goffset
+context_offset (Context *context,
+                char    *cur)
+{
+    if (context->raw_encoding == RAW_ENCODING_UTF8 ||
+        context->raw_encoding == RAW_ENCODING_UNKNOWN)
+        return context->offset + (cur - context->line);
+    if (context->markcur == NULL || cur < context->markcur) {
+        context->markcur = context->line;
+        context->markoffset = context->offset;
+    }
+    context->markoffset += context_raw_length (context, context->markcur, cur - context->markcur);
+    context->markcur = cur;
+    return context->markoffset;
+}
+
+
+/* Moves the line offset past text, which has been consumed */
+static void
+context_advance_offset (Context    *context,
+                        const char *text,
+                        gsize       len)
+{
+    context->offset += context_raw_length (context, text, len);
+    context->markcur = NULL;
+}
+
+
+/* Events start and end where their markup does in the document. Markup
+   from an entity gets the span of the reference to that entity in the
+   document, since its own bytes aren't there.
+ */
+static void
+context_mark_start (Context *context,
+                    char    *cur)
+{
+    AxingXmlParser *parser = context->parser;
+    if (context->parent == NULL) {
+        parser->span_start = context_offset (context, cur);
+        parser->span_entity = FALSE;
+    }
+    else {
+        parser->span_start = context->refstart;
+        parser->span_entity = TRUE;
+    }
+}
+
+
+static void
+parser_mark_end (AxingXmlParser *parser)
+{
+    Context *context = parser->context;
+    if (context->parent == NULL) {
+        parser->span_end = context_offset (context, context->linecur);
+    }
+    else {
+        parser->span_end = context->refend;
+        parser->span_entity = TRUE;
+    }
+}
+
+
+/* Called when entctxt is pushed for a reference reflen bytes long that
+   context just read.
+ */
+static void
+context_set_refspan (Context *entctxt,
+                     Context *context,
+                     gsize    reflen)
+{
+    if (context->parent == NULL) {
+        entctxt->refstart = context_offset (context, context->linecur - reflen);
+        entctxt->refend = context_offset (context, context->linecur);
+    }
+    else {
+        entctxt->refstart = context->refstart;
+        entctxt->refend = context->refend;
+    }
 }
 
 
@@ -1618,8 +3368,10 @@ context_parse_xml_decl (Context *context)
         c = c + 3;
 
     if (!(bufsize >= 6 + (c - buf) && EQ5(c, '<', '?', 'x', 'm', 'l') && XML_IS_SPACE(c + 5, context) )) {
-        if (c != buf)
+        if (c != buf) {
             g_input_stream_skip (G_INPUT_STREAM (context->datastream), c - buf, NULL, NULL);
+            context_advance_offset (context, (char *) buf, c - buf);
+        }
         return;
     }
     
@@ -1728,6 +3480,7 @@ context_parse_xml_decl (Context *context)
     c += 2; context->colnum += 2;
 
     g_input_stream_skip (G_INPUT_STREAM (context->datastream), c - buf, NULL, NULL);
+    context_advance_offset (context, (char *) buf, c - buf);
 
     if (encoding != NULL) {
         switch (context->bom_encoding) {
@@ -1888,7 +3641,10 @@ context_parse_line (Context *context)
                 ERROR_EXTRACONTENT (context); // test: element11
             }
             else if (context->state == PARSER_STATE_TEXT) {
-                context_parse_text (context);
+                if (context->parser->filter != NULL && context->parser->filter_depth == 0)
+                    context_skip_text (context);
+                else
+                    context_parse_text (context);
                 /* entities could give us a new context, bubble out */
                 if (context != context->parser->context)
                     return;
@@ -1938,6 +3694,11 @@ context_parse_line (Context *context)
             if (context != context->parser->context)
                 return;
             break;
+        case PARSER_STATE_SKIP:
+            context_parse_skip (context);
+            if (context->parser->event_type != AXING_NODE_TYPE_NONE)
+                return;
+            break;
         default:
             g_assert_not_reached ();
         }
@@ -2119,6 +3880,13 @@ context_parse_doctype (Context *context)
             context->doctype_state = DOCTYPE_STATE_NULL;
             context->state = PARSER_STATE_PROLOG;
             context->linecur++; context->colnum++;
+            if (context->parser->load_dtd) {
+                parser_load_external_subset (context->parser);
+                if (context->parser->error)
+                    goto error;
+            }
+            if (context->parser->prefetch)
+                parser_start_prefetch (context->parser);
             return;
         default:
             ERROR_SYNTAX_MSG (context, "Expected internal subset or closing angle bracket"); // test: doctype33
@@ -2126,14 +3894,37 @@ context_parse_doctype (Context *context)
     }
 
     if (context->doctype_state == DOCTYPE_STATE_INT) {
+        if (context->ignoring > 0) {
+            context_parse_ignore (context);
+            return;
+        }
+        if (context->cond_state != COND_STATE_NONE) {
+            context_parse_condsect (context);
+            if (context->parser->error) goto error;
+            return;
+        }
         CONTEXT_EAT_SPACES (context);
         if (context->linecur[0] == '\0') {
             return;
         }
+        else if (EQ3 (context->linecur, ']', ']', '>') && context->condsects > 0) {
+            context->linecur += 3; context->colnum += 3;
+            context->condsects--;
+        }
         else if (context->linecur[0] == ']') {
+            if (context->condsects > 0)
+                ERROR_SYNTAX_MSG (context, "Unclosed conditional section");
             context->linecur++; context->colnum++;
             context->doctype_state = DOCTYPE_STATE_AFTER_INT;
         }
+        else if (EQ3 (context->linecur, '<', '!', '[')) {
+            if (!context_in_external_dtd (context))
+                ERROR_SYNTAX_MSG (context, "Conditional sections are only allowed in the external subset");
+            context->linecur += 3; context->colnum += 3;
+            context->cond_state = COND_STATE_KEYWORD;
+            context_parse_condsect (context);
+            if (context->parser->error) goto error;
+        }
         else if (context->linecur[0] == '%') {
             context_parse_parameter (context);
             if (context->parser->error) goto error;
@@ -2219,6 +4010,13 @@ context_parse_doctype (Context *context)
         context->doctype_state = DOCTYPE_STATE_NULL;
         context->state = PARSER_STATE_PROLOG;
         context->linecur++; context->colnum++;
+        if (context->parser->load_dtd) {
+            parser_load_external_subset (context->parser);
+            if (context->parser->error)
+                goto error;
+        }
+        if (context->parser->prefetch)
+            parser_start_prefetch (context->parser);
         return;
     }
 
@@ -2839,79 +4637,249 @@ context_parse_doctype_entity (Context *context) {
     }
 
  error:
-    return;
+    return;
+}
+
+
+static void
+context_parse_parameter (Context *context)
+{
+    const char *beg = context->linecur + 1;
+    char *entname = NULL;
+    char *value = NULL;
+    char *public = NULL;
+    char *system = NULL;
+    Context *entctxt;
+    gint64 colnum = context->colnum;
+
+    AXING_DEBUG ("context_parse_parameter: %s\n", context->linecur);
+    g_assert (context->linecur[0] == '%');
+    context->linecur++; colnum++;
+
+    while (context->linecur[0] != '\0') {
+        gunichar cp;
+        if (context->linecur[0] == ';') {
+            break;
+        }
+        /* FIXME */
+        cp = g_utf8_get_char (context->linecur);
+        if (context->linecur == beg) {
+            if (!XML_IS_NAME_START_CHAR (cp)) {
+                ERROR_ENTITY (context);
+            }
+        }
+        else {
+            if (!XML_IS_NAME_CHAR (cp)) {
+                ERROR_ENTITY (context);
+            }
+        }
+        context->linecur = g_utf8_next_char (context->linecur);
+        colnum += 1;
+    }
+    if (context->linecur[0] != ';') {
+        ERROR_ENTITY (context);
+    }
+    entname = g_strndup (beg, context->linecur - beg);
+    context->linecur++; colnum++;
+
+    for (entctxt = context; entctxt != NULL; entctxt = entctxt->parent) {
+        if (entctxt->entname != NULL && g_str_equal (entctxt->entname, entname)) {
+            ERROR_ENTITY_MSG (context, "Recursive parameter entity reference");
+        }
+    }
+
+    if (!axing_dtd_schema_get_parameter_full (context->parser->doctype, entname,
+                                              &value, &public, &system)) {
+        ERROR_FIXME (context);
+    }
+    else if (value) {
+        AXING_DEBUG ("  PUSH PARAMETER STRING CONTEXT\n");
+        entctxt = context_new (context->parser);
+
+        entctxt->parent = context;
+        /* context_free knows not to free a basename shared with the parent */
+        entctxt->basename = context->basename;
+        /* Let entctxt own entname */
+        entctxt->entname = entname;
+        entname = NULL;
+        entctxt->entchar = '%';
+        entctxt->state = context->state;
+        entctxt->init_state = context->state;
+        entctxt->doctype_state = context->doctype_state;
+
+        entctxt->parent = context;
+        context->parser->context = entctxt;
+        /* Let entctxt own value */
+        entctxt->line = value;
+        value = NULL;
+        entctxt->linecur = entctxt->line;
+    }
+    else if (context->parser->load_dtd || context->parser->external_subset) {
+        AxingResource *resource;
+        Context *base;
+
+        /* Resolve against the nearest file, not a string entity */
+        for (base = context; base->resource == NULL && base->parent != NULL; base = base->parent);
+
+        if (context->parser->resolver == NULL)
+            context->parser->resolver = axing_resolver_get_default ();
+        resource = axing_resolver_resolve (context->parser->resolver,
+                                           base->resource ? base->resource : context->parser->resource,
+                                           NULL, system, public,
+                                           AXING_RESOLVER_HINT_ENTITY,
+                                           context->parser->cancellable,
+                                           &(context->parser->error));
+        if (context->parser->error)
+            goto error;
+        if (context->parser->external_subset)
+            parser_add_dtd_dep (context->parser, resource);
+
+        AXING_DEBUG ("  PUSH PARAMETER SYSTEM CONTEXT\n");
+        entctxt = context_new (context->parser);
+        entctxt->parent = context;
+        entctxt->resource = resource;
+        entctxt->basename = resource_get_basename (resource);
+        entctxt->entname = entname;
+        entname = NULL;
+        entctxt->state = PARSER_STATE_TEXTDECL;
+        entctxt->init_state = context->state;
+        entctxt->doctype_state = DOCTYPE_STATE_INT;
+        context->parser->context = entctxt;
+
+        context_start_sync (entctxt);
+    }
+    /* Without loading the DTD, an external parameter entity is skipped,
+       and we can't trust anything declared after it (XML 1.0 5.1). FIXME.
+     */
+    else {
+        ERROR_FIXME (context);
+    }
+
+ error:
+    context->colnum = colnum;
+    g_free (entname);
+    g_free (value);
+    g_free (public);
+    g_free (system);
+}
+
+
+/* Conditional sections are only allowed in the external subset, which
+   means a parser loading one, or anything an external parameter entity
+   brings in.
+ */
+static gboolean
+context_in_external_dtd (Context *context)
+{
+    if (context->parser->external_subset)
+        return TRUE;
+    for (; context->parent != NULL; context = context->parent) {
+        if (context->resource != NULL)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+
+/* Picks up after <![ and reads up to the opening bracket. The keyword
+   can be INCLUDE, IGNORE, or a parameter entity reference to either.
+   Any of it can be split across lines, so cond_state says where we are.
+ */
+static void
+context_parse_condsect (Context *context)
+{
+    char *keyword = NULL;
+    char *entname = NULL;
+
+    AXING_DEBUG ("context_parse_condsect: %s\n", context->linecur);
+
+    if (context->cond_state == COND_STATE_KEYWORD) {
+        const char *beg;
+
+        CONTEXT_EAT_SPACES (context);
+        if (context->linecur[0] == '\0')
+            return;
+
+        if (context->linecur[0] == '%') {
+            context->linecur++; context->colnum++;
+            beg = context->linecur;
+            while (context->linecur[0] != '\0' && context->linecur[0] != ';') {
+                gunichar cp = g_utf8_get_char (context->linecur);
+                if (!XML_IS_NAME_CHAR (cp))
+                    break;
+                context->linecur = g_utf8_next_char (context->linecur);
+                context->colnum++;
+            }
+            if (context->linecur == beg || context->linecur[0] != ';')
+                ERROR_ENTITY (context);
+            entname = g_strndup (beg, context->linecur - beg);
+            context->linecur++; context->colnum++;
+            keyword = axing_dtd_schema_get_parameter (context->parser->doctype, entname);
+            if (keyword == NULL)
+                ERROR_ENTITY_MSG (context, "Undeclared or external parameter entity in conditional section");
+            g_strstrip (keyword);
+        }
+        else {
+            beg = context->linecur;
+            while (context->linecur[0] >= 'A' && context->linecur[0] <= 'Z') {
+                context->linecur++; context->colnum++;
+            }
+            keyword = g_strndup (beg, context->linecur - beg);
+        }
+
+        if (g_str_equal (keyword, "INCLUDE"))
+            context->cond_state = COND_STATE_INCLUDE;
+        else if (g_str_equal (keyword, "IGNORE"))
+            context->cond_state = COND_STATE_IGNORE;
+        else
+            ERROR_SYNTAX_MSG (context, "Expected INCLUDE or IGNORE");
+    }
+
+    CONTEXT_EAT_SPACES (context);
+    if (context->linecur[0] == '\0')
+        goto error;
+    if (context->linecur[0] != '[')
+        ERROR_SYNTAX_MSG (context, "Expected open bracket");
+    context->linecur++; context->colnum++;
+
+    if (context->cond_state == COND_STATE_INCLUDE)
+        context->condsects++;
+    else
+        context->ignoring = 1;
+    context->cond_state = COND_STATE_NONE;
+
+ error:
+    g_free (keyword);
+    g_free (entname);
 }
 
 
+/* Skips the contents of an IGNORE section, which can have nested
+   conditional sections but is otherwise just characters.
+ */
 static void
-context_parse_parameter (Context *context)
+context_parse_ignore (Context *context)
 {
-    const char *beg = context->linecur + 1;
-    char *entname = NULL;
-    char *value = NULL;
-    int colnum = context->colnum;
-
-    AXING_DEBUG ("context_parse_parameter: %s\n", context->linecur);
-    g_assert (context->linecur[0] == '%');
-    context->linecur++; colnum++;
-
     while (context->linecur[0] != '\0') {
-        gunichar cp;
-        if (context->linecur[0] == ';') {
-            break;
+        if (EQ3 (context->linecur, '<', '!', '[')) {
+            context->linecur += 3; context->colnum += 3;
+            context->ignoring++;
         }
-        /* FIXME */
-        cp = g_utf8_get_char (context->linecur);
-        if (context->linecur == beg) {
-            if (!XML_IS_NAME_START_CHAR (cp)) {
-                ERROR_ENTITY (context);
-            }
+        else if (EQ3 (context->linecur, ']', ']', '>')) {
+            context->linecur += 3; context->colnum += 3;
+            context->ignoring--;
+            if (context->ignoring == 0)
+                return;
+        }
+        else if (context->linecur[0] == '\n') {
+            context->linecur++;
+            context->linenum++; context->colnum = 1;
         }
         else {
-            if (!XML_IS_NAME_CHAR (cp)) {
-                ERROR_ENTITY (context);
-            }
+            context->linecur = g_utf8_next_char (context->linecur);
+            context->colnum++;
         }
-        context->linecur = g_utf8_next_char (context->linecur);
-        colnum += 1;
-    }
-    if (context->linecur[0] != ';') {
-        ERROR_ENTITY (context);
-    }
-    entname = g_strndup (beg, context->linecur - beg);
-    context->linecur++; colnum++;
-
-    value = axing_dtd_schema_get_parameter (context->parser->doctype, entname);
-    if (value) {
-        Context *entctxt = context_new (context->parser);
-        AXING_DEBUG ("  PUSH PARAMETER STRING CONTEXT\n");
-
-        entctxt->parent = context;
-        /* FIXME: maybe we could avoid the strdup, and have context_free
-           check if ->basename == ->parent->basename before freeing */
-        entctxt->basename = g_strdup (context->basename);
-        /* FIXME: we can hand ownership over without the strdup */
-        entctxt->entname = g_strdup (entname);
-        entctxt->showname = g_strdup_printf ("%s(%%%s;)", entctxt->basename, entname);
-        entctxt->state = context->state;
-        entctxt->init_state = context->state;
-        entctxt->doctype_state = context->doctype_state;
-
-        entctxt->parent = context;
-        context->parser->context = entctxt;
-        /* Let entctxt own value */
-        entctxt->line = value;
-        value = NULL;
-        entctxt->linecur = entctxt->line;
-    }
-    else {
-        ERROR_FIXME (context);
     }
-
- error:
-    context->colnum = colnum;
-    g_free (entname);
-    g_free (value);
 }
 
 
@@ -2923,6 +4891,7 @@ context_parse_cdata (Context *context)
     AXING_DEBUG ("context_parse_cdata: %s\n", context->linecur);
     if (context->state != PARSER_STATE_CDATA) {
         g_assert (EQ9 (context->linecur, '<', '!', '[', 'C', 'D', 'A', 'T', 'A', '['));
+        context_mark_start (context, context->linecur);
         context->parser->txtlinenum = context->linenum;
         context->parser->txtcolnum = context->colnum;
         context->linecur += 9; context->colnum += 9;
@@ -2954,6 +4923,7 @@ context_parse_comment (Context *context)
     AXING_DEBUG ("context_parse_comment: %s\n", context->linecur);
     if (context->state != PARSER_STATE_COMMENT) {
         g_assert (EQ4 (context->linecur, '<', '!', '-', '-'));
+        context_mark_start (context, context->linecur);
         context->parser->txtlinenum = context->linenum;
         context->parser->txtcolnum = context->colnum;
         context->linecur += 4; context->colnum += 4;
@@ -3006,6 +4976,7 @@ context_parse_instruction (Context *context)
     AXING_DEBUG ("context_parse_instruction: %s\n", context->linecur);
     if (context->state != PARSER_STATE_INSTRUCTION) {
         g_assert (EQ2 (context->linecur, '<', '?'));
+        context_mark_start (context, context->linecur);
         context->parser->txtlinenum = context->linenum;
         context->parser->txtcolnum = context->colnum;
         context->linecur += 2; context->colnum += 2;
@@ -3071,7 +5042,7 @@ context_parse_end_element (Context *context)
     if (context->state != PARSER_STATE_ENDELM) {
         gboolean matches;
         int i;
-        int colnum;
+        gint64 colnum;
         /* We've just encountered an end tag. This could be skipped if there is
            space or newlines between the qname and the ">". That would set the
            state and potentially re-enter this function later.
@@ -3083,6 +5054,7 @@ context_parse_end_element (Context *context)
             ERROR_EXTRACONTENT (context); // test: element13
         }
 
+        context_mark_start (context, context->linecur);
         colnum = context->colnum;
         context->colnum += 2;
         context->linecur += 2; 
@@ -3160,6 +5132,7 @@ context_parse_start_element (Context *context)
     context->parser->event = event;
     event->linenum = context->linenum;
     event->colnum = context->colnum;
+    context_mark_start (context, context->linecur);
     context->linecur++; context->colnum++;
 
     CONTEXT_GET_NAME (context, event->qname);
@@ -3215,6 +5188,8 @@ context_parse_attrs (Context *context)
         attr->parent = context->parser->event->attrs;
         attr->linenum = context->linenum;
         attr->colnum = context->colnum;
+        attr->start = (context->parent == NULL) ?
+            context_offset (context, context->linecur) : context->refstart;
         context->parser->event->attrs = attr;
 
         CONTEXT_GET_NAME (context, context->parser->event->attrs->qname);
@@ -3265,6 +5240,8 @@ context_parse_attrs (Context *context)
                 attrval = g_strdup (context->parser->cur_text->str);
                 g_string_truncate (context->parser->cur_text, 0);
                 attr = context->parser->event->attrs;
+                attr->end = (context->parent == NULL) ?
+                    context_offset (context, cur + 1) : context->refend;
 
                 if (EQ6 (attr->qname, 'x', 'm', 'l', 'n', 's', ':')) {
                     /* FIXME: if cur_attrname == "xmlns:"? */
@@ -3351,7 +5328,7 @@ static void
 context_parse_entity (Context *context)
 {
     char *entname = NULL;
-    int colnum = context->colnum;
+    gint64 colnum = context->colnum;
     AXING_DEBUG ("context_parse_entity: %s\n", context->linecur);
     g_assert (context->linecur[0] == '&');
     context->linecur++; context->colnum++;
@@ -3442,7 +5419,9 @@ context_parse_entity (Context *context)
             g_string_append_c (context->parser->cur_text, builtin);
         }
         else {
+            /* context_process_entity takes ownership of entname */
             context_process_entity (context, entname);
+            entname = NULL;
         }
     }
  error:
@@ -3452,10 +5431,11 @@ context_parse_entity (Context *context)
 
 
 static void
-context_process_entity (Context *context, const char *entname)
-{ 
+context_process_entity (Context *context, char *entname)
+{
     Context *parent;
     char *value=NULL, *system=NULL, *public=NULL, *ndata=NULL;
+    gsize reflen = strlen (entname) + 2;
     AXING_DEBUG ("context_process_entity: %s\n", entname);
 
     for (parent = context->parent; parent != NULL; parent = parent->parent) {
@@ -3471,15 +5451,18 @@ context_process_entity (Context *context, const char *entname)
             Context *entctxt = context_new (context->parser);
             AXING_DEBUG ("  PUSH ENTITY STRING CONTEXT\n");
             entctxt->parent = context;
+            context_set_refspan (entctxt, context, reflen);
             context->parser->context = entctxt;
-            entctxt->basename = g_strdup (context->basename);
-            entctxt->entname = g_strdup ((char *) entname);
-            /* Let entctxt own value */
+            /* context_free knows not to free a basename shared with the parent */
+            entctxt->basename = context->basename;
+            /* Let entctxt own entname and value */
+            entctxt->entname = entname;
+            entname = NULL;
             entctxt->line = value;
             value = NULL;
             entctxt->linecur = entctxt->line;
 
-            entctxt->showname = g_strdup_printf ("%s(&%s;)", entctxt->basename, entname);
+            entctxt->entchar = '&';
             entctxt->state = context->state;
             entctxt->init_state = context->state;
         }
@@ -3517,23 +5500,29 @@ context_process_entity (Context *context, const char *entname)
 #endif /* REFACTOR */
             if (TRUE) {
                 Context *entctxt;
-                AxingResource *resource;
-                resource = axing_resolver_resolve (context->parser->resolver,
-                                                   context->resource,
-                                                   NULL, system, public,
-                                                   AXING_RESOLVER_HINT_ENTITY,
-                                                   context->parser->cancellable,
-                                                   &(context->parser->error));
+                AxingResource *resource = NULL;
+                /* Prefetches were resolved against the document */
+                if (context->resource == context->parser->resource)
+                    resource = parser_take_prefetched (context->parser, entname);
+                if (resource == NULL)
+                    resource = axing_resolver_resolve (context->parser->resolver,
+                                                       context->resource,
+                                                       NULL, system, public,
+                                                       AXING_RESOLVER_HINT_ENTITY,
+                                                       context->parser->cancellable,
+                                                       &(context->parser->error));
                 if (context->parser->error)
                     goto error;
 
                 AXING_DEBUG ("  PUSH ENTITY SYSTEM CONTEXT SYNC\n");
                 entctxt = context_new (context->parser);
                 entctxt->parent = context;
+                context_set_refspan (entctxt, context, reflen);
 
                 entctxt->resource = resource;
                 entctxt->basename = resource_get_basename (resource);
-                entctxt->entname = g_strdup (entname);
+                entctxt->entname = entname;
+                entname = NULL;
                 entctxt->state = PARSER_STATE_TEXTDECL;
                 entctxt->init_state = context->state;
                 context->parser->context = entctxt;
@@ -3553,6 +5542,7 @@ context_process_entity (Context *context, const char *entname)
     g_free (public);
     g_free (system);
     g_free (ndata);
+    g_free (entname);
 }
 
 
@@ -3610,6 +5600,7 @@ context_parse_text (Context *context)
             return;
         }
         if (context->parser->cur_text->len == 0) {
+            context_mark_start (context, cur);
             context->parser->txtlinenum = context->linenum;
             context->parser->txtcolnum = context->colnum;
         }
@@ -3638,6 +5629,360 @@ context_parse_text (Context *context)
 }
 
 
+/* Like context_parse_text, but for text the path filter would drop anyway.
+   Entity references still get expanded, because they could have elements
+   that match, but no text is kept.
+ */
+static void
+context_skip_text (Context *context)
+{
+    AXING_DEBUG ("context_skip_text: %s\n", context->linecur);
+    while (context->linecur[0] != '\0') {
+        if (context->linecur[0] == '<')
+            return;
+        if (context->linecur[0] == '&') {
+            if (context->linecur[1] == '#') {
+                context_skip_reference (context);
+            }
+            else {
+                context_parse_entity (context);
+                g_string_truncate (context->parser->cur_text, 0);
+            }
+            if (context->parser->error)
+                goto error;
+            /* entities could give us a new context, bubble out */
+            if (context != context->parser->context)
+                return;
+            continue;
+        }
+        SKIP_ADVANCE_CHAR (context, context->linecur);
+    }
+ error:
+    return;
+}
+
+
+static inline const char *
+parser_skip_names_top (AxingXmlParser *parser)
+{
+    const char *str = parser->skip_names->str;
+    gsize i = parser->skip_names->len - 1;
+    while (i > 0 && str[i - 1] != '\0')
+        i--;
+    return str + i;
+}
+
+
+/* Scans raw data up to the end tag for the current element, without creating
+   events or keeping any text. With AXING_SKIP_MODE_WELL_FORMED, this still
+   checks characters, names, nesting, attribute syntax, and reference syntax.
+   It doesn't check for duplicate attributes, namespaces, or undeclared
+   entities, because those need exactly the names and values we're avoiding.
+   References aren't expanded, which is fine because replacement text has to
+   be balanced on its own. With AXING_SKIP_MODE_BALANCED, this only does what
+   it has to in order to count tags.
+ */
+static void
+context_parse_skip (Context *context)
+{
+    AxingXmlParser *parser = context->parser;
+    gboolean check = (parser->skip_mode == AXING_SKIP_MODE_WELL_FORMED);
+    char *qname = NULL;
+    AXING_DEBUG ("context_parse_skip: %s\n", context->linecur);
+
+    while (context->linecur[0] != '\0') {
+        switch (context->skip_state) {
+        case SKIP_STATE_TEXT:
+            if (context->linecur[0] == '&' && check) {
+                context_skip_reference (context);
+                if (parser->error)
+                    goto error;
+            }
+            else if (context->linecur[0] != '<') {
+                SKIP_ADVANCE_CHAR (context, context->linecur);
+            }
+            else if (context->linecur[1] == '/') {
+                if (parser->skip_depth == 1) {
+                    /* Just like context_parse_end_element, re-use the start event */
+                    parser->event->linenum = context->linenum;
+                    parser->event->colnum = context->colnum;
+                    context_mark_start (context, context->linecur);
+                }
+                context->linecur += 2; context->colnum += 2;
+                if (check) {
+                    const char *top = parser_skip_names_top (parser);
+                    gsize len = strlen (top);
+                    if (strncmp (context->linecur, top, len) != 0 ||
+                        axing_utf8_bytes_name (context->linecur + len)) {
+                        gint64 colnum = context->colnum - 2;
+                        CONTEXT_GET_NAME (context, qname);
+                        context->colnum = colnum;
+                        ERROR_WRONGEND (context, qname);
+                    }
+                    context->linecur += len;
+                    context->colnum += g_utf8_strlen (top, len);
+                    g_string_truncate (parser->skip_names, top - parser->skip_names->str);
+                }
+                else {
+                    while (!(context->linecur[0] == '\0' || context->linecur[0] == '>' ||
+                             XML_IS_SPACE (context->linecur, context)))
+                        SKIP_ADVANCE_CHAR (context, context->linecur);
+                }
+                context->skip_state = SKIP_STATE_ENDELM;
+            }
+            else if (context->linecur[1] == '!') {
+                if (EQ7 (context->linecur + 2, '[', 'C', 'D', 'A', 'T', 'A', '[')) {
+                    context->linecur += 9; context->colnum += 9;
+                    context->skip_state = SKIP_STATE_CDATA;
+                }
+                else if (EQ2 (context->linecur + 2, '-', '-')) {
+                    context->linecur += 4; context->colnum += 4;
+                    context->skip_state = SKIP_STATE_COMMENT;
+                }
+                else {
+                    ERROR_SYNTAX_MSG (context, "Expected comment or CDATA");
+                }
+            }
+            else if (context->linecur[1] == '?') {
+                context->linecur += 2; context->colnum += 2;
+                if (check) {
+                    CONTEXT_SKIP_NAME (context);
+                    if (!(XML_IS_SPACE(context->linecur, context) ||
+                          context->linecur[0] == '\0' || context->linecur[0] == '?')) {
+                        ERROR_SYNTAX_MSG (context, "Expected space or question mark");
+                    }
+                }
+                context->skip_state = SKIP_STATE_INSTRUCTION;
+            }
+            else {
+                char *start;
+                context->linecur++; context->colnum++;
+                start = context->linecur;
+                if (check) {
+                    CONTEXT_SKIP_NAME (context);
+                    if (!(XML_IS_SPACE(context->linecur, context) ||
+                          context->linecur[0] == '\0' || context->linecur[0] == '>' ||
+                          EQ2 (context->linecur, '/', '>'))) {
+                        ERROR_SYNTAX_MSG (context, "Expected space, slash, or closing angle bracket");
+                    }
+                    g_string_append_len (parser->skip_names, start, context->linecur - start);
+                    g_string_append_c (parser->skip_names, '\0');
+                }
+                else {
+                    while (!(context->linecur[0] == '\0' || context->linecur[0] == '>' ||
+                             context->linecur[0] == '/' || XML_IS_SPACE (context->linecur, context)))
+                        SKIP_ADVANCE_CHAR (context, context->linecur);
+                }
+                parser->skip_depth++;
+                context->skip_state = SKIP_STATE_STELM;
+            }
+            break;
+        case SKIP_STATE_STELM:
+            CONTEXT_EAT_SPACES (context);
+            if (context->linecur[0] == '>') {
+                context->linecur++; context->colnum++;
+                context->skip_state = SKIP_STATE_TEXT;
+            }
+            else if (EQ2 (context->linecur, '/', '>')) {
+                context->linecur += 2; context->colnum += 2;
+                parser->skip_depth--;
+                if (check)
+                    g_string_truncate (parser->skip_names,
+                                       parser_skip_names_top (parser) - parser->skip_names->str);
+                context->skip_state = SKIP_STATE_TEXT;
+            }
+            else if (context->linecur[0] == '\0') {
+                break;
+            }
+            else if (check) {
+                CONTEXT_SKIP_NAME (context);
+                if (!(XML_IS_SPACE(context->linecur, context) ||
+                      context->linecur[0] == '\0' || context->linecur[0] == '=')) {
+                    ERROR_SYNTAX_MSG (context, "Expected space or equals sign");
+                }
+                context->skip_state = SKIP_STATE_ATTNAME;
+            }
+            else if (context->linecur[0] == '\'' || context->linecur[0] == '"') {
+                context->quotechar = context->linecur[0];
+                context->linecur++; context->colnum++;
+                context->skip_state = SKIP_STATE_ATTVAL;
+            }
+            else {
+                SKIP_ADVANCE_CHAR (context, context->linecur);
+            }
+            break;
+        case SKIP_STATE_ATTNAME:
+            CONTEXT_EAT_SPACES (context);
+            if (context->linecur[0] == '=') {
+                context->linecur++; context->colnum++;
+                context->skip_state = SKIP_STATE_ATTEQ;
+            }
+            else if (context->linecur[0] != '\0') {
+                ERROR_SYNTAX_MSG (context, "Expected space or equals sign");
+            }
+            break;
+        case SKIP_STATE_ATTEQ:
+            CONTEXT_EAT_SPACES (context);
+            if (context->linecur[0] == '\'' || context->linecur[0] == '"') {
+                context->quotechar = context->linecur[0];
+                context->linecur++; context->colnum++;
+                context->skip_state = SKIP_STATE_ATTVAL;
+            }
+            else if (context->linecur[0] != '\0') {
+                ERROR_SYNTAX_MSG (context, "Expected quote character");
+            }
+            break;
+        case SKIP_STATE_ATTVAL:
+            if (context->linecur[0] == context->quotechar) {
+                context->linecur++; context->colnum++;
+                if (check && !(context->linecur[0] == '>' || context->linecur[0] == '/' ||
+                               context->linecur[0] == '\0' || XML_IS_SPACE (context->linecur, context))) {
+                    ERROR_SYNTAX_MSG (context, "Expected space or closing angle bracket");
+                }
+                context->skip_state = SKIP_STATE_STELM;
+            }
+            else if (check && context->linecur[0] == '&') {
+                context_skip_reference (context);
+                if (parser->error)
+                    goto error;
+            }
+            else if (check && context->linecur[0] == '<') {
+                ERROR_SYNTAX_MSG (context, "Opening angle bracket not allowed in attribute values");
+            }
+            else {
+                SKIP_ADVANCE_CHAR (context, context->linecur);
+            }
+            break;
+        case SKIP_STATE_ENDELM:
+            CONTEXT_EAT_SPACES (context);
+            if (context->linecur[0] == '>') {
+                context->linecur++; context->colnum++;
+                context->skip_state = SKIP_STATE_TEXT;
+                if (--parser->skip_depth == 0) {
+                    if (parser->event->parent == NULL) {
+                        context->state = context->init_state;
+                        if (context->state == PARSER_STATE_PROLOG)
+                            context->state = PARSER_STATE_EPILOG;
+                    }
+                    else {
+                        context->state = PARSER_STATE_TEXT;
+                    }
+                    parser->event_type = AXING_NODE_TYPE_END_ELEMENT;
+                    return;
+                }
+            }
+            else if (context->linecur[0] != '\0') {
+                ERROR_SYNTAX_MSG (context, "Expected space or closing angle bracket");
+            }
+            break;
+        case SKIP_STATE_COMMENT:
+            if (EQ2 (context->linecur, '-', '-')) {
+                if (context->linecur[2] == '>') {
+                    context->linecur += 3; context->colnum += 3;
+                    context->skip_state = SKIP_STATE_TEXT;
+                }
+                else if (check) {
+                    ERROR_SYNTAX_MSG (context, "Two hyphens not allowed in comment");
+                }
+                else {
+                    context->linecur += 2; context->colnum += 2;
+                }
+            }
+            else {
+                SKIP_ADVANCE_CHAR (context, context->linecur);
+            }
+            break;
+        case SKIP_STATE_CDATA:
+            if (EQ3 (context->linecur, ']', ']', '>')) {
+                context->linecur += 3; context->colnum += 3;
+                context->skip_state = SKIP_STATE_TEXT;
+            }
+            else {
+                SKIP_ADVANCE_CHAR (context, context->linecur);
+            }
+            break;
+        case SKIP_STATE_INSTRUCTION:
+            if (EQ2 (context->linecur, '?', '>')) {
+                context->linecur += 2; context->colnum += 2;
+                context->skip_state = SKIP_STATE_TEXT;
+            }
+            else {
+                SKIP_ADVANCE_CHAR (context, context->linecur);
+            }
+            break;
+        }
+    }
+
+ error:
+    g_free (qname);
+    return;
+}
+
+
+/* Checks the syntax of an entity or character reference in skipped data,
+   the same way context_parse_entity would, but without expanding it.
+ */
+static void
+context_skip_reference (Context *context)
+{
+    gint64 colnum = context->colnum;
+    g_assert (context->linecur[0] == '&');
+    context->linecur++; context->colnum++;
+
+    if (context->linecur[0] == '#') {
+        gunichar cp = 0;
+        context->linecur++; context->colnum++;
+        if (context->linecur[0] == 'x') {
+            context->linecur++; context->colnum++;
+            while (context->linecur[0] != '\0' && context->linecur[0] != ';') {
+                if (context->linecur[0] >= '0' && context->linecur[0] <= '9')
+                    cp = 16 * cp + (context->linecur[0] - '0');
+                else if (context->linecur[0] >= 'A' && context->linecur[0] <= 'F')
+                    cp = 16 * cp + 10 + (context->linecur[0] - 'A');
+                else if (context->linecur[0] >= 'a' && context->linecur[0] <= 'f')
+                    cp = 16 * cp + 10 + (context->linecur[0] - 'a');
+                else
+                    ERROR_ENTITY_MSG (context, "Expected hexadecimal digit");
+                context->linecur++; context->colnum++;
+            }
+            if (context->linecur[0] != ';')
+                ERROR_ENTITY_MSG (context, "Expected hexadecimal digit");
+        }
+        else {
+            while (context->linecur[0] != '\0' && context->linecur[0] != ';') {
+                if (context->linecur[0] >= '0' && context->linecur[0] <= '9')
+                    cp = 10 * cp + (context->linecur[0] - '0');
+                else
+                    ERROR_ENTITY_MSG (context, "Expected decimal digit");
+                context->linecur++; context->colnum++;
+            }
+            if (context->linecur[0] != ';')
+                ERROR_ENTITY_MSG (context, "Expected decimal digit");
+        }
+        context->linecur++; context->colnum++;
+        if (!(XML_IS_CHAR(cp, context) || XML_IS_CHAR_RESTRICTED(cp, context))) {
+            context->colnum = colnum;
+            ERROR_ENTITY_MSG (context, "Replacement text contains invalid character");
+        }
+    }
+    else {
+        gsize bytes = axing_utf8_bytes_name_start (context->linecur);
+        if (bytes == 0)
+            ERROR_ENTITY_MSG (context, "Expected name start character");
+        do {
+            context->linecur += bytes;
+            context->colnum++;
+        } while ((bytes = axing_utf8_bytes_name (context->linecur)) != 0);
+        if (context->linecur[0] != ';')
+            ERROR_ENTITY_MSG (context, "Expected name character or semicolon");
+        context->linecur++; context->colnum++;
+    }
+
+ error:
+    return;
+}
+
+
 static void
 context_finish_start_element (Context *context)
 {
@@ -3776,12 +6121,33 @@ resource_get_basename (AxingResource *resource)
 }
 
 
+static const char *
+context_get_showname (Context *context)
+{
+    /* String entity contexts are shown as the entity reference inside the
+       resource that contains them. We only need that for error messages, so
+       it isn't built until something asks for it.
+     */
+    if (context->showname == NULL && context->entchar != '\0')
+        context->showname = g_strdup_printf ("%s(%c%s;)", context->basename,
+                                             context->entchar, context->entname);
+    return context->showname ? context->showname : context->basename;
+}
+
+
 static inline Context *
 context_new (AxingXmlParser *parser)
 {
     Context *context;
 
-    context = g_new0 (Context, 1);
+    /* Contexts are strictly pushed and popped, so the pool is a stack */
+    if (parser->contextpooldepth < CONTEXTPOOLSIZE) {
+        context = &(parser->contextpool[parser->contextpooldepth++]);
+        memset (context, 0, sizeof (Context));
+    }
+    else {
+        context = g_new0 (Context, 1);
+    }
     context->state = PARSER_STATE_NONE;
     context->init_state = PARSER_STATE_PROLOG;
     context->bom_encoding = BOM_ENCODING_NONE;
@@ -3805,8 +6171,10 @@ context_free (Context *context)
     g_clear_object (&context->datastream);
 
     g_free (context->line);
+    g_free (context->raw_charset);
 
-    g_free (context->basename);
+    if (context->parent == NULL || context->basename != context->parent->basename)
+        g_free (context->basename);
     g_free (context->entname);
     g_free (context->showname);
     g_free (context->pause_line);
@@ -3816,7 +6184,11 @@ context_free (Context *context)
     g_free (context->decl_public);
     g_free (context->decl_ndata);
 
-    g_free (context);
+    if (context >= context->parser->contextpool &&
+        context < context->parser->contextpool + CONTEXTPOOLSIZE)
+        context->parser->contextpooldepth = context - context->parser->contextpool;
+    else
+        g_free (context);
 }
 
 
@@ -3845,6 +6217,8 @@ static inline void
 event_free (Event *event)
 {
     event->parent = NULL;
+    event->name_id = 0;
+    event->ns_id = 0;
 
     if (event->qname)
         g_clear_pointer (&(event->qname), g_free);
@@ -3884,3 +6258,19 @@ event_free (Event *event)
         g_free (event);
     }
 }
+
+
+static inline void
+event_intern_names (AxingXmlParser *parser,
+                    Event          *event)
+{
+    /* Names are never empty, so a 0 name_id means we haven't done this yet */
+    if (event->name_id != 0)
+        return;
+    if (parser->names == NULL)
+        parser->names = axing_name_table_new ();
+    event->name_id = axing_name_table_intern (parser->names,
+                                              event->localname ? event->localname : event->qname,
+                                              -1);
+    event->ns_id = axing_name_table_intern (parser->names, event->namespace, -1);
+}
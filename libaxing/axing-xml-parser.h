@@ -28,6 +28,8 @@
 #include "axing-resolver.h"
 #include "axing-resource.h"
 #include "axing-reader.h"
+#include "axing-dtd-schema.h"
+#include "axing-name-table.h"
 
 G_BEGIN_DECLS
 
@@ -50,11 +52,119 @@ typedef enum {
     AXING_XML_PARSER_ERROR_OTHER
 } AxingXmlParserError;
 
+/* Attributes as passed to the start_element callback. The value is not
+   NUL-terminated in general, and is only valid during the callback.
+ */
+typedef struct {
+    guint32      name_id;
+    guint32      ns_id;
+    const char  *value;
+    gsize        value_len;
+} AxingXmlAttrSpan;
+
+/* Callbacks for axing_xml_parser_parse_with_callbacks. Names and namespaces
+   are IDs in the parser's name table, and text is only valid during the
+   callback. Any callback can be NULL. The AxingReader getters also work on
+   the parser during a callback, for things like line numbers.
+ */
+typedef struct {
+    void  (* start_element)  (AxingXmlParser         *parser,
+                              guint32                 name_id,
+                              guint32                 ns_id,
+                              const AxingXmlAttrSpan *attrs,
+                              guint                   n_attrs,
+                              gpointer                user_data);
+    void  (* end_element)    (AxingXmlParser         *parser,
+                              guint32                 name_id,
+                              guint32                 ns_id,
+                              gpointer                user_data);
+    void  (* text)           (AxingXmlParser         *parser,
+                              const char             *text,
+                              gsize                   len,
+                              gpointer                user_data);
+    void  (* cdata)          (AxingXmlParser         *parser,
+                              const char             *text,
+                              gsize                   len,
+                              gpointer                user_data);
+    void  (* comment)        (AxingXmlParser         *parser,
+                              const char             *text,
+                              gsize                   len,
+                              gpointer                user_data);
+    void  (* instruction)    (AxingXmlParser         *parser,
+                              guint32                 target_id,
+                              const char             *data,
+                              gsize                   len,
+                              gpointer                user_data);
+} AxingXmlParserCallbacks;
+
+/* The current event of a parser, as a plain struct. Use it in place of the
+   AxingReader getters when you know you have an AxingXmlParser, so nothing
+   gets type-checked or dispatched per field. prefix and namespace are ""
+   when there's none. attrs and attr_values are NULL-terminated and line up
+   with each other. Everything is valid until the next read.
+ */
+typedef struct {
+    AxingNodeType        type;
+    const char          *qname;
+    const char          *localname;
+    const char          *prefix;
+    const char          *namespace;
+    const char          *content;
+    gsize                content_len;
+    const char * const  *attrs;
+    const char * const  *attr_values;
+    gint64               linenum;
+    gint64               colnum;
+} AxingXmlEventView;
+
+/* Called by axing_parse_many on a worker thread for each resource */
+typedef void  (* AxingParseManyFunc) (AxingXmlParser         *parser,
+                                      AxingResource          *resource,
+                                      gpointer                user_data);
+
 GQuark            axing_xml_parser_error_quark     (void);
 
 AxingXmlParser *  axing_xml_parser_new             (AxingResource        *resource,
                                                     AxingResolver        *resolver);
 
+gboolean          axing_xml_parser_add_path_filter (AxingXmlParser       *parser,
+                                                    const char           *pattern,
+                                                    GError              **error);
+void              axing_xml_parser_set_skip_mode   (AxingXmlParser       *parser,
+                                                    AxingSkipMode         mode);
+
+void              axing_xml_parser_set_load_external_dtd (AxingXmlParser *parser,
+                                                          gboolean        load);
+void              axing_xml_parser_set_prefetch_entities (AxingXmlParser *parser,
+                                                          gboolean        prefetch);
+void              axing_xml_parser_add_external_dtd      (const char     *public,
+                                                          const char     *uri,
+                                                          AxingDtdSchema *schema);
+
+AxingNameTable *  axing_xml_parser_get_name_table  (AxingXmlParser       *parser);
+
+const AxingXmlEventView *
+                  axing_xml_parser_get_event_view  (AxingXmlParser       *parser);
+gboolean          axing_xml_parser_get_event_span  (AxingXmlParser       *parser,
+                                                    goffset              *start,
+                                                    goffset              *end);
+
+gboolean          axing_xml_parser_parse_with_callbacks (AxingXmlParser                *parser,
+                                                         const AxingXmlParserCallbacks *callbacks,
+                                                         gpointer                       user_data,
+                                                         GError                       **error);
+
+void              axing_xml_parser_reset           (AxingXmlParser       *parser,
+                                                    AxingResource        *resource);
+
+void              axing_parse_many                 (AxingResource       **resources,
+                                                    guint                 n_resources,
+                                                    AxingResolver        *resolver,
+                                                    guint                 n_threads,
+                                                    AxingParseManyFunc    func,
+                                                    gpointer              user_data,
+                                                    GCancellable         *cancellable);
+
 #ifdef REFACTOR
 void              axing_xml_parser_parse           (AxingXmlParser       *parser,
                                                     GCancellable         *cancellable,
@@ -68,6 +178,19 @@ void              axing_xml_parser_parse_finish    (AxingXmlParser       *parser
                                                     GError              **error);
 #endif /* REFACTOR */
 
+static inline const char *
+axing_xml_event_view_get_attr_value (const AxingXmlEventView *view,
+                                     const char              *qname)
+{
+    int i;
+    if (view->attrs == NULL)
+        return NULL;
+    for (i = 0; view->attrs[i] != NULL; i++)
+        if (strcmp (view->attrs[i], qname) == 0)
+            return view->attr_values[i];
+    return NULL;
+}
+
 G_END_DECLS
 
 #endif /* __AXING_XML_PARSER_H__ */
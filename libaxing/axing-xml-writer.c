@@ -0,0 +1,1059 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+
+/* AxingXmlWriter writes XML text, from reader events or from calls made
+   by hand. Output goes into a buffer that's written to the stream in
+   FLUSH_SIZE pieces, or that's kept to be stolen when there's no stream.
+   Runs of text too big for the buffer are written straight from the
+   caller's memory.
+
+   Escaping looks at eight bytes at a time, using the usual trick for
+   finding a zero byte in a word on the word XORed with each special
+   character. Clean words are skipped, and a word with something in it is
+   handled a byte at a time. Text escapes &, <, >, and CR. Attribute
+   values escape quotes and the other whitespace too, so that they come
+   back the same after attribute value normalization.
+
+   Readers don't report namespace declarations, so the writer makes its
+   own from the namespaces of element and attribute names. With namespace
+   minimization, which is the default, a prefix is declared only where
+   it isn't already bound to the right namespace. Without it, each
+   element declares every prefix it uses, so any element can be cut out
+   on its own.
+
+   Given the bytes of the document a parser is reading, the writer can
+   copy a whole element straight from them, tags and all, in one piece,
+   using the parser's event spans. Filters that change a few elements in
+   a big document can copy everything they don't touch. The copied start
+   tag gets declarations for any namespaces the element uses that were
+   declared on its ancestors, so it means the same wherever it lands.
+   From the first event that came from entity replacement text or has
+   entity references in it, the rest is written event by event, since
+   the DTD doesn't come along. So is everything without namespace
+   minimization, which wants declarations the source doesn't have.
+ */
+
+#include <string.h>
+
+#include "axing-private.h"
+#include "axing-xml-writer.h"
+
+#define FLUSH_SIZE 65536
+
+#define ESCAPE_TEXT 1
+#define ESCAPE_ATTR 2
+
+#define ONES  G_GUINT64_CONSTANT (0x0101010101010101)
+#define HIGHS G_GUINT64_CONSTANT (0x8080808080808080)
+#define HAS_ZERO(v)    (((v) - ONES) & ~(v) & HIGHS)
+#define HAS_BYTE(v, c) HAS_ZERO ((v) ^ (ONES * (guint8) (c)))
+
+#define TEXT_DIRTY(v) (HAS_BYTE (v, '&') | HAS_BYTE (v, '<') | HAS_BYTE (v, '>') | \
+                       HAS_BYTE (v, '\r'))
+#define ATTR_DIRTY(v) (TEXT_DIRTY (v) | HAS_BYTE (v, '"') | HAS_BYTE (v, '\t') | \
+                       HAS_BYTE (v, '\n'))
+
+static const guint8 escape_flags[256] = {
+    ['&']  = ESCAPE_TEXT | ESCAPE_ATTR,
+    ['<']  = ESCAPE_TEXT | ESCAPE_ATTR,
+    ['>']  = ESCAPE_TEXT | ESCAPE_ATTR,
+    ['\r'] = ESCAPE_TEXT | ESCAPE_ATTR,
+    ['"']  = ESCAPE_ATTR,
+    ['\t'] = ESCAPE_ATTR,
+    ['\n'] = ESCAPE_ATTR
+};
+
+typedef struct {
+    gsize prefix; /* offsets into nsdata */
+    gsize uri;
+    guint depth;
+} Binding;
+
+/* Namespaces seen while copying an element. depth is 1 for the element
+   itself, or 0 for something its start tag has to declare.
+ */
+typedef struct {
+    char *prefix;
+    char *uri;
+    int   depth;
+} CopyBinding;
+
+struct _AxingXmlWriter {
+    GObject parent;
+
+    GOutputStream  *stream;
+    GByteArray     *buf;
+    GBytes         *source;
+    gboolean        minimize_ns;
+    gboolean        open_tag;   /* written "<name" but not ">" */
+
+    GString        *names;      /* qnames of open elements, NUL after each */
+    GArray         *name_offsets;
+    GString        *nsdata;     /* prefixes and URIs of bindings, NUL after each */
+    GArray         *bindings;
+};
+
+G_DEFINE_TYPE (AxingXmlWriter, axing_xml_writer, G_TYPE_OBJECT);
+
+static void      axing_xml_writer_init        (AxingXmlWriter      *writer);
+static void      axing_xml_writer_class_init  (AxingXmlWriterClass *klass);
+static void      axing_xml_writer_dispose     (GObject             *object);
+static void      axing_xml_writer_finalize    (GObject             *object);
+
+static gboolean  writer_drain                 (AxingXmlWriter      *writer,
+                                               GError             **error);
+static gboolean  writer_put                   (AxingXmlWriter      *writer,
+                                               const char          *data,
+                                               gsize                len,
+                                               GError             **error);
+static gboolean  writer_escape                (AxingXmlWriter      *writer,
+                                               const char          *text,
+                                               gsize                len,
+                                               guint8               flag,
+                                               GError             **error);
+static gboolean  writer_copy_span             (AxingXmlWriter      *writer,
+                                               AxingXmlParser      *parser,
+                                               gboolean            *copied,
+                                               GError             **error);
+static gboolean  writer_copy_raw              (AxingXmlWriter      *writer,
+                                               const char          *tag,
+                                               const char          *end,
+                                               gsize                qnamelen,
+                                               GArray              *needed,
+                                               GError             **error);
+static void      writer_adopt                 (AxingXmlWriter      *writer,
+                                               GPtrArray           *open,
+                                               GArray              *declared,
+                                               GArray              *needed);
+static void      writer_close_tag             (AxingXmlWriter      *writer);
+static void      writer_push_name             (AxingXmlWriter      *writer,
+                                               const char          *qname);
+static const char *
+                 writer_lookup                (AxingXmlWriter      *writer,
+                                               const char          *prefix);
+static void      writer_declare               (AxingXmlWriter      *writer,
+                                               const char          *qname,
+                                               gsize                prefixlen,
+                                               const char          *uri);
+static void      writer_put_xmlns             (AxingXmlWriter      *writer,
+                                               const char          *prefix,
+                                               gsize                prefixlen,
+                                               const char          *uri);
+static void      writer_bind                  (AxingXmlWriter      *writer,
+                                               const char          *prefix,
+                                               gsize                prefixlen,
+                                               const char          *uri,
+                                               guint                depth);
+
+static gboolean  span_is_clean                (AxingNodeType        type,
+                                               const char          *c,
+                                               const char          *end);
+static void      copy_start_element           (AxingXmlParser      *parser,
+                                               int                  depth,
+                                               GArray              *declared,
+                                               GArray              *needed,
+                                               GPtrArray           *open);
+static void      copy_end_element             (int                  depth,
+                                               GArray              *declared,
+                                               GPtrArray           *open);
+static void      copy_note_ns                 (GArray              *declared,
+                                               GArray              *needed,
+                                               const char          *prefix,
+                                               const char          *uri);
+static void      copy_bindings_free           (GArray              *bindings);
+
+#define PUT(writer, str) g_byte_array_append ((writer)->buf, (const guint8 *) (str), strlen (str))
+
+static void
+axing_xml_writer_init (AxingXmlWriter *writer)
+{
+    writer->buf = g_byte_array_sized_new (FLUSH_SIZE + 1024);
+    writer->minimize_ns = TRUE;
+    writer->names = g_string_new (NULL);
+    writer->name_offsets = g_array_new (FALSE, FALSE, sizeof (gsize));
+    writer->nsdata = g_string_new (NULL);
+    writer->bindings = g_array_new (FALSE, FALSE, sizeof (Binding));
+}
+
+static void
+axing_xml_writer_class_init (AxingXmlWriterClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+    object_class->dispose = axing_xml_writer_dispose;
+    object_class->finalize = axing_xml_writer_finalize;
+}
+
+static void
+axing_xml_writer_dispose (GObject *object)
+{
+    AxingXmlWriter *writer = AXING_XML_WRITER (object);
+    g_clear_object (&(writer->stream));
+    g_clear_pointer (&(writer->source), g_bytes_unref);
+    G_OBJECT_CLASS (axing_xml_writer_parent_class)->dispose (object);
+}
+
+static void
+axing_xml_writer_finalize (GObject *object)
+{
+    AxingXmlWriter *writer = AXING_XML_WRITER (object);
+    g_byte_array_free (writer->buf, TRUE);
+    g_string_free (writer->names, TRUE);
+    g_array_free (writer->name_offsets, TRUE);
+    g_string_free (writer->nsdata, TRUE);
+    g_array_free (writer->bindings, TRUE);
+    G_OBJECT_CLASS (axing_xml_writer_parent_class)->finalize (object);
+}
+
+/* With a NULL stream, everything is kept for axing_xml_writer_steal_bytes */
+AxingXmlWriter *
+axing_xml_writer_new (GOutputStream *stream)
+{
+    AxingXmlWriter *writer;
+    g_return_val_if_fail (stream == NULL || G_IS_OUTPUT_STREAM (stream), NULL);
+    writer = g_object_new (AXING_TYPE_XML_WRITER, NULL);
+    if (stream != NULL)
+        writer->stream = g_object_ref (stream);
+    return writer;
+}
+
+void
+axing_xml_writer_set_minimize_ns (AxingXmlWriter *writer,
+                                  gboolean        minimize)
+{
+    g_return_if_fail (AXING_IS_XML_WRITER (writer));
+    writer->minimize_ns = minimize;
+}
+
+/* Sets the bytes of the document being read, for copying elements with
+   axing_xml_writer_copy_element. Only documents in UTF-8 get copied, and
+   the rest are written event by event.
+ */
+void
+axing_xml_writer_set_source (AxingXmlWriter *writer,
+                             GBytes         *source)
+{
+    g_return_if_fail (AXING_IS_XML_WRITER (writer));
+    if (source != NULL)
+        g_bytes_ref (source);
+    g_clear_pointer (&(writer->source), g_bytes_unref);
+    writer->source = source;
+}
+
+/* namespace is NULL or "" for none. Attributes can follow until anything
+   else is written.
+ */
+gboolean
+axing_xml_writer_start_element (AxingXmlWriter  *writer,
+                                const char      *qname,
+                                const char      *namespace,
+                                GError         **error)
+{
+    const char *colon;
+
+    g_return_val_if_fail (AXING_IS_XML_WRITER (writer), FALSE);
+    g_return_val_if_fail (qname != NULL, FALSE);
+
+    writer_close_tag (writer);
+    PUT (writer, "<");
+    PUT (writer, qname);
+    writer_push_name (writer, qname);
+
+    colon = strchr (qname, ':');
+    writer_declare (writer, qname, colon ? colon - qname : 0, namespace ? namespace : "");
+    writer->open_tag = TRUE;
+
+    if (writer->buf->len >= FLUSH_SIZE)
+        return writer_drain (writer, error);
+    return TRUE;
+}
+
+gboolean
+axing_xml_writer_write_attribute (AxingXmlWriter  *writer,
+                                  const char      *qname,
+                                  const char      *namespace,
+                                  const char      *value,
+                                  GError         **error)
+{
+    const char *colon;
+
+    g_return_val_if_fail (AXING_IS_XML_WRITER (writer), FALSE);
+    g_return_val_if_fail (writer->open_tag, FALSE);
+    g_return_val_if_fail (qname != NULL && value != NULL, FALSE);
+
+    /* Unprefixed attributes are in no namespace, whatever the default is */
+    colon = strchr (qname, ':');
+    if (colon != NULL)
+        writer_declare (writer, qname, colon - qname, namespace ? namespace : "");
+
+    PUT (writer, " ");
+    PUT (writer, qname);
+    PUT (writer, "=\"");
+    if (!writer_escape (writer, value, strlen (value), ESCAPE_ATTR, error))
+        return FALSE;
+    PUT (writer, "\"");
+    return TRUE;
+}
+
+gboolean
+axing_xml_writer_end_element (AxingXmlWriter  *writer,
+                              GError         **error)
+{
+    guint depth;
+    gsize offset;
+
+    g_return_val_if_fail (AXING_IS_XML_WRITER (writer), FALSE);
+    g_return_val_if_fail (writer->name_offsets->len > 0, FALSE);
+
+    depth = writer->name_offsets->len;
+    offset = g_array_index (writer->name_offsets, gsize, depth - 1);
+    if (writer->open_tag) {
+        PUT (writer, "/>");
+        writer->open_tag = FALSE;
+    }
+    else {
+        PUT (writer, "</");
+        PUT (writer, writer->names->str + offset);
+        PUT (writer, ">");
+    }
+    g_string_truncate (writer->names, offset);
+    g_array_set_size (writer->name_offsets, depth - 1);
+
+    if (writer->bindings->len > 0) {
+        guint i = writer->bindings->len;
+        while (i > 0 && g_array_index (writer->bindings, Binding, i - 1).depth == depth)
+            i--;
+        if (i < writer->bindings->len) {
+            g_string_truncate (writer->nsdata,
+                               g_array_index (writer->bindings, Binding, i).prefix);
+            g_array_set_size (writer->bindings, i);
+        }
+    }
+
+    if (writer->buf->len >= FLUSH_SIZE)
+        return writer_drain (writer, error);
+    return TRUE;
+}
+
+/* len -1 means content is NUL-terminated */
+gboolean
+axing_xml_writer_write_content (AxingXmlWriter  *writer,
+                                const char      *content,
+                                gssize           len,
+                                GError         **error)
+{
+    g_return_val_if_fail (AXING_IS_XML_WRITER (writer), FALSE);
+    g_return_val_if_fail (content != NULL, FALSE);
+
+    writer_close_tag (writer);
+    return writer_escape (writer, content, len < 0 ? strlen (content) : (gsize) len,
+                          ESCAPE_TEXT, error);
+}
+
+/* A "]]>" in content ends the section and starts another */
+gboolean
+axing_xml_writer_write_cdata (AxingXmlWriter  *writer,
+                              const char      *content,
+                              GError         **error)
+{
+    const char *c, *end;
+
+    g_return_val_if_fail (AXING_IS_XML_WRITER (writer), FALSE);
+    g_return_val_if_fail (content != NULL, FALSE);
+
+    writer_close_tag (writer);
+    PUT (writer, "<![CDATA[");
+    c = content;
+    while ((end = strstr (c, "]]>")) != NULL) {
+        if (!writer_put (writer, c, end + 2 - c, error))
+            return FALSE;
+        PUT (writer, "]]><![CDATA[");
+        c = end + 2;
+    }
+    if (!writer_put (writer, c, strlen (c), error))
+        return FALSE;
+    PUT (writer, "]]>");
+    return TRUE;
+}
+
+/* There's no escaping in comments, so content can't have "--" */
+gboolean
+axing_xml_writer_write_comment (AxingXmlWriter  *writer,
+                                const char      *content,
+                                GError         **error)
+{
+    g_return_val_if_fail (AXING_IS_XML_WRITER (writer), FALSE);
+    g_return_val_if_fail (content != NULL, FALSE);
+
+    writer_close_tag (writer);
+    PUT (writer, "<!--");
+    if (!writer_put (writer, content, strlen (content), error))
+        return FALSE;
+    PUT (writer, "-->");
+    return TRUE;
+}
+
+gboolean
+axing_xml_writer_write_instruction (AxingXmlWriter  *writer,
+                                    const char      *target,
+                                    const char      *data,
+                                    GError         **error)
+{
+    g_return_val_if_fail (AXING_IS_XML_WRITER (writer), FALSE);
+    g_return_val_if_fail (target != NULL, FALSE);
+
+    writer_close_tag (writer);
+    PUT (writer, "<?");
+    PUT (writer, target);
+    if (data != NULL && data[0] != '\0') {
+        PUT (writer, " ");
+        if (!writer_put (writer, data, strlen (data), error))
+            return FALSE;
+    }
+    PUT (writer, "?>");
+    if (writer->buf->len >= FLUSH_SIZE)
+        return writer_drain (writer, error);
+    return TRUE;
+}
+
+/* Writes the reader's current event. Output is buffered, so call
+   axing_xml_writer_flush when you're done.
+ */
+gboolean
+axing_xml_writer_write_event (AxingXmlWriter  *writer,
+                              AxingReader     *reader,
+                              GError         **error)
+{
+    g_return_val_if_fail (AXING_IS_XML_WRITER (writer), FALSE);
+    g_return_val_if_fail (AXING_IS_READER (reader), FALSE);
+
+    switch (axing_reader_get_node_type (reader)) {
+    case AXING_NODE_TYPE_ELEMENT: {
+        const char * const *attrs = axing_reader_get_attrs (reader);
+        guint i;
+        if (!axing_xml_writer_start_element (writer,
+                                             axing_reader_get_qname (reader),
+                                             axing_reader_get_namespace (reader),
+                                             error))
+            return FALSE;
+        for (i = 0; attrs[i] != NULL; i++) {
+            if (!axing_xml_writer_write_attribute (writer, attrs[i],
+                                                   axing_reader_get_attr_namespace (reader, attrs[i]),
+                                                   axing_reader_get_attr_value (reader, attrs[i]),
+                                                   error))
+                return FALSE;
+        }
+        return TRUE;
+    }
+    case AXING_NODE_TYPE_END_ELEMENT:
+        return axing_xml_writer_end_element (writer, error);
+    case AXING_NODE_TYPE_CONTENT:
+        return axing_xml_writer_write_content (writer, axing_reader_get_content (reader), -1, error);
+    case AXING_NODE_TYPE_CDATA:
+        return axing_xml_writer_write_cdata (writer, axing_reader_get_content (reader), error);
+    case AXING_NODE_TYPE_COMMENT:
+        return axing_xml_writer_write_comment (writer, axing_reader_get_content (reader), error);
+    case AXING_NODE_TYPE_INSTRUCTION:
+        return axing_xml_writer_write_instruction (writer,
+                                                   axing_reader_get_qname (reader),
+                                                   axing_reader_get_content (reader),
+                                                   error);
+    default:
+        return TRUE;
+    }
+}
+
+/* Reads the rest of reader, writing each event, and flushes */
+gboolean
+axing_xml_writer_write_all (AxingXmlWriter  *writer,
+                            AxingReader     *reader,
+                            GError         **error)
+{
+    GError *readerror = NULL;
+
+    g_return_val_if_fail (AXING_IS_XML_WRITER (writer), FALSE);
+    g_return_val_if_fail (AXING_IS_READER (reader), FALSE);
+
+    while (axing_reader_read (reader, &readerror)) {
+        if (!axing_xml_writer_write_event (writer, reader, error))
+            return FALSE;
+    }
+    if (readerror != NULL) {
+        if (error != NULL)
+            *error = g_error_copy (readerror);
+        return FALSE;
+    }
+    return axing_xml_writer_flush (writer, error);
+}
+
+/* Writes the element the parser is on and everything in it, leaving the
+   parser on its END_ELEMENT. With a source set, the element is copied
+   from it in one piece, up to the first event that can't be copied. From
+   there, text, comments, and instructions are still copied when they can
+   be, and everything else is written from its event.
+ */
+gboolean
+axing_xml_writer_copy_element (AxingXmlWriter  *writer,
+                               AxingXmlParser  *parser,
+                               GError         **error)
+{
+    AxingReader *reader = AXING_READER (parser);
+    GError *readerror = NULL;
+    GArray *declared, *needed;
+    GPtrArray *open;
+    const char *data = NULL;
+    gsize size = 0, qnamelen = 0;
+    goffset first = -1, last = -1;
+    int depth = 0;
+    gboolean ret = FALSE;
+
+    g_return_val_if_fail (AXING_IS_XML_WRITER (writer), FALSE);
+    g_return_val_if_fail (AXING_IS_XML_PARSER (parser), FALSE);
+    g_return_val_if_fail (axing_reader_get_node_type (reader) == AXING_NODE_TYPE_ELEMENT, FALSE);
+
+    declared = g_array_new (FALSE, FALSE, sizeof (CopyBinding));
+    needed = g_array_new (FALSE, FALSE, sizeof (CopyBinding));
+    open = g_ptr_array_new_with_free_func (g_free);
+
+    /* Events have to follow each other in the source with nothing in
+       between, or something we didn't see would get copied. */
+    if (writer->source != NULL && writer->minimize_ns)
+        data = g_bytes_get_data (writer->source, &size);
+    while (data != NULL) {
+        AxingNodeType type = axing_reader_get_node_type (reader);
+        goffset start, stop;
+
+        if (!axing_xml_parser_get_event_span (parser, &start, &stop))
+            break;
+        if ((gsize) stop > size) {
+            g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                         "Source is shorter than the parsed document");
+            goto done;
+        }
+        if ((first >= 0 && start != last) || !span_is_clean (type, data + start, data + stop))
+            break;
+        if (first < 0) {
+            const char *qname = axing_reader_get_qname (reader);
+            qnamelen = strlen (qname);
+            if ((gsize) (stop - start) <= qnamelen + 1 || data[start] != '<' ||
+                strncmp (data + start + 1, qname, qnamelen) != 0)
+                break;
+            first = start;
+        }
+
+        if (type == AXING_NODE_TYPE_ELEMENT)
+            copy_start_element (parser, ++depth, declared, needed, open);
+        else if (type == AXING_NODE_TYPE_END_ELEMENT)
+            copy_end_element (depth--, declared, open);
+        last = stop;
+
+        if (depth == 0) {
+            ret = writer_copy_raw (writer, data + first, data + last, qnamelen, needed, error);
+            goto done;
+        }
+        if (!axing_reader_read (reader, &readerror))
+            goto error;
+    }
+
+    /* Copy what we got through, and let the writer know what's open */
+    if (first >= 0) {
+        if (!writer_copy_raw (writer, data + first, data + last, qnamelen, needed, error))
+            goto done;
+        writer_adopt (writer, open, declared, needed);
+    }
+
+    while (TRUE) {
+        AxingNodeType type = axing_reader_get_node_type (reader);
+        gboolean copied = FALSE;
+        if (type != AXING_NODE_TYPE_ELEMENT && type != AXING_NODE_TYPE_END_ELEMENT &&
+            !writer_copy_span (writer, parser, &copied, error))
+            goto done;
+        if (!copied && !axing_xml_writer_write_event (writer, reader, error))
+            goto done;
+        if (type == AXING_NODE_TYPE_ELEMENT)
+            depth++;
+        else if (type == AXING_NODE_TYPE_END_ELEMENT && --depth == 0) {
+            ret = TRUE;
+            goto done;
+        }
+        if (!axing_reader_read (reader, &readerror))
+            goto error;
+    }
+
+ error:
+    /* The parser owns the error it reports */
+    if (readerror != NULL) {
+        if (error != NULL)
+            *error = g_error_copy (readerror);
+    }
+    else {
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                     "Document ended inside an element");
+    }
+
+ done:
+    copy_bindings_free (declared);
+    copy_bindings_free (needed);
+    g_ptr_array_free (open, TRUE);
+    return ret;
+}
+
+/* Doesn't close an open start tag, since attributes could still come */
+gboolean
+axing_xml_writer_flush (AxingXmlWriter  *writer,
+                        GError         **error)
+{
+    g_return_val_if_fail (AXING_IS_XML_WRITER (writer), FALSE);
+
+    if (writer->stream == NULL)
+        return TRUE;
+    if (!writer_drain (writer, error))
+        return FALSE;
+    return g_output_stream_flush (writer->stream, NULL, error);
+}
+
+/* Returns everything written so far and starts over with an empty
+   buffer. Only for writers without a stream.
+ */
+GBytes *
+axing_xml_writer_steal_bytes (AxingXmlWriter *writer)
+{
+    GBytes *bytes;
+
+    g_return_val_if_fail (AXING_IS_XML_WRITER (writer), NULL);
+    g_return_val_if_fail (writer->stream == NULL, NULL);
+
+    bytes = g_byte_array_free_to_bytes (writer->buf);
+    writer->buf = g_byte_array_sized_new (FLUSH_SIZE + 1024);
+    return bytes;
+}
+
+static gboolean
+writer_drain (AxingXmlWriter  *writer,
+              GError         **error)
+{
+    if (writer->stream == NULL || writer->buf->len == 0)
+        return TRUE;
+    if (!g_output_stream_write_all (writer->stream, writer->buf->data, writer->buf->len,
+                                    NULL, NULL, error))
+        return FALSE;
+    g_byte_array_set_size (writer->buf, 0);
+    return TRUE;
+}
+
+/* Big pieces skip the buffer and go straight to the stream */
+static gboolean
+writer_put (AxingXmlWriter  *writer,
+            const char      *data,
+            gsize            len,
+            GError         **error)
+{
+    if (writer->stream != NULL && len >= FLUSH_SIZE) {
+        if (!writer_drain (writer, error))
+            return FALSE;
+        return g_output_stream_write_all (writer->stream, data, len, NULL, NULL, error);
+    }
+    g_byte_array_append (writer->buf, (const guint8 *) data, len);
+    if (writer->buf->len >= FLUSH_SIZE)
+        return writer_drain (writer, error);
+    return TRUE;
+}
+
+static gboolean
+writer_escape (AxingXmlWriter  *writer,
+               const char      *text,
+               gsize            len,
+               guint8           flag,
+               GError         **error)
+{
+    const char *c = text, *end = text + len, *run = text;
+
+    while (c < end) {
+        const char *stop;
+
+        while (end - c >= 8) {
+            guint64 v;
+            memcpy (&v, c, 8);
+            if (flag == ESCAPE_TEXT ? TEXT_DIRTY (v) : ATTR_DIRTY (v))
+                break;
+            c += 8;
+        }
+
+        stop = MIN (c + 8, end);
+        for (; c < stop; c++) {
+            const char *ent;
+            if (!(escape_flags[(guint8) *c] & flag))
+                continue;
+            switch (*c) {
+            case '&':  ent = "&amp;";  break;
+            case '<':  ent = "&lt;";   break;
+            case '>':  ent = "&gt;";   break;
+            case '"':  ent = "&quot;"; break;
+            case '\t': ent = "&#9;";   break;
+            case '\n': ent = "&#10;";  break;
+            default:   ent = "&#13;";  break;
+            }
+            g_byte_array_append (writer->buf, (const guint8 *) run, c - run);
+            PUT (writer, ent);
+            run = c + 1;
+        }
+
+        if (writer->buf->len >= FLUSH_SIZE && !writer_drain (writer, error))
+            return FALSE;
+        if (c - run >= FLUSH_SIZE) {
+            if (!writer_put (writer, run, c - run, error))
+                return FALSE;
+            run = c;
+        }
+    }
+    return writer_put (writer, run, end - run, error);
+}
+
+/* Copies the bytes of the parser's current event from the source, if
+   there's a source, the parser has a span for the event, and the bytes
+   have no entity references other than the predefined ones and character
+   references. Otherwise copied is FALSE and nothing is written.
+ */
+static gboolean
+writer_copy_span (AxingXmlWriter  *writer,
+                  AxingXmlParser  *parser,
+                  gboolean        *copied,
+                  GError         **error)
+{
+    const char *data;
+    goffset start, stop;
+    gsize size;
+
+    *copied = FALSE;
+    if (writer->source == NULL || !axing_xml_parser_get_event_span (parser, &start, &stop))
+        return TRUE;
+    data = g_bytes_get_data (writer->source, &size);
+    if ((gsize) stop > size) {
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                     "Source is shorter than the parsed document");
+        return FALSE;
+    }
+
+    if (!span_is_clean (axing_reader_get_node_type (AXING_READER (parser)),
+                        data + start, data + stop))
+        return TRUE;
+
+    writer_close_tag (writer);
+    *copied = TRUE;
+    return writer_put (writer, data + start, stop - start, error);
+}
+
+/* Copies the source from tag to end, adding the declarations in needed
+   that the writer doesn't already have in scope to the first start tag.
+   Without any, it's a single put.
+ */
+static gboolean
+writer_copy_raw (AxingXmlWriter  *writer,
+                 const char      *tag,
+                 const char      *end,
+                 gsize            qnamelen,
+                 GArray          *needed,
+                 GError         **error)
+{
+    const char *rest = tag + 1 + qnamelen;
+    gboolean split = FALSE;
+    guint i;
+
+    writer_close_tag (writer);
+    for (i = 0; i < needed->len; i++) {
+        CopyBinding *need = &g_array_index (needed, CopyBinding, i);
+        const char *bound = writer_lookup (writer, need->prefix);
+        if (bound ? g_str_equal (bound, need->uri) : need->uri[0] == '\0')
+            continue;
+        if (!split) {
+            if (!writer_put (writer, tag, rest - tag, error))
+                return FALSE;
+            split = TRUE;
+        }
+        writer_put_xmlns (writer, need->prefix, strlen (need->prefix), need->uri);
+    }
+    if (!split)
+        return writer_put (writer, tag, end - tag, error);
+    return writer_put (writer, rest, end - rest, error);
+}
+
+/* After a partial copy, open records the elements that are still open,
+   and the writer takes them on as if it had written them. The bindings
+   are the ones the copied start tags declared.
+ */
+static void
+writer_adopt (AxingXmlWriter *writer,
+              GPtrArray      *open,
+              GArray         *declared,
+              GArray         *needed)
+{
+    guint base = writer->name_offsets->len;
+    guint i;
+
+    for (i = 0; i < open->len; i++)
+        writer_push_name (writer, open->pdata[i]);
+    for (i = 0; i < needed->len; i++) {
+        CopyBinding *need = &g_array_index (needed, CopyBinding, i);
+        writer_bind (writer, need->prefix, strlen (need->prefix), need->uri, base + 1);
+    }
+    for (i = 0; i < declared->len; i++) {
+        CopyBinding *decl = &g_array_index (declared, CopyBinding, i);
+        writer_bind (writer, decl->prefix, strlen (decl->prefix), decl->uri, base + decl->depth);
+    }
+}
+
+static void
+writer_close_tag (AxingXmlWriter *writer)
+{
+    if (writer->open_tag) {
+        PUT (writer, ">");
+        writer->open_tag = FALSE;
+    }
+}
+
+static void
+writer_push_name (AxingXmlWriter *writer,
+                  const char     *qname)
+{
+    gsize offset = writer->names->len;
+    g_string_append_len (writer->names, qname, strlen (qname) + 1);
+    g_array_append_val (writer->name_offsets, offset);
+}
+
+/* The namespace prefix is bound to where we are, or NULL */
+static const char *
+writer_lookup (AxingXmlWriter *writer,
+               const char     *prefix)
+{
+    guint i;
+    for (i = writer->bindings->len; i > 0; i--) {
+        Binding *bound = &g_array_index (writer->bindings, Binding, i - 1);
+        if (g_str_equal (writer->nsdata->str + bound->prefix, prefix))
+            return writer->nsdata->str + bound->uri;
+    }
+    return NULL;
+}
+
+/* Declares the prefix of qname on the open element if it needs it */
+static void
+writer_declare (AxingXmlWriter *writer,
+                const char     *qname,
+                gsize           prefixlen,
+                const char     *uri)
+{
+    guint depth = writer->name_offsets->len;
+    guint i;
+
+    if (prefixlen == 3 && strncmp (qname, "xml", 3) == 0)
+        return;
+    /* Prefixes can't be undeclared in XML 1.0, so this is just broken */
+    if (prefixlen > 0 && uri[0] == '\0')
+        return;
+
+    for (i = writer->bindings->len; i > 0; i--) {
+        Binding *bound = &g_array_index (writer->bindings, Binding, i - 1);
+        const char *prefix = writer->nsdata->str + bound->prefix;
+        if (strlen (prefix) == prefixlen && strncmp (prefix, qname, prefixlen) == 0) {
+            if (g_str_equal (writer->nsdata->str + bound->uri, uri)) {
+                if (writer->minimize_ns || bound->depth == depth)
+                    return;
+            }
+            else if (bound->depth == depth) {
+                g_critical ("Prefix %.*s is bound to two namespaces on one element",
+                            (int) prefixlen, qname);
+                return;
+            }
+            break;
+        }
+    }
+    /* Nothing in scope is the same as the empty default namespace */
+    if (i == 0 && prefixlen == 0 && uri[0] == '\0')
+        return;
+
+    writer_put_xmlns (writer, qname, prefixlen, uri);
+    writer_bind (writer, qname, prefixlen, uri, depth);
+}
+
+static void
+writer_put_xmlns (AxingXmlWriter *writer,
+                  const char     *prefix,
+                  gsize           prefixlen,
+                  const char     *uri)
+{
+    if (prefixlen == 0) {
+        PUT (writer, " xmlns=\"");
+    }
+    else {
+        PUT (writer, " xmlns:");
+        g_byte_array_append (writer->buf, (const guint8 *) prefix, prefixlen);
+        PUT (writer, "=\"");
+    }
+    /* If this has to drain and the write fails, the buffer is kept and
+       the next write that can report errors fails the same way.
+     */
+    writer_escape (writer, uri, strlen (uri), ESCAPE_ATTR, NULL);
+    PUT (writer, "\"");
+}
+
+static void
+writer_bind (AxingXmlWriter *writer,
+             const char     *prefix,
+             gsize           prefixlen,
+             const char     *uri,
+             guint           depth)
+{
+    Binding binding;
+
+    binding.prefix = writer->nsdata->len;
+    g_string_append_len (writer->nsdata, prefix, prefixlen);
+    g_string_append_c (writer->nsdata, '\0');
+    binding.uri = writer->nsdata->len;
+    g_string_append_len (writer->nsdata, uri, strlen (uri) + 1);
+    binding.depth = depth;
+    g_array_append_val (writer->bindings, binding);
+}
+
+/* Whether the bytes have no entity references but the predefined ones
+   and character references, and so mean the same without the DTD. Only
+   text and start tags have references. An & anywhere else is just an &.
+ */
+static gboolean
+span_is_clean (AxingNodeType  type,
+               const char    *c,
+               const char    *end)
+{
+    static const char *predefined[] = { "amp;", "lt;", "gt;", "quot;", "apos;", NULL };
+
+    if (type != AXING_NODE_TYPE_CONTENT && type != AXING_NODE_TYPE_ELEMENT)
+        return TRUE;
+
+    while ((c = memchr (c, '&', end - c)) != NULL) {
+        int i;
+        c++;
+        if (c < end && *c == '#')
+            continue;
+        for (i = 0; predefined[i] != NULL; i++) {
+            gsize len = strlen (predefined[i]);
+            if ((gsize) (end - c) >= len && strncmp (c, predefined[i], len) == 0)
+                break;
+        }
+        if (predefined[i] == NULL)
+            return FALSE;
+    }
+    return TRUE;
+}
+
+/* Notes the declarations on the start tag the parser is on, and what the
+   names in it need from outside the copied element.
+ */
+static void
+copy_start_element (AxingXmlParser *parser,
+                    int             depth,
+                    GArray         *declared,
+                    GArray         *needed,
+                    GPtrArray      *open)
+{
+    AxingReader *reader = AXING_READER (parser);
+    const char * const *attrs = axing_reader_get_attrs (reader);
+    const char **decls;
+    guint i;
+
+    decls = axing_xml_parser_get_ns_declarations (parser);
+    for (i = 0; decls[i] != NULL; i += 2) {
+        CopyBinding decl;
+        decl.prefix = g_strdup (decls[i]);
+        decl.uri = g_strdup (decls[i + 1]);
+        decl.depth = depth;
+        g_array_append_val (declared, decl);
+    }
+    g_free (decls);
+
+    g_ptr_array_add (open, g_strdup (axing_reader_get_qname (reader)));
+    copy_note_ns (declared, needed,
+                  axing_reader_get_prefix (reader),
+                  axing_reader_get_namespace (reader));
+    /* Unprefixed attributes are in no namespace, whatever the default is */
+    for (i = 0; attrs[i] != NULL; i++) {
+        const char *prefix = axing_reader_get_attr_prefix (reader, attrs[i]);
+        if (prefix[0] != '\0')
+            copy_note_ns (declared, needed, prefix,
+                          axing_reader_get_attr_namespace (reader, attrs[i]));
+    }
+}
+
+static void
+copy_end_element (int        depth,
+                  GArray    *declared,
+                  GPtrArray *open)
+{
+    guint i = declared->len;
+    while (i > 0 && g_array_index (declared, CopyBinding, i - 1).depth == depth) {
+        CopyBinding *decl = &g_array_index (declared, CopyBinding, i - 1);
+        g_free (decl->prefix);
+        g_free (decl->uri);
+        i--;
+    }
+    g_array_set_size (declared, i);
+    g_ptr_array_remove_index (open, open->len - 1);
+}
+
+/* A name whose prefix wasn't declared inside the copied element got its
+   binding from an ancestor, so the copy has to declare it.
+ */
+static void
+copy_note_ns (GArray     *declared,
+              GArray     *needed,
+              const char *prefix,
+              const char *uri)
+{
+    CopyBinding need;
+    guint i;
+
+    if (g_str_equal (prefix, "xml"))
+        return;
+    for (i = declared->len; i > 0; i--) {
+        if (g_str_equal (g_array_index (declared, CopyBinding, i - 1).prefix, prefix))
+            return;
+    }
+    for (i = 0; i < needed->len; i++) {
+        if (g_str_equal (g_array_index (needed, CopyBinding, i).prefix, prefix))
+            return;
+    }
+    need.prefix = g_strdup (prefix);
+    need.uri = g_strdup (uri);
+    need.depth = 0;
+    g_array_append_val (needed, need);
+}
+
+static void
+copy_bindings_free (GArray *bindings)
+{
+    guint i;
+    for (i = 0; i < bindings->len; i++) {
+        CopyBinding *binding = &g_array_index (bindings, CopyBinding, i);
+        g_free (binding->prefix);
+        g_free (binding->uri);
+    }
+    g_array_free (bindings, TRUE);
+}
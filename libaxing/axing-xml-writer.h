@@ -0,0 +1,86 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+
+#ifndef __AXING_XML_WRITER_H__
+#define __AXING_XML_WRITER_H__
+
+#include <glib-object.h>
+#include <gio/gio.h>
+#include "axing-reader.h"
+#include "axing-xml-parser.h"
+
+G_BEGIN_DECLS
+
+#define AXING_TYPE_XML_WRITER (axing_xml_writer_get_type ())
+G_DECLARE_FINAL_TYPE (AxingXmlWriter, axing_xml_writer, AXING, XML_WRITER, GObject)
+
+AxingXmlWriter *  axing_xml_writer_new                 (GOutputStream   *stream);
+
+void              axing_xml_writer_set_minimize_ns     (AxingXmlWriter  *writer,
+                                                        gboolean         minimize);
+void              axing_xml_writer_set_source          (AxingXmlWriter  *writer,
+                                                        GBytes          *source);
+
+gboolean          axing_xml_writer_start_element       (AxingXmlWriter  *writer,
+                                                        const char      *qname,
+                                                        const char      *namespace,
+                                                        GError         **error);
+gboolean          axing_xml_writer_write_attribute     (AxingXmlWriter  *writer,
+                                                        const char      *qname,
+                                                        const char      *namespace,
+                                                        const char      *value,
+                                                        GError         **error);
+gboolean          axing_xml_writer_end_element         (AxingXmlWriter  *writer,
+                                                        GError         **error);
+gboolean          axing_xml_writer_write_content       (AxingXmlWriter  *writer,
+                                                        const char      *content,
+                                                        gssize           len,
+                                                        GError         **error);
+gboolean          axing_xml_writer_write_cdata         (AxingXmlWriter  *writer,
+                                                        const char      *content,
+                                                        GError         **error);
+gboolean          axing_xml_writer_write_comment       (AxingXmlWriter  *writer,
+                                                        const char      *content,
+                                                        GError         **error);
+gboolean          axing_xml_writer_write_instruction   (AxingXmlWriter  *writer,
+                                                        const char      *target,
+                                                        const char      *data,
+                                                        GError         **error);
+
+gboolean          axing_xml_writer_write_event         (AxingXmlWriter  *writer,
+                                                        AxingReader     *reader,
+                                                        GError         **error);
+gboolean          axing_xml_writer_write_all           (AxingXmlWriter  *writer,
+                                                        AxingReader     *reader,
+                                                        GError         **error);
+gboolean          axing_xml_writer_copy_element        (AxingXmlWriter  *writer,
+                                                        AxingXmlParser  *parser,
+                                                        GError         **error);
+gboolean          axing_xml_writer_flush               (AxingXmlWriter  *writer,
+                                                        GError         **error);
+GBytes *          axing_xml_writer_steal_bytes         (AxingXmlWriter  *writer);
+
+G_END_DECLS
+
+#endif /* __AXING_XML_WRITER_H__ */
@@ -9,32 +9,312 @@ gcc -g3 -o test-axing-simple-resolver-sync \
     $(pkg-config --libs gio-2.0 --cflags gio-2.0) \
     axing-resolver.c \
     axing-resource.c \
+    axing-resource-cache.c \
     axing-simple-resolver.c \
     axing-utils.c \
     test-axing-simple-resolver-sync.c
 
+gcc -g3 -o test-axing-http-resolver \
+    $(pkg-config --libs gio-2.0 --cflags gio-2.0) \
+    axing-http-resolver.c \
+    axing-resolver.c \
+    axing-resource.c \
+    axing-resource-cache.c \
+    axing-simple-resolver.c \
+    axing-utils.c \
+    test-axing-http-resolver.c
+
 gcc -g3 -o test-axing-xml-parser-sync \
     $(pkg-config --libs gio-2.0 --cflags gio-2.0) \
     axing-dtd-schema.c \
+    axing-name-table.c \
+    axing-path-filter.c \
     axing-reader.c \
     axing-resolver.c \
     axing-resource.c \
+    axing-resource-cache.c \
     axing-simple-resolver.c \
     axing-xml-parser.c \
     axing-utils.c \
     test-axing-xml-parser-sync.c
 
+gcc -g3 -o test-axing-read-batch \
+    $(pkg-config --libs gio-2.0 --cflags gio-2.0) \
+    axing-dtd-schema.c \
+    axing-name-table.c \
+    axing-path-filter.c \
+    axing-reader.c \
+    axing-resolver.c \
+    axing-resource.c \
+    axing-resource-cache.c \
+    axing-simple-resolver.c \
+    axing-xinclude-reader.c \
+    axing-xml-parser.c \
+    axing-utils.c \
+    test-axing-read-batch.c
+
+gcc -g3 -o test-axing-document \
+    $(pkg-config --libs gio-2.0 --cflags gio-2.0) \
+    axing-document.c \
+    axing-dtd-schema.c \
+    axing-name-table.c \
+    axing-path-filter.c \
+    axing-reader.c \
+    axing-resolver.c \
+    axing-resource.c \
+    axing-resource-cache.c \
+    axing-simple-resolver.c \
+    axing-xinclude-reader.c \
+    axing-xml-parser.c \
+    axing-utils.c \
+    test-axing-document.c
+
+gcc -g3 -o test-axing-xinclude-reader \
+    $(pkg-config --libs gio-2.0 --cflags gio-2.0) \
+    axing-dtd-schema.c \
+    axing-name-table.c \
+    axing-path-filter.c \
+    axing-reader.c \
+    axing-resolver.c \
+    axing-resource.c \
+    axing-resource-cache.c \
+    axing-simple-resolver.c \
+    axing-xinclude-reader.c \
+    axing-xml-parser.c \
+    axing-utils.c \
+    test-axing-xinclude-reader.c
+
+gcc -g3 -o test-axing-xml-writer \
+    $(pkg-config --libs gio-2.0 --cflags gio-2.0) \
+    axing-dtd-schema.c \
+    axing-name-table.c \
+    axing-path-filter.c \
+    axing-reader.c \
+    axing-resolver.c \
+    axing-resource.c \
+    axing-resource-cache.c \
+    axing-simple-resolver.c \
+    axing-xml-parser.c \
+    axing-xml-writer.c \
+    axing-utils.c \
+    test-axing-xml-writer.c
+
+gcc -g3 -o test-axing-external-dtd \
+    $(pkg-config --libs gio-2.0 --cflags gio-2.0) \
+    axing-dtd-schema.c \
+    axing-name-table.c \
+    axing-path-filter.c \
+    axing-reader.c \
+    axing-resolver.c \
+    axing-resource.c \
+    axing-resource-cache.c \
+    axing-simple-resolver.c \
+    axing-xml-parser.c \
+    axing-utils.c \
+    test-axing-external-dtd.c
+
+gcc -g3 -o test-axing-offsets \
+    $(pkg-config --libs gio-2.0 --cflags gio-2.0) \
+    axing-dtd-schema.c \
+    axing-name-table.c \
+    axing-path-filter.c \
+    axing-reader.c \
+    axing-resolver.c \
+    axing-resource.c \
+    axing-resource-cache.c \
+    axing-simple-resolver.c \
+    axing-xml-parser.c \
+    axing-utils.c \
+    test-axing-offsets.c
+
+gcc -g3 -o test-axing-parallel-parser \
+    $(pkg-config --libs gio-2.0 --cflags gio-2.0) \
+    axing-dtd-schema.c \
+    axing-event-reader.c \
+    axing-event-writer.c \
+    axing-name-table.c \
+    axing-parallel-parser.c \
+    axing-path-filter.c \
+    axing-reader.c \
+    axing-resolver.c \
+    axing-resource.c \
+    axing-resource-cache.c \
+    axing-simple-resolver.c \
+    axing-xml-parser.c \
+    axing-utils.c \
+    test-axing-parallel-parser.c
+
+gcc -g3 -o test-axing-dtd-schema \
+    $(pkg-config --libs gio-2.0 --cflags gio-2.0) \
+    axing-dtd-schema.c \
+    axing-utils.c \
+    test-axing-dtd-schema.c
+
+gcc -g3 -o test-axing-catalog-resolver \
+    $(pkg-config --libs gio-2.0 --cflags gio-2.0) \
+    axing-catalog-resolver.c \
+    axing-dtd-schema.c \
+    axing-name-table.c \
+    axing-path-filter.c \
+    axing-reader.c \
+    axing-resolver.c \
+    axing-resource.c \
+    axing-resource-cache.c \
+    axing-simple-resolver.c \
+    axing-xml-parser.c \
+    axing-utils.c \
+    test-axing-catalog-resolver.c
+
+gcc -g3 -o test-axing-caching-resolver \
+    $(pkg-config --libs gio-2.0 --cflags gio-2.0) \
+    axing-caching-resolver.c \
+    axing-resolver.c \
+    axing-resource.c \
+    axing-resource-cache.c \
+    axing-simple-resolver.c \
+    axing-utils.c \
+    test-axing-caching-resolver.c
+
+gcc -g3 -o test-axing-parse-cache \
+    $(pkg-config --libs gio-2.0 --cflags gio-2.0) \
+    axing-dtd-schema.c \
+    axing-event-reader.c \
+    axing-event-writer.c \
+    axing-name-table.c \
+    axing-parse-cache.c \
+    axing-path-filter.c \
+    axing-reader.c \
+    axing-resolver.c \
+    axing-resource.c \
+    axing-resource-cache.c \
+    axing-simple-resolver.c \
+    axing-xml-parser.c \
+    axing-utils.c \
+    test-axing-parse-cache.c
+
+gcc -g3 -o test-axing-prefetch \
+    $(pkg-config --libs gio-2.0 --cflags gio-2.0) \
+    axing-dtd-schema.c \
+    axing-name-table.c \
+    axing-path-filter.c \
+    axing-reader.c \
+    axing-resolver.c \
+    axing-resource.c \
+    axing-resource-cache.c \
+    axing-simple-resolver.c \
+    axing-xml-parser.c \
+    axing-utils.c \
+    test-axing-prefetch.c
+
+gcc -g3 -o test-axing-resource-cache \
+    $(pkg-config --libs gio-2.0 --cflags gio-2.0) \
+    axing-resource-cache.c \
+    test-axing-resource-cache.c
+
+gcc -g3 -o test-axing-resource \
+    $(pkg-config --libs gio-2.0 --cflags gio-2.0) \
+    axing-resource.c \
+    axing-resource-cache.c \
+    test-axing-resource.c
+
+gcc -g3 -o test-axing-parse-many \
+    $(pkg-config --libs gio-2.0 --cflags gio-2.0) \
+    axing-dtd-schema.c \
+    axing-name-table.c \
+    axing-path-filter.c \
+    axing-reader.c \
+    axing-resolver.c \
+    axing-resource.c \
+    axing-resource-cache.c \
+    axing-simple-resolver.c \
+    axing-xml-parser.c \
+    axing-utils.c \
+    test-axing-parse-many.c
+
+gcc -g3 -o test-axing-skip-element \
+    $(pkg-config --libs gio-2.0 --cflags gio-2.0) \
+    axing-dtd-schema.c \
+    axing-name-table.c \
+    axing-path-filter.c \
+    axing-reader.c \
+    axing-resolver.c \
+    axing-resource.c \
+    axing-resource-cache.c \
+    axing-simple-resolver.c \
+    axing-xml-parser.c \
+    axing-utils.c \
+    test-axing-skip-element.c
+
+gcc -g3 -o test-axing-path-filter \
+    $(pkg-config --libs gio-2.0 --cflags gio-2.0) \
+    axing-dtd-schema.c \
+    axing-name-table.c \
+    axing-path-filter.c \
+    axing-reader.c \
+    axing-resolver.c \
+    axing-resource.c \
+    axing-resource-cache.c \
+    axing-simple-resolver.c \
+    axing-xml-parser.c \
+    axing-utils.c \
+    test-axing-path-filter.c
+
+gcc -g3 -o test-axing-callbacks \
+    $(pkg-config --libs gio-2.0 --cflags gio-2.0) \
+    axing-dtd-schema.c \
+    axing-name-table.c \
+    axing-path-filter.c \
+    axing-reader.c \
+    axing-resolver.c \
+    axing-resource.c \
+    axing-resource-cache.c \
+    axing-simple-resolver.c \
+    axing-xml-parser.c \
+    axing-utils.c \
+    test-axing-callbacks.c
+
+gcc -g3 -o test-axing-event-view \
+    $(pkg-config --libs gio-2.0 --cflags gio-2.0) \
+    axing-dtd-schema.c \
+    axing-name-table.c \
+    axing-path-filter.c \
+    axing-reader.c \
+    axing-resolver.c \
+    axing-resource.c \
+    axing-resource-cache.c \
+    axing-simple-resolver.c \
+    axing-xml-parser.c \
+    axing-utils.c \
+    test-axing-event-view.c
+
 gcc -g3 -o time-axing-xml-parser \
     $(pkg-config --libs gio-2.0 --cflags gio-2.0) \
     axing-dtd-schema.c \
+    axing-name-table.c \
+    axing-path-filter.c \
     axing-reader.c \
     axing-resolver.c \
     axing-resource.c \
+    axing-resource-cache.c \
     axing-simple-resolver.c \
     axing-xml-parser.c \
     axing-utils.c \
     time-axing-xml-parser.c
 
+gcc -g3 -O2 -o time-axing-large-input \
+    $(pkg-config --libs gio-2.0 --cflags gio-2.0) \
+    axing-dtd-schema.c \
+    axing-name-table.c \
+    axing-path-filter.c \
+    axing-reader.c \
+    axing-resolver.c \
+    axing-resource.c \
+    axing-resource-cache.c \
+    axing-simple-resolver.c \
+    axing-xml-parser.c \
+    axing-utils.c \
+    time-axing-large-input.c
+
 gcc -g3 -o time-libxml2 \
     $(pkg-config --libs libxml-2.0 --cflags libxml-2.0) \
     time-libxml2.c
@@ -0,0 +1,209 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+
+/* Wraps a resolver that counts its calls in an AxingCachingResolver, and
+   checks which lookups it gets: least recently used entries are evicted
+   first, failures are remembered but cancellations aren't, and with
+   mtime checking on, a file that goes away is resolved again.
+ */
+
+#include <locale.h>
+#include <glib/gstdio.h>
+
+#include "axing-caching-resolver.h"
+
+#define COUNTING_TYPE_RESOLVER counting_resolver_get_type ()
+G_DECLARE_FINAL_TYPE (CountingResolver, counting_resolver, COUNTING, RESOLVER, AxingResolver)
+
+struct _CountingResolver {
+    AxingResolver parent;
+
+    guint calls;
+};
+
+G_DEFINE_TYPE (CountingResolver, counting_resolver, AXING_TYPE_RESOLVER);
+
+/* Links are URIs, except missing and cancel, which fail like they say */
+static AxingResource *
+counting_resolver_resolve (AxingResolver     *resolver,
+                           AxingResource     *base,
+                           const char        *xml_base,
+                           const char        *link,
+                           const char        *pubid,
+                           AxingResolverHint  hint,
+                           GCancellable      *cancellable,
+                           GError           **error)
+{
+    AxingResource *resource;
+    GFile *file;
+
+    COUNTING_RESOLVER (resolver)->calls++;
+    if (g_str_equal (link, "missing")) {
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "Not found");
+        return NULL;
+    }
+    if (g_str_equal (link, "cancel")) {
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED, "Cancelled");
+        return NULL;
+    }
+    file = g_file_new_for_uri (link);
+    resource = axing_resource_new (file, NULL);
+    g_object_unref (file);
+    return resource;
+}
+
+static void
+counting_resolver_init (CountingResolver *resolver)
+{
+}
+
+static void
+counting_resolver_class_init (CountingResolverClass *klass)
+{
+    AXING_RESOLVER_CLASS (klass)->resolve = counting_resolver_resolve;
+}
+
+static int
+check_resolve (AxingResolver    *cacher,
+               CountingResolver *counter,
+               const char       *link,
+               guint             calls)
+{
+    AxingResource *resource;
+    GError *error = NULL;
+    char *uri;
+    int ret = 0;
+
+    resource = axing_resolver_resolve (cacher, NULL, NULL, link, NULL,
+                                       AXING_RESOLVER_HINT_ENTITY, NULL, &error);
+    if (resource != NULL) {
+        uri = g_file_get_uri (axing_resource_get_file (resource));
+        if (!g_str_equal (uri, link)) {
+            g_print ("%s: resolved to %s\n", link, uri);
+            ret = 1;
+        }
+        g_free (uri);
+        g_object_unref (resource);
+    }
+    else if (error == NULL || !(g_str_equal (link, "missing") || g_str_equal (link, "cancel"))) {
+        g_print ("%s: %s\n", link, error ? error->message : "not resolved");
+        ret = 1;
+    }
+    g_clear_error (&error);
+
+    if (counter->calls != calls) {
+        g_print ("%s: expected %u calls, got %u\n", link, calls, counter->calls);
+        ret = 1;
+    }
+    return ret;
+}
+
+static int
+check_eviction (void)
+{
+    CountingResolver *counter = g_object_new (COUNTING_TYPE_RESOLVER, NULL);
+    AxingResolver *cacher = axing_caching_resolver_new (AXING_RESOLVER (counter), 2);
+    int ret = 0;
+
+    ret |= check_resolve (cacher, counter, "file:///a", 1);
+    ret |= check_resolve (cacher, counter, "file:///b", 2);
+    ret |= check_resolve (cacher, counter, "file:///a", 2);
+    /* b is the least recently used */
+    ret |= check_resolve (cacher, counter, "file:///c", 3);
+    ret |= check_resolve (cacher, counter, "file:///a", 3);
+    ret |= check_resolve (cacher, counter, "file:///b", 4);
+    ret |= check_resolve (cacher, counter, "file:///c", 5);
+    ret |= check_resolve (cacher, counter, "file:///b", 5);
+
+    axing_caching_resolver_clear (AXING_CACHING_RESOLVER (cacher));
+    ret |= check_resolve (cacher, counter, "file:///b", 6);
+
+    g_object_unref (cacher);
+    g_object_unref (counter);
+    return ret;
+}
+
+static int
+check_failures (void)
+{
+    CountingResolver *counter = g_object_new (COUNTING_TYPE_RESOLVER, NULL);
+    AxingResolver *cacher = axing_caching_resolver_new (AXING_RESOLVER (counter), 0);
+    int ret = 0;
+
+    ret |= check_resolve (cacher, counter, "missing", 1);
+    ret |= check_resolve (cacher, counter, "missing", 1);
+    ret |= check_resolve (cacher, counter, "cancel", 2);
+    ret |= check_resolve (cacher, counter, "cancel", 3);
+
+    g_object_unref (cacher);
+    g_object_unref (counter);
+    return ret;
+}
+
+static int
+check_mtime (void)
+{
+    CountingResolver *counter = g_object_new (COUNTING_TYPE_RESOLVER, NULL);
+    AxingResolver *cacher = axing_caching_resolver_new (AXING_RESOLVER (counter), 0);
+    GError *error = NULL;
+    GFile *file;
+    char *path, *uri;
+    int fd, ret = 0;
+
+    fd = g_file_open_tmp ("test-axing-caching-resolver-XXXXXX", &path, &error);
+    if (fd < 0) {
+        g_print ("mtime: %s\n", error->message);
+        g_error_free (error);
+        return 1;
+    }
+    g_close (fd, NULL);
+    file = g_file_new_for_path (path);
+    uri = g_file_get_uri (file);
+
+    axing_caching_resolver_set_check_mtime (AXING_CACHING_RESOLVER (cacher), TRUE);
+    ret |= check_resolve (cacher, counter, uri, 1);
+    ret |= check_resolve (cacher, counter, uri, 1);
+    g_unlink (path);
+    ret |= check_resolve (cacher, counter, uri, 2);
+
+    g_free (uri);
+    g_free (path);
+    g_object_unref (file);
+    g_object_unref (cacher);
+    g_object_unref (counter);
+    return ret;
+}
+
+int
+main (int argc, char **argv)
+{
+    int retcode = 0;
+
+    setlocale(LC_ALL, "");
+
+    retcode |= check_eviction ();
+    retcode |= check_failures ();
+    retcode |= check_mtime ();
+    return retcode;
+}
@@ -0,0 +1,244 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+/* Parses each document on the command line with
+   axing_xml_parser_parse_with_callbacks and with axing_reader_read, and
+   checks that both give the same events, attributes in the same order,
+   and the same error.
+ */
+
+#include <locale.h>
+#include <string.h>
+
+#include "axing-xml-parser.h"
+
+static void
+append_name (GString        *out,
+             AxingNameTable *names,
+             guint32         name_id,
+             guint32         ns_id)
+{
+    const char *ns = axing_name_table_lookup (names, ns_id);
+    g_string_append_printf (out, "{%s}%s", ns ? ns : "",
+                            axing_name_table_lookup (names, name_id));
+}
+
+static void
+cb_start_element (AxingXmlParser         *parser,
+                  guint32                 name_id,
+                  guint32                 ns_id,
+                  const AxingXmlAttrSpan *attrs,
+                  guint                   n_attrs,
+                  gpointer                user_data)
+{
+    GString *out = user_data;
+    AxingNameTable *names = axing_xml_parser_get_name_table (parser);
+    guint i;
+
+    g_string_append (out, "[ ");
+    append_name (out, names, name_id, ns_id);
+    for (i = 0; i < n_attrs; i++) {
+        g_string_append_c (out, ' ');
+        append_name (out, names, attrs[i].name_id, attrs[i].ns_id);
+        g_string_append (out, "=\"");
+        g_string_append_len (out, attrs[i].value, attrs[i].value_len);
+        g_string_append_c (out, '"');
+    }
+    g_string_append_c (out, '\n');
+}
+
+static void
+cb_end_element (AxingXmlParser *parser,
+                guint32         name_id,
+                guint32         ns_id,
+                gpointer        user_data)
+{
+    GString *out = user_data;
+    g_string_append (out, "] ");
+    append_name (out, axing_xml_parser_get_name_table (parser), name_id, ns_id);
+    g_string_append_c (out, '\n');
+}
+
+static void
+append_text (GString    *out,
+             const char *mark,
+             const char *text,
+             gsize       len)
+{
+    g_string_append (out, mark);
+    g_string_append_len (out, text, len);
+    g_string_append_c (out, '\n');
+}
+
+static void
+cb_text (AxingXmlParser *parser,
+         const char     *text,
+         gsize           len,
+         gpointer        user_data)
+{
+    append_text (user_data, "# ", text, len);
+}
+
+static void
+cb_cdata (AxingXmlParser *parser,
+          const char     *text,
+          gsize           len,
+          gpointer        user_data)
+{
+    append_text (user_data, "* ", text, len);
+}
+
+static void
+cb_comment (AxingXmlParser *parser,
+            const char     *text,
+            gsize           len,
+            gpointer        user_data)
+{
+    append_text (user_data, "! ", text, len);
+}
+
+static void
+cb_instruction (AxingXmlParser *parser,
+                guint32         target_id,
+                const char     *data,
+                gsize           len,
+                gpointer        user_data)
+{
+    GString *out = user_data;
+    g_string_append_printf (out, "? %s ",
+                            axing_name_table_lookup (axing_xml_parser_get_name_table (parser),
+                                                     target_id));
+    g_string_append_len (out, data, len);
+    g_string_append_c (out, '\n');
+}
+
+static const AxingXmlParserCallbacks callbacks = {
+    cb_start_element,
+    cb_end_element,
+    cb_text,
+    cb_cdata,
+    cb_comment,
+    cb_instruction
+};
+
+static AxingXmlParser *
+new_parser (const char *path)
+{
+    GFile *file = g_file_new_for_path (path);
+    AxingResource *resource = axing_resource_new (file, NULL);
+    AxingXmlParser *parser = axing_xml_parser_new (resource, NULL);
+    g_object_unref (resource);
+    g_object_unref (file);
+    return parser;
+}
+
+static char *
+callback_events (const char *path)
+{
+    AxingXmlParser *parser = new_parser (path);
+    GString *out = g_string_new (NULL);
+    GError *error = NULL;
+
+    if (!axing_xml_parser_parse_with_callbacks (parser, &callbacks, out, &error)) {
+        g_string_append_printf (out, "error: %s\n", error->message);
+        g_error_free (error);
+    }
+
+    g_object_unref (parser);
+    return g_string_free (out, FALSE);
+}
+
+static char *
+reader_events (const char *path)
+{
+    AxingXmlParser *parser = new_parser (path);
+    AxingReader *reader = AXING_READER (parser);
+    GString *out = g_string_new (NULL);
+    GError *error = NULL;
+    const char * const *attrs;
+
+    while (axing_reader_read (reader, &error)) {
+        switch (axing_reader_get_node_type (reader)) {
+        case AXING_NODE_TYPE_ELEMENT:
+            g_string_append_printf (out, "[ {%s}%s",
+                                    axing_reader_get_namespace (reader),
+                                    axing_reader_get_localname (reader));
+            for (attrs = axing_reader_get_attrs (reader); *attrs != NULL; attrs++)
+                g_string_append_printf (out, " {%s}%s=\"%s\"",
+                                        axing_reader_get_attr_namespace (reader, *attrs),
+                                        axing_reader_get_attr_localname (reader, *attrs),
+                                        axing_reader_get_attr_value (reader, *attrs));
+            g_string_append_c (out, '\n');
+            break;
+        case AXING_NODE_TYPE_END_ELEMENT:
+            g_string_append_printf (out, "] {%s}%s\n",
+                                    axing_reader_get_namespace (reader),
+                                    axing_reader_get_localname (reader));
+            break;
+        case AXING_NODE_TYPE_CONTENT:
+            g_string_append_printf (out, "# %s\n", axing_reader_get_content (reader));
+            break;
+        case AXING_NODE_TYPE_CDATA:
+            g_string_append_printf (out, "* %s\n", axing_reader_get_content (reader));
+            break;
+        case AXING_NODE_TYPE_COMMENT:
+            g_string_append_printf (out, "! %s\n", axing_reader_get_content (reader));
+            break;
+        case AXING_NODE_TYPE_INSTRUCTION:
+            g_string_append_printf (out, "? %s %s\n",
+                                    axing_reader_get_qname (reader),
+                                    axing_reader_get_content (reader));
+            break;
+        default:
+            break;
+        }
+    }
+
+    /* The parser owns the error */
+    if (error != NULL)
+        g_string_append_printf (out, "error: %s\n", error->message);
+
+    g_object_unref (parser);
+    return g_string_free (out, FALSE);
+}
+
+int
+main (int argc, char **argv)
+{
+    int i;
+    int retcode = 0;
+
+    setlocale(LC_ALL, "");
+
+    for (i = 1; i < argc; i++) {
+        char *fromcallbacks = callback_events (argv[i]);
+        char *fromreader = reader_events (argv[i]);
+        if (!g_str_equal (fromcallbacks, fromreader)) {
+            g_print ("%s: callbacks:\n%sreader:\n%s", argv[i], fromcallbacks, fromreader);
+            retcode = 1;
+        }
+        g_free (fromcallbacks);
+        g_free (fromreader);
+    }
+    return retcode;
+}
@@ -0,0 +1,127 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+
+/* Resolves identifiers through tests/catalog/catalog.xml, which pulls in
+   next.xml, and checks where each one ends up. Relative results are
+   against tests/catalog. Absolute ones are links the catalogs don't map,
+   which the fallback resolver leaves alone.
+ */
+
+#include <locale.h>
+
+#include "axing-catalog-resolver.h"
+
+typedef struct {
+    const char        *link;
+    const char        *pubid;
+    AxingResolverHint  hint;
+    const char        *expected;
+} CatalogCase;
+
+#define OTHER "http://example.com/other.dtd"
+
+static const CatalogCase cases[] = {
+    /* system and rewriteSystem, longest prefix first */
+    { "http://example.com/system.dtd",     NULL, AXING_RESOLVER_HINT_ENTITY, "dtd/system.dtd" },
+    { "http://example.com/dtd/deep/a.dtd", NULL, AXING_RESOLVER_HINT_ENTITY, "deep/a.dtd" },
+    { "http://example.com/dtd/b.dtd",      NULL, AXING_RESOLVER_HINT_ENTITY, "dtd/b.dtd" },
+    /* public, with the first catalog winning over next.xml */
+    { OTHER, "-//Axing//DTD Public//EN",   AXING_RESOLVER_HINT_ENTITY, "dtd/public.dtd" },
+    { NULL,  " -//Axing//DTD  Spaced//EN", AXING_RESOLVER_HINT_ENTITY, "dtd/spaced.dtd" },
+    /* prefer="system" on a group only skips the entry with a system ID */
+    { OTHER, "-//Axing//DTD System//EN",   AXING_RESOLVER_HINT_ENTITY, OTHER },
+    { NULL,  "-//Axing//DTD System//EN",   AXING_RESOLVER_HINT_ENTITY, "group/system.dtd" },
+    { OTHER, "-//Axing//DTD After Group//EN", AXING_RESOLVER_HINT_ENTITY, "dtd/after.dtd" },
+    /* prefer="system" on the next catalog's root */
+    { OTHER, "-//Axing//DTD Next//EN",     AXING_RESOLVER_HINT_ENTITY, OTHER },
+    { NULL,  "-//Axing//DTD Next//EN",     AXING_RESOLVER_HINT_ENTITY, "next/next.dtd" },
+    { "http://example.com/next.dtd", NULL, AXING_RESOLVER_HINT_ENTITY, "next/next.dtd" },
+    /* uri and rewriteURI, only for things that aren't entities */
+    { "http://example.com/schema.rng",   NULL, AXING_RESOLVER_HINT_OTHER,    "schema/schema.rng" },
+    { "http://example.com/schema.rng",   NULL, AXING_RESOLVER_HINT_ENTITY,   "http://example.com/schema.rng" },
+    { "http://example.com/docs/a/b.xml", NULL, AXING_RESOLVER_HINT_XINCLUDE, "docs/a/b.xml" }
+};
+
+int
+main (int argc, char **argv)
+{
+    AxingResolver *resolver;
+    AxingResource *base;
+    GFile *file;
+    GError *error = NULL;
+    gsize i;
+    int retcode = 0;
+
+    setlocale(LC_ALL, "");
+
+    resolver = axing_catalog_resolver_new (NULL);
+    file = g_file_new_for_path ("tests/catalog/catalog.xml");
+    if (!axing_catalog_resolver_add_catalog (AXING_CATALOG_RESOLVER (resolver), file, NULL, &error)) {
+        g_print ("catalog.xml: %s\n", error->message);
+        g_error_free (error);
+        return 1;
+    }
+    g_object_unref (file);
+
+    file = g_file_new_for_path ("tests/catalog/doc.xml");
+    base = axing_resource_new (file, NULL);
+    g_object_unref (file);
+
+    for (i = 0; i < G_N_ELEMENTS (cases); i++) {
+        const CatalogCase *cc = &cases[i];
+        AxingResource *resource;
+        char *expected, *got = NULL;
+
+        if (g_str_has_prefix (cc->expected, "http:")) {
+            expected = g_strdup (cc->expected);
+        }
+        else {
+            char *path = g_build_filename ("tests/catalog", cc->expected, NULL);
+            file = g_file_new_for_path (path);
+            expected = g_file_get_uri (file);
+            g_object_unref (file);
+            g_free (path);
+        }
+
+        resource = axing_resolver_resolve (resolver, base, NULL, cc->link, cc->pubid,
+                                           cc->hint, NULL, &error);
+        if (resource != NULL) {
+            got = g_file_get_uri (axing_resource_get_file (resource));
+            g_object_unref (resource);
+        }
+        if (got == NULL || !g_str_equal (got, expected)) {
+            g_print ("%s %s: expected %s, got %s\n",
+                     cc->link ? cc->link : "-", cc->pubid ? cc->pubid : "-",
+                     expected, got ? got : (error ? error->message : "nothing"));
+            retcode = 1;
+        }
+        g_clear_error (&error);
+        g_free (expected);
+        g_free (got);
+    }
+
+    g_object_unref (base);
+    g_object_unref (resolver);
+    return retcode;
+}
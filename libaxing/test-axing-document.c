@@ -0,0 +1,145 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+/* Builds a document with an element that has more attributes than
+   axing_document_new_from_reader's first batch holds, and checks that
+   nothing around it goes missing.
+ */
+
+#include <locale.h>
+#include <string.h>
+
+#include "axing-document.h"
+#include "axing-xinclude-reader.h"
+#include "axing-xml-parser.h"
+
+#define N_ATTRS 300
+
+static const char *children[] = { "a", "big", "c", NULL };
+
+static int
+check_document (AxingReader *reader,
+                const char  *what)
+{
+    AxingDocument *document;
+    AxingNameTable *names;
+    GError *error = NULL;
+    guint32 root, node;
+    int i;
+
+    document = axing_document_new_from_reader (reader, &error);
+    if (document == NULL) {
+        g_print ("%s: %s\n", what, error->message);
+        g_error_free (error);
+        return 1;
+    }
+    names = axing_document_get_name_table (document);
+
+    root = axing_document_get_root_element (document);
+    node = axing_document_node_get_first_child (document, root);
+    for (i = 0; children[i] != NULL; i++) {
+        if (node == AXING_DOCUMENT_NO_NODE ||
+            !g_str_equal (axing_document_node_get_name (document, node), children[i])) {
+            g_print ("%s: expected child %s\n", what, children[i]);
+            goto fail;
+        }
+        if (g_str_equal (children[i], "big")) {
+            guint j;
+            if (axing_document_node_get_n_attrs (document, node) != N_ATTRS) {
+                g_print ("%s: expected %i attributes, got %u\n", what, N_ATTRS,
+                         axing_document_node_get_n_attrs (document, node));
+                goto fail;
+            }
+            for (j = 0; j < N_ATTRS; j++) {
+                char *name = g_strdup_printf ("a%u", j);
+                char *value = g_strdup_printf ("%u", j);
+                const char *got;
+                got = axing_document_node_lookup_attr (document, node,
+                                                       axing_name_table_find (names, name),
+                                                       0);
+                if (got == NULL || !g_str_equal (got, value)) {
+                    g_print ("%s: expected %s=\"%s\", got \"%s\"\n", what, name, value,
+                             got ? got : "(none)");
+                    g_free (name);
+                    g_free (value);
+                    goto fail;
+                }
+                g_free (name);
+                g_free (value);
+            }
+        }
+        node = axing_document_node_get_next_sibling (document, node);
+    }
+    if (node != AXING_DOCUMENT_NO_NODE) {
+        g_print ("%s: extra child\n", what);
+        goto fail;
+    }
+
+    g_object_unref (document);
+    return 0;
+
+ fail:
+    g_object_unref (document);
+    return 1;
+}
+
+int
+main (int argc, char **argv)
+{
+    GString *xml;
+    GFile *file;
+    int i, xinclude, retcode = 0;
+
+    setlocale(LC_ALL, "");
+
+    xml = g_string_new ("<doc><a/><big");
+    for (i = 0; i < N_ATTRS; i++)
+        g_string_append_printf (xml, " a%i=\"%i\"", i, i);
+    g_string_append (xml, "/><c/></doc>\n");
+
+    file = g_file_new_for_path ("test-axing-document.xml");
+
+    /* The parser fills batches itself, AxingXIncludeReader uses the default */
+    for (xinclude = 0; xinclude < 2; xinclude++) {
+        GInputStream *stream;
+        AxingResource *resource;
+        AxingReader *reader;
+
+        stream = g_memory_input_stream_new_from_data (xml->str, xml->len, NULL);
+        resource = axing_resource_new (file, stream);
+        if (xinclude)
+            reader = AXING_READER (axing_xinclude_reader_new (resource, NULL));
+        else
+            reader = AXING_READER (axing_xml_parser_new (resource, NULL));
+
+        retcode |= check_document (reader, xinclude ? "default" : "parser");
+
+        g_object_unref (reader);
+        g_object_unref (resource);
+        g_object_unref (stream);
+    }
+
+    g_object_unref (file);
+    g_string_free (xml, TRUE);
+    return retcode;
+}
@@ -0,0 +1,218 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+
+/* Saves a DTD schema with one of each kind of declaration, loads it back
+   from bytes and from a file, and checks that every lookup gives the same
+   answer as it did on the original. Also checks that damaged data is
+   refused instead of loaded.
+ */
+
+#include <locale.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "axing-dtd-schema.h"
+
+static const char *entities[] = { "text", "ext", "pic", "nothere", NULL };
+static const char *parameters[] = { "mode", "ents", "nothere", NULL };
+
+static AxingDtdSchema *
+build_schema (void)
+{
+    AxingDtdSchema *dtd = axing_dtd_schema_new ();
+
+    axing_dtd_schema_set_doctype (dtd, "doc");
+    axing_dtd_schema_set_public_id (dtd, "-//Axing//DTD Test//EN");
+    axing_dtd_schema_set_system_id (dtd, "doc.dtd");
+    axing_dtd_schema_set_base_uri (dtd, "file:///axing/dtd/doc.dtd");
+    axing_dtd_schema_add_entity (dtd, "text", "some <b>text</b> &amp; \xC3\xA9");
+    axing_dtd_schema_add_external_entity (dtd, "ext", NULL, "parts/ext.xml");
+    axing_dtd_schema_add_unparsed_entity (dtd, "pic", "-//Axing//Picture//EN", "pic.png", "png");
+    axing_dtd_schema_add_parameter (dtd, "mode", "INCLUDE");
+    axing_dtd_schema_add_external_parameter (dtd, "ents", "-//Axing//ENTITIES//EN", "ents.ent");
+    axing_dtd_schema_add_notation (dtd, "png", NULL, "image/png");
+    return dtd;
+}
+
+/* Every lookup result, one per line, so two schemas can be compared */
+static char *
+describe_schema (AxingDtdSchema *dtd)
+{
+    GString *ret = g_string_new (NULL);
+    char **names;
+    int i;
+
+#define ADD(label, val) G_STMT_START {                                   \
+        char *tmp = (val);                                               \
+        g_string_append_printf (ret, "%s %s\n", label, tmp ? tmp : "-"); \
+        g_free (tmp);                                                    \
+    } G_STMT_END
+
+    ADD ("public", g_strdup (axing_dtd_schema_get_public_id (dtd)));
+    ADD ("system", g_strdup (axing_dtd_schema_get_system_id (dtd)));
+    for (i = 0; entities[i] != NULL; i++) {
+        char *value = NULL, *public = NULL, *system = NULL, *ndata = NULL;
+        g_string_append_printf (ret, "entity %s\n", entities[i]);
+        ADD ("  value", axing_dtd_schema_get_entity (dtd, entities[i]));
+        ADD ("  external", axing_dtd_schema_get_external_entity (dtd, entities[i]));
+        ADD ("  unparsed", axing_dtd_schema_get_unparsed_entity (dtd, entities[i]));
+        if (axing_dtd_schema_get_entity_full (dtd, entities[i], &value, &public, &system, &ndata)) {
+            ADD ("  full value", value);
+            ADD ("  full public", public);
+            ADD ("  full system", system);
+            ADD ("  full ndata", ndata);
+        }
+    }
+    for (i = 0; parameters[i] != NULL; i++) {
+        char *value = NULL, *public = NULL, *system = NULL;
+        g_string_append_printf (ret, "parameter %s\n", parameters[i]);
+        ADD ("  value", axing_dtd_schema_get_parameter (dtd, parameters[i]));
+        if (axing_dtd_schema_get_parameter_full (dtd, parameters[i], &value, &public, &system)) {
+            ADD ("  full value", value);
+            ADD ("  full public", public);
+            ADD ("  full system", system);
+        }
+    }
+    names = axing_dtd_schema_get_external_entity_names (dtd);
+    for (i = 0; names[i] != NULL; i++)
+        g_string_append_printf (ret, "external name %s\n", names[i]);
+    g_strfreev (names);
+#undef ADD
+
+    return g_string_free (ret, FALSE);
+}
+
+static int
+check_loaded (AxingDtdSchema *loaded,
+              const char     *what,
+              const char     *expected)
+{
+    char *got;
+    int ret = 0;
+
+    if (!axing_dtd_schema_is_frozen (loaded)) {
+        g_print ("%s: not frozen\n", what);
+        ret = 1;
+    }
+    got = describe_schema (loaded);
+    if (!g_str_equal (got, expected)) {
+        g_print ("%s: expected\n%sgot\n%s", what, expected, got);
+        ret = 1;
+    }
+    g_free (got);
+    return ret;
+}
+
+int
+main (int argc, char **argv)
+{
+    AxingDtdSchema *dtd, *loaded;
+    GOutputStream *out;
+    GBytes *bytes, *damaged;
+    GFile *file;
+    GError *error = NULL;
+    char *expected, *path;
+    const char *data;
+    gsize size;
+    int fd, retcode = 0;
+
+    setlocale(LC_ALL, "");
+
+    dtd = build_schema ();
+    expected = describe_schema (dtd);
+
+    out = g_memory_output_stream_new_resizable ();
+    if (!axing_dtd_schema_save (dtd, out, NULL, &error) ||
+        !g_output_stream_close (out, NULL, &error)) {
+        g_print ("save: %s\n", error->message);
+        g_error_free (error);
+        return 1;
+    }
+    bytes = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (out));
+    g_object_unref (out);
+
+    loaded = axing_dtd_schema_new_from_bytes (bytes, &error);
+    if (loaded == NULL) {
+        g_print ("bytes: %s\n", error->message);
+        g_clear_error (&error);
+        retcode = 1;
+    }
+    else {
+        retcode |= check_loaded (loaded, "bytes", expected);
+        g_object_unref (loaded);
+    }
+
+    data = g_bytes_get_data (bytes, &size);
+    fd = g_file_open_tmp ("test-axing-dtd-schema-XXXXXX", &path, &error);
+    if (fd < 0 || !g_file_set_contents (path, data, size, &error)) {
+        g_print ("file: %s\n", error->message);
+        g_clear_error (&error);
+        retcode = 1;
+    }
+    else {
+        file = g_file_new_for_path (path);
+        loaded = axing_dtd_schema_new_for_file (file, NULL, &error);
+        if (loaded == NULL) {
+            g_print ("file: %s\n", error->message);
+            g_clear_error (&error);
+            retcode = 1;
+        }
+        else {
+            retcode |= check_loaded (loaded, "file", expected);
+            g_object_unref (loaded);
+        }
+        g_object_unref (file);
+    }
+    if (fd >= 0) {
+        g_close (fd, NULL);
+        g_unlink (path);
+        g_free (path);
+    }
+
+    /* Cut off in the middle of the last declaration */
+    damaged = g_bytes_new_from_bytes (bytes, 0, size - 8);
+    loaded = axing_dtd_schema_new_from_bytes (damaged, &error);
+    if (loaded != NULL || error == NULL) {
+        g_print ("truncated: loaded anyway\n");
+        g_clear_object (&loaded);
+        retcode = 1;
+    }
+    g_clear_error (&error);
+    g_bytes_unref (damaged);
+
+    damaged = g_bytes_new_static ("AXDT\x63\0\0\0", 8);
+    loaded = axing_dtd_schema_new_from_bytes (damaged, &error);
+    if (loaded != NULL || error == NULL) {
+        g_print ("version: loaded anyway\n");
+        g_clear_object (&loaded);
+        retcode = 1;
+    }
+    g_clear_error (&error);
+    g_bytes_unref (damaged);
+
+    g_bytes_unref (bytes);
+    g_free (expected);
+    g_object_unref (dtd);
+    return retcode;
+}
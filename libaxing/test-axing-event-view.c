@@ -0,0 +1,165 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+/* Reads each document on the command line and checks every field of the
+   AxingXmlEventView from axing_xml_parser_get_event_view against the
+   AxingReader getters. The view is turned on before the first read once,
+   and after it once, since turning it on has to fill in the current event.
+ */
+
+#include <locale.h>
+#include <string.h>
+
+#include "axing-xml-parser.h"
+
+static gboolean
+same_str (const char *a,
+          const char *b)
+{
+    return g_str_equal (a ? a : "", b ? b : "");
+}
+
+static int
+check_event (const char              *path,
+             AxingReader             *reader,
+             const AxingXmlEventView *view)
+{
+    AxingNodeType type = axing_reader_get_node_type (reader);
+    const char * const *attrs;
+    const char *field = NULL;
+    guint i;
+
+    if (view->type != type) {
+        field = "type";
+        goto error;
+    }
+
+    switch (type) {
+    case AXING_NODE_TYPE_ELEMENT:
+    case AXING_NODE_TYPE_END_ELEMENT:
+        if (!same_str (view->qname, axing_reader_get_qname (reader)))
+            field = "qname";
+        else if (!same_str (view->localname, axing_reader_get_localname (reader)))
+            field = "localname";
+        else if (!same_str (view->prefix, axing_reader_get_prefix (reader)))
+            field = "prefix";
+        else if (!same_str (view->namespace, axing_reader_get_namespace (reader)))
+            field = "namespace";
+        if (field != NULL || type == AXING_NODE_TYPE_END_ELEMENT)
+            break;
+        attrs = axing_reader_get_attrs (reader);
+        for (i = 0; attrs[i] != NULL; i++) {
+            if (view->attrs[i] == NULL || !g_str_equal (view->attrs[i], attrs[i])) {
+                field = "attrs";
+                break;
+            }
+            if (!same_str (view->attr_values[i], axing_reader_get_attr_value (reader, attrs[i]))) {
+                field = "attr_values";
+                break;
+            }
+        }
+        if (field == NULL && (view->attrs[i] != NULL || view->attr_values[i] != NULL))
+            field = "attrs";
+        break;
+    case AXING_NODE_TYPE_INSTRUCTION:
+        if (!same_str (view->qname, axing_reader_get_qname (reader))) {
+            field = "qname";
+            break;
+        }
+        /* fall through */
+    case AXING_NODE_TYPE_CONTENT:
+    case AXING_NODE_TYPE_COMMENT:
+    case AXING_NODE_TYPE_CDATA:
+        if (!same_str (view->content, axing_reader_get_content (reader)))
+            field = "content";
+        else if (view->content_len != strlen (axing_reader_get_content (reader)))
+            field = "content_len";
+        break;
+    default:
+        /* The view only fills in its type for anything else */
+        return 0;
+    }
+    if (field != NULL)
+        goto error;
+
+    if (view->linenum != axing_reader_get_linenum (reader))
+        field = "linenum";
+    else if (view->colnum != axing_reader_get_colnum (reader))
+        field = "colnum";
+    if (field != NULL)
+        goto error;
+    return 0;
+
+ error:
+    g_print ("%s:%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT ": view %s differs\n",
+             path, axing_reader_get_linenum (reader), axing_reader_get_colnum (reader),
+             field);
+    return 1;
+}
+
+static int
+check_document (const char *path,
+                gboolean    early)
+{
+    GFile *file = g_file_new_for_path (path);
+    AxingResource *resource = axing_resource_new (file, NULL);
+    AxingXmlParser *parser = axing_xml_parser_new (resource, NULL);
+    AxingReader *reader = AXING_READER (parser);
+    const AxingXmlEventView *view = NULL;
+    GError *error = NULL;
+    int ret = 0;
+
+    if (early)
+        view = axing_xml_parser_get_event_view (parser);
+
+    while (ret == 0 && axing_reader_read (reader, &error)) {
+        if (view == NULL)
+            view = axing_xml_parser_get_event_view (parser);
+        else if (axing_xml_parser_get_event_view (parser) != view) {
+            g_print ("%s: view moved\n", path);
+            ret = 1;
+        }
+        ret |= check_event (path, reader, view);
+    }
+
+    /* The parser owns the error, and the view doesn't carry one */
+    g_object_unref (parser);
+    g_object_unref (resource);
+    g_object_unref (file);
+    return ret;
+}
+
+int
+main (int argc, char **argv)
+{
+    int i;
+    int retcode = 0;
+
+    setlocale(LC_ALL, "");
+
+    for (i = 1; i < argc; i++) {
+        retcode |= check_document (argv[i], TRUE);
+        retcode |= check_document (argv[i], FALSE);
+    }
+    return retcode;
+}
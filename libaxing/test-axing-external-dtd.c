@@ -0,0 +1,191 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+
+/* Parses the documents in tests/dtd with external DTD loading turned on
+   and checks the text content, or the error code for the ones that should
+   fail. Each document is parsed twice, so the second time goes through
+   the DTD cache, which must give the same answer. Then a DTD in a temp
+   directory pulls in a parameter entity, and the cache has to notice
+   when that file changes, or when another resolver maps it elsewhere.
+ */
+
+#include <locale.h>
+#include <glib/gstdio.h>
+
+#include "axing-xml-parser.h"
+
+#define ALT_TYPE_RESOLVER alt_resolver_get_type ()
+G_DECLARE_FINAL_TYPE (AltResolver, alt_resolver, ALT, RESOLVER, AxingResolver)
+
+struct _AltResolver {
+    AxingResolver parent;
+};
+
+G_DEFINE_TYPE (AltResolver, alt_resolver, AXING_TYPE_RESOLVER);
+
+/* Resolves like the default resolver, except ext.ent is alt.ent */
+static AxingResource *
+alt_resolver_resolve (AxingResolver     *resolver,
+                      AxingResource     *base,
+                      const char        *xml_base,
+                      const char        *link,
+                      const char        *pubid,
+                      AxingResolverHint  hint,
+                      GCancellable      *cancellable,
+                      GError           **error)
+{
+    AxingResolver *real = axing_resolver_get_default ();
+    AxingResource *ret;
+
+    if (g_str_equal (link, "ext.ent"))
+        link = "alt.ent";
+    ret = axing_resolver_resolve (real, base, xml_base, link, pubid, hint, cancellable, error);
+    g_object_unref (real);
+    return ret;
+}
+
+static void
+alt_resolver_init (AltResolver *resolver)
+{
+}
+
+static void
+alt_resolver_class_init (AltResolverClass *klass)
+{
+    AXING_RESOLVER_CLASS (klass)->resolve = alt_resolver_resolve;
+}
+
+static int
+check_parse (const char    *path,
+             const char    *content,
+             int            code,
+             AxingResolver *resolver)
+{
+    GFile *file = g_file_new_for_path (path);
+    AxingResource *resource = axing_resource_new (file, NULL);
+    AxingXmlParser *parser = axing_xml_parser_new (resource, resolver);
+    AxingReader *reader = AXING_READER (parser);
+    GString *text = g_string_new (NULL);
+    GError *error = NULL;
+    int ret = 0;
+
+    axing_xml_parser_set_load_external_dtd (parser, TRUE);
+    while (axing_reader_read (reader, &error)) {
+        if (axing_reader_get_node_type (reader) == AXING_NODE_TYPE_CONTENT)
+            g_string_append (text, axing_reader_get_content (reader));
+    }
+
+    /* The parser owns the error it sets */
+    if (error != NULL) {
+        if (content != NULL || error->domain != AXING_XML_PARSER_ERROR || error->code != code) {
+            g_print ("%s: %s\n", path, error->message);
+            ret = 1;
+        }
+    }
+    else if (content == NULL) {
+        g_print ("%s: expected an error\n", path);
+        ret = 1;
+    }
+    else if (!g_str_equal (text->str, content)) {
+        g_print ("%s: expected \"%s\", got \"%s\"\n", path, content, text->str);
+        ret = 1;
+    }
+
+    g_string_free (text, TRUE);
+    g_object_unref (parser);
+    g_object_unref (resource);
+    g_object_unref (file);
+    return ret;
+}
+
+/* Modification times only go to the second, so set them outright */
+static void
+write_file (const char *dir,
+            const char *name,
+            const char *contents,
+            guint64     mtime)
+{
+    char *path = g_build_filename (dir, name, NULL);
+    GFile *file = g_file_new_for_path (path);
+
+    g_file_set_contents (path, contents, -1, NULL);
+    g_file_set_attribute_uint64 (file, G_FILE_ATTRIBUTE_TIME_MODIFIED, mtime,
+                                 G_FILE_QUERY_INFO_NONE, NULL, NULL);
+    g_object_unref (file);
+    g_free (path);
+}
+
+static int
+check_parameter_entities (void)
+{
+    AxingResolver *alt;
+    const char *names[] = { "doc.xml", "doc.dtd", "ext.ent", "alt.ent", NULL };
+    char *dir, *doc;
+    int i, ret = 0;
+
+    dir = g_dir_make_tmp ("axing-dtd-XXXXXX", NULL);
+    write_file (dir, "doc.xml", "<!DOCTYPE doc SYSTEM \"doc.dtd\"><doc>&e;</doc>", 1000000000);
+    write_file (dir, "doc.dtd", "<!ENTITY % ext SYSTEM \"ext.ent\">\n%ext;\n", 1000000000);
+    write_file (dir, "ext.ent", "<!ENTITY e \"one\">", 1000000000);
+    write_file (dir, "alt.ent", "<!ENTITY e \"alt\">", 1000000000);
+    doc = g_build_filename (dir, "doc.xml", NULL);
+
+    ret |= check_parse (doc, "one", 0, NULL);
+    ret |= check_parse (doc, "one", 0, NULL);
+
+    alt = g_object_new (ALT_TYPE_RESOLVER, NULL);
+    ret |= check_parse (doc, "alt", 0, alt);
+    g_object_unref (alt);
+
+    /* Only the parameter entity changes, not the DTD */
+    write_file (dir, "ext.ent", "<!ENTITY e \"two\">", 1000000100);
+    ret |= check_parse (doc, "two", 0, NULL);
+
+    for (i = 0; names[i] != NULL; i++) {
+        char *path = g_build_filename (dir, names[i], NULL);
+        g_unlink (path);
+        g_free (path);
+    }
+    g_rmdir (dir);
+    g_free (doc);
+    g_free (dir);
+    return ret;
+}
+
+int
+main (int argc, char **argv)
+{
+    int i, retcode = 0;
+
+    setlocale(LC_ALL, "");
+
+    for (i = 0; i < 2; i++) {
+        retcode |= check_parse ("tests/dtd/condsect.xml", "draft|b|ext", 0, NULL);
+        retcode |= check_parse ("tests/dtd/broken.xml", NULL, AXING_XML_PARSER_ERROR_SYNTAX, NULL);
+        retcode |= check_parse ("tests/dtd/internal.xml", NULL, AXING_XML_PARSER_ERROR_SYNTAX, NULL);
+        retcode |= check_parse ("tests/dtd/missing.xml", "text", 0, NULL);
+    }
+    retcode |= check_parameter_entities ();
+    return retcode;
+}
@@ -0,0 +1,348 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+/* Runs AxingHttpResolver against a stand-in server on the loopback
+   interface. The server answers at most two requests, so anything that
+   goes to the network after that fails to connect. main cancels the
+   server once it's done with it, so a fetch that never connects makes
+   the test fail instead of hang. A second server then sends one broken
+   or stalled response per request, to check the client's limits.
+ */
+
+#include <locale.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "axing-http-resolver.h"
+#include "axing-simple-resolver.h"
+
+#define ETAG "\"v1\""
+#define BODY "<!ENTITY foo \"bar\">\n"
+
+static GSocketListener *listener;
+static GCancellable *stop;
+static int requests = 0;
+static int conditional = 0;
+static char *request_line = NULL;
+
+static gpointer
+server_thread (gpointer data)
+{
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        GSocketConnection *conn;
+        GDataInputStream *in;
+        GOutputStream *out;
+        gboolean match = FALSE;
+        char *line;
+
+        conn = g_socket_listener_accept (listener, NULL, stop, NULL);
+        if (conn == NULL)
+            break;
+        requests++;
+        in = g_data_input_stream_new (g_io_stream_get_input_stream (G_IO_STREAM (conn)));
+        g_data_input_stream_set_newline_type (in, G_DATA_STREAM_NEWLINE_TYPE_CR_LF);
+        while ((line = g_data_input_stream_read_line (in, NULL, stop, NULL)) != NULL) {
+            gboolean done = (line[0] == '\0');
+            if (g_str_has_prefix (line, "If-None-Match: ")) {
+                conditional++;
+                match = g_str_equal (line + 15, ETAG);
+            }
+            g_free (line);
+            if (done)
+                break;
+        }
+
+        out = g_io_stream_get_output_stream (G_IO_STREAM (conn));
+        if (match) {
+            const char *resp = "HTTP/1.1 304 Not Modified\r\nETag: " ETAG "\r\n\r\n";
+            g_output_stream_write_all (out, resp, strlen (resp), NULL, NULL, NULL);
+        }
+        else {
+            /* Chunked, split in the middle, to exercise the decoder */
+            char *resp = g_strdup_printf ("HTTP/1.1 200 OK\r\n"
+                                          "ETag: " ETAG "\r\n"
+                                          "Transfer-Encoding: chunked\r\n\r\n"
+                                          "%x\r\n%.10s\r\n%x\r\n%s\r\n0\r\n\r\n",
+                                          10, BODY, (int) strlen (BODY + 10), BODY + 10);
+            g_output_stream_write_all (out, resp, strlen (resp), NULL, NULL, NULL);
+            g_free (resp);
+        }
+        g_io_stream_close (G_IO_STREAM (conn), NULL, NULL);
+        g_object_unref (in);
+        g_object_unref (conn);
+    }
+    return NULL;
+}
+
+/* Answers each request with the next of responses. An empty response
+   sends nothing and waits for the client to hang up.
+ */
+static gpointer
+bad_server_thread (gpointer data)
+{
+    char **responses = data;
+    int i;
+
+    for (i = 0; responses[i] != NULL; i++) {
+        GSocketConnection *conn;
+        GDataInputStream *in;
+        char *line;
+
+        conn = g_socket_listener_accept (listener, NULL, stop, NULL);
+        if (conn == NULL)
+            break;
+        in = g_data_input_stream_new (g_io_stream_get_input_stream (G_IO_STREAM (conn)));
+        g_data_input_stream_set_newline_type (in, G_DATA_STREAM_NEWLINE_TYPE_CR_LF);
+        while ((line = g_data_input_stream_read_line (in, NULL, stop, NULL)) != NULL) {
+            gboolean done = (line[0] == '\0');
+            if (g_str_has_prefix (line, "GET ")) {
+                g_free (request_line);
+                request_line = g_strdup (line);
+            }
+            g_free (line);
+            if (done)
+                break;
+        }
+
+        if (responses[i][0] != '\0') {
+            g_output_stream_write_all (g_io_stream_get_output_stream (G_IO_STREAM (conn)),
+                                       responses[i], strlen (responses[i]),
+                                       NULL, stop, NULL);
+        }
+        else {
+            char buf[64];
+            while (g_input_stream_read (G_INPUT_STREAM (in), buf, sizeof (buf), stop, NULL) > 0);
+        }
+        g_io_stream_close (G_IO_STREAM (conn), NULL, NULL);
+        g_object_unref (in);
+        g_object_unref (conn);
+    }
+    return NULL;
+}
+
+static char *
+resolve_contents (AxingResolver  *resolver,
+                  AxingResource  *base,
+                  const char     *link,
+                  GError        **error)
+{
+    AxingResource *resource;
+    GOutputStream *out;
+    char *ret = NULL;
+
+    resource = axing_resolver_resolve (resolver, base, NULL, link, NULL,
+                                       AXING_RESOLVER_HINT_ENTITY, NULL, error);
+    if (resource == NULL)
+        return NULL;
+    out = g_memory_output_stream_new_resizable ();
+    if (g_output_stream_splice (out, axing_resource_read (resource, NULL, error),
+                                G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET, NULL, error) >= 0)
+        ret = g_strndup (g_memory_output_stream_get_data (G_MEMORY_OUTPUT_STREAM (out)),
+                         g_memory_output_stream_get_data_size (G_MEMORY_OUTPUT_STREAM (out)));
+    g_object_unref (out);
+    g_object_unref (resource);
+    return ret;
+}
+
+static void
+remove_dir (const char *path)
+{
+    GDir *dir = g_dir_open (path, 0, NULL);
+    const char *name;
+
+    while (dir && (name = g_dir_read_name (dir)) != NULL) {
+        char *child = g_build_filename (path, name, NULL);
+        g_unlink (child);
+        g_free (child);
+    }
+    if (dir)
+        g_dir_close (dir);
+    g_rmdir (path);
+}
+
+static gboolean
+check (gboolean    ok,
+       const char *what)
+{
+    if (!ok)
+        g_print ("test-axing-http-resolver: %s\n", what);
+    return ok;
+}
+
+int
+main (int argc, char **argv)
+{
+    AxingResolver *simple, *resolver;
+    AxingResource *base;
+    GFile *dir, *file;
+    GThread *thread;
+    GError *error = NULL;
+    char *tmpdir, *uri, *contents;
+    guint16 port;
+    gboolean ok = TRUE;
+
+    setlocale(LC_ALL, "");
+
+    listener = g_socket_listener_new ();
+    stop = g_cancellable_new ();
+    port = g_socket_listener_add_any_inet_port (listener, NULL, NULL);
+    thread = g_thread_new ("server", server_thread, NULL);
+
+    tmpdir = g_dir_make_tmp ("axing-http-XXXXXX", NULL);
+    dir = g_file_new_for_path (tmpdir);
+    simple = axing_simple_resolver_new ();
+    resolver = axing_http_resolver_new (simple, dir);
+
+    uri = g_strdup_printf ("http://127.0.0.1:%u/doc.xml", port);
+    file = g_file_new_for_uri (uri);
+    base = axing_resource_new (file, NULL);
+
+    /* Fetched and cached */
+    contents = resolve_contents (resolver, base, "doc.dtd", NULL);
+    ok &= check (g_strcmp0 (contents, BODY) == 0, "first fetch");
+    g_free (contents);
+
+    /* Revalidated, and the server says it hasn't changed */
+    contents = resolve_contents (resolver, base, "doc.dtd", NULL);
+    ok &= check (g_strcmp0 (contents, BODY) == 0, "revalidated fetch");
+    ok &= check (conditional == 1, "conditional request");
+    g_free (contents);
+
+    g_cancellable_cancel (stop);
+    g_thread_join (thread);
+    g_socket_listener_close (listener);
+    g_object_unref (listener);
+
+    /* Straight from the cache, with the server gone */
+    axing_http_resolver_set_offline (AXING_HTTP_RESOLVER (resolver), TRUE);
+    contents = resolve_contents (resolver, base, "doc.dtd", NULL);
+    ok &= check (g_strcmp0 (contents, BODY) == 0, "offline fetch");
+    g_free (contents);
+
+    contents = resolve_contents (resolver, base, "other.dtd", &error);
+    ok &= check (contents == NULL &&
+                 g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND),
+                 "offline miss");
+    g_clear_error (&error);
+    g_free (contents);
+
+    /* Stale copy when the server can't be reached */
+    axing_http_resolver_set_offline (AXING_HTTP_RESOLVER (resolver), FALSE);
+    contents = resolve_contents (resolver, base, "doc.dtd", NULL);
+    ok &= check (g_strcmp0 (contents, BODY) == 0, "unreachable fetch");
+    g_free (contents);
+
+    ok &= check (requests == 2, "request count");
+
+    g_object_unref (base);
+    g_object_unref (file);
+    g_free (uri);
+
+    /* A server that misbehaves. None of these are cached, so every
+       failure comes straight back. */
+    {
+        GString *many = g_string_new ("HTTP/1.1 200 OK\r\n");
+        GString *longline = g_string_new ("HTTP/1.1 200 OK\r\nX-Long: ");
+        char *responses[6];
+        int i;
+
+        for (i = 0; i < 200; i++)
+            g_string_append_printf (many, "X-Header-%i: %i\r\n", i, i);
+        g_string_append (many, "Content-Length: 0\r\n\r\n");
+        for (i = 0; i < 10000; i++)
+            g_string_append_c (longline, 'x');
+        g_string_append (longline, "\r\nContent-Length: 0\r\n\r\n");
+
+        responses[0] = g_strdup_printf ("HTTP/1.1 200 OK\r\n"
+                                        "Content-Length: %i\r\n\r\n%s",
+                                        (int) strlen (BODY), BODY);
+        responses[1] = g_string_free (many, FALSE);
+        responses[2] = g_string_free (longline, FALSE);
+        responses[3] = g_strdup ("HTTP/1.1 200 OK\r\n"
+                                 "Transfer-Encoding: chunked\r\n\r\n"
+                                 "ffffffffffffffffff\r\nx\r\n0\r\n\r\n");
+        responses[4] = g_strdup ("");
+        responses[5] = NULL;
+
+        listener = g_socket_listener_new ();
+        g_cancellable_reset (stop);
+        port = g_socket_listener_add_any_inet_port (listener, NULL, NULL);
+        thread = g_thread_new ("server", bad_server_thread, responses);
+        uri = g_strdup_printf ("http://127.0.0.1:%u/doc.xml", port);
+        file = g_file_new_for_uri (uri);
+        base = axing_resource_new (file, NULL);
+
+        /* The space doesn't go on the wire as is */
+        contents = resolve_contents (resolver, base, "has space.dtd", NULL);
+        ok &= check (g_strcmp0 (contents, BODY) == 0, "escaped fetch");
+        ok &= check (g_strcmp0 (request_line, "GET /has%20space.dtd HTTP/1.1") == 0,
+                     "escaped request line");
+        g_free (contents);
+
+        contents = resolve_contents (resolver, base, "many.dtd", &error);
+        ok &= check (contents == NULL &&
+                     g_error_matches (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA),
+                     "too many headers");
+        g_clear_error (&error);
+
+        contents = resolve_contents (resolver, base, "long.dtd", &error);
+        ok &= check (contents == NULL &&
+                     g_error_matches (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA),
+                     "header line too long");
+        g_clear_error (&error);
+
+        contents = resolve_contents (resolver, base, "chunk.dtd", &error);
+        ok &= check (contents == NULL &&
+                     g_error_matches (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA),
+                     "chunk too big");
+        g_clear_error (&error);
+
+        axing_http_resolver_set_timeout (AXING_HTTP_RESOLVER (resolver), 1);
+        contents = resolve_contents (resolver, base, "stall.dtd", &error);
+        ok &= check (contents == NULL &&
+                     g_error_matches (error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT),
+                     "timeout");
+        g_clear_error (&error);
+
+        g_cancellable_cancel (stop);
+        g_thread_join (thread);
+        g_socket_listener_close (listener);
+        g_object_unref (listener);
+        for (i = 0; responses[i] != NULL; i++)
+            g_free (responses[i]);
+        g_free (request_line);
+        g_object_unref (base);
+        g_object_unref (file);
+        g_free (uri);
+    }
+    g_object_unref (resolver);
+    g_object_unref (simple);
+    g_object_unref (dir);
+    remove_dir (tmpdir);
+    g_free (tmpdir);
+    g_object_unref (stop);
+
+    return ok ? 0 : 1;
+}
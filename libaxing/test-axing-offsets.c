@@ -0,0 +1,251 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+
+/* Checks the byte offsets AxingXmlParser gives for events and attributes
+   in the same document in different encodings. The offsets are checked
+   by decoding those bytes of the input and comparing them to the markup,
+   and the first element's start is checked against the length of the
+   BOM and everything before it. Offsets for events from entities are
+   the span of the reference. Documents in stateful encodings must not
+   give offsets at all.
+ */
+
+#include <locale.h>
+#include <string.h>
+
+#include "axing-xml-parser.h"
+
+#define NIHON "\xE6\x97\xA5\xE6\x9C\xAC"
+#define GCLEF "\xF0\x9D\x84\x9E"
+
+#define PROLOG \
+    "<?xml version=\"1.0\" encoding=\"%s\"?>\n" \
+    "<!DOCTYPE doc [<!ENTITY e \"<i>r</i>\">]>\n"
+#define BODY \
+    "<doc a=\"1\">t&#233;xt%s<p b=\"x\"/>&e;</doc>\n"
+
+typedef struct {
+    const char *declared; /* in the XML declaration */
+    const char *charset;  /* to encode with, after the BOM */
+    const char *bom;
+    gsize       bomlen;
+    const char *text;
+    gboolean    offsets;
+} OffsetCase;
+
+static const OffsetCase cases[] = {
+    { "UTF-8",       "UTF-8",       "",                 0, NIHON,       TRUE },
+    { "UTF-8",       "UTF-8",       "\xEF\xBB\xBF",     3, GCLEF NIHON, TRUE },
+    { "UTF-16",      "UTF-16LE",    "\xFF\xFE",         2, GCLEF NIHON, TRUE },
+    { "UTF-16",      "UTF-16BE",    "\xFE\xFF",         2, GCLEF NIHON, TRUE },
+    { "UCS-4",       "UCS-4LE",     "\xFF\xFE\x00\x00", 4, GCLEF NIHON, TRUE },
+    { "UCS-4",       "UCS-4BE",     "\x00\x00\xFE\xFF", 4, GCLEF NIHON, TRUE },
+    { "Shift_JIS",   "SHIFT_JIS",   "",                 0, NIHON,       TRUE },
+    { "ISO-2022-JP", "ISO-2022-JP", "",                 0, NIHON,       FALSE }
+};
+
+typedef struct {
+    AxingNodeType  type;
+    const char    *markup; /* %s gets the case's text */
+    const char    *attr;
+    const char    *attrmarkup;
+} OffsetEvent;
+
+static const OffsetEvent events[] = {
+    { AXING_NODE_TYPE_ELEMENT,     "<doc a=\"1\">", "a", "a=\"1\"" },
+    { AXING_NODE_TYPE_CONTENT,     "t&#233;xt%s",   NULL, NULL },
+    { AXING_NODE_TYPE_ELEMENT,     "<p b=\"x\"/>",  "b", "b=\"x\"" },
+    { AXING_NODE_TYPE_END_ELEMENT, "",              NULL, NULL },
+    { AXING_NODE_TYPE_ELEMENT,     "&e;",           NULL, NULL },
+    { AXING_NODE_TYPE_CONTENT,     "&e;",           NULL, NULL },
+    { AXING_NODE_TYPE_END_ELEMENT, "&e;",           NULL, NULL },
+    { AXING_NODE_TYPE_END_ELEMENT, "</doc>",        NULL, NULL }
+};
+
+static int
+check_span (const OffsetCase *oc,
+            GByteArray       *raw,
+            const char       *what,
+            goffset           start,
+            goffset           end,
+            const char       *markup)
+{
+    char *got = NULL;
+    int ret = 0;
+
+    if (start < 0 || end < start || end > (goffset) raw->len)
+        ret = 1;
+    else
+        got = g_convert ((const char *) raw->data + start, end - start,
+                         "UTF-8", oc->charset, NULL, NULL, NULL);
+    if (ret || got == NULL || !g_str_equal (got, markup)) {
+        g_print ("%s %s: expected \"%s\", got \"%s\" at %" G_GINT64_FORMAT "-%" G_GINT64_FORMAT "\n",
+                 oc->charset, what, markup, got ? got : "", (gint64) start, (gint64) end);
+        ret = 1;
+    }
+    g_free (got);
+    return ret;
+}
+
+static int
+check_case (const OffsetCase *oc)
+{
+    char *prolog = g_strdup_printf (PROLOG, oc->declared);
+    char *body = g_strdup_printf (BODY, oc->text);
+    char *doc = g_strconcat (prolog, body, NULL);
+    char *encoded, *markup;
+    gsize enclen, prologlen = 0;
+    GByteArray *raw;
+    GBytes *bytes;
+    GInputStream *stream;
+    GFile *file;
+    AxingResource *resource;
+    AxingXmlParser *parser;
+    AxingReader *reader;
+    GError *error = NULL;
+    guint n = 0;
+    int ret = 0;
+
+    encoded = g_convert (prolog, -1, oc->charset, "UTF-8", NULL, &prologlen, NULL);
+    g_free (encoded);
+    encoded = g_convert (doc, -1, oc->charset, "UTF-8", NULL, &enclen, NULL);
+    if (encoded == NULL) {
+        g_print ("%s: can't encode the document\n", oc->charset);
+        g_free (prolog);
+        g_free (body);
+        g_free (doc);
+        return 1;
+    }
+    raw = g_byte_array_new ();
+    g_byte_array_append (raw, (const guint8 *) oc->bom, oc->bomlen);
+    g_byte_array_append (raw, (const guint8 *) encoded, enclen);
+
+    bytes = g_bytes_new_static (raw->data, raw->len);
+    stream = g_memory_input_stream_new_from_bytes (bytes);
+    file = g_file_new_for_path ("test-axing-offsets.xml");
+    resource = axing_resource_new (file, stream);
+    parser = axing_xml_parser_new (resource, NULL);
+    reader = AXING_READER (parser);
+
+    while (axing_reader_read (reader, &error)) {
+        AxingNodeType type = axing_reader_get_node_type (reader);
+        const OffsetEvent *ev;
+        goffset start = -1, end = -1, spanstart, spanend;
+        gboolean has, span;
+
+        if (type != AXING_NODE_TYPE_ELEMENT && type != AXING_NODE_TYPE_END_ELEMENT &&
+            type != AXING_NODE_TYPE_CONTENT)
+            continue;
+        if (n >= G_N_ELEMENTS (events)) {
+            g_print ("%s: too many events\n", oc->charset);
+            ret = 1;
+            break;
+        }
+        ev = &events[n++];
+        if (type != ev->type) {
+            g_print ("%s: wrong type for event %u\n", oc->charset, n);
+            ret = 1;
+            break;
+        }
+
+        has = axing_reader_get_offsets (reader, &start, &end);
+        if (!oc->offsets) {
+            if (has || (ev->attr && axing_reader_get_attr_offsets (reader, ev->attr, NULL, NULL)) ||
+                axing_xml_parser_get_event_span (parser, NULL, NULL)) {
+                g_print ("%s: offsets for event %u\n", oc->charset, n);
+                ret = 1;
+            }
+            continue;
+        }
+        if (!has) {
+            g_print ("%s: no offsets for event %u\n", oc->charset, n);
+            ret = 1;
+            continue;
+        }
+
+        markup = g_strdup_printf (ev->markup, oc->text);
+        ret |= check_span (oc, raw, "event", start, end, markup);
+        g_free (markup);
+
+        /* BOM, XML declaration, and DOCTYPE all counted */
+        if (n == 1 && start != (goffset) (oc->bomlen + prologlen)) {
+            g_print ("%s: document element at %" G_GINT64_FORMAT ", expected %" G_GSIZE_FORMAT "\n",
+                     oc->charset, (gint64) start, oc->bomlen + prologlen);
+            ret = 1;
+        }
+
+        if (ev->attr) {
+            if (!axing_reader_get_attr_offsets (reader, ev->attr, &start, &end)) {
+                g_print ("%s: no offsets for attribute %s\n", oc->charset, ev->attr);
+                ret = 1;
+            }
+            else {
+                ret |= check_span (oc, raw, "attribute", start, end, ev->attrmarkup);
+            }
+        }
+
+        /* Spans are only for UTF-8 bytes that are really the event's text */
+        span = axing_xml_parser_get_event_span (parser, &spanstart, &spanend);
+        if (span != (g_str_equal (oc->charset, "UTF-8") && !g_str_equal (ev->markup, "&e;"))) {
+            g_print ("%s: wrong event span for event %u\n", oc->charset, n);
+            ret = 1;
+        }
+    }
+
+    /* The parser owns the error it sets */
+    if (error != NULL) {
+        g_print ("%s: %s\n", oc->charset, error->message);
+        ret = 1;
+    }
+    else if (ret == 0 && n != G_N_ELEMENTS (events)) {
+        g_print ("%s: expected %u events, got %u\n",
+                 oc->charset, (guint) G_N_ELEMENTS (events), n);
+        ret = 1;
+    }
+
+    g_object_unref (parser);
+    g_object_unref (resource);
+    g_object_unref (file);
+    g_object_unref (stream);
+    g_bytes_unref (bytes);
+    g_byte_array_unref (raw);
+    g_free (encoded);
+    g_free (prolog);
+    g_free (body);
+    g_free (doc);
+    return ret;
+}
+
+int
+main (int argc, char **argv)
+{
+    gsize i;
+    int retcode = 0;
+
+    setlocale(LC_ALL, "");
+
+    for (i = 0; i < G_N_ELEMENTS (cases); i++)
+        retcode |= check_case (&cases[i]);
+    return retcode;
+}
@@ -0,0 +1,152 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+/* Parses a few megabytes with AxingParallelParser and with a plain
+   AxingXmlParser and checks that the events, their positions, and any
+   error all come out the same. One document has an error far enough in
+   that it's in a later chunk.
+ */
+
+#include <locale.h>
+#include <string.h>
+
+#include "axing-parallel-parser.h"
+#include "axing-xml-parser.h"
+
+#define N_ENTRIES 60000
+
+static GBytes *
+make_document (gboolean broken)
+{
+    GString *xml = g_string_new ("<?xml version=\"1.0\"?>\n"
+                                 "<!DOCTYPE feed [<!ENTITY who \"somebody\">]>\n"
+                                 "<feed xmlns=\"urn:feed\">\n");
+    int i;
+
+    for (i = 0; i < N_ENTRIES; i++) {
+        if (broken && i == N_ENTRIES * 3 / 4)
+            g_string_append (xml, "  <entry n=\"bad\">a & b</entry>\n");
+        g_string_append_printf (xml,
+                                "  <entry n=\"%i\"><title>Entry %i by &who;</title>"
+                                "<!-- c --><![CDATA[<x>]]></entry>\n", i, i);
+    }
+    g_string_append (xml, "</feed>\n");
+    return g_string_free_to_bytes (xml);
+}
+
+static char *
+next_event (AxingReader  *reader,
+            GError      **error)
+{
+    GError *tmperror = NULL;
+
+    if (!axing_reader_read (reader, &tmperror)) {
+        if (tmperror != NULL) {
+            *error = tmperror;
+            return g_strdup ("error");
+        }
+        return NULL;
+    }
+    return g_strdup_printf ("%i %s %s %" G_GINT64_FORMAT ":%" G_GINT64_FORMAT,
+                            axing_reader_get_node_type (reader),
+                            axing_reader_get_node_type (reader) == AXING_NODE_TYPE_CONTENT ||
+                            axing_reader_get_node_type (reader) == AXING_NODE_TYPE_CDATA ||
+                            axing_reader_get_node_type (reader) == AXING_NODE_TYPE_COMMENT ?
+                            "" : axing_reader_get_qname (reader),
+                            axing_reader_get_content (reader) ? axing_reader_get_content (reader) : "",
+                            axing_reader_get_linenum (reader),
+                            axing_reader_get_colnum (reader));
+}
+
+static int
+check_document (gboolean broken)
+{
+    GBytes *bytes = make_document (broken);
+    GFile *file = g_file_new_for_path ("test-axing-parallel-parser.xml");
+    GInputStream *stream1, *stream2;
+    AxingResource *resource1, *resource2;
+    AxingReader *plain, *parallel;
+    const char *what = broken ? "broken" : "good";
+    guint64 n_events = 0;
+    int ret = 0;
+
+    stream1 = g_memory_input_stream_new_from_bytes (bytes);
+    resource1 = axing_resource_new (file, stream1);
+    plain = AXING_READER (axing_xml_parser_new (resource1, NULL));
+    stream2 = g_memory_input_stream_new_from_bytes (bytes);
+    resource2 = axing_resource_new (file, stream2);
+    parallel = AXING_READER (axing_parallel_parser_new (resource2, NULL, 4));
+
+    while (TRUE) {
+        GError *error1 = NULL, *error2 = NULL;
+        char *event1 = next_event (plain, &error1);
+        char *event2 = next_event (parallel, &error2);
+        gboolean same = g_strcmp0 (event1, event2) == 0;
+
+        if (same && error1 != NULL)
+            same = g_str_equal (error1->message, error2->message);
+        if (!same) {
+            g_print ("%s: event %" G_GUINT64_FORMAT ":\n  %s\n  %s\n", what, n_events,
+                     error1 ? error1->message : event1 ? event1 : "(end)",
+                     error2 ? error2->message : event2 ? event2 : "(end)");
+            ret = 1;
+        }
+        else if (error1 != NULL && !broken) {
+            g_print ("%s: %s\n", what, error1->message);
+            ret = 1;
+        }
+        else if (event1 == NULL && broken) {
+            g_print ("%s: no error\n", what);
+            ret = 1;
+        }
+        /* The plain parser owns the error it reports */
+        g_clear_error (&error2);
+        g_free (event1);
+        g_free (event2);
+        if (!same || error1 != NULL || event1 == NULL)
+            break;
+        n_events++;
+    }
+
+    g_object_unref (parallel);
+    g_object_unref (resource2);
+    g_object_unref (stream2);
+    g_object_unref (plain);
+    g_object_unref (resource1);
+    g_object_unref (stream1);
+    g_object_unref (file);
+    g_bytes_unref (bytes);
+    return ret;
+}
+
+int
+main (int argc, char **argv)
+{
+    int retcode = 0;
+
+    setlocale(LC_ALL, "");
+
+    retcode |= check_document (FALSE);
+    retcode |= check_document (TRUE);
+    return retcode;
+}
@@ -0,0 +1,257 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+
+/* Reads a document with an external entity through an AxingParseCache in
+   a temporary directory. The first read parses and stores an entry. The
+   second replays it, with a resolver that fails everything to show that
+   nothing got parsed. Then the entity changes, and the third read has to
+   parse again and see the change. The same goes for a document whose
+   external DTD pulls in a parameter entity, read with DTD loading on,
+   after a plain parser has already put that DTD in the DTD cache. Each
+   read is compared with the events from a plain AxingXmlParser.
+ */
+
+#include <locale.h>
+#include <glib/gstdio.h>
+
+#include "axing-parse-cache.h"
+#include "axing-xml-parser.h"
+
+#define FAILING_TYPE_RESOLVER failing_resolver_get_type ()
+G_DECLARE_FINAL_TYPE (FailingResolver, failing_resolver, FAILING, RESOLVER, AxingResolver)
+
+struct _FailingResolver {
+    AxingResolver parent;
+};
+
+G_DEFINE_TYPE (FailingResolver, failing_resolver, AXING_TYPE_RESOLVER);
+
+static AxingResource *
+failing_resolver_resolve (AxingResolver     *resolver,
+                          AxingResource     *base,
+                          const char        *xml_base,
+                          const char        *link,
+                          const char        *pubid,
+                          AxingResolverHint  hint,
+                          GCancellable      *cancellable,
+                          GError           **error)
+{
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED, "Resolved %s", link);
+    return NULL;
+}
+
+static void
+failing_resolver_init (FailingResolver *resolver)
+{
+}
+
+static void
+failing_resolver_class_init (FailingResolverClass *klass)
+{
+    AXING_RESOLVER_CLASS (klass)->resolve = failing_resolver_resolve;
+}
+
+#define DOC "<!DOCTYPE doc [<!ENTITY ext SYSTEM \"ext.xml\">]>\n" \
+            "<doc a=\"1\">&ext;<b>text &amp; more</b><!-- c --></doc>\n"
+#define DTDDOC "<!DOCTYPE doc SYSTEM \"doc.dtd\">\n<doc>&e;</doc>\n"
+#define DTD "<!ENTITY % pe SYSTEM \"pe.ent\">\n%pe;\n"
+
+/* Events as lines of text, or NULL with error set */
+static char *
+read_events (AxingReader  *reader,
+             GError      **error)
+{
+    GString *ret = g_string_new (NULL);
+
+    while (axing_reader_read (reader, error)) {
+        switch (axing_reader_get_node_type (reader)) {
+        case AXING_NODE_TYPE_ELEMENT:
+            g_string_append_printf (ret, "[ %s\n", axing_reader_get_qname (reader));
+            break;
+        case AXING_NODE_TYPE_END_ELEMENT:
+            g_string_append_printf (ret, "] %s\n", axing_reader_get_qname (reader));
+            break;
+        case AXING_NODE_TYPE_CONTENT:
+            g_string_append_printf (ret, "# %s\n", axing_reader_get_content (reader));
+            break;
+        case AXING_NODE_TYPE_COMMENT:
+            g_string_append_printf (ret, "! %s\n", axing_reader_get_content (reader));
+            break;
+        default:
+            break;
+        }
+    }
+    if (*error != NULL) {
+        g_string_free (ret, TRUE);
+        return NULL;
+    }
+    return g_string_free (ret, FALSE);
+}
+
+static int
+check_read (AxingParseCache *cache,
+            GFile           *file,
+            AxingResolver   *resolver,
+            gboolean         load_dtd,
+            const char      *what)
+{
+    AxingResource *resource;
+    AxingXmlParser *parser;
+    AxingReader *reader;
+    GError *error = NULL;
+    char *expected, *got;
+    int ret = 0;
+
+    resource = axing_resource_new (file, NULL);
+    parser = axing_xml_parser_new (resource, NULL);
+    axing_xml_parser_set_load_external_dtd (parser, load_dtd);
+    /* The parser owns the error it sets */
+    expected = read_events (AXING_READER (parser), &error);
+    if (expected == NULL)
+        g_print ("%s: %s\n", what, error->message);
+    g_object_unref (parser);
+    g_object_unref (resource);
+    if (expected == NULL)
+        return 1;
+
+    resource = axing_resource_new (file, NULL);
+    axing_parse_cache_set_load_external_dtd (cache, load_dtd);
+    reader = axing_parse_cache_read (cache, resource, resolver, NULL, &error);
+    g_object_unref (resource);
+    if (reader == NULL) {
+        g_print ("%s: %s\n", what, error->message);
+        g_error_free (error);
+        g_free (expected);
+        return 1;
+    }
+    got = read_events (reader, &error);
+    if (got == NULL) {
+        g_print ("%s: %s\n", what, error->message);
+        g_error_free (error);
+        ret = 1;
+    }
+    else if (!g_str_equal (got, expected)) {
+        g_print ("%s: expected\n%sgot\n%s", what, expected, got);
+        ret = 1;
+    }
+
+    g_object_unref (reader);
+    g_free (expected);
+    g_free (got);
+    return ret;
+}
+
+/* The DTD cache goes by modification time, which only has seconds */
+static void
+write_file (const char *path,
+            const char *contents,
+            guint64     mtime)
+{
+    GFile *file = g_file_new_for_path (path);
+    g_file_set_contents (path, contents, -1, NULL);
+    g_file_set_attribute_uint64 (file, G_FILE_ATTRIBUTE_TIME_MODIFIED, mtime,
+                                 G_FILE_QUERY_INFO_NONE, NULL, NULL);
+    g_object_unref (file);
+}
+
+static void
+remove_tree (const char *path)
+{
+    GDir *dir = g_dir_open (path, 0, NULL);
+    if (dir != NULL) {
+        const char *name;
+        while ((name = g_dir_read_name (dir)) != NULL) {
+            char *child = g_build_filename (path, name, NULL);
+            remove_tree (child);
+            g_free (child);
+        }
+        g_dir_close (dir);
+        g_rmdir (path);
+    }
+    else {
+        g_unlink (path);
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+    AxingParseCache *cache;
+    AxingResolver *failing;
+    GFile *dirfile, *file, *dtdfile;
+    GError *error = NULL;
+    char *tmpdir, *path, *extpath, *cachepath, *dtddocpath, *dtdpath, *pepath;
+    int retcode = 0;
+
+    setlocale(LC_ALL, "");
+
+    tmpdir = g_dir_make_tmp ("test-axing-parse-cache-XXXXXX", &error);
+    if (tmpdir == NULL) {
+        g_print ("%s\n", error->message);
+        g_error_free (error);
+        return 1;
+    }
+    path = g_build_filename (tmpdir, "doc.xml", NULL);
+    extpath = g_build_filename (tmpdir, "ext.xml", NULL);
+    g_file_set_contents (path, DOC, -1, NULL);
+    g_file_set_contents (extpath, "<e>one</e>", -1, NULL);
+    dtddocpath = g_build_filename (tmpdir, "dtddoc.xml", NULL);
+    dtdpath = g_build_filename (tmpdir, "doc.dtd", NULL);
+    pepath = g_build_filename (tmpdir, "pe.ent", NULL);
+    write_file (dtddocpath, DTDDOC, 1000000000);
+    write_file (dtdpath, DTD, 1000000000);
+    write_file (pepath, "<!ENTITY e \"one\">", 1000000000);
+
+    cachepath = g_build_filename (tmpdir, "cache", NULL);
+    dirfile = g_file_new_for_path (cachepath);
+    cache = axing_parse_cache_new (dirfile);
+    file = g_file_new_for_path (path);
+    failing = g_object_new (FAILING_TYPE_RESOLVER, NULL);
+
+    retcode |= check_read (cache, file, NULL, FALSE, "first read");
+    retcode |= check_read (cache, file, failing, FALSE, "cached read");
+    g_file_set_contents (extpath, "<e>two</e>", -1, NULL);
+    retcode |= check_read (cache, file, NULL, FALSE, "changed entity");
+
+    dtdfile = g_file_new_for_path (dtddocpath);
+    retcode |= check_read (cache, dtdfile, NULL, TRUE, "first DTD read");
+    retcode |= check_read (cache, dtdfile, failing, TRUE, "cached DTD read");
+    write_file (pepath, "<!ENTITY e \"two\">", 1000000100);
+    retcode |= check_read (cache, dtdfile, NULL, TRUE, "changed parameter entity");
+
+    g_object_unref (dtdfile);
+    g_object_unref (failing);
+    g_object_unref (file);
+    g_object_unref (cache);
+    g_object_unref (dirfile);
+    remove_tree (tmpdir);
+    g_free (cachepath);
+    g_free (pepath);
+    g_free (dtdpath);
+    g_free (dtddocpath);
+    g_free (extpath);
+    g_free (path);
+    g_free (tmpdir);
+    return retcode;
+}
@@ -0,0 +1,232 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+/* Parses the documents on the command line with axing_parse_many, on one
+   thread and on several, and checks that each one comes out the same as
+   parsing it alone with a new parser. Every other document gets a path
+   filter and a skip mode, so a reused parser that kept them would show up
+   on the next document. Then checks that cancelling stops the document
+   being parsed and the ones after it.
+ */
+
+#include <locale.h>
+#include <string.h>
+
+#include "axing-xml-parser.h"
+
+typedef struct {
+    AxingResource **resources;
+    char          **results;
+    guint           n_resources;
+    GCancellable   *cancellable;
+    gint            calls;
+} ManyData;
+
+static AxingResource **
+make_resources (char **paths,
+                guint  n_paths)
+{
+    AxingResource **resources = g_new0 (AxingResource *, n_paths);
+    guint i;
+
+    for (i = 0; i < n_paths; i++) {
+        GFile *file = g_file_new_for_path (paths[i]);
+        resources[i] = axing_resource_new (file, NULL);
+        g_object_unref (file);
+    }
+    return resources;
+}
+
+static void
+free_resources (AxingResource **resources,
+                guint           n_resources)
+{
+    guint i;
+    for (i = 0; i < n_resources; i++)
+        g_object_unref (resources[i]);
+    g_free (resources);
+}
+
+static void
+configure (AxingXmlParser *parser,
+           guint           i)
+{
+    if (i % 2 == 1) {
+        axing_xml_parser_add_path_filter (parser, "/*/*", NULL);
+        axing_xml_parser_set_skip_mode (parser, AXING_SKIP_MODE_BALANCED);
+    }
+}
+
+static char *
+transcript (AxingXmlParser *parser)
+{
+    AxingReader *reader = AXING_READER (parser);
+    GString *out = g_string_new (NULL);
+    GError *error = NULL;
+
+    while (axing_reader_read (reader, &error)) {
+        AxingNodeType type = axing_reader_get_node_type (reader);
+        g_string_append_printf (out, "%i %s %s\n", type,
+                                type == AXING_NODE_TYPE_CONTENT ||
+                                type == AXING_NODE_TYPE_CDATA ||
+                                type == AXING_NODE_TYPE_COMMENT ?
+                                "" : axing_reader_get_qname (reader),
+                                axing_reader_get_content (reader) ?
+                                axing_reader_get_content (reader) : "");
+    }
+    /* The parser owns the error */
+    if (error != NULL)
+        g_string_append_printf (out, "error: %s\n", error->message);
+    return g_string_free (out, FALSE);
+}
+
+static void
+many_func (AxingXmlParser *parser,
+           AxingResource  *resource,
+           gpointer        user_data)
+{
+    ManyData *data = user_data;
+    guint i;
+
+    for (i = 0; data->resources[i] != resource; i++);
+    configure (parser, i);
+    data->results[i] = transcript (parser);
+}
+
+static int
+check_many (char  **paths,
+            char  **expected,
+            guint   n_paths,
+            guint   n_threads)
+{
+    ManyData data;
+    guint i;
+    int ret = 0;
+
+    data.resources = make_resources (paths, n_paths);
+    data.results = g_new0 (char *, n_paths);
+    data.n_resources = n_paths;
+
+    axing_parse_many (data.resources, n_paths, NULL, n_threads,
+                      many_func, &data, NULL);
+
+    for (i = 0; i < n_paths; i++) {
+        if (data.results[i] == NULL) {
+            g_print ("%s: not parsed with %u threads\n", paths[i], n_threads);
+            ret = 1;
+        }
+        else if (!g_str_equal (data.results[i], expected[i])) {
+            g_print ("%s: differs with %u threads\n", paths[i], n_threads);
+            ret = 1;
+        }
+        g_free (data.results[i]);
+    }
+
+    g_free (data.results);
+    free_resources (data.resources, n_paths);
+    return ret;
+}
+
+/* Cancels in the first call, before anything is read */
+static void
+cancel_func (AxingXmlParser *parser,
+             AxingResource  *resource,
+             gpointer        user_data)
+{
+    ManyData *data = user_data;
+    GError *error = NULL;
+
+    g_atomic_int_inc (&(data->calls));
+    g_cancellable_cancel (data->cancellable);
+    if (axing_reader_read (AXING_READER (parser), &error) ||
+        !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        data->results[0] = g_strdup ("parser not cancelled");
+}
+
+static int
+check_cancel (char  **paths,
+              guint   n_paths)
+{
+    ManyData data;
+    int ret = 0;
+
+    data.resources = make_resources (paths, n_paths);
+    data.results = g_new0 (char *, 1);
+    data.n_resources = n_paths;
+    data.cancellable = g_cancellable_new ();
+    data.calls = 0;
+
+    axing_parse_many (data.resources, n_paths, NULL, 1,
+                      cancel_func, &data, data.cancellable);
+
+    if (data.results[0] != NULL) {
+        g_print ("cancel: %s\n", data.results[0]);
+        ret = 1;
+    }
+    if (data.calls != 1) {
+        g_print ("cancel: %i calls after cancelling\n", data.calls);
+        ret = 1;
+    }
+
+    g_free (data.results[0]);
+    g_free (data.results);
+    g_object_unref (data.cancellable);
+    free_resources (data.resources, n_paths);
+    return ret;
+}
+
+int
+main (int argc, char **argv)
+{
+    AxingResource **resources;
+    char **expected;
+    guint n_paths, i;
+    int retcode = 0;
+
+    setlocale(LC_ALL, "");
+
+    if (argc < 2) {
+        g_printerr ("Usage: test-axing-parse-many FILE...\n");
+        return 1;
+    }
+    n_paths = argc - 1;
+
+    resources = make_resources (argv + 1, n_paths);
+    expected = g_new0 (char *, n_paths);
+    for (i = 0; i < n_paths; i++) {
+        AxingXmlParser *parser = axing_xml_parser_new (resources[i], NULL);
+        configure (parser, i);
+        expected[i] = transcript (parser);
+        g_object_unref (parser);
+    }
+    free_resources (resources, n_paths);
+
+    retcode |= check_many (argv + 1, expected, n_paths, 1);
+    retcode |= check_many (argv + 1, expected, n_paths, 4);
+    retcode |= check_cancel (argv + 1, n_paths);
+
+    for (i = 0; i < n_paths; i++)
+        g_free (expected[i]);
+    g_free (expected);
+    return retcode;
+}
@@ -0,0 +1,213 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+/* Parses small documents with path filters from
+   axing_xml_parser_add_path_filter and checks which events get through.
+   Covers absolute, descendant, wildcard, and attribute steps, several
+   patterns at once, entities in text the filter drops, both skip modes
+   for elements it drops, and pattern syntax errors.
+ */
+
+#include <locale.h>
+#include <string.h>
+
+#include "axing-path-filter.h"
+#include "axing-xml-parser.h"
+
+#define DOC "<doc><a>1</a><b><a>2</a></b><a x=\"y\">3</a></doc>"
+#define A3 "<a x=\"y\">3</a>"
+
+typedef struct {
+    const char    *xml;
+    const char    *patterns[3];
+    AxingSkipMode  mode;
+    const char    *expected; /* NULL if parsing has to fail */
+} FilterCase;
+
+static const FilterCase cases[] = {
+    { DOC, { "/doc/a" }, AXING_SKIP_MODE_WELL_FORMED, "<a>1</a>" A3 },
+    { DOC, { "a" }, AXING_SKIP_MODE_WELL_FORMED, "<a>1</a><a>2</a>" A3 },
+    { DOC, { "//b//a" }, AXING_SKIP_MODE_WELL_FORMED, "<a>2</a>" },
+    { DOC, { "/doc/*/a" }, AXING_SKIP_MODE_WELL_FORMED, "<a>2</a>" },
+    { DOC, { "/*" }, AXING_SKIP_MODE_WELL_FORMED, DOC },
+    { DOC, { "a[@x]" }, AXING_SKIP_MODE_WELL_FORMED, A3 },
+    { DOC, { "a[@x='y']" }, AXING_SKIP_MODE_WELL_FORMED, A3 },
+    { DOC, { "a[@x=\"z\"]" }, AXING_SKIP_MODE_WELL_FORMED, "" },
+    { DOC, { "/doc/b", "/doc/a[@x]" }, AXING_SKIP_MODE_WELL_FORMED, "<b><a>2</a></b>" A3 },
+    { DOC, { "/a" }, AXING_SKIP_MODE_WELL_FORMED, "" },
+    /* Comments and PIs only come through inside a match */
+    { "<doc><!--out--><?pi out?><a><!--in--><?pi in?>1</a></doc>",
+      { "a" }, AXING_SKIP_MODE_WELL_FORMED, "<a><!--in--><?pi in?>1</a>" },
+    /* Dropped text still expands entities, which can have matches */
+    { "<!DOCTYPE doc [<!ENTITY e \"<a>4</a>\">]><doc>x &e; y &#65; <a>5</a></doc>",
+      { "a" }, AXING_SKIP_MODE_WELL_FORMED, "<a>4</a><a>5</a>" },
+    { "<doc>x &#xZZ; <a>1</a></doc>",
+      { "a" }, AXING_SKIP_MODE_WELL_FORMED, NULL },
+    /* Dropped elements are only checked for nesting in well-formed mode */
+    { "<doc><b><c></d></b><a>1</a></doc>",
+      { "a" }, AXING_SKIP_MODE_WELL_FORMED, NULL },
+    { "<doc><b><c></d></b><a>1</a></doc>",
+      { "a" }, AXING_SKIP_MODE_BALANCED, "<a>1</a>" },
+    { "<doc><b><!-- a -- b --></b><a>1</a></doc>",
+      { "a" }, AXING_SKIP_MODE_WELL_FORMED, NULL },
+    { "<doc><b><!-- a -- b --></b><a>1</a></doc>",
+      { "a" }, AXING_SKIP_MODE_BALANCED, "<a>1</a>" },
+    /* Skipping still has to find the end of a dropped element */
+    { "<doc><b><a>1</a></doc>",
+      { "/doc/a" }, AXING_SKIP_MODE_BALANCED, NULL }
+};
+
+static const char *bad_patterns[] = {
+    "", "/doc/", "doc//", "a[x]", "a[@]", "a[@x=y]", "a[@x='y]", "a[@x", "a b"
+};
+
+static char *
+filtered_events (const FilterCase  *test,
+                 GError           **error)
+{
+    GBytes *bytes = g_bytes_new_static (test->xml, strlen (test->xml));
+    GFile *file = g_file_new_for_path ("test-axing-path-filter.xml");
+    GInputStream *stream = g_memory_input_stream_new_from_bytes (bytes);
+    AxingResource *resource = axing_resource_new (file, stream);
+    AxingXmlParser *parser = axing_xml_parser_new (resource, NULL);
+    AxingReader *reader = AXING_READER (parser);
+    GString *out = g_string_new (NULL);
+    GError *readerror = NULL;
+    int i;
+
+    for (i = 0; i < G_N_ELEMENTS (test->patterns) && test->patterns[i] != NULL; i++)
+        axing_xml_parser_add_path_filter (parser, test->patterns[i], NULL);
+    axing_xml_parser_set_skip_mode (parser, test->mode);
+
+    while (axing_reader_read (reader, &readerror)) {
+        const char *qname = axing_reader_get_qname (reader);
+        const char *content = axing_reader_get_content (reader);
+        switch (axing_reader_get_node_type (reader)) {
+        case AXING_NODE_TYPE_ELEMENT:
+            g_string_append_printf (out, "<%s", qname);
+            if (axing_reader_get_attr_value (reader, "x") != NULL)
+                g_string_append_printf (out, " x=\"%s\"",
+                                        axing_reader_get_attr_value (reader, "x"));
+            g_string_append_c (out, '>');
+            break;
+        case AXING_NODE_TYPE_END_ELEMENT:
+            g_string_append_printf (out, "</%s>", qname);
+            break;
+        case AXING_NODE_TYPE_CONTENT:
+            g_string_append (out, content);
+            break;
+        case AXING_NODE_TYPE_COMMENT:
+            g_string_append_printf (out, "<!--%s-->", content);
+            break;
+        case AXING_NODE_TYPE_INSTRUCTION:
+            g_string_append_printf (out, "<?%s %s?>", qname, content);
+            break;
+        default:
+            break;
+        }
+    }
+
+    /* The parser owns the error */
+    if (readerror != NULL) {
+        g_set_error_literal (error, readerror->domain, readerror->code,
+                             readerror->message);
+        g_string_free (out, TRUE);
+        out = NULL;
+    }
+
+    g_object_unref (parser);
+    g_object_unref (resource);
+    g_object_unref (stream);
+    g_object_unref (file);
+    g_bytes_unref (bytes);
+    return out ? g_string_free (out, FALSE) : NULL;
+}
+
+static int
+check_case (const FilterCase *test)
+{
+    GError *error = NULL;
+    char *events = filtered_events (test, &error);
+    const char *mode = test->mode == AXING_SKIP_MODE_BALANCED ? "balanced" : "well-formed";
+    int ret = 0;
+
+    if (events == NULL && test->expected != NULL) {
+        g_print ("%s (%s) %s: %s\n", test->patterns[0], mode, test->xml, error->message);
+        ret = 1;
+    }
+    else if (events != NULL && test->expected == NULL) {
+        g_print ("%s (%s) %s: expected an error, got\n  %s\n",
+                 test->patterns[0], mode, test->xml, events);
+        ret = 1;
+    }
+    else if (events != NULL && !g_str_equal (events, test->expected)) {
+        g_print ("%s (%s) %s:\n  expected %s\n  got      %s\n",
+                 test->patterns[0], mode, test->xml, test->expected, events);
+        ret = 1;
+    }
+
+    g_clear_error (&error);
+    g_free (events);
+    return ret;
+}
+
+static int
+check_bad_pattern (const char *pattern)
+{
+    GBytes *bytes = g_bytes_new_static (DOC, strlen (DOC));
+    GFile *file = g_file_new_for_path ("test-axing-path-filter.xml");
+    GInputStream *stream = g_memory_input_stream_new_from_bytes (bytes);
+    AxingResource *resource = axing_resource_new (file, stream);
+    AxingXmlParser *parser = axing_xml_parser_new (resource, NULL);
+    GError *error = NULL;
+    int ret = 0;
+
+    if (axing_xml_parser_add_path_filter (parser, pattern, &error) ||
+        !g_error_matches (error, AXING_PATH_FILTER_ERROR, AXING_PATH_FILTER_ERROR_SYNTAX)) {
+        g_print ("\"%s\": expected a syntax error\n", pattern);
+        ret = 1;
+    }
+
+    g_clear_error (&error);
+    g_object_unref (parser);
+    g_object_unref (resource);
+    g_object_unref (stream);
+    g_object_unref (file);
+    g_bytes_unref (bytes);
+    return ret;
+}
+
+int
+main (int argc, char **argv)
+{
+    int i;
+    int retcode = 0;
+
+    setlocale(LC_ALL, "");
+
+    for (i = 0; i < G_N_ELEMENTS (cases); i++)
+        retcode |= check_case (&cases[i]);
+    for (i = 0; i < G_N_ELEMENTS (bad_patterns); i++)
+        retcode |= check_bad_pattern (bad_patterns[i]);
+    return retcode;
+}
@@ -0,0 +1,246 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+/* Parses each document on the command line with entity prefetching on
+   and off, and checks that the events and any error come out the same.
+   Then it fills the prefetch pool with jobs that block, so the job for
+   an entity in the next document is still queued when the parser gets
+   to it. The parser has to take it back and resolve the entity itself
+   instead of waiting.
+ */
+
+#include <locale.h>
+#include <string.h>
+
+#include "axing-xml-parser.h"
+
+/* The pool has four threads, so four jobs that block fill it */
+#define POOL_THREADS 4
+
+#define GATE_TYPE_RESOLVER gate_resolver_get_type ()
+G_DECLARE_FINAL_TYPE (GateResolver, gate_resolver, GATE, RESOLVER, AxingResolver)
+
+struct _GateResolver {
+    AxingResolver parent;
+};
+
+G_DEFINE_TYPE (GateResolver, gate_resolver, AXING_TYPE_RESOLVER);
+
+static GMutex    gate_mutex;
+static GCond     gate_cond;
+static gboolean  gate_open = FALSE;
+static int       gate_waiting = 0;
+static GThread  *main_thread;
+static int       main_resolves = 0;
+
+/* Links starting with "block" wait for the gate and then fail. Anything
+   else resolves like the default resolver, and is counted if it's on the
+   main thread.
+ */
+static AxingResource *
+gate_resolver_resolve (AxingResolver     *resolver,
+                       AxingResource     *base,
+                       const char        *xml_base,
+                       const char        *link,
+                       const char        *pubid,
+                       AxingResolverHint  hint,
+                       GCancellable      *cancellable,
+                       GError           **error)
+{
+    AxingResolver *real;
+    AxingResource *ret;
+
+    if (g_str_has_prefix (link, "block")) {
+        g_mutex_lock (&gate_mutex);
+        gate_waiting++;
+        g_cond_broadcast (&gate_cond);
+        while (!gate_open)
+            g_cond_wait (&gate_cond, &gate_mutex);
+        g_mutex_unlock (&gate_mutex);
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "Blocked %s", link);
+        return NULL;
+    }
+
+    if (g_thread_self () == main_thread)
+        g_atomic_int_inc (&main_resolves);
+    real = axing_resolver_get_default ();
+    ret = axing_resolver_resolve (real, base, xml_base, link, pubid, hint, cancellable, error);
+    g_object_unref (real);
+    return ret;
+}
+
+static void
+gate_resolver_init (GateResolver *resolver)
+{
+}
+
+static void
+gate_resolver_class_init (GateResolverClass *klass)
+{
+    AXING_RESOLVER_CLASS (klass)->resolve = gate_resolver_resolve;
+}
+
+/* Events as lines of text, ending with the error if there is one */
+static char *
+read_events (AxingXmlParser *parser)
+{
+    AxingReader *reader = AXING_READER (parser);
+    GString *ret = g_string_new (NULL);
+    GError *error = NULL;
+
+    while (axing_reader_read (reader, &error)) {
+        switch (axing_reader_get_node_type (reader)) {
+        case AXING_NODE_TYPE_ELEMENT: {
+            const char * const *attrs = axing_reader_get_attrs (reader);
+            int i;
+            g_string_append_printf (ret, "[ %s", axing_reader_get_qname (reader));
+            for (i = 0; attrs[i] != NULL; i++)
+                g_string_append_printf (ret, " %s=\"%s\"", attrs[i],
+                                        axing_reader_get_attr_value (reader, attrs[i]));
+            g_string_append_c (ret, '\n');
+            break;
+        }
+        case AXING_NODE_TYPE_END_ELEMENT:
+            g_string_append_printf (ret, "] %s\n", axing_reader_get_qname (reader));
+            break;
+        case AXING_NODE_TYPE_CONTENT:
+        case AXING_NODE_TYPE_CDATA:
+        case AXING_NODE_TYPE_COMMENT:
+            g_string_append_printf (ret, "%i %s\n", axing_reader_get_node_type (reader),
+                                    axing_reader_get_content (reader));
+            break;
+        case AXING_NODE_TYPE_INSTRUCTION:
+            g_string_append_printf (ret, "? %s %s\n", axing_reader_get_qname (reader),
+                                    axing_reader_get_content (reader));
+            break;
+        default:
+            break;
+        }
+    }
+    /* The parser owns the error it sets */
+    if (error != NULL)
+        g_string_append_printf (ret, "error %s %i\n",
+                                g_quark_to_string (error->domain), error->code);
+    return g_string_free (ret, FALSE);
+}
+
+static char *
+parse_file (const char    *path,
+            AxingResolver *resolver,
+            gboolean       prefetch)
+{
+    GFile *file = g_file_new_for_path (path);
+    AxingResource *resource = axing_resource_new (file, NULL);
+    AxingXmlParser *parser = axing_xml_parser_new (resource, resolver);
+    char *ret;
+
+    axing_xml_parser_set_prefetch_entities (parser, prefetch);
+    ret = read_events (parser);
+    g_object_unref (parser);
+    g_object_unref (resource);
+    g_object_unref (file);
+    return ret;
+}
+
+static int
+check_same (const char    *path,
+            AxingResolver *resolver)
+{
+    char *plain, *prefetched;
+    int ret = 0;
+
+    plain = parse_file (path, NULL, FALSE);
+    prefetched = parse_file (path, resolver, TRUE);
+    if (!g_str_equal (plain, prefetched)) {
+        g_print ("%s: expected\n%sgot\n%s", path, plain, prefetched);
+        ret = 1;
+    }
+    g_free (plain);
+    g_free (prefetched);
+    return ret;
+}
+
+/* Keeps the pool busy while path is parsed */
+static int
+check_queued (const char *path)
+{
+    AxingResolver *gate = g_object_new (GATE_TYPE_RESOLVER, NULL);
+    GString *xml = g_string_new ("<!DOCTYPE a [\n");
+    GBytes *bytes;
+    GInputStream *stream;
+    GFile *file;
+    AxingResource *resource;
+    AxingXmlParser *blocker;
+    GError *error = NULL;
+    int i, ret = 0;
+
+    for (i = 0; i < POOL_THREADS; i++)
+        g_string_append_printf (xml, "<!ENTITY b%i SYSTEM \"block%i\">\n", i, i);
+    g_string_append (xml, "]><a/>");
+    bytes = g_string_free_to_bytes (xml);
+    stream = g_memory_input_stream_new_from_bytes (bytes);
+    file = g_file_new_for_path (path);
+    resource = axing_resource_new (file, stream);
+    blocker = axing_xml_parser_new (resource, gate);
+    axing_xml_parser_set_prefetch_entities (blocker, TRUE);
+
+    /* The prefetch starts when the DOCTYPE closes */
+    axing_reader_read (AXING_READER (blocker), &error);
+    g_mutex_lock (&gate_mutex);
+    while (gate_waiting < POOL_THREADS)
+        g_cond_wait (&gate_cond, &gate_mutex);
+    g_mutex_unlock (&gate_mutex);
+
+    ret |= check_same (path, gate);
+    if (main_resolves == 0) {
+        g_print ("%s: waited for a queued prefetch\n", path);
+        ret = 1;
+    }
+
+    g_mutex_lock (&gate_mutex);
+    gate_open = TRUE;
+    g_cond_broadcast (&gate_cond);
+    g_mutex_unlock (&gate_mutex);
+
+    g_object_unref (blocker);
+    g_object_unref (resource);
+    g_object_unref (file);
+    g_object_unref (stream);
+    g_bytes_unref (bytes);
+    g_object_unref (gate);
+    return ret;
+}
+
+int
+main (int argc, char **argv)
+{
+    int i, retcode = 0;
+
+    setlocale(LC_ALL, "");
+    main_thread = g_thread_self ();
+
+    for (i = 1; i < argc; i++)
+        retcode |= check_same (argv[i], NULL);
+    retcode |= check_queued ("tests/xml/entities20.xml");
+    return retcode;
+}
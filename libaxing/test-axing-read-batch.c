@@ -0,0 +1,219 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+/* Checks that axing_reader_read_batch gives the same events as
+   axing_reader_read, starting with a single record so every element with
+   attributes hits G_IO_ERROR_NO_SPACE first. This runs against the
+   parser's own read_batch and against the default one, which
+   AxingXIncludeReader uses.
+ */
+
+#include <locale.h>
+#include <string.h>
+
+#include "axing-xinclude-reader.h"
+#include "axing-xml-parser.h"
+
+#define S(str) ((str) ? (str) : "")
+
+static AxingReader *
+new_reader (const char *filename,
+            gboolean    xinclude)
+{
+    GFile *file = g_file_new_for_path (filename);
+    AxingResource *resource = axing_resource_new (file, NULL);
+    AxingReader *reader;
+
+    if (xinclude)
+        reader = AXING_READER (axing_xinclude_reader_new (resource, NULL));
+    else
+        reader = AXING_READER (axing_xml_parser_new (resource, NULL));
+
+    g_object_unref (resource);
+    g_object_unref (file);
+    return reader;
+}
+
+/* Attributes have to come in the same order from both, so they're kept in
+   the order the reader gives them.
+ */
+static GPtrArray *
+read_events (AxingReader *reader)
+{
+    GPtrArray *events = g_ptr_array_new_with_free_func (g_free);
+    GError *error = NULL;
+
+    while (axing_reader_read (reader, &error)) {
+        AxingNodeType type = axing_reader_get_node_type (reader);
+        GString *str = g_string_new (NULL);
+        g_string_append_printf (str, "%i", type);
+        switch (type) {
+        case AXING_NODE_TYPE_ELEMENT:
+        case AXING_NODE_TYPE_END_ELEMENT:
+            g_string_append_printf (str, " %s {%s}",
+                                    axing_reader_get_localname (reader),
+                                    S(axing_reader_get_namespace (reader)));
+            if (type == AXING_NODE_TYPE_ELEMENT) {
+                const char * const *attrs = axing_reader_get_attrs (reader);
+                for (; *attrs != NULL; attrs++)
+                    g_string_append_printf (str, " @%s {%s} \"%s\"",
+                                            axing_reader_get_attr_localname (reader, *attrs),
+                                            S(axing_reader_get_attr_namespace (reader, *attrs)),
+                                            axing_reader_get_attr_value (reader, *attrs));
+            }
+            break;
+        case AXING_NODE_TYPE_INSTRUCTION:
+            g_string_append_printf (str, " %s", axing_reader_get_qname (reader));
+            /* fall through */
+        case AXING_NODE_TYPE_CONTENT:
+        case AXING_NODE_TYPE_COMMENT:
+        case AXING_NODE_TYPE_CDATA:
+            g_string_append_printf (str, " \"%s\"", axing_reader_get_content (reader));
+            break;
+        default:
+            break;
+        }
+        g_ptr_array_add (events, g_string_free (str, FALSE));
+    }
+    if (error != NULL) {
+        g_printerr ("%s\n", error->message);
+        g_error_free (error);
+    }
+    return events;
+}
+
+static GPtrArray *
+read_batch_events (AxingReader *reader)
+{
+    GPtrArray *events = g_ptr_array_new_with_free_func (g_free);
+    AxingNameTable *names = axing_reader_get_name_table (reader);
+    AxingEventRecord *records = g_new (AxingEventRecord, 1);
+    guint n_records = 1;
+
+    while (TRUE) {
+        GError *error = NULL;
+        guint count, i;
+
+        count = axing_reader_read_batch (reader, records, n_records, &error);
+        if (count == 0) {
+            if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NO_SPACE)) {
+                /* Grow and retry, which has to give us the same element */
+                g_clear_error (&error);
+                n_records *= 2;
+                records = g_renew (AxingEventRecord, records, n_records);
+                continue;
+            }
+            if (error != NULL) {
+                g_printerr ("%s\n", error->message);
+                g_error_free (error);
+            }
+            break;
+        }
+
+        for (i = 0; i < count; i++) {
+            AxingEventRecord *record = &(records[i]);
+            GString *str = g_string_new (NULL);
+            g_string_append_printf (str, "%i", record->type);
+            switch (record->type) {
+            case AXING_NODE_TYPE_ELEMENT:
+            case AXING_NODE_TYPE_END_ELEMENT: {
+                guint j;
+                if (record->text != NULL)
+                    g_string_append (str, " [text not NULL]");
+                g_string_append_printf (str, " %s {%s}",
+                                        axing_name_table_lookup (names, record->name_id),
+                                        S(axing_name_table_lookup (names, record->ns_id)));
+                for (j = 0; j < record->n_attrs; j++) {
+                    AxingEventRecord *attr = &(records[i + 1 + j]);
+                    g_string_append_printf (str, " @%s {%s} \"%s\"",
+                                            axing_name_table_lookup (names, attr->name_id),
+                                            S(axing_name_table_lookup (names, attr->ns_id)),
+                                            attr->text);
+                }
+                i += record->n_attrs;
+                break;
+            }
+            case AXING_NODE_TYPE_INSTRUCTION:
+                g_string_append_printf (str, " %s", axing_name_table_lookup (names, record->name_id));
+                /* fall through */
+            case AXING_NODE_TYPE_CONTENT:
+            case AXING_NODE_TYPE_COMMENT:
+            case AXING_NODE_TYPE_CDATA:
+                g_string_append_printf (str, " \"%s\"", record->text);
+                break;
+            default:
+                if (record->text != NULL)
+                    g_string_append (str, " [text not NULL]");
+                break;
+            }
+            g_ptr_array_add (events, g_string_free (str, FALSE));
+        }
+
+        /* Back down to one, so the next element overflows again */
+        n_records = 1;
+    }
+
+    g_free (records);
+    return events;
+}
+
+int
+main (int argc, char **argv)
+{
+    int i, retcode = 0;
+
+    setlocale(LC_ALL, "");
+
+    for (i = 1; i < argc; i++) {
+        int xinclude;
+        for (xinclude = 0; xinclude < 2; xinclude++) {
+            AxingReader *reader;
+            GPtrArray *expect, *got;
+            guint j;
+
+            reader = new_reader (argv[i], xinclude);
+            expect = read_events (reader);
+            g_object_unref (reader);
+
+            reader = new_reader (argv[i], xinclude);
+            got = read_batch_events (reader);
+            g_object_unref (reader);
+
+            for (j = 0; j < MAX (expect->len, got->len); j++) {
+                const char *e = j < expect->len ? expect->pdata[j] : "(none)";
+                const char *g = j < got->len ? got->pdata[j] : "(none)";
+                if (!g_str_equal (e, g)) {
+                    g_print ("%s (%s): event %u\n  expected: %s\n  got:      %s\n",
+                             argv[i], xinclude ? "default" : "parser", j, e, g);
+                    retcode = 1;
+                    break;
+                }
+            }
+
+            g_ptr_array_free (expect, TRUE);
+            g_ptr_array_free (got, TRUE);
+        }
+    }
+
+    return retcode;
+}
@@ -0,0 +1,241 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+/* Checks AxingResourceCache against files in a temporary directory. A hit
+   hands back the same GBytes that was stored, so comparing pointers tells
+   hits from misses. The cache holds 400 bytes, so a file can use at most
+   100, and four 100-byte files fill it.
+ */
+
+#include <locale.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "axing-resource-cache.h"
+
+#define MAX_BYTES 400
+
+static char *tmpdir;
+
+/* Modification times are set outright, so changes don't depend on the
+   clock moving between writes.
+ */
+static GFile *
+write_file (const char *name,
+            char        fill,
+            gsize       size,
+            guint64     mtime)
+{
+    char *path = g_build_filename (tmpdir, name, NULL);
+    char *contents = g_malloc (size);
+    GFile *file;
+
+    memset (contents, fill, size);
+    g_file_set_contents (path, contents, size, NULL);
+    file = g_file_new_for_path (path);
+    g_file_set_attribute_uint64 (file, G_FILE_ATTRIBUTE_TIME_MODIFIED, mtime,
+                                 G_FILE_QUERY_INFO_NONE, NULL, NULL);
+    g_file_set_attribute_uint32 (file, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC, 0,
+                                 G_FILE_QUERY_INFO_NONE, NULL, NULL);
+    g_free (contents);
+    g_free (path);
+    return file;
+}
+
+/* Looks file up, and checks whether it hit and what it got. With prev
+   NULL, it has to miss. Otherwise it has to hit if hit is set, and miss
+   if it isn't. Returns the new bytes, or NULL on failure.
+ */
+static GBytes *
+lookup (AxingResourceCache *cache,
+        GFile              *file,
+        GBytes             *prev,
+        gboolean            hit,
+        char                fill,
+        gsize               size,
+        int                *ret)
+{
+    GError *error = NULL;
+    GBytes *bytes;
+    const char *data;
+    gsize len, i;
+    char *name = g_file_get_basename (file);
+
+    bytes = axing_resource_cache_lookup (cache, file, NULL, &error);
+    if (bytes == NULL) {
+        g_print ("%s: %s\n", name, error ? error->message : "not cached");
+        g_clear_error (&error);
+        g_free (name);
+        *ret = 1;
+        return NULL;
+    }
+    if ((prev == bytes) != (prev != NULL && hit)) {
+        g_print ("%s: expected a %s\n", name, prev != NULL && hit ? "hit" : "miss");
+        *ret = 1;
+    }
+    data = g_bytes_get_data (bytes, &len);
+    for (i = 0; i < len && data[i] == fill; i++);
+    if (len != size || i != len) {
+        g_print ("%s: wrong content\n", name);
+        *ret = 1;
+    }
+    g_free (name);
+    return bytes;
+}
+
+static int
+check_lru (AxingResourceCache *cache)
+{
+    GFile *a, *b, *c, *d, *e;
+    GBytes *ba, *bb, *bc, *bd, *be, *bytes;
+    int ret = 0;
+
+    a = write_file ("a", 'a', 100, 1000000000);
+    b = write_file ("b", 'b', 100, 1000000000);
+    c = write_file ("c", 'c', 100, 1000000000);
+    d = write_file ("d", 'd', 100, 1000000000);
+    e = write_file ("e", 'e', 100, 1000000000);
+
+    /* Fills the cache, then a is used again. Oldest first: b c d a */
+    ba = lookup (cache, a, NULL, FALSE, 'a', 100, &ret);
+    bb = lookup (cache, b, NULL, FALSE, 'b', 100, &ret);
+    bc = lookup (cache, c, NULL, FALSE, 'c', 100, &ret);
+    bd = lookup (cache, d, NULL, FALSE, 'd', 100, &ret);
+    bytes = lookup (cache, a, ba, TRUE, 'a', 100, &ret);
+    g_bytes_unref (bytes);
+    bytes = lookup (cache, b, bb, TRUE, 'b', 100, &ret);
+    g_bytes_unref (bytes);
+
+    /* Oldest first: c d a b. Adding e pushes out c, and nothing else. */
+    be = lookup (cache, e, NULL, FALSE, 'e', 100, &ret);
+    bytes = lookup (cache, d, bd, TRUE, 'd', 100, &ret);
+    g_bytes_unref (bytes);
+    bytes = lookup (cache, a, ba, TRUE, 'a', 100, &ret);
+    g_bytes_unref (bytes);
+    bytes = lookup (cache, b, bb, TRUE, 'b', 100, &ret);
+    g_bytes_unref (bytes);
+    bytes = lookup (cache, e, be, TRUE, 'e', 100, &ret);
+    g_bytes_unref (bytes);
+    bytes = lookup (cache, c, bc, FALSE, 'c', 100, &ret);
+    g_bytes_unref (bytes);
+
+    g_bytes_unref (ba);
+    g_bytes_unref (bb);
+    g_bytes_unref (bc);
+    g_bytes_unref (bd);
+    g_bytes_unref (be);
+    g_object_unref (a);
+    g_object_unref (b);
+    g_object_unref (c);
+    g_object_unref (d);
+    g_object_unref (e);
+    return ret;
+}
+
+/* Anything over max_bytes/4 is left to be streamed */
+static int
+check_cap (AxingResourceCache *cache)
+{
+    GFile *big;
+    GBytes *bytes;
+    GError *error = NULL;
+    int ret = 0;
+
+    big = write_file ("big", 'x', MAX_BYTES / 4 + 1, 1000000000);
+    bytes = axing_resource_cache_lookup (cache, big, NULL, &error);
+    if (bytes != NULL || error != NULL) {
+        g_print ("big: expected to be left uncached\n");
+        ret = 1;
+    }
+    if (bytes != NULL)
+        g_bytes_unref (bytes);
+    g_clear_error (&error);
+    g_object_unref (big);
+    return ret;
+}
+
+/* Same size with a new time, then a new size with the same time */
+static int
+check_changes (AxingResourceCache *cache)
+{
+    GFile *file;
+    GBytes *first, *second, *bytes;
+    int ret = 0;
+
+    file = write_file ("f", '1', 50, 1000000000);
+    first = lookup (cache, file, NULL, FALSE, '1', 50, &ret);
+    g_object_unref (file);
+
+    file = write_file ("f", '2', 50, 1000000100);
+    second = lookup (cache, file, first, FALSE, '2', 50, &ret);
+    bytes = lookup (cache, file, second, TRUE, '2', 50, &ret);
+    g_bytes_unref (bytes);
+    g_object_unref (file);
+
+    file = write_file ("f", '3', 60, 1000000100);
+    bytes = lookup (cache, file, second, FALSE, '3', 60, &ret);
+    g_bytes_unref (bytes);
+    g_object_unref (file);
+
+    g_bytes_unref (first);
+    g_bytes_unref (second);
+    return ret;
+}
+
+static void
+remove_dir (const char *path)
+{
+    GDir *dir = g_dir_open (path, 0, NULL);
+    const char *name;
+
+    while (dir && (name = g_dir_read_name (dir)) != NULL) {
+        char *child = g_build_filename (path, name, NULL);
+        g_unlink (child);
+        g_free (child);
+    }
+    if (dir)
+        g_dir_close (dir);
+    g_rmdir (path);
+}
+
+int
+main (int argc, char **argv)
+{
+    AxingResourceCache *cache;
+    int retcode = 0;
+
+    setlocale(LC_ALL, "");
+
+    tmpdir = g_dir_make_tmp ("axing-resource-cache-XXXXXX", NULL);
+    cache = axing_resource_cache_new (MAX_BYTES);
+
+    retcode |= check_lru (cache);
+    axing_resource_cache_clear (cache);
+    retcode |= check_cap (cache);
+    retcode |= check_changes (cache);
+
+    g_object_unref (cache);
+    remove_dir (tmpdir);
+    g_free (tmpdir);
+    return retcode;
+}
@@ -0,0 +1,223 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+/* Reads each file on the command line with axing_resource_read_async,
+   with and without a default resource cache, and checks that the stream
+   has the file's content and is kept by the resource. Then checks that a
+   cancelled read and a missing file fail in the callback without leaving
+   a stream on the resource.
+ */
+
+#include <locale.h>
+#include <string.h>
+
+#include "axing-resource.h"
+#include "axing-resource-cache.h"
+
+typedef struct {
+    GInputStream *stream;
+    GError       *error;
+} ReadData;
+
+static GMainLoop *loop;
+
+static void
+read_cb (GObject      *source,
+         GAsyncResult *res,
+         gpointer      user_data)
+{
+    ReadData *data = user_data;
+
+    data->stream = axing_resource_read_finish (AXING_RESOURCE (source), res,
+                                               &(data->error));
+    g_main_loop_quit (loop);
+}
+
+/* Runs the main loop until the read finishes */
+static void
+read_resource (AxingResource *resource,
+               GCancellable  *cancellable,
+               ReadData      *data)
+{
+    data->stream = NULL;
+    data->error = NULL;
+    axing_resource_read_async (resource, cancellable, read_cb, data);
+    g_main_loop_run (loop);
+}
+
+static GBytes *
+read_all (GInputStream *stream)
+{
+    GByteArray *array = g_byte_array_new ();
+    guint8 buf[4096];
+    gssize len;
+
+    while ((len = g_input_stream_read (stream, buf, sizeof (buf), NULL, NULL)) > 0)
+        g_byte_array_append (array, buf, len);
+    if (len < 0) {
+        g_byte_array_unref (array);
+        return NULL;
+    }
+    return g_byte_array_free_to_bytes (array);
+}
+
+static int
+check_read (const char *path,
+            gboolean    cached)
+{
+    GFile *file;
+    AxingResource *resource;
+    ReadData data;
+    GInputStream *stream = NULL;
+    GBytes *bytes = NULL;
+    char *contents = NULL;
+    gsize len;
+    int ret = 0;
+
+    file = g_file_new_for_path (path);
+    resource = axing_resource_new (file, NULL);
+
+    read_resource (resource, NULL, &data);
+    if (data.stream == NULL) {
+        g_print ("%s: %s\n", path, data.error->message);
+        g_error_free (data.error);
+        ret = 1;
+        goto done;
+    }
+    stream = data.stream;
+    if (axing_resource_get_input_stream (resource) != stream) {
+        g_print ("%s: stream not kept by resource\n", path);
+        ret = 1;
+    }
+    if (cached != (axing_resource_get_bytes (resource) != NULL)) {
+        g_print ("%s: expected %s\n", path, cached ? "cached bytes" : "no bytes");
+        ret = 1;
+    }
+
+    /* A second read hands back the same stream */
+    read_resource (resource, NULL, &data);
+    if (data.stream != stream) {
+        g_print ("%s: second read returned a different stream\n", path);
+        ret = 1;
+    }
+    g_clear_object (&(data.stream));
+    g_clear_error (&(data.error));
+
+    g_file_get_contents (path, &contents, &len, NULL);
+    bytes = read_all (stream);
+    if (bytes == NULL || g_bytes_get_size (bytes) != len ||
+        memcmp (g_bytes_get_data (bytes, NULL), contents, len) != 0) {
+        g_print ("%s: stream content differs from file\n", path);
+        ret = 1;
+    }
+
+ done:
+    if (bytes)
+        g_bytes_unref (bytes);
+    g_free (contents);
+    g_clear_object (&stream);
+    g_object_unref (resource);
+    g_object_unref (file);
+    return ret;
+}
+
+/* Both have to fail through the callback and leave the resource unread */
+static int
+check_errors (const char *path)
+{
+    GFile *file;
+    AxingResource *resource;
+    GCancellable *cancellable;
+    ReadData data;
+    int ret = 0;
+
+    file = g_file_new_for_path (path);
+    resource = axing_resource_new (file, NULL);
+    cancellable = g_cancellable_new ();
+    g_cancellable_cancel (cancellable);
+    read_resource (resource, cancellable, &data);
+    if (data.stream != NULL ||
+        !g_error_matches (data.error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        g_print ("%s: expected cancelled\n", path);
+        ret = 1;
+    }
+    if (axing_resource_get_input_stream (resource) != NULL) {
+        g_print ("%s: cancelled read left a stream\n", path);
+        ret = 1;
+    }
+    g_clear_object (&(data.stream));
+    g_clear_error (&(data.error));
+    g_object_unref (cancellable);
+    g_object_unref (resource);
+    g_object_unref (file);
+
+    file = g_file_new_for_path ("tests/nonexistent.xml");
+    resource = axing_resource_new (file, NULL);
+    read_resource (resource, NULL, &data);
+    if (data.stream != NULL ||
+        !g_error_matches (data.error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND)) {
+        g_print ("tests/nonexistent.xml: expected not found\n");
+        ret = 1;
+    }
+    if (axing_resource_get_input_stream (resource) != NULL) {
+        g_print ("tests/nonexistent.xml: failed read left a stream\n");
+        ret = 1;
+    }
+    g_clear_object (&(data.stream));
+    g_clear_error (&(data.error));
+    g_object_unref (resource);
+    g_object_unref (file);
+    return ret;
+}
+
+int
+main (int argc, char **argv)
+{
+    AxingResourceCache *cache;
+    int i;
+    int retcode = 0;
+
+    setlocale(LC_ALL, "");
+
+    if (argc < 2) {
+        g_printerr ("Usage: test-axing-resource FILE...\n");
+        return 1;
+    }
+
+    loop = g_main_loop_new (NULL, FALSE);
+
+    for (i = 1; i < argc; i++)
+        retcode |= check_read (argv[i], FALSE);
+
+    cache = axing_resource_cache_new (0);
+    axing_resource_cache_set_default (cache);
+    for (i = 1; i < argc; i++)
+        retcode |= check_read (argv[i], TRUE);
+    axing_resource_cache_set_default (NULL);
+    g_object_unref (cache);
+
+    retcode |= check_errors (argv[1]);
+
+    g_main_loop_unref (loop);
+    return retcode;
+}
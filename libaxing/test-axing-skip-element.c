@@ -0,0 +1,155 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+/* Usage: test-axing-skip-element MODE NAME FILE
+
+   Reads FILE and calls axing_reader_skip_element with MODE, either
+   well-formed or balanced, on every element called NAME. Prints the
+   events it gets, with a "-" line where it skipped. Also checks that
+   each skip lands on the END_ELEMENT of the element it started from.
+ */
+
+#include <locale.h>
+#include <string.h>
+
+#include "axing-xml-parser.h"
+
+static int indent = 0;
+
+static void
+print_event (AxingReader *reader,
+             const char  *mark)
+{
+    AxingNodeType type = axing_reader_get_node_type (reader);
+    char *encval;
+    int i;
+
+    for (i = 0; i < indent; i++)
+        g_print ("  ");
+    if (type == AXING_NODE_TYPE_ELEMENT || type == AXING_NODE_TYPE_END_ELEMENT) {
+        g_print ("%s %s %" G_GINT64_FORMAT ":%" G_GINT64_FORMAT "\n",
+                 mark, axing_reader_get_qname (reader),
+                 axing_reader_get_linenum (reader),
+                 axing_reader_get_colnum (reader));
+        return;
+    }
+    encval = g_uri_escape_string (axing_reader_get_content (reader), NULL, FALSE);
+    if (type == AXING_NODE_TYPE_INSTRUCTION)
+        g_print ("%s %s %s\n", mark, axing_reader_get_qname (reader), encval);
+    else
+        g_print ("%s %s\n", mark, encval);
+    g_free (encval);
+}
+
+int
+main (int argc, char **argv)
+{
+    GFile *file;
+    AxingResource *resource;
+    AxingXmlParser *parser;
+    AxingReader *reader;
+    AxingSkipMode mode;
+    const char *name;
+    GError *error = NULL;
+    int retcode = 0;
+    int i;
+
+    setlocale(LC_ALL, "");
+
+    if (argc != 4) {
+        g_printerr ("Usage: test-axing-skip-element MODE NAME FILE\n");
+        return 1;
+    }
+    if (g_str_equal (argv[1], "well-formed"))
+        mode = AXING_SKIP_MODE_WELL_FORMED;
+    else if (g_str_equal (argv[1], "balanced"))
+        mode = AXING_SKIP_MODE_BALANCED;
+    else {
+        g_printerr ("Unknown skip mode %s\n", argv[1]);
+        return 1;
+    }
+    name = argv[2];
+
+    file = g_file_new_for_commandline_arg (argv[3]);
+    resource = axing_resource_new (file, NULL);
+    parser = axing_xml_parser_new (resource, NULL);
+    reader = AXING_READER (parser);
+    g_object_unref (resource);
+    g_object_unref (file);
+
+    while (axing_reader_read (reader, &error)) {
+        switch (axing_reader_get_node_type (reader)) {
+        case AXING_NODE_TYPE_ELEMENT:
+            print_event (reader, "[");
+            if (g_str_equal (axing_reader_get_qname (reader), name)) {
+                for (i = 0; i < indent; i++)
+                    g_print ("  ");
+                g_print ("- %s\n", name);
+                if (!axing_reader_skip_element (reader, mode, &error))
+                    break;
+                if (axing_reader_get_node_type (reader) != AXING_NODE_TYPE_END_ELEMENT ||
+                    !g_str_equal (axing_reader_get_qname (reader), name)) {
+                    g_print ("skip: did not land on the end of %s\n", name);
+                    retcode = 1;
+                }
+                print_event (reader, "]");
+            }
+            else {
+                indent++;
+            }
+            break;
+        case AXING_NODE_TYPE_END_ELEMENT:
+            indent--;
+            print_event (reader, "]");
+            break;
+        case AXING_NODE_TYPE_CONTENT:
+            print_event (reader, "#");
+            break;
+        case AXING_NODE_TYPE_INSTRUCTION:
+            print_event (reader, "?");
+            break;
+        case AXING_NODE_TYPE_COMMENT:
+            print_event (reader, "!");
+            break;
+        case AXING_NODE_TYPE_CDATA:
+            print_event (reader, "*");
+            break;
+        default:
+            break;
+        }
+        if (error != NULL)
+            break;
+    }
+
+    /* The parser owns the error */
+    if (error) {
+        retcode = 1;
+        g_print ("error: %s\n", error->message);
+    }
+    else {
+        g_print ("finish\n");
+    }
+
+    g_object_unref (parser);
+    return retcode;
+}
@@ -21,9 +21,51 @@
  */
 
 #include <locale.h>
+#include <string.h>
 
 #include "axing-utils.h"
 
+/* The examples from RFC 3986 section 5.4, all against this base */
+static const char *bench_base = "http://a/b/c/d;p?q";
+static const char *bench_links[] = {
+    "g:h", "g", "./g", "g/", "/g", "//g", "?y", "g?y", "#s", "g#s",
+    "g?y#s", ";x", "g;x", "g;x?y#s", "", ".", "./", "..", "../", "../g",
+    "../..", "../../", "../../g", "../../../g", "../../../../g", "/./g",
+    "/../g", "g.", ".g", "g..", "..g", "./../g", "./g/.", "g/./h", "g/../h",
+    "g;x=1/./y", "g;x=1/../y", "g?y/./x", "g?y/../x", "g#s/./x", "g#s/../x",
+    NULL
+};
+
+static void
+benchmark (void)
+{
+    GTimer *timer;
+    char buf[256];
+    int i, j, count = 100000;
+    gdouble elapsed;
+
+    timer = g_timer_new ();
+    for (i = 0; i < count; i++) {
+        for (j = 0; bench_links[j] != NULL; j++) {
+            char *result = axing_uri_resolve_relative (bench_base, bench_links[j]);
+            g_free (result);
+        }
+    }
+    elapsed = g_timer_elapsed (timer, NULL);
+    g_print ("axing_uri_resolve_relative:     %.3fs\n", elapsed);
+
+    g_timer_start (timer);
+    for (i = 0; i < count; i++) {
+        for (j = 0; bench_links[j] != NULL; j++)
+            axing_uri_resolve_relative_buf (bench_base, bench_links[j],
+                                            buf, sizeof (buf), NULL);
+    }
+    elapsed = g_timer_elapsed (timer, NULL);
+    g_print ("axing_uri_resolve_relative_buf: %.3fs\n", elapsed);
+
+    g_timer_destroy (timer);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -33,7 +75,11 @@ main (int argc, char **argv)
 
     errcode = 1;
 
-    if (argc > 2) {
+    if (argc > 1 && g_str_equal (argv[1], "--benchmark")) {
+        benchmark ();
+        return 0;
+    }
+    else if (argc > 2) {
         char *result = axing_uri_resolve_relative (argv[1], argv[2]);
         g_print ("%s\n", result);
         g_free (result);
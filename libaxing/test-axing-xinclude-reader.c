@@ -0,0 +1,120 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+/* Prints the events an AxingXIncludeReader makes for each document given,
+   in the shape of test-axing-xml-parser-sync's output, and returns nonzero
+   if any document fails. Errors are printed by code, since the messages
+   have absolute URIs in them.
+ */
+
+#include <locale.h>
+
+#include "axing-xinclude-reader.h"
+
+static const char *codes[] = { "syntax", "resource", "recursion" };
+
+static int
+print_events (const char *path)
+{
+    GFile *file;
+    AxingResource *resource;
+    AxingXIncludeReader *xinc;
+    AxingReader *reader;
+    GError *error = NULL;
+    int i, indent = 0;
+    char *encval;
+
+    file = g_file_new_for_commandline_arg (path);
+    resource = axing_resource_new (file, NULL);
+    xinc = axing_xinclude_reader_new (resource, NULL);
+    reader = AXING_READER (xinc);
+    g_object_unref (resource);
+    g_object_unref (file);
+
+    while (axing_reader_read (reader, &error)) {
+        switch (axing_reader_get_node_type (reader)) {
+        case AXING_NODE_TYPE_ELEMENT:
+            for (i = 0; i < indent; i++) g_print ("  ");
+            indent++;
+            g_print ("[ %s\n", axing_reader_get_qname (reader));
+            break;
+        case AXING_NODE_TYPE_END_ELEMENT:
+            indent--;
+            for (i = 0; i < indent; i++) g_print ("  ");
+            g_print ("] %s\n", axing_reader_get_qname (reader));
+            break;
+        case AXING_NODE_TYPE_CONTENT:
+            for (i = 0; i < indent; i++) g_print ("  ");
+            encval = g_uri_escape_string (axing_reader_get_content (reader), NULL, FALSE);
+            g_print ("# %s\n", encval);
+            g_free (encval);
+            break;
+        case AXING_NODE_TYPE_INSTRUCTION:
+            for (i = 0; i < indent; i++) g_print ("  ");
+            encval = g_uri_escape_string (axing_reader_get_content (reader), NULL, FALSE);
+            g_print ("? %s %s\n", axing_reader_get_qname (reader), encval);
+            g_free (encval);
+            break;
+        case AXING_NODE_TYPE_COMMENT:
+            for (i = 0; i < indent; i++) g_print ("  ");
+            encval = g_uri_escape_string (axing_reader_get_content (reader), NULL, FALSE);
+            g_print ("! %s\n", encval);
+            g_free (encval);
+            break;
+        case AXING_NODE_TYPE_CDATA:
+            for (i = 0; i < indent; i++) g_print ("  ");
+            encval = g_uri_escape_string (axing_reader_get_content (reader), NULL, FALSE);
+            g_print ("* %s\n", encval);
+            g_free (encval);
+            break;
+        default:
+            break;
+        }
+    }
+
+    g_object_unref (xinc);
+
+    if (error != NULL) {
+        if (error->domain == AXING_XINCLUDE_READER_ERROR && error->code >= 0 &&
+            error->code < (int) G_N_ELEMENTS (codes))
+            g_print ("error: %s\n", codes[error->code]);
+        else
+            g_print ("error: %s\n", error->message);
+        g_error_free (error);
+        return 1;
+    }
+    g_print ("finish\n");
+    return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+    int i, retcode = 0;
+
+    setlocale(LC_ALL, "");
+
+    for (i = 1; i < argc; i++)
+        retcode |= print_events (argv[i]);
+    return retcode;
+}
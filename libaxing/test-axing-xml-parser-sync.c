@@ -55,7 +55,7 @@ main (int argc, char **argv)
       case AXING_NODE_TYPE_ELEMENT:
         for (i = 0; i < indent; i++) g_print ("  ");
         indent++;
-        g_print ("[ %s %s|%s (%s) %s %i:%i\n",
+        g_print ("[ %s %s|%s (%s) %s %" G_GINT64_FORMAT ":%" G_GINT64_FORMAT "\n",
                  axing_reader_get_qname (reader),
                  axing_reader_get_prefix (reader),
                  axing_reader_get_localname (reader),
@@ -68,7 +68,7 @@ main (int argc, char **argv)
           for (i = 0; i < indent; i++) g_print ("  ");
           encval = g_uri_escape_string (axing_reader_get_attr_value (reader, *attrs),
                                         NULL, FALSE);
-          g_print ("@ %s %s|%s (%s) %s %i:%i \"%s\"\n",
+          g_print ("@ %s %s|%s (%s) %s %" G_GINT64_FORMAT ":%" G_GINT64_FORMAT " \"%s\"\n",
                    *attrs,
                    axing_reader_get_attr_prefix (reader, *attrs),
                    axing_reader_get_attr_localname (reader, *attrs),
@@ -84,7 +84,7 @@ main (int argc, char **argv)
       case AXING_NODE_TYPE_END_ELEMENT:
         indent--;
         for (i = 0; i < indent; i++) g_print ("  ");
-        g_print ("] %s %s|%s (%s) %s %i:%i\n",
+        g_print ("] %s %s|%s (%s) %s %" G_GINT64_FORMAT ":%" G_GINT64_FORMAT "\n",
                  axing_reader_get_qname (reader),
                  axing_reader_get_prefix (reader),
                  axing_reader_get_localname (reader),
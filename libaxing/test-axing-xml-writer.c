@@ -0,0 +1,188 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * Copyright (C) 2020 Shaun McCance  <shaunm@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ * Author: Shaun McCance  <shaunm@gnome.org>
+ */
+
+
+/* Checks what AxingXmlWriter makes of escaping, namespace declarations,
+   and elements copied from a parser's source.
+ */
+
+#include <locale.h>
+#include <string.h>
+
+#include "axing-xml-parser.h"
+#include "axing-xml-writer.h"
+
+static int
+check_bytes (AxingXmlWriter *writer,
+             const char     *what,
+             const char     *expected)
+{
+    GBytes *bytes = axing_xml_writer_steal_bytes (writer);
+    gsize size;
+    const char *data = g_bytes_get_data (bytes, &size);
+    int ret = 0;
+
+    if (size != strlen (expected) || memcmp (data, expected, size) != 0) {
+        g_print ("%s: expected\n  %s\ngot\n  %.*s\n", what, expected, (int) size, data);
+        ret = 1;
+    }
+    g_bytes_unref (bytes);
+    return ret;
+}
+
+static int
+check_escape (void)
+{
+    AxingXmlWriter *writer = axing_xml_writer_new (NULL);
+    int ret;
+
+    axing_xml_writer_start_element (writer, "e", NULL, NULL);
+    axing_xml_writer_write_attribute (writer, "a", NULL, "<\"&\t\n\r>", NULL);
+    axing_xml_writer_write_content (writer, "0123456789abcdef&<>\r'\"\n", -1, NULL);
+    axing_xml_writer_write_cdata (writer, "a]]>b", NULL);
+    axing_xml_writer_end_element (writer, NULL);
+
+    ret = check_bytes (writer, "escape",
+                       "<e a=\"&lt;&quot;&amp;&#9;&#10;&#13;&gt;\">"
+                       "0123456789abcdef&amp;&lt;&gt;&#13;'\"\n"
+                       "<![CDATA[a]]]]><![CDATA[>b]]></e>");
+    g_object_unref (writer);
+    return ret;
+}
+
+static void
+write_namespaces (AxingXmlWriter *writer)
+{
+    axing_xml_writer_start_element (writer, "p:a", "urn:p", NULL);
+    axing_xml_writer_start_element (writer, "p:b", "urn:p", NULL);
+    axing_xml_writer_write_attribute (writer, "q:x", "urn:q", "1", NULL);
+    axing_xml_writer_start_element (writer, "d", "urn:d", NULL);
+    axing_xml_writer_start_element (writer, "e", NULL, NULL);
+    axing_xml_writer_start_element (writer, "p:b", "urn:other", NULL);
+    axing_xml_writer_end_element (writer, NULL);
+    axing_xml_writer_end_element (writer, NULL);
+    axing_xml_writer_end_element (writer, NULL);
+    axing_xml_writer_end_element (writer, NULL);
+    axing_xml_writer_end_element (writer, NULL);
+}
+
+static int
+check_namespaces (void)
+{
+    AxingXmlWriter *writer = axing_xml_writer_new (NULL);
+    int ret;
+
+    write_namespaces (writer);
+    ret = check_bytes (writer, "namespaces",
+                       "<p:a xmlns:p=\"urn:p\"><p:b xmlns:q=\"urn:q\" q:x=\"1\">"
+                       "<d xmlns=\"urn:d\"><e xmlns=\"\"><p:b xmlns:p=\"urn:other\"/>"
+                       "</e></d></p:b></p:a>");
+
+    axing_xml_writer_set_minimize_ns (writer, FALSE);
+    write_namespaces (writer);
+    ret |= check_bytes (writer, "unminimized namespaces",
+                        "<p:a xmlns:p=\"urn:p\"><p:b xmlns:p=\"urn:p\" xmlns:q=\"urn:q\" q:x=\"1\">"
+                        "<d xmlns=\"urn:d\"><e xmlns=\"\"><p:b xmlns:p=\"urn:other\"/>"
+                        "</e></d></p:b></p:a>");
+    g_object_unref (writer);
+    return ret;
+}
+
+/* The copied elements use a prefix and a default namespace from their
+   parent, which the copies have to declare. keep also uses an entity
+   from the DTD, which doesn't come along, so it's copied up to there and
+   written from events after. whole is copied as it is, declarations
+   inside it and all, except for the ones added to its start tag. Inside
+   out, which already has the default namespace, only the prefix needs
+   declaring.
+ */
+static const char copy_source[] =
+    "<!DOCTYPE doc [<!ENTITY ent \"E&amp;\">]>\n"
+    "<doc xmlns=\"urn:d\" xmlns:p=\"urn:p\"><skip/><keep>"
+    "<p:a p:x=\"1\">t &lt; &ent; u</p:a><b>plain &amp; text<!-- c --></b>"
+    "</keep><whole  x='1'><p:c>a &amp; b&#33;</p:c><!-- c --><?pi x?>"
+    "<q:e xmlns:q=\"urn:q\" q:y=\"2\"/><![CDATA[<&>]]></whole></doc>\n";
+
+#define WHOLE "<p:c>a &amp; b&#33;</p:c><!-- c --><?pi x?>" \
+              "<q:e xmlns:q=\"urn:q\" q:y=\"2\"/><![CDATA[<&>]]></whole>"
+
+static int
+check_copy (void)
+{
+    AxingXmlWriter *writer = axing_xml_writer_new (NULL);
+    GBytes *source = g_bytes_new_static (copy_source, strlen (copy_source));
+    GInputStream *stream = g_memory_input_stream_new_from_bytes (source);
+    GFile *file = g_file_new_for_path ("test-axing-xml-writer.xml");
+    AxingResource *resource = axing_resource_new (file, stream);
+    AxingXmlParser *parser = axing_xml_parser_new (resource, NULL);
+    AxingReader *reader = AXING_READER (parser);
+    GError *error = NULL;
+    int ret = 0;
+
+    axing_xml_writer_set_source (writer, source);
+    while (axing_reader_read (reader, &error)) {
+        if (axing_reader_get_node_type (reader) == AXING_NODE_TYPE_ELEMENT &&
+            g_str_equal (axing_reader_get_qname (reader), "whole")) {
+            axing_xml_writer_start_element (writer, "out", "urn:d", NULL);
+            if (!axing_xml_writer_copy_element (writer, parser, &error))
+                break;
+            axing_xml_writer_end_element (writer, NULL);
+        }
+        else if (axing_reader_get_node_type (reader) == AXING_NODE_TYPE_ELEMENT &&
+                 g_str_equal (axing_reader_get_qname (reader), "keep") &&
+                 !axing_xml_writer_copy_element (writer, parser, &error))
+            break;
+    }
+    if (error != NULL) {
+        g_print ("copy: %s\n", error->message);
+        g_error_free (error);
+        ret = 1;
+    }
+    else {
+        ret = check_bytes (writer, "copy",
+                           "<keep xmlns=\"urn:d\" xmlns:p=\"urn:p\"><p:a p:x=\"1\">"
+                           "t &lt; E&amp; u</p:a><b>plain &amp; text<!-- c --></b></keep>"
+                           "<out xmlns=\"urn:d\"><whole xmlns:p=\"urn:p\"  x='1'>"
+                           WHOLE "</out>");
+    }
+
+    g_object_unref (parser);
+    g_object_unref (resource);
+    g_object_unref (file);
+    g_object_unref (stream);
+    g_bytes_unref (source);
+    g_object_unref (writer);
+    return ret;
+}
+
+int
+main (int argc, char **argv)
+{
+    int retcode = 0;
+
+    setlocale(LC_ALL, "");
+
+    retcode |= check_escape ();
+    retcode |= check_namespaces ();
+    retcode |= check_copy ();
+    return retcode;
+}
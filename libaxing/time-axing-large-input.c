@@ -0,0 +1,189 @@
+#include <locale.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include "axing-xml-parser.h"
+#include "axing-reader.h"
+
+/* Streams a synthetic document of a few gigabytes through the parser and
+   checks the positions of the final end tag. The document is generated on
+   the fly, so nothing touches the disk, and the parser only ever holds one
+   line at a time. Usage:
+
+     time-axing-large-input [GIGABYTES] [RECORDS_PER_LINE]
+
+   Long lines are the interesting case for column numbers, but the parser
+   reads a whole line into memory, so RECORDS_PER_LINE is what bounds it.
+ */
+
+#define LARGE_TYPE_STREAM large_stream_get_type ()
+G_DECLARE_FINAL_TYPE (LargeStream, large_stream, LARGE, STREAM, GInputStream)
+
+struct _LargeStream {
+  GInputStream parent;
+
+  guint64 target;
+  guint   per_line;
+
+  guint64 offset;
+  gint64  lines;   /* completed lines */
+  guint64 records;
+  gboolean footer;
+
+  char    buf[256];
+  gsize   buflen;
+  gsize   bufpos;
+};
+
+G_DEFINE_TYPE (LargeStream, large_stream, G_TYPE_INPUT_STREAM);
+
+#define HEADER "<?xml version=\"1.0\"?>\n<log>\n"
+#define FOOTER "</log>\n"
+
+static void
+large_stream_fill (LargeStream *stream)
+{
+  if (stream->footer) {
+    stream->buflen = 0;
+  }
+  else if (stream->offset == 0) {
+    stream->buflen = strlen (HEADER);
+    memcpy (stream->buf, HEADER, stream->buflen);
+    stream->lines = 2;
+  }
+  else if (stream->offset >= stream->target && stream->records % stream->per_line == 0) {
+    stream->buflen = strlen (FOOTER);
+    memcpy (stream->buf, FOOTER, stream->buflen);
+    stream->footer = TRUE;
+  }
+  else {
+    stream->records++;
+    stream->buflen = g_snprintf (stream->buf, sizeof (stream->buf),
+                                 "<entry n=\"%" G_GUINT64_FORMAT "\" level=\"info\">"
+                                 "The quick brown fox &amp; the lazy dog</entry>%s",
+                                 stream->records,
+                                 stream->records % stream->per_line == 0 ? "\n" : "");
+    if (stream->records % stream->per_line == 0)
+      stream->lines++;
+  }
+  stream->bufpos = 0;
+}
+
+static gssize
+large_stream_read (GInputStream  *input,
+                   void          *buffer,
+                   gsize          count,
+                   GCancellable  *cancellable,
+                   GError       **error)
+{
+  LargeStream *stream = LARGE_STREAM (input);
+  gsize nread = 0;
+
+  while (nread < count) {
+    gsize len;
+    if (stream->bufpos == stream->buflen) {
+      large_stream_fill (stream);
+      if (stream->buflen == 0)
+        break;
+    }
+    len = MIN (count - nread, stream->buflen - stream->bufpos);
+    memcpy ((char *) buffer + nread, stream->buf + stream->bufpos, len);
+    stream->bufpos += len;
+    stream->offset += len;
+    nread += len;
+  }
+
+  return nread;
+}
+
+static gboolean
+large_stream_close (GInputStream  *input,
+                    GCancellable  *cancellable,
+                    GError       **error)
+{
+  return TRUE;
+}
+
+static void
+large_stream_init (LargeStream *stream)
+{
+}
+
+static void
+large_stream_class_init (LargeStreamClass *klass)
+{
+  GInputStreamClass *stream_class = G_INPUT_STREAM_CLASS (klass);
+  stream_class->read_fn = large_stream_read;
+  stream_class->close_fn = large_stream_close;
+}
+
+int
+main (int argc, char **argv)
+{
+  LargeStream *stream;
+  GFile *file;
+  AxingResource *resource;
+  AxingXmlParser *parser;
+  AxingReader *reader;
+  GError *error = NULL;
+  struct rusage usage;
+  guint64 events = 0;
+  gint64 linenum = 0, colnum = 0, starttime;
+  goffset start = -1, end = -1;
+  double gigs = argc > 1 ? atof (argv[1]) : 5;
+  int ret = 0;
+
+  setlocale(LC_ALL, "");
+
+  stream = g_object_new (LARGE_TYPE_STREAM, NULL);
+  stream->target = (guint64) (gigs * 1024 * 1024 * 1024);
+  stream->per_line = argc > 2 ? MAX (atoi (argv[2]), 1) : 1;
+
+  file = g_file_new_for_path ("large.xml");
+  resource = axing_resource_new (file, G_INPUT_STREAM (stream));
+  parser = axing_xml_parser_new (resource, NULL);
+  reader = AXING_READER (parser);
+
+  starttime = g_get_monotonic_time ();
+  while (axing_reader_read (reader, &error)) {
+    events++;
+    if (axing_reader_get_node_type (reader) == AXING_NODE_TYPE_END_ELEMENT) {
+      linenum = axing_reader_get_linenum (reader);
+      colnum = axing_reader_get_colnum (reader);
+      axing_reader_get_offsets (reader, &start, &end);
+    }
+  }
+  if (error != NULL) {
+    g_printerr ("%s\n", error->message);
+    g_error_free (error);
+    ret = 1;
+    goto out;
+  }
+
+  g_print ("%" G_GUINT64_FORMAT " bytes, %" G_GUINT64_FORMAT " events in %.1fs\n",
+           stream->offset, events,
+           (g_get_monotonic_time () - starttime) / (double) G_USEC_PER_SEC);
+  if (getrusage (RUSAGE_SELF, &usage) == 0)
+    g_print ("peak RSS %li KiB\n", usage.ru_maxrss);
+
+  /* The last end element is </log>, alone on the last line */
+  g_print ("</log> at %" G_GINT64_FORMAT ":%" G_GINT64_FORMAT
+           ", bytes %" G_GINT64_FORMAT "-%" G_GINT64_FORMAT "\n",
+           linenum, colnum, (gint64) start, (gint64) end);
+  if (linenum != stream->lines + 1 || colnum != 1 ||
+      start != (goffset) (stream->offset - strlen (FOOTER)) ||
+      end != (goffset) (stream->offset - 1)) {
+    g_printerr ("Expected %" G_GINT64_FORMAT ":1, bytes %" G_GUINT64_FORMAT "-%" G_GUINT64_FORMAT "\n",
+                stream->lines + 1,
+                stream->offset - strlen (FOOTER), stream->offset - 1);
+    ret = 1;
+  }
+
+ out:
+  g_object_unref (parser);
+  g_object_unref (resource);
+  g_object_unref (file);
+  g_object_unref (stream);
+  return ret;
+}
@@ -12,7 +12,7 @@ main (int argc, char **argv)
   AxingResource *resource;
   AxingXmlParser *parser;
   AxingReader *reader;
-  int i;
+  int i, j;
 
   setlocale(LC_ALL, "");
 
@@ -22,6 +22,10 @@ main (int argc, char **argv)
     parser = axing_xml_parser_new (resource, NULL);
     reader = AXING_READER (parser);
 
+    /* Any other arguments are path filter patterns */
+    for (j = 2; j < argc; j++)
+      axing_xml_parser_add_path_filter (parser, argv[j], NULL);
+
     while (axing_reader_read (reader, NULL)) { }
 
     g_object_unref (resource);